@@ -0,0 +1,290 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <math.h>
+#include <string.h>
+
+#include "proxy.h"
+#include "timer.h"
+
+#include "libavutil/tx.h"
+
+/*
+ * Time offset alignment between two audio streams.
+ *
+ * A window is decoded from each instance, downmixed and resampled to mono float at a common
+ * analysis rate, and cross-correlated over all lags within the search range. The correlation
+ * is computed in the frequency domain with the real FFT of av_tx (which has SIMD kernels), so
+ * its cost grows with N log N instead of N * lags, and the PCM never leaves native memory.
+ * As in the managed CrossCorrelation, the correlation at a lag only covers the overlapping
+ * parts of the windows and is normalized by the energy of both complete windows.
+ */
+
+/*
+ * Decodes `count` samples at the analysis rate, starting at the given position of the instance,
+ * into a mono float buffer. Samples that cannot be decoded (e.g. beyond the end) are zero.
+ * Returns the number of decoded samples, or a negative number on error.
+ */
+static int decode_window(ProxyInstance *pi, int64_t position, int rate, float *window, int count)
+{
+	int sample_rate = pi->audio_output.format.sample_rate;
+	int channels = pi->audio_output.format.channels;
+	int block_size = channels * pi->audio_output.format.sample_size;
+	enum AVSampleFormat format = pi->audio_output.format.sample_size == 2 ? AV_SAMPLE_FMT_S16 : AV_SAMPLE_FMT_FLT;
+	AVChannelLayout in_layout, out_layout = (AVChannelLayout)AV_CHANNEL_LAYOUT_MONO;
+	SwrContext *swr = NULL;
+	uint8_t *buffer;
+	int buffer_size, decoded = 0, samples, frame_type, ret;
+	int64_t timestamp, end;
+
+	memset(window, 0, sizeof(float) * count);
+
+	av_channel_layout_default(&in_layout, channels);
+	ret = swr_alloc_set_opts2(&swr, &out_layout, AV_SAMPLE_FMT_FLT, rate, &in_layout, format, sample_rate, 0, NULL);
+	av_channel_layout_uninit(&in_layout);
+	if (ret < 0 || swr_init(swr) < 0) {
+		proxy_log(pi, PI_LOG_ERROR, "align: cannot create the resampler");
+		swr_free(&swr);
+		return -1;
+	}
+
+	buffer_size = pi->audio_output.frame_size * block_size;
+	buffer = av_malloc(buffer_size);
+	if (buffer == NULL) {
+		swr_free(&swr);
+		return -1;
+	}
+
+	if (stream_seek(pi, position, TYPE_AUDIO) < 0) {
+		decoded = -1;
+		goto end;
+	}
+
+	// The window ends where the resampled output is complete, plus the resampler delay
+	end = position + av_rescale(count, sample_rate, rate) + sample_rate / 10;
+
+	while (decoded < count && (samples = stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type)) >= 0) {
+		const uint8_t *in = buffer;
+		uint8_t *out;
+
+		if (frame_type != TYPE_AUDIO) {
+			continue;
+		}
+		if (timestamp + samples <= position) {
+			continue; // preroll of the seek
+		}
+		if (timestamp < position) {
+			in += (position - timestamp) * block_size;
+			samples -= (int)(position - timestamp);
+			timestamp = position;
+		}
+		else if (decoded == 0 && timestamp > position) {
+			// The seek ended up behind the position, keep the window aligned by leaving a gap
+			decoded = FFMIN((int)av_rescale(timestamp - position, rate, sample_rate), count);
+		}
+
+		out = (uint8_t *)(window + decoded);
+		if ((ret = swr_convert(swr, &out, count - decoded, &in, samples)) < 0) {
+			decoded = -1;
+			goto end;
+		}
+		decoded += ret;
+
+		if (timestamp + samples >= end) {
+			break;
+		}
+	}
+
+	// Drain the resampler
+	if (decoded >= 0 && decoded < count) {
+		uint8_t *out = (uint8_t *)(window + decoded);
+		if ((ret = swr_convert(swr, &out, count - decoded, NULL, 0)) > 0) {
+			decoded += ret;
+		}
+	}
+
+	if (stream_has_error(pi)) {
+		decoded = -1;
+	}
+
+end:
+	av_free(buffer);
+	swr_free(&swr);
+
+	return decoded;
+}
+
+/*
+ * Removes the mean of the signal and returns its energy.
+ */
+static double center(float *x, int n)
+{
+	double mean = 0, energy = 0;
+
+	for (int i = 0; i < n; i++) {
+		mean += x[i];
+	}
+	mean /= n;
+
+	for (int i = 0; i < n; i++) {
+		x[i] -= (float)mean;
+		energy += (double)x[i] * x[i];
+	}
+
+	return energy;
+}
+
+/*
+ * Finds the time offset between a window of the source and a window of the target instance with
+ * FFT-based cross-correlation, and returns 0 on success or a negative number on error.
+ *
+ * The windows start at the given positions (in samples of the respective instance) and span
+ * `length` source samples. Lags up to `max_lag` source samples in both directions are searched
+ * (0 selects half the window length). The analysis runs at `rate` Hz (0 selects ALIGN_DEFAULT_RATE,
+ * but never more than the lower sample rate of both instances), and both instances are left
+ * positioned somewhere after their windows.
+ */
+int stream_align(ProxyInstance *source, int64_t source_position, ProxyInstance *target, int64_t target_position,
+	int64_t length, int64_t max_lag, int rate, AlignResult *result)
+{
+	AVTXContext *forward = NULL, *inverse = NULL;
+	av_tx_fn forward_fn, inverse_fn;
+	float *x = NULL, *y = NULL, *correlation = NULL;
+	AVComplexFloat *fx = NULL, *fy = NULL;
+	float forward_scale = 1.0f, inverse_scale;
+	double denominator, peak_value = -1;
+	int n, lags, fft_size, peak = 0, ret = -1;
+	int64_t start = timer_now_ns();
+
+	if (!(source->mode & TYPE_AUDIO) || !(target->mode & TYPE_AUDIO)) {
+		proxy_log(source, PI_LOG_ERROR, "align: both instances must decode audio");
+		return -1;
+	}
+	if ((source->mode | target->mode) & TYPE_VIDEO) {
+		// The read buffer is sized for audio frames, video frames would not fit
+		proxy_log(source, PI_LOG_ERROR, "align: instances that decode video are not supported");
+		return -1;
+	}
+	if ((source->mode | target->mode) & MODE_LIVE || source->tracks != NULL || target->tracks != NULL) {
+		proxy_log(source, PI_LOG_ERROR, "align: live instances and instances with selected tracks are not supported");
+		return -1;
+	}
+	if (length <= 0) {
+		proxy_log(source, PI_LOG_ERROR, "align: invalid window length %"PRId64, length);
+		return -1;
+	}
+
+	if (rate <= 0) {
+		rate = ALIGN_DEFAULT_RATE;
+	}
+	rate = FFMIN(rate, FFMIN(source->audio_output.format.sample_rate, target->audio_output.format.sample_rate));
+
+	n = (int)av_rescale(length, rate, source->audio_output.format.sample_rate);
+	lags = max_lag > 0 ? (int)av_rescale(max_lag, rate, source->audio_output.format.sample_rate) : n / 2;
+	lags = FFMIN(lags, n - 1);
+	if (n < 2) {
+		proxy_log(source, PI_LOG_ERROR, "align: window too short");
+		return -1;
+	}
+
+	// Zero-padding to at least 2n turns the circular correlation of the FFT into a linear one
+	for (fft_size = 2; fft_size < 2 * n; fft_size <<= 1);
+	inverse_scale = 1.0f / fft_size;
+
+	x = av_mallocz(sizeof(float) * fft_size);
+	y = av_mallocz(sizeof(float) * fft_size);
+	correlation = av_malloc(sizeof(float) * fft_size);
+	fx = av_malloc(sizeof(AVComplexFloat) * (fft_size / 2 + 1));
+	fy = av_malloc(sizeof(AVComplexFloat) * (fft_size / 2 + 1));
+	if (x == NULL || y == NULL || correlation == NULL || fx == NULL || fy == NULL) {
+		goto end;
+	}
+
+	if (decode_window(source, source_position, rate, x, n) < 0 || decode_window(target, target_position, rate, y, n) < 0) {
+		proxy_log(source, PI_LOG_ERROR, "align: cannot decode the windows");
+		goto end;
+	}
+
+	denominator = sqrt(center(x, n) * center(y, n));
+	if (denominator == 0) {
+		proxy_log(source, PI_LOG_WARNING, "align: silent window");
+		memset(result, 0, sizeof(AlignResult));
+		result->rate = rate;
+		ret = 0;
+		goto end;
+	}
+
+	if (av_tx_init(&forward, &forward_fn, AV_TX_FLOAT_RDFT, 0, fft_size, &forward_scale, 0) < 0 ||
+		av_tx_init(&inverse, &inverse_fn, AV_TX_FLOAT_RDFT, 1, fft_size, &inverse_scale, 0) < 0) {
+		proxy_log(source, PI_LOG_ERROR, "align: cannot create the FFT");
+		goto end;
+	}
+
+	forward_fn(forward, fx, x, sizeof(float));
+	forward_fn(forward, fy, y, sizeof(float));
+
+	// r[k] = sum x[i] * y[i + k] <=> R = conj(X) * Y
+	for (int i = 0; i <= fft_size / 2; i++) {
+		float re = fx[i].re * fy[i].re + fx[i].im * fy[i].im;
+		float im = fx[i].re * fy[i].im - fx[i].im * fy[i].re;
+		fx[i].re = re;
+		fx[i].im = im;
+	}
+
+	inverse_fn(inverse, correlation, fx, sizeof(AVComplexFloat));
+
+	// Negative lags are wrapped around to the end of the correlation
+	for (int lag = -lags; lag <= lags; lag++) {
+		double value = fabs(correlation[lag < 0 ? fft_size + lag : lag]);
+		if (value > peak_value) {
+			peak_value = value;
+			peak = lag;
+		}
+	}
+
+	result->lag = peak;
+	result->rate = rate;
+	result->confidence = FFMIN(peak_value / denominator, 1.0);
+	result->offset = (double)peak / rate;
+
+	// Parabolic interpolation of the peak
+	if (peak > -lags && peak < lags) {
+		double l = fabs(correlation[peak - 1 < 0 ? fft_size + peak - 1 : peak - 1]);
+		double r = fabs(correlation[peak + 1 < 0 ? fft_size + peak + 1 : peak + 1]);
+		double curvature = l - 2 * peak_value + r;
+		if (curvature < 0) {
+			result->offset = (peak + 0.5 * (l - r) / curvature) / rate;
+		}
+	}
+
+	proxy_log(source, PI_LOG_DEBUG, "align: %d samples at %d Hz, %d lags, offset %f s, confidence %f, %.1f ms",
+		n, rate, lags, result->offset, result->confidence, (timer_now_ns() - start) / 1e6);
+	ret = 0;
+
+end:
+	av_tx_uninit(&forward);
+	av_tx_uninit(&inverse);
+	av_free(x);
+	av_free(y);
+	av_free(correlation);
+	av_free(fx);
+	av_free(fy);
+
+	return ret;
+}
@@ -0,0 +1,35 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#define ALIGN_DEFAULT_RATE 11025 // analysis sample rate, enough bandwidth to locate speech and music
+
+/*
+ * Result of stream_align. The offset has the same meaning as in the managed
+ * CrossCorrelation: the time by which the target content lags behind the source content,
+ * i.e. the source window at time t matches the target window at time t + offset.
+ */
+typedef struct AlignResult {
+	double				offset; // seconds, interpolated between the analysis samples
+	double				confidence; // absolute normalized correlation coefficient at the offset (0..1)
+	int					lag; // offset in analysis samples
+	int					rate; // analysis sample rate
+} AlignResult;
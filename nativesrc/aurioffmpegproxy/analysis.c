@@ -0,0 +1,170 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+
+#include "analysis.h"
+
+#include "libavutil/opt.h"
+
+/*
+ * Sets the options that reduce the decoding work of the stream's decoder, and returns the
+ * ANALYSIS_PATH_* flags of the reductions. FFmpeg's AAC, MP3 and Opus decoders have no such
+ * options (e.g. to skip SBR, or to synthesize at a lower rate), and are fully decoded.
+ */
+int analysis_decoder_options(const AVCodecParameters *codecpar, AVDictionary **options)
+{
+	int path = ANALYSIS_PATH_FULL;
+
+	switch (codecpar->codec_id) {
+	case AV_CODEC_ID_AC3:
+	case AV_CODEC_ID_EAC3:
+		// Downmixed in the frequency domain, which saves the inverse transforms of all other channels
+		if (codecpar->ch_layout.nb_channels > 1) {
+			av_dict_set(options, "downmix", "mono", 0);
+			path |= ANALYSIS_PATH_DECODER_DOWNMIX;
+		}
+		break;
+	case AV_CODEC_ID_DTS:
+		// The lossless and extension layers of DTS-HD only add resolution and channels
+		av_dict_set(options, "core_only", "1", 0);
+		path |= ANALYSIS_PATH_DECODER_CORE;
+		// fall through
+	case AV_CODEC_ID_TRUEHD:
+	case AV_CODEC_ID_MLP:
+		// Decodes only the substreams that are required for the stereo presentation
+		if (codecpar->ch_layout.nb_channels > 2) {
+			av_dict_set(options, "downmix", "stereo", 0);
+			path |= ANALYSIS_PATH_DECODER_DOWNMIX;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return path;
+}
+
+/*
+ * Creates the converter to the analysis output with the given sample rate, for a decoder
+ * with the given decoder reductions.
+ */
+Analysis *analysis_create(int sample_rate, int decoder_path)
+{
+	Analysis *a;
+
+	a = calloc(1, sizeof(Analysis));
+	if (a == NULL) {
+		return NULL;
+	}
+
+	a->out_sample_rate = sample_rate;
+	a->path = decoder_path;
+
+	return a;
+}
+
+static int configure(Analysis *a, AVFrame *frame)
+{
+	AVChannelLayout mono = AV_CHANNEL_LAYOUT_MONO;
+
+	swr_free(&a->swr);
+	if (swr_alloc_set_opts2(&a->swr, &mono, AV_SAMPLE_FMT_FLT, a->out_sample_rate,
+		&frame->ch_layout, frame->format, frame->sample_rate, 0, NULL) < 0 || swr_init(a->swr) < 0) {
+		swr_free(&a->swr);
+		return -1;
+	}
+
+	av_channel_layout_uninit(&a->in_layout);
+	av_channel_layout_copy(&a->in_layout, &frame->ch_layout);
+	a->in_sample_rate = frame->sample_rate;
+	a->in_format = frame->format;
+	a->synced = 0;
+
+	a->path &= ANALYSIS_PATH_DECODER_DOWNMIX | ANALYSIS_PATH_DECODER_CORE;
+	if (frame->sample_rate != a->out_sample_rate) {
+		a->path |= ANALYSIS_PATH_RESAMPLE;
+	}
+	if (frame->ch_layout.nb_channels > 1) {
+		a->path |= ANALYSIS_PATH_MIX;
+	}
+
+	return 0;
+}
+
+/*
+ * Converts a decoded frame into the analysis output and returns the number of output samples,
+ * which can differ from the number of decoded samples when resampling, or a negative number on
+ * error (-2 if the output buffer is too small).
+ *
+ * The resampler output is continuous, so only the first frame after a reset keeps its PTS, which
+ * is moved to the first output sample. The following frames have no PTS to let the position
+ * accumulate from the output sample counts, which would otherwise jitter by the rounding of the
+ * output timestamps to the stream time base.
+ */
+int analysis_convert(Analysis *a, AVFrame *frame, AVRational time_base, uint8_t *output_buffer, int output_buffer_size)
+{
+	int ret;
+
+	if (a->swr == NULL || frame->sample_rate != a->in_sample_rate || frame->format != a->in_format
+		|| av_channel_layout_compare(&frame->ch_layout, &a->in_layout) != 0) {
+		if (configure(a, frame) < 0) {
+			return -1;
+		}
+	}
+
+	if (swr_get_out_samples(a->swr, frame->nb_samples) * (int)sizeof(float) > output_buffer_size) {
+		return -2;
+	}
+
+	if (!a->synced) {
+		if (frame->pts != AV_NOPTS_VALUE) {
+			// swresample timestamps are in units of 1 / (in_sample_rate * out_sample_rate)
+			int64_t scale = (int64_t)a->in_sample_rate * a->out_sample_rate;
+			int64_t pts = swr_next_pts(a->swr, av_rescale(frame->pts, time_base.num * scale, time_base.den));
+			frame->pts = av_rescale(pts, time_base.den, time_base.num * scale);
+			a->synced = 1;
+		}
+	}
+	else {
+		frame->pts = AV_NOPTS_VALUE;
+	}
+
+	ret = swr_convert(a->swr, &output_buffer, output_buffer_size / sizeof(float), (const uint8_t **)frame->extended_data, frame->nb_samples);
+
+	return ret;
+}
+
+/*
+ * Drops the buffered samples of the resampler, e.g. after a seek.
+ */
+void analysis_reset(Analysis *a)
+{
+	if (a->swr != NULL) {
+		swr_init(a->swr);
+	}
+	a->synced = 0;
+}
+
+void analysis_free(Analysis *a)
+{
+	swr_free(&a->swr);
+	av_channel_layout_uninit(&a->in_layout);
+	free(a);
+}
@@ -0,0 +1,55 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <stdint.h>
+
+// FFmpeg includes
+#include "libavcodec/avcodec.h"
+#include "libswresample/swresample.h"
+
+/*
+ * Reduced-cost decoding for analysis (MODE_ANALYSIS), which outputs mono float samples at
+ * no more than ANALYSIS_SAMPLE_RATE. Decoders that can skip work are told to do so through
+ * their options, e.g. to downmix multichannel audio before the synthesis filterbank, or to
+ * skip lossless extension layers. Everything else is reduced by swresample after decoding.
+ */
+
+#define ANALYSIS_SAMPLE_RATE 16000 // covers the 8 kHz of audio bandwidth that the analyses use
+
+#define ANALYSIS_PATH_FULL				0x00 // full decoding
+#define ANALYSIS_PATH_DECODER_DOWNMIX	0x01 // the decoder mixes down the channels
+#define ANALYSIS_PATH_DECODER_CORE		0x02 // the decoder skips the extension layers
+#define ANALYSIS_PATH_RESAMPLE			0x04 // swresample reduces the sample rate
+#define ANALYSIS_PATH_MIX				0x08 // swresample mixes down the channels
+
+typedef struct Analysis {
+	SwrContext			*swr; // configured from the decoded frames, which can differ from the stream parameters
+	AVChannelLayout		in_layout;
+	int					in_sample_rate;
+	int					in_format;
+	int					out_sample_rate;
+	int					synced; // whether the next output continues the previous output without a gap
+	int					path; // ANALYSIS_PATH_* flags of the reductions in use
+} Analysis;
+
+int analysis_decoder_options(const AVCodecParameters *codecpar, AVDictionary **options);
+Analysis *analysis_create(int sample_rate, int decoder_path);
+int analysis_convert(Analysis *a, AVFrame *frame, AVRational time_base, uint8_t *output_buffer, int output_buffer_size);
+void analysis_reset(Analysis *a);
+void analysis_free(Analysis *a);
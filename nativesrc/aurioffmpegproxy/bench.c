@@ -0,0 +1,424 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/* Compatibility settings for the MSVC compiler */
+#ifdef _MSC_VER
+	#define _CRT_SECURE_NO_WARNINGS // disable fopen compile error
+#endif
+
+/**
+ * Benchmark for the FFmpeg proxy.
+ *
+ * Generates synthetic test media with the libavcodec encoders (or takes a list of existing
+ * files), runs the proxy API against each file, and writes the measurements as JSON to
+ * compare proxy builds. All generated signals and seek positions are derived from a fixed
+ * seed, so runs are repeatable.
+ *
+ * Usage: aurioffmpegproxy_bench [-o results.json] [-d workdir] [-t seconds] [-r repeats]
+ *                               [-n seeks] [-s seed] [file...]
+ */
+
+// System includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+#endif
+
+#include "proxy.h"
+#include "timer.h"
+#include "synthmedia.h"
+
+#include "libavutil/avutil.h"
+
+typedef struct BenchMedia {
+	const char			*name;
+	const char			*filename; // the container format is derived from the extension
+	enum AVCodecID		audio_codec;
+	enum AVCodecID		video_codec; // AV_CODEC_ID_NONE for audio-only media
+} BenchMedia;
+
+static const BenchMedia bench_media[] = {
+	{ "aac", "aac.m4a", AV_CODEC_ID_AAC, AV_CODEC_ID_NONE },
+	{ "mp3", "mp3.mp3", AV_CODEC_ID_MP3, AV_CODEC_ID_NONE },
+	{ "flac", "flac.flac", AV_CODEC_ID_FLAC, AV_CODEC_ID_NONE },
+	{ "opus", "opus.opus", AV_CODEC_ID_OPUS, AV_CODEC_ID_NONE },
+	{ "pcm_wav", "pcm.wav", AV_CODEC_ID_PCM_S16LE, AV_CODEC_ID_NONE },
+	{ "h264_aac_mp4", "h264_aac.mp4", AV_CODEC_ID_AAC, AV_CODEC_ID_H264 },
+	{ "h264_aac_mkv", "h264_aac.mkv", AV_CODEC_ID_AAC, AV_CODEC_ID_H264 },
+	{ "h264_aac_ts", "h264_aac.ts", AV_CODEC_ID_AAC, AV_CODEC_ID_H264 },
+};
+
+typedef struct BenchConfig {
+	const char			*output;
+	const char			*workdir;
+	int					duration; // seconds of generated media
+	int					repeats;
+	int					seeks;
+	uint32_t			seed;
+} BenchConfig;
+
+typedef struct Percentiles {
+	double				p50;
+	double				p90;
+	double				p99;
+	double				max;
+} Percentiles;
+
+static int compare_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static Percentiles percentiles(double *values, int count) {
+	Percentiles p = { 0, 0, 0, 0 };
+
+	if (count == 0) {
+		return p;
+	}
+
+	qsort(values, count, sizeof(double), compare_double);
+	p.p50 = values[(int)ceil(0.50 * count) - 1];
+	p.p90 = values[(int)ceil(0.90 * count) - 1];
+	p.p99 = values[(int)ceil(0.99 * count) - 1];
+	p.max = values[count - 1];
+
+	return p;
+}
+
+static double median(double *values, int count) {
+	return percentiles(values, count).p50;
+}
+
+static int64_t peak_rss_kb(void) {
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+		return (int64_t)(pmc.PeakWorkingSetSize / 1024);
+	}
+	return -1;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		return usage.ru_maxrss; // kilobytes on Linux
+	}
+	return -1;
+#endif
+}
+
+static int64_t file_size(const char *filename) {
+	FILE *f = fopen(filename, "rb");
+	int64_t size;
+
+	if (f == NULL) {
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fclose(f);
+
+	return size;
+}
+
+/*
+ * Measurements
+ */
+
+static void bench_open(const char *filename, int repeats, FILE *json) {
+	double *times = malloc(sizeof(double) * repeats);
+	double min = 0;
+
+	for (int i = 0; i < repeats; i++) {
+		int64_t start = timer_now_ns();
+		ProxyInstance *pi = stream_open_file(TYPE_AUDIO, (char *)filename);
+		times[i] = (timer_now_ns() - start) / 1e6;
+		stream_close(pi);
+		if (i == 0 || times[i] < min) {
+			min = times[i];
+		}
+	}
+
+	fprintf(json, "\t\t\t\"open_ms\": { \"min\": %.3f, \"median\": %.3f },\n", min, median(times, repeats));
+	free(times);
+}
+
+static void bench_decode(const char *filename, int type, int repeats, int64_t input_bytes, FILE *json) {
+	double *times = malloc(sizeof(double) * repeats);
+	int64_t units = 0, output_bytes = 0;
+	const char *name = type == TYPE_AUDIO ? "decode" : "video_decode";
+
+	for (int i = 0; i < repeats; i++) {
+		ProxyInstance *pi = stream_open_file(type, (char *)filename);
+		int64_t timestamp, start;
+		int buffer_size, ret, frame_type;
+		uint8_t *buffer;
+
+		if (stream_has_error(pi)) {
+			stream_close(pi);
+			free(times);
+			fprintf(json, "\t\t\t\"%s\": null,\n", name);
+			return;
+		}
+
+		buffer_size = type == TYPE_AUDIO
+			? pi->audio_output.frame_size * pi->audio_output.format.channels * pi->audio_output.format.sample_size
+			: pi->video_output.frame_size;
+		buffer = malloc(buffer_size);
+		units = 0;
+		output_bytes = 0;
+
+		start = timer_now_ns();
+		while ((ret = stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type)) >= 0) {
+			units += ret;
+			output_bytes += type == TYPE_AUDIO
+				? (int64_t)ret * pi->audio_output.format.channels * pi->audio_output.format.sample_size
+				: buffer_size;
+		}
+		times[i] = (timer_now_ns() - start) / 1e9;
+
+		free(buffer);
+		stream_close(pi);
+	}
+
+	double seconds = median(times, repeats);
+	fprintf(json, "\t\t\t\"%s\": { \"%s\": %"PRId64", \"seconds\": %.6f, \"%s_per_s\": %.1f, \"input_mb_per_s\": %.3f, \"output_mb_per_s\": %.3f },\n",
+		name, type == TYPE_AUDIO ? "samples" : "frames", units, seconds,
+		type == TYPE_AUDIO ? "samples" : "frames", units / seconds,
+		input_bytes / 1e6 / seconds, output_bytes / 1e6 / seconds);
+	free(times);
+}
+
+/*
+ * Measures the latency of a seek including the decoding of the first frame at the
+ * target, which is the latency a consumer actually experiences.
+ */
+static Percentiles bench_seeks(ProxyInstance *pi, const int64_t *positions, int count, uint8_t *buffer, int buffer_size) {
+	double *times = malloc(sizeof(double) * count);
+	int64_t timestamp;
+	int frame_type;
+	Percentiles p;
+
+	for (int i = 0; i < count; i++) {
+		int64_t start = timer_now_ns();
+		stream_seek(pi, positions[i], TYPE_AUDIO);
+		stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type);
+		times[i] = (timer_now_ns() - start) / 1e6;
+	}
+
+	p = percentiles(times, count);
+	free(times);
+
+	return p;
+}
+
+static void print_percentiles(FILE *json, const char *name, Percentiles p, int last) {
+	fprintf(json, "\t\t\t\t\"%s\": { \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f }%s\n",
+		name, p.p50, p.p90, p.p99, p.max, last ? "" : ",");
+}
+
+static void bench_seek(const char *filename, int seeks, uint32_t seed, FILE *json) {
+	ProxyInstance *pi = stream_open_file(TYPE_AUDIO, (char *)filename);
+	int64_t *positions, origin, length, start;
+	int buffer_size, frame_type;
+	uint8_t *buffer;
+	uint32_t prng = seed;
+	double index_ms;
+
+	if (stream_has_error(pi) || pi->audio_output.length == AV_NOPTS_VALUE || seeks <= 0) {
+		stream_close(pi);
+		fprintf(json, "\t\t\t\"seek_ms\": null,\n\t\t\t\"seekindex_build_ms\": null,\n");
+		return;
+	}
+
+	buffer_size = pi->audio_output.frame_size * pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+	buffer = malloc(buffer_size);
+	positions = malloc(sizeof(int64_t) * seeks);
+
+	// Seek targets are relative to the first timestamp, and stay one second away from the end
+	stream_read_frame(pi, &origin, buffer, buffer_size, &frame_type);
+	length = FFMAX(pi->audio_output.length - pi->audio_output.format.sample_rate, 1);
+
+	fprintf(json, "\t\t\t\"seek_ms\": {\n");
+
+	for (int i = 0; i < seeks; i++) {
+		positions[i] = origin + (int64_t)(synth_prng_uniform(&prng) * length);
+	}
+	print_percentiles(json, "random", bench_seeks(pi, positions, seeks, buffer, buffer_size), 0);
+
+	for (int i = 0; i < seeks; i++) {
+		positions[i] = origin + length * i / seeks;
+	}
+	print_percentiles(json, "forward", bench_seeks(pi, positions, seeks, buffer, buffer_size), 0);
+
+	for (int i = 0; i < seeks; i++) {
+		positions[i] = origin + length * (seeks - 1 - i) / seeks;
+	}
+	print_percentiles(json, "backward", bench_seeks(pi, positions, seeks, buffer, buffer_size), 0);
+
+	start = timer_now_ns();
+	stream_seekindex_create(pi, TYPE_AUDIO);
+	index_ms = (timer_now_ns() - start) / 1e6;
+
+	prng = seed;
+	for (int i = 0; i < seeks; i++) {
+		positions[i] = origin + (int64_t)(synth_prng_uniform(&prng) * length);
+	}
+	print_percentiles(json, "random_indexed", bench_seeks(pi, positions, seeks, buffer, buffer_size), 1);
+
+	fprintf(json, "\t\t\t},\n");
+	fprintf(json, "\t\t\t\"seekindex_build_ms\": %.3f,\n", index_ms);
+
+	free(positions);
+	free(buffer);
+	stream_close(pi);
+}
+
+static void print_json_string(FILE *json, const char *value) {
+	fputc('"', json);
+	for (; *value; value++) {
+		if (*value == '"' || *value == '\\') {
+			fputc('\\', json);
+		}
+		fputc(*value, json);
+	}
+	fputc('"', json);
+}
+
+static void bench_file(const char *name, const char *filename, int has_video, const BenchConfig *config, FILE *json, int last) {
+	int64_t bytes = file_size(filename);
+
+#if defined(PROXY_AUDIO_ONLY)
+	has_video = 0; // not supported by this build
+#endif
+
+	fprintf(stderr, "benchmarking %s (%s)\n", name, filename);
+
+	fprintf(json, "\t\t{\n");
+	fprintf(json, "\t\t\t\"name\": ");
+	print_json_string(json, name);
+	fprintf(json, ",\n");
+	fprintf(json, "\t\t\t\"bytes\": %"PRId64",\n", bytes);
+
+	bench_open(filename, config->repeats, json);
+	bench_decode(filename, TYPE_AUDIO, config->repeats, bytes, json);
+	if (has_video) {
+		bench_decode(filename, TYPE_VIDEO, config->repeats, bytes, json);
+	}
+	bench_seek(filename, config->seeks, config->seed, json);
+
+	// Cumulative over all files, the allocations should stop growing once the pools are warm
+	BufferPoolStats pool;
+	proxy_get_bufpool_stats(&pool);
+	fprintf(json, "\t\t\t\"bufpool\": { \"requests\": %"PRId64", \"allocations\": %"PRId64", \"pooled_bytes\": %"PRId64", \"fallbacks\": %"PRId64" },\n",
+		pool.requests, pool.allocations, pool.pooled_bytes, pool.fallbacks);
+	fprintf(json, "\t\t\t\"peak_rss_kb\": %"PRId64"\n", peak_rss_kb()); // process peak up to this point
+	fprintf(json, "\t\t}%s\n", last ? "" : ",");
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: aurioffmpegproxy_bench [-o results.json] [-d workdir] [-t seconds] [-r repeats] [-n seeks] [-s seed] [file...]\n");
+	fprintf(stderr, "Without files, synthetic media is generated in the workdir and benchmarked.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	BenchConfig config = { "bench.json", ".", 60, 5, 200, 0x2545F491 };
+	const int media_count = sizeof(bench_media) / sizeof(bench_media[0]);
+	char filename[1024];
+	FILE *json;
+	int first_file = argc;
+
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] != '-' || i + 1 >= argc) {
+			first_file = i;
+			break;
+		}
+		switch (argv[i][1]) {
+			case 'o': config.output = argv[++i]; break;
+			case 'd': config.workdir = argv[++i]; break;
+			case 't': config.duration = atoi(argv[++i]); break;
+			case 'r': config.repeats = FFMAX(atoi(argv[++i]), 1); break;
+			case 'n': config.seeks = atoi(argv[++i]); break;
+			case 's': config.seed = (uint32_t)strtoul(argv[++i], NULL, 0); break;
+			default: usage(); return 1;
+		}
+	}
+	if (config.seed == 0) {
+		config.seed = 1; // xorshift must not be seeded with 0
+	}
+
+	json = strcmp(config.output, "-") == 0 ? stdout : fopen(config.output, "w");
+	if (json == NULL) {
+		fprintf(stderr, "cannot write %s\n", config.output);
+		return 1;
+	}
+
+	fprintf(json, "{\n");
+	fprintf(json, "\t\"ffmpeg\": \"%s\",\n", av_version_info());
+	fprintf(json, "\t\"config\": { \"duration\": %d, \"repeats\": %d, \"seeks\": %d, \"seed\": %u },\n",
+		config.duration, config.repeats, config.seeks, config.seed);
+	fprintf(json, "\t\"media\": [\n");
+
+	if (first_file < argc) {
+		for (int i = first_file; i < argc; i++) {
+			// The video stream is probed by opening the file in video mode
+			ProxyInstance *pi = stream_open_file(TYPE_VIDEO, argv[i]);
+			int has_video = !stream_has_error(pi);
+			stream_close(pi);
+			bench_file(argv[i], argv[i], has_video, &config, json, i == argc - 1);
+		}
+	}
+	else {
+		int generated[sizeof(bench_media) / sizeof(bench_media[0])];
+		int last = -1;
+
+		for (int i = 0; i < media_count; i++) {
+			int ret;
+			snprintf(filename, sizeof(filename), "%s/%s", config.workdir, bench_media[i].filename);
+			fprintf(stderr, "generating %s\n", filename);
+			if ((ret = synth_generate_media(filename, bench_media[i].audio_codec, bench_media[i].video_codec, config.duration, config.seed)) < 0) {
+				fprintf(stderr, "skipping %s: %s\n", bench_media[i].name, av_err2str(ret));
+				generated[i] = 0;
+			}
+			else {
+				generated[i] = 1;
+				last = i;
+			}
+		}
+
+		for (int i = 0; i < media_count; i++) {
+			if (generated[i]) {
+				snprintf(filename, sizeof(filename), "%s/%s", config.workdir, bench_media[i].filename);
+				bench_file(bench_media[i].name, filename, bench_media[i].video_codec != AV_CODEC_ID_NONE, &config, json, i == last);
+			}
+		}
+	}
+
+	fprintf(json, "\t]\n}\n");
+	if (json != stdout) {
+		fclose(json);
+	}
+
+	return 0;
+}
@@ -0,0 +1,272 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+
+#include "proxy.h"
+#include "bufpool.h"
+#include "thread.h"
+
+#include "libavutil/imgutils.h"
+
+/*
+ * Frame buffers shared by all decoders of the process.
+ *
+ * FFmpeg's default allocator keeps a buffer pool per decoder, which is rebuilt whenever
+ * a decoder is opened. With many short-lived instances, frames are therefore mostly
+ * allocated from scratch. The pools here are shared between all decoders and instances
+ * and organized in size classes, so that once the pools are warm, decoding a frame does
+ * not allocate anything. A size class covers a quarter of a power of two, which wastes
+ * at most 25% of a buffer. The memory of the pools is bound by the largest number of
+ * buffers that were in use at the same time, and capped at BUFPOOL_MAX_BYTES. It is kept
+ * until proxy_trim_bufpool releases it.
+ */
+
+static AVBufferPool *volatile pools[BUFPOOL_CLASSES];
+static volatile int64_t pool_users; // threads that are getting a buffer from a pool
+static volatile int64_t stat_requests;
+static volatile int64_t stat_allocations;
+static volatile int64_t stat_pooled_bytes;
+static volatile int64_t stat_fallbacks;
+
+static size_t class_size(int index)
+{
+	return ((size_t)BUFPOOL_MIN_SIZE << (index / 4)) / 4 * (4 + index % 4);
+}
+
+static void pool_free(void *opaque, uint8_t *data)
+{
+	atomic_int64_fetch_add(&stat_pooled_bytes, -(int64_t)(intptr_t)opaque);
+	av_free(data);
+}
+
+static AVBufferRef *pool_alloc(void *opaque, size_t size)
+{
+	AVBufferRef *buf;
+	uint8_t *data;
+
+	(void)opaque;
+
+	// Reserve the memory first, so that concurrent allocations cannot exceed the cap
+	if (atomic_int64_fetch_add(&stat_pooled_bytes, size) + (int64_t)size > BUFPOOL_MAX_BYTES) {
+		atomic_int64_fetch_add(&stat_pooled_bytes, -(int64_t)size);
+		return NULL;
+	}
+
+	data = av_malloc(size);
+	buf = data != NULL ? av_buffer_create(data, size, pool_free, (void *)(intptr_t)size, 0) : NULL;
+	if (buf == NULL) {
+		av_free(data);
+		atomic_int64_fetch_add(&stat_pooled_bytes, -(int64_t)size);
+		return NULL;
+	}
+
+	atomic_int64_fetch_add(&stat_allocations, 1);
+
+	return buf;
+}
+
+/*
+ * Returns a buffer of at least the given size from the pool of its size class.
+ */
+static AVBufferRef *pool_get(size_t size)
+{
+	AVBufferPool *pool, *previous;
+	AVBufferRef *buf = NULL;
+	int index = 0;
+
+	while (index < BUFPOOL_CLASSES && class_size(index) < size) {
+		index++;
+	}
+	if (index == BUFPOOL_CLASSES) {
+		return NULL;
+	}
+
+	// Keeps proxy_trim_bufpool from freeing the pool while it is used here
+	atomic_int64_fetch_add(&pool_users, 1);
+
+	pool = atomic_ptr_load((void *volatile *)&pools[index]);
+	if (pool == NULL) {
+		pool = av_buffer_pool_init2(class_size(index), NULL, pool_alloc, NULL);
+		if (pool == NULL) {
+			goto end;
+		}
+		// Another thread may have created the pool in the meantime
+		previous = atomic_ptr_compare_exchange((void *volatile *)&pools[index], NULL, pool);
+		if (previous != NULL) {
+			av_buffer_pool_uninit(&pool);
+			pool = previous;
+		}
+	}
+
+	atomic_int64_fetch_add(&stat_requests, 1);
+	buf = av_buffer_pool_get(pool);
+
+end:
+	atomic_int64_fetch_add(&pool_users, -1);
+
+	return buf;
+}
+
+/*
+ * Allocates the planes of a video frame like the FFmpeg default allocator, with the
+ * dimensions and line sizes aligned to the requirements of the decoder.
+ */
+static int get_video_buffer(AVCodecContext *s, AVFrame *frame)
+{
+	int linesize_align[AV_NUM_DATA_POINTERS];
+	int linesize[4];
+	ptrdiff_t linesize1[4];
+	size_t sizes[4];
+	int w = frame->width, h = frame->height, unaligned;
+
+	avcodec_align_dimensions2(s, &w, &h, linesize_align);
+
+	do {
+		// Do not align the line sizes individually, decoders rely on their ratios (e.g. 4:2:2)
+		if (av_image_fill_linesizes(linesize, frame->format, w) < 0) {
+			return -1;
+		}
+		w += w & ~(w - 1); // increase the alignment for the next try
+
+		unaligned = 0;
+		for (int i = 0; i < 4; i++) {
+			unaligned |= linesize[i] % BUFPOOL_STRIDE_ALIGN;
+		}
+	} while (unaligned);
+
+	for (int i = 0; i < 4; i++) {
+		linesize1[i] = linesize[i];
+	}
+	if (av_image_fill_plane_sizes(sizes, frame->format, h, linesize1) < 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < 4 && sizes[i] > 0; i++) {
+		// Some decoders read or write slightly beyond the plane
+		frame->buf[i] = pool_get(sizes[i] + 16 + BUFPOOL_STRIDE_ALIGN - 1);
+		if (frame->buf[i] == NULL) {
+			return -1;
+		}
+		frame->data[i] = frame->buf[i]->data;
+		frame->linesize[i] = linesize[i];
+	}
+	frame->extended_data = frame->data;
+
+	return 0;
+}
+
+static int get_audio_buffer(AVFrame *frame)
+{
+	int channels = frame->ch_layout.nb_channels;
+	int planes = av_sample_fmt_is_planar(frame->format) ? channels : 1;
+	int linesize;
+
+	if (planes > AV_NUM_DATA_POINTERS) {
+		return 1; // requires extended buffers, left to the default allocator
+	}
+	if (av_samples_get_buffer_size(&linesize, channels, frame->nb_samples, frame->format, 0) < 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < planes; i++) {
+		frame->buf[i] = pool_get(linesize);
+		if (frame->buf[i] == NULL) {
+			return -1;
+		}
+		frame->data[i] = frame->buf[i]->data;
+	}
+	frame->linesize[0] = linesize;
+	frame->extended_data = frame->data;
+
+	return 0;
+}
+
+/*
+ * Frame allocation callback of the decoders (AVCodecContext.get_buffer2), which must only
+ * be installed for decoders with AV_CODEC_CAP_DR1.
+ */
+int bufpool_get_buffer2(AVCodecContext *s, AVFrame *frame, int flags)
+{
+	int ret;
+
+	if (frame->hw_frames_ctx != NULL) {
+		ret = 1;
+	}
+	else if (s->codec_type == AVMEDIA_TYPE_VIDEO) {
+		ret = get_video_buffer(s, frame);
+	}
+	else if (s->codec_type == AVMEDIA_TYPE_AUDIO) {
+		ret = get_audio_buffer(frame);
+	}
+	else {
+		ret = 1;
+	}
+
+	if (ret != 0) {
+		// Release partially allocated planes, and let FFmpeg allocate the frame
+		for (int i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+			av_buffer_unref(&frame->buf[i]);
+			frame->data[i] = NULL;
+		}
+		atomic_int64_fetch_add(&stat_fallbacks, 1);
+		return avcodec_default_get_buffer2(s, frame, flags);
+	}
+
+	return 0;
+}
+
+/*
+ * Copies the counters of the frame buffer pools, which are shared by all instances.
+ */
+void proxy_get_bufpool_stats(BufferPoolStats *stats)
+{
+	stats->requests = atomic_int64_load(&stat_requests);
+	stats->allocations = atomic_int64_load(&stat_allocations);
+	stats->pooled_bytes = atomic_int64_load(&stat_pooled_bytes);
+	stats->fallbacks = atomic_int64_load(&stat_fallbacks);
+}
+
+/*
+ * Releases the memory of the frame buffer pools, e.g. after decoding a burst of large frames
+ * in a long-running process. Buffers that are still in use are freed when their frames are
+ * released. Decoding can continue concurrently, and refills the pools on demand.
+ */
+void proxy_trim_bufpool(void)
+{
+	AVBufferPool *trimmed[BUFPOOL_CLASSES];
+
+	for (int i = 0; i < BUFPOOL_CLASSES; i++) {
+		trimmed[i] = atomic_ptr_load((void *volatile *)&pools[i]);
+		if (trimmed[i] != NULL && atomic_ptr_compare_exchange((void *volatile *)&pools[i], trimmed[i], NULL) != trimmed[i]) {
+			trimmed[i] = NULL; // trimmed concurrently
+		}
+	}
+
+	// Wait for threads that took a pool before it was removed
+	while (atomic_int64_load(&pool_users) > 0) {
+		thread_yield();
+	}
+
+	for (int i = 0; i < BUFPOOL_CLASSES; i++) {
+		if (trimmed[i] != NULL) {
+			av_buffer_pool_uninit(&trimmed[i]);
+		}
+	}
+}
@@ -0,0 +1,41 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+// FFmpeg includes
+#include "libavcodec/avcodec.h"
+
+#define BUFPOOL_MIN_SIZE 4096 // bytes, smallest size class
+#define BUFPOOL_CLASSES 64 // four classes per power of two, from BUFPOOL_MIN_SIZE up to 224 MB
+#define BUFPOOL_STRIDE_ALIGN 64 // bytes, alignment of video lines (enough for AVX-512)
+#define BUFPOOL_MAX_BYTES (256LL << 20) // memory held by all pools, beyond it frames are allocated by the FFmpeg default allocator
+
+/*
+ * Counters of the shared frame buffer pools, see proxy_get_bufpool_stats.
+ */
+typedef struct BufferPoolStats {
+	int64_t				requests; // plane buffers handed out to decoders
+	int64_t				allocations; // plane buffers newly allocated because the pool was empty
+	int64_t				pooled_bytes; // memory held by the pools, whether in use or not
+	int64_t				fallbacks; // frames allocated by the FFmpeg default allocator
+} BufferPoolStats;
+
+int bufpool_get_buffer2(AVCodecContext *s, AVFrame *frame, int flags);
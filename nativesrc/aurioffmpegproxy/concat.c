@@ -0,0 +1,484 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#include <string.h>
+
+#include "proxy.h"
+#include "concat.h"
+
+#include "libavutil/cpu.h"
+
+/*
+ * Gapless playback of a list of files, e.g. the chunks of a long recording.
+ *
+ * All sources are opened in low-footprint mode (MODE_LOWMEM), which probes them and determines
+ * their lengths, so the concatenated timeline is known from the start, but keeps only the
+ * source that is read with open decoders. While a source is read, a background thread opens
+ * the decoders of the next source and decodes its first frame, so the transition does not
+ * stall on opening the file.
+ *
+ * Sources with timelines that continue each other (e.g. the chunks of a camera, whose
+ * timestamps continue across files) are joined by their timestamps: samples that the next
+ * source repeats from the end of the previous source are trimmed. Sources with independent
+ * timelines are appended.
+ */
+
+typedef struct ConcatOpen {
+	Concat				*c;
+	int					mode;
+	volatile int64_t	next;
+} ConcatOpen;
+
+static void *open_worker(void *arg)
+{
+	ConcatOpen *o = arg;
+	int64_t i;
+
+	while ((i = atomic_int64_fetch_add(&o->next, 1)) < o->c->count) {
+		o->c->sources[i].pi = stream_open_file(o->mode, o->c->sources[i].filename);
+	}
+
+	return NULL;
+}
+
+/*
+ * Opens all sources in parallel, which is limited by the storage rather than the CPU.
+ */
+static void open_sources(Concat *c, int mode)
+{
+	ConcatOpen o;
+	Thread *threads;
+	int thread_count, started = 0;
+
+	o.c = c;
+	o.mode = mode;
+	o.next = 0;
+
+	thread_count = FFMIN(av_cpu_count(), c->count);
+	threads = malloc(sizeof(Thread) * thread_count);
+	if (threads != NULL) {
+		for (; started < thread_count; started++) {
+			if (thread_create(&threads[started], open_worker, &o) < 0) {
+				break;
+			}
+		}
+	}
+	if (started == 0) {
+		open_worker(&o);
+	}
+	for (int i = 0; i < started; i++) {
+		thread_join(threads[i]);
+	}
+	free(threads);
+}
+
+/*
+ * Positions the instance of a source at its start and decodes the first frame.
+ */
+static void prepare_source(Concat *c, ConcatSource *s)
+{
+	int frame_type;
+
+	if (!s->fresh) {
+		s->preroll_samples = 0;
+		if (stream_seek(s->pi, s->start, TYPE_AUDIO) < 0) {
+			return;
+		}
+		s->fresh = 1;
+	}
+
+	if (s->preroll_samples == 0) {
+		int ret = stream_read_frame(s->pi, &s->preroll_timestamp, s->preroll, c->frame_size * c->block_size, &frame_type);
+		s->preroll_samples = FFMAX(ret, 0);
+	}
+}
+
+static void *prepare_worker(void *arg)
+{
+	Concat *c = arg;
+
+	mutex_lock(&c->mutex);
+	while (1) {
+		int i;
+
+		while (!c->stop && c->prepare < 0) {
+			cond_wait(&c->cond, &c->mutex);
+		}
+		if (c->stop) {
+			break;
+		}
+
+		i = c->prepare;
+		c->prepare = -1;
+		c->preparing = i;
+		mutex_unlock(&c->mutex);
+
+		prepare_source(c, &c->sources[i]);
+
+		mutex_lock(&c->mutex);
+		c->preparing = -1;
+		cond_broadcast(&c->cond);
+	}
+	mutex_unlock(&c->mutex);
+
+	return NULL;
+}
+
+static void request_prepare(Concat *c, int source)
+{
+	mutex_lock(&c->mutex);
+	c->prepare = source;
+	cond_broadcast(&c->cond);
+	mutex_unlock(&c->mutex);
+}
+
+/*
+ * Cancels the pending preparation of a source or waits for its running preparation, after
+ * which the calling thread has exclusive access to its instance.
+ */
+static void wait_source(Concat *c, int source)
+{
+	mutex_lock(&c->mutex);
+	if (c->prepare == source) {
+		c->prepare = -1;
+	}
+	while (c->preparing == source) {
+		cond_wait(&c->cond, &c->mutex);
+	}
+	mutex_unlock(&c->mutex);
+}
+
+/*
+ * Cancels a pending preparation and waits for a running one, after which the calling thread
+ * has exclusive access to all instances.
+ */
+static void wait_idle(Concat *c)
+{
+	mutex_lock(&c->mutex);
+	c->prepare = -1;
+	while (c->preparing >= 0) {
+		cond_wait(&c->cond, &c->mutex);
+	}
+	mutex_unlock(&c->mutex);
+}
+
+/*
+ * Makes the given source the one that is read (the count for the end), and releases the
+ * decoders of the previous one and of its prepared successor, if it is not the new source.
+ * A released prepared source keeps its first frame and continues after it when reopened.
+ */
+static void enter_source(Concat *c, int source)
+{
+	int previous = c->current;
+
+	wait_idle(c);
+
+	if (previous != source && previous < c->count) {
+		stream_release(c->sources[previous].pi);
+		c->sources[previous].fresh = 0;
+		c->sources[previous].preroll_samples = 0;
+		if (previous + 1 != source && previous + 1 < c->count) {
+			stream_release(c->sources[previous + 1].pi);
+		}
+	}
+
+	c->current = source;
+}
+
+/*
+ * Determines the position of each source in the concatenated timeline. Returns 0 on success,
+ * or a negative number if the sources cannot be concatenated.
+ */
+static int build_timeline(Concat *c)
+{
+	ProxyInstance *first = c->sources[0].pi;
+	int sample_rate = first->audio_output.format.sample_rate;
+	int64_t tolerance = (int64_t)(CONCAT_CONTINUITY_TOLERANCE * sample_rate);
+	int64_t offset = 0;
+
+	c->output.format.sample_rate = sample_rate;
+	c->output.format.sample_size = first->audio_output.format.sample_size;
+	c->output.format.channels = first->audio_output.format.channels;
+	c->block_size = c->output.format.channels * c->output.format.sample_size;
+	c->frame_size = 0;
+
+	for (int i = 0; i < c->count; i++) {
+		ConcatSource *s = &c->sources[i];
+		ProxyInstance *pi = s->pi;
+		int64_t origin, length, overlap = 0;
+		int released;
+
+		if (pi->audio_output.format.sample_rate != c->output.format.sample_rate
+			|| pi->audio_output.format.sample_size != c->output.format.sample_size
+			|| pi->audio_output.format.channels != c->output.format.channels) {
+			proxy_log(pi, PI_LOG_ERROR, "concat: %s has a different audio format than %s", s->filename, c->sources[0].filename);
+			return -1;
+		}
+		if (pi->audio_output.length == AV_NOPTS_VALUE) {
+			proxy_log(pi, PI_LOG_ERROR, "concat: %s has an unknown length", s->filename);
+			return -1;
+		}
+
+		// The start time is only known to the opened input, a released source is released again after
+		released = pi->released;
+		if (released && acquire_decoders(pi, 0) < 0) {
+			return -1;
+		}
+		origin = pi->audio_stream->start_time != AV_NOPTS_VALUE
+			? pts_to_samples(sample_rate, pi->audio_stream->time_base, pi->audio_stream->start_time)
+			: 0;
+		if (released) {
+			stream_release(pi);
+		}
+		length = pi->audio_output.length;
+
+		if (i > 0) {
+			ConcatSource *previous = &c->sources[i - 1];
+			int64_t previous_end = previous->start + previous->length;
+
+			if (origin < previous_end && previous_end - origin <= tolerance && previous_end - origin < length) {
+				overlap = previous_end - origin;
+			}
+		}
+
+		s->start = origin + overlap;
+		s->length = length - overlap;
+		s->offset = offset;
+		s->fresh = 1;
+		offset += s->length;
+
+		c->frame_size = FFMAX(c->frame_size, pi->audio_output.frame_size);
+	}
+
+	c->output.length = offset;
+	c->output.frame_size = c->frame_size;
+	c->output.sample_position = 0;
+
+	return 0;
+}
+
+/*
+ * Opens a list of files as one continuous audio stream, with the output format of the first
+ * file. All files must have the same output format and a known length. The mode can contain
+ * MODE_* flags (e.g. MODE_ANALYSIS), except MODE_LIVE and MODE_DISPATCH. Returns NULL on error.
+ */
+Concat *concat_open(int mode, char **filenames, int count)
+{
+	Concat *c;
+
+	if (count <= 0 || (mode & (MODE_LIVE | MODE_DISPATCH))) {
+		proxy_log(NULL, PI_LOG_ERROR, "concat: no sources, or unsupported mode");
+		return NULL;
+	}
+
+	c = calloc(1, sizeof(Concat));
+	if (c == NULL) {
+		return NULL;
+	}
+	c->sources = calloc(count, sizeof(ConcatSource));
+	if (c->sources == NULL) {
+		free(c);
+		return NULL;
+	}
+	c->count = count;
+	c->current = 0;
+	c->prepare = -1;
+	c->preparing = -1;
+	mutex_init(&c->mutex);
+	cond_init(&c->cond);
+
+	for (int i = 0; i < count; i++) {
+		c->sources[i].filename = strdup(filenames[i]);
+	}
+
+	open_sources(c, (mode & ~TYPE_MASK) | TYPE_AUDIO | MODE_LOWMEM);
+
+	for (int i = 0; i < count; i++) {
+		if (c->sources[i].pi == NULL || stream_has_error(c->sources[i].pi)) {
+			proxy_log(NULL, PI_LOG_ERROR, "concat: cannot open %s: %s", c->sources[i].filename,
+				c->sources[i].pi != NULL ? stream_get_error(c->sources[i].pi) : "out of memory");
+			concat_close(c);
+			return NULL;
+		}
+	}
+
+	if (build_timeline(c) < 0) {
+		concat_close(c);
+		return NULL;
+	}
+
+	for (int i = 0; i < count; i++) {
+		c->sources[i].preroll = malloc((size_t)c->frame_size * c->block_size);
+		if (c->sources[i].preroll == NULL) {
+			concat_close(c);
+			return NULL;
+		}
+	}
+
+	if (thread_create(&c->thread, prepare_worker, c) < 0) {
+		proxy_log(NULL, PI_LOG_ERROR, "concat: cannot create thread");
+		concat_close(c);
+		return NULL;
+	}
+	c->running = 1;
+
+	// Prepare the first source while the caller sets up playback
+	request_prepare(c, 0);
+
+	return c;
+}
+
+void *concat_get_output_config(Concat *c)
+{
+	return &c->output;
+}
+
+/*
+ * Reads the next frame of the concatenated stream into the output buffer, which must fit
+ * output.frame_size samples. Returns the number of samples per channel, with the position in
+ * the concatenated timeline in timestamp, or -1 at the end of the stream.
+ */
+int concat_read_frame(Concat *c, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size)
+{
+	while (c->current < c->count) {
+		ConcatSource *s = &c->sources[c->current];
+		int64_t frame_timestamp, from, to;
+		int samples, frame_type;
+
+		if (s->fresh) {
+			// Take over the source from the background preparation, or prepare it now if it has not started
+			wait_source(c, c->current);
+			prepare_source(c, s);
+			if (c->current + 1 < c->count) {
+				request_prepare(c, c->current + 1);
+			}
+		}
+
+		if (s->preroll_samples > 0) {
+			samples = s->preroll_samples;
+			frame_timestamp = s->preroll_timestamp;
+			if (samples * c->block_size > output_buffer_size) {
+				proxy_log(s->pi, PI_LOG_ERROR, "concat: output buffer too small (%d)", output_buffer_size);
+				return -1;
+			}
+			memcpy(output_buffer, s->preroll, (size_t)samples * c->block_size);
+			s->preroll_samples = 0;
+		}
+		else {
+			samples = stream_read_frame(s->pi, &frame_timestamp, output_buffer, output_buffer_size, &frame_type);
+		}
+		s->fresh = 0;
+
+		if (samples < 0 || frame_timestamp >= s->start + s->length) {
+			// The end of the source, or samples beyond its length that would shift the following sources
+			enter_source(c, c->current + 1);
+			continue;
+		}
+
+		from = FFMAX(frame_timestamp, s->start);
+		to = FFMIN(frame_timestamp + samples, s->start + s->length);
+		if (to <= from) {
+			continue; // repeated from the previous source
+		}
+		if (from > frame_timestamp) {
+			memmove(output_buffer, output_buffer + (from - frame_timestamp) * c->block_size, (size_t)(to - from) * c->block_size);
+		}
+
+		*timestamp = s->offset + (from - s->start);
+		c->output.sample_position = *timestamp + (to - from);
+
+		return (int)(to - from);
+	}
+
+	return -1;
+}
+
+/*
+ * Seeks to a position in the concatenated timeline. The next read continues at the position
+ * in the source that contains it. Returns 0 on success, or a negative number on error.
+ */
+int concat_seek(Concat *c, int64_t position)
+{
+	int lo = 0, hi = c->count - 1;
+	ConcatSource *s;
+
+	// Find the last source that starts at or before the position
+	while (lo < hi) {
+		int mid = lo + (hi - lo + 1) / 2;
+		if (c->sources[mid].offset <= position) {
+			lo = mid;
+		}
+		else {
+			hi = mid - 1;
+		}
+	}
+
+	enter_source(c, lo);
+	s = &c->sources[lo];
+
+	if (position <= s->offset) {
+		// The start of a source is positioned exactly, and possibly already prepared
+		if (!s->fresh) {
+			prepare_source(c, s);
+		}
+		c->output.sample_position = s->offset;
+		return 0;
+	}
+
+	s->fresh = 0;
+	s->preroll_samples = 0;
+	if (stream_seek(s->pi, s->start + (position - s->offset), TYPE_AUDIO) < 0) {
+		return -1;
+	}
+	c->output.sample_position = position;
+	if (lo + 1 < c->count) {
+		request_prepare(c, lo + 1);
+	}
+
+	return 0;
+}
+
+int64_t concat_get_length(Concat *c)
+{
+	return c->output.length;
+}
+
+void concat_close(Concat *c)
+{
+	if (c->running) {
+		mutex_lock(&c->mutex);
+		c->stop = 1;
+		cond_broadcast(&c->cond);
+		mutex_unlock(&c->mutex);
+		thread_join(c->thread);
+	}
+	mutex_destroy(&c->mutex);
+	cond_destroy(&c->cond);
+
+	for (int i = 0; i < c->count; i++) {
+		if (c->sources[i].pi != NULL) {
+			stream_close(c->sources[i].pi);
+		}
+		free(c->sources[i].preroll);
+		free(c->sources[i].filename);
+	}
+	free(c->sources);
+	free(c);
+}
@@ -0,0 +1,67 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#pragma once
+
+#include <stdint.h>
+
+#include "thread.h"
+
+#define CONCAT_CONTINUITY_TOLERANCE 1.0 // seconds, max distance between timelines that continue each other
+
+typedef struct ConcatSource {
+	char				*filename;
+	struct ProxyInstance *pi;
+	int64_t				start; // first sample of the source in its own timeline, after trimming the overlap
+	int64_t				length; // samples in the concatenated timeline
+	int64_t				offset; // position of the first sample in the concatenated timeline
+	int					fresh; // the next read returns the start of the source
+	uint8_t				*preroll; // first decoded frame, prepared in the background
+	int					preroll_samples; // 0 if none
+	int64_t				preroll_timestamp;
+} ConcatSource;
+
+/*
+ * Presents the audio of a list of files as one continuous stream, see concat_open.
+ */
+typedef struct Concat {
+	ConcatSource		*sources;
+	int					count;
+	int					current; // source that is read
+	int					block_size;
+	int					frame_size;
+
+	struct {
+		struct {
+			int					sample_rate;
+			int					sample_size;
+			int					channels;
+		}					format;
+		int64_t				length;
+		int					frame_size;
+		int64_t				sample_position;
+	}					output; // same layout as ProxyInstance.audio_output
+
+	// background preparation of the next source
+	Thread				thread;
+	Mutex				mutex;
+	Cond				cond;
+	int					prepare; // source to prepare, -1 if none
+	int					preparing; // source that is being prepared, -1 if none
+	int					stop;
+	int					running; // the thread has been started
+} Concat;
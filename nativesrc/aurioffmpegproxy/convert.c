@@ -0,0 +1,390 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <string.h>
+
+#include "convert.h"
+
+#include "libavutil/cpu.h"
+
+/*
+ * Fast paths for the trivial sample conversions from the decoder output to the output
+ * format of this layer (see determine_target_format), which otherwise go through the
+ * generic conversion machinery of swresample. Since the channel layout and sample rate
+ * never change, these are plain copies, (de)interleaving and int to float scaling.
+ * The results are bit-identical to swresample, which is checked by the convert test
+ * (test.c).
+ */
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define HAVE_X86 1
+	#include <emmintrin.h>
+	#include <immintrin.h>
+	#if defined(__GNUC__)
+		// Allows compiling the kernels without enabling the instruction sets globally
+		#define TARGET_SSE2 __attribute__((target("sse2")))
+		#define TARGET_AVX2 __attribute__((target("avx2")))
+	#else
+		#define TARGET_SSE2
+		#define TARGET_AVX2
+	#endif
+#else
+	#define HAVE_X86 0
+#endif
+
+#define S32_TO_FLT_SCALE (1.0f / (1U << 31)) // same scale as swresample
+
+/*
+ * Scalar kernels, also used for the remainders of the SIMD kernels.
+ */
+
+static void copy_s16(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	memcpy(dst, src[0], (size_t)samples * channels * sizeof(int16_t));
+}
+
+static void copy_flt(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	memcpy(dst, src[0], (size_t)samples * channels * sizeof(float));
+}
+
+static void interleave_s16_c(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	int16_t *out = (int16_t *)dst;
+
+	for (int i = 0; i < samples; i++) {
+		for (int c = 0; c < channels; c++) {
+			*out++ = ((const int16_t *)src[c])[i];
+		}
+	}
+}
+
+static void interleave_flt_c(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	float *out = (float *)dst;
+
+	for (int i = 0; i < samples; i++) {
+		for (int c = 0; c < channels; c++) {
+			*out++ = ((const float *)src[c])[i];
+		}
+	}
+}
+
+static void s32_to_flt_c(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	const int32_t *in = (const int32_t *)src[0];
+	float *out = (float *)dst;
+	int count = samples * channels;
+
+	for (int i = 0; i < count; i++) {
+		out[i] = in[i] * S32_TO_FLT_SCALE;
+	}
+}
+
+static void s32p_to_flt_c(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	float *out = (float *)dst;
+
+	for (int i = 0; i < samples; i++) {
+		for (int c = 0; c < channels; c++) {
+			*out++ = ((const int32_t *)src[c])[i] * S32_TO_FLT_SCALE;
+		}
+	}
+}
+
+/*
+ * Converts the samples from `offset` on with the scalar kernel, for the remainders that
+ * do not fill a whole vector.
+ */
+static void convert_tail(SampleConverter kernel, int bytes_per_sample, int planar,
+	uint8_t *dst, const uint8_t **src, int channels, int samples, int offset)
+{
+	const uint8_t *tail_src[CONVERT_MAX_CHANNELS];
+
+	if (offset >= samples) {
+		return;
+	}
+
+	if (planar) {
+		for (int c = 0; c < channels; c++) {
+			tail_src[c] = src[c] + (size_t)offset * bytes_per_sample;
+		}
+	}
+	else {
+		tail_src[0] = src[0] + (size_t)offset * channels * bytes_per_sample;
+	}
+
+	kernel(dst + (size_t)offset * channels * bytes_per_sample, tail_src, channels, samples - offset);
+}
+
+#if HAVE_X86
+
+/*
+ * SSE2 kernels
+ */
+
+TARGET_SSE2 static void interleave_s16_sse2(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	int i = 0;
+
+	if (channels == 1) {
+		copy_s16(dst, src, channels, samples);
+		return;
+	}
+	else if (channels == 2) {
+		const int16_t *l = (const int16_t *)src[0];
+		const int16_t *r = (const int16_t *)src[1];
+		int16_t *out = (int16_t *)dst;
+
+		for (; i + 8 <= samples; i += 8) {
+			__m128i vl = _mm_loadu_si128((const __m128i *)(l + i));
+			__m128i vr = _mm_loadu_si128((const __m128i *)(r + i));
+			_mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi16(vl, vr));
+			_mm_storeu_si128((__m128i *)(out + 2 * i + 8), _mm_unpackhi_epi16(vl, vr));
+		}
+	}
+
+	convert_tail(interleave_s16_c, sizeof(int16_t), 1, dst, src, channels, samples, i);
+}
+
+TARGET_SSE2 static void interleave_flt_sse2(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	float *out = (float *)dst;
+	int i = 0;
+
+	if (channels == 1) {
+		copy_flt(dst, src, channels, samples);
+		return;
+	}
+	else if (channels == 2) {
+		const float *l = (const float *)src[0];
+		const float *r = (const float *)src[1];
+
+		for (; i + 4 <= samples; i += 4) {
+			__m128 vl = _mm_loadu_ps(l + i);
+			__m128 vr = _mm_loadu_ps(r + i);
+			_mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(vl, vr));
+			_mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(vl, vr));
+		}
+	}
+	else if (channels >= 4) {
+		// Transpose blocks of 4 channels x 4 samples, and copy the remaining channels
+		for (; i + 4 <= samples; i += 4) {
+			int c = 0;
+
+			for (; c + 4 <= channels; c += 4) {
+				__m128 v0 = _mm_loadu_ps((const float *)src[c] + i);
+				__m128 v1 = _mm_loadu_ps((const float *)src[c + 1] + i);
+				__m128 v2 = _mm_loadu_ps((const float *)src[c + 2] + i);
+				__m128 v3 = _mm_loadu_ps((const float *)src[c + 3] + i);
+				_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+				_mm_storeu_ps(out + (size_t)i * channels + c, v0);
+				_mm_storeu_ps(out + (size_t)(i + 1) * channels + c, v1);
+				_mm_storeu_ps(out + (size_t)(i + 2) * channels + c, v2);
+				_mm_storeu_ps(out + (size_t)(i + 3) * channels + c, v3);
+			}
+			for (; c < channels; c++) {
+				for (int k = 0; k < 4; k++) {
+					out[(size_t)(i + k) * channels + c] = ((const float *)src[c])[i + k];
+				}
+			}
+		}
+	}
+
+	convert_tail(interleave_flt_c, sizeof(float), 1, dst, src, channels, samples, i);
+}
+
+TARGET_SSE2 static void s32_to_flt_sse2(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	const int32_t *in = (const int32_t *)src[0];
+	float *out = (float *)dst;
+	const __m128 scale = _mm_set1_ps(S32_TO_FLT_SCALE);
+	int count = samples * channels;
+	int i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+	for (; i < count; i++) {
+		out[i] = in[i] * S32_TO_FLT_SCALE;
+	}
+}
+
+TARGET_SSE2 static void s32p_to_flt_sse2(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	float *out = (float *)dst;
+	int i = 0;
+
+	if (channels == 1) {
+		s32_to_flt_sse2(dst, src, channels, samples);
+		return;
+	}
+	else if (channels == 2) {
+		const int32_t *l = (const int32_t *)src[0];
+		const int32_t *r = (const int32_t *)src[1];
+		const __m128 scale = _mm_set1_ps(S32_TO_FLT_SCALE);
+
+		for (; i + 4 <= samples; i += 4) {
+			__m128 vl = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(l + i))), scale);
+			__m128 vr = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(r + i))), scale);
+			_mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(vl, vr));
+			_mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(vl, vr));
+		}
+	}
+
+	convert_tail(s32p_to_flt_c, sizeof(int32_t), 1, dst, src, channels, samples, i);
+}
+
+/*
+ * AVX2 kernels, for the stereo case that covers most sources. The in-lane unpacks
+ * interleave the low and high halves of each 128 bit lane, which are put back in
+ * order by the cross-lane permutes.
+ */
+
+TARGET_AVX2 static void interleave_s16_avx2(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	const int16_t *l, *r;
+	int16_t *out = (int16_t *)dst;
+	int i = 0;
+
+	if (channels != 2) {
+		interleave_s16_sse2(dst, src, channels, samples);
+		return;
+	}
+
+	l = (const int16_t *)src[0];
+	r = (const int16_t *)src[1];
+
+	for (; i + 16 <= samples; i += 16) {
+		__m256i vl = _mm256_loadu_si256((const __m256i *)(l + i));
+		__m256i vr = _mm256_loadu_si256((const __m256i *)(r + i));
+		__m256i lo = _mm256_unpacklo_epi16(vl, vr);
+		__m256i hi = _mm256_unpackhi_epi16(vl, vr);
+		_mm256_storeu_si256((__m256i *)(out + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(out + 2 * i + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	convert_tail(interleave_s16_sse2, sizeof(int16_t), 1, dst, src, channels, samples, i);
+}
+
+TARGET_AVX2 static void interleave_flt_avx2(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	const float *l, *r;
+	float *out = (float *)dst;
+	int i = 0;
+
+	if (channels != 2) {
+		interleave_flt_sse2(dst, src, channels, samples);
+		return;
+	}
+
+	l = (const float *)src[0];
+	r = (const float *)src[1];
+
+	for (; i + 8 <= samples; i += 8) {
+		__m256 vl = _mm256_loadu_ps(l + i);
+		__m256 vr = _mm256_loadu_ps(r + i);
+		__m256 lo = _mm256_unpacklo_ps(vl, vr);
+		__m256 hi = _mm256_unpackhi_ps(vl, vr);
+		_mm256_storeu_ps(out + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+		_mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+	}
+
+	convert_tail(interleave_flt_sse2, sizeof(float), 1, dst, src, channels, samples, i);
+}
+
+TARGET_AVX2 static void s32_to_flt_avx2(uint8_t *dst, const uint8_t **src, int channels, int samples)
+{
+	const int32_t *in = (const int32_t *)src[0];
+	float *out = (float *)dst;
+	const __m256 scale = _mm256_set1_ps(S32_TO_FLT_SCALE);
+	int count = samples * channels;
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	for (; i < count; i++) {
+		out[i] = in[i] * S32_TO_FLT_SCALE;
+	}
+}
+
+#endif
+
+/*
+ * Returns the fastest converter for the given format pair and channel count on a CPU with the given
+ * capabilities (av_get_cpu_flags), or NULL if the conversion needs swresample.
+ */
+SampleConverter convert_select(enum AVSampleFormat in_fmt, enum AVSampleFormat out_fmt, int channels, int cpu_flags)
+{
+	int sse2 = 0, avx2 = 0;
+
+	if (channels > CONVERT_MAX_CHANNELS) {
+		return NULL;
+	}
+
+#if HAVE_X86
+	sse2 = (cpu_flags & AV_CPU_FLAG_SSE2) != 0;
+	avx2 = (cpu_flags & AV_CPU_FLAG_AVX2) != 0;
+#endif
+
+	if (out_fmt == AV_SAMPLE_FMT_S16) {
+		switch (in_fmt) {
+		case AV_SAMPLE_FMT_S16:
+			return copy_s16;
+		case AV_SAMPLE_FMT_S16P:
+#if HAVE_X86
+			if (avx2) return interleave_s16_avx2;
+			if (sse2) return interleave_s16_sse2;
+#endif
+			return interleave_s16_c;
+		default:
+			return NULL;
+		}
+	}
+	else if (out_fmt == AV_SAMPLE_FMT_FLT) {
+		switch (in_fmt) {
+		case AV_SAMPLE_FMT_FLT:
+			return copy_flt;
+		case AV_SAMPLE_FMT_FLTP:
+#if HAVE_X86
+			if (avx2) return interleave_flt_avx2;
+			if (sse2) return interleave_flt_sse2;
+#endif
+			return interleave_flt_c;
+		case AV_SAMPLE_FMT_S32:
+#if HAVE_X86
+			if (avx2) return s32_to_flt_avx2;
+			if (sse2) return s32_to_flt_sse2;
+#endif
+			return s32_to_flt_c;
+		case AV_SAMPLE_FMT_S32P:
+#if HAVE_X86
+			if (sse2) return s32p_to_flt_sse2;
+#endif
+			return s32p_to_flt_c;
+		default:
+			return NULL;
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,33 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include "libavutil/samplefmt.h"
+
+#define CONVERT_MAX_CHANNELS 64
+
+/*
+ * Converts `samples` samples per channel from the decoder format into the interleaved
+ * output buffer. Planar input has one source pointer per channel, interleaved input one.
+ */
+typedef void (*SampleConverter)(uint8_t *dst, const uint8_t **src, int channels, int samples);
+
+SampleConverter convert_select(enum AVSampleFormat in_fmt, enum AVSampleFormat out_fmt, int channels, int cpu_flags);
@@ -0,0 +1,558 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#include <string.h>
+
+#include "proxy.h"
+#include "dispatch.h"
+#include "timer.h"
+
+/*
+ * Demuxing once and decoding audio and video independently (MODE_DISPATCH).
+ *
+ * A demux thread reads the packets of the source and appends them to the queue of
+ * their stream type. Each stream type is then decoded by the thread that reads its
+ * frames, so an audio playback thread and a video rendering thread can consume the
+ * same instance at their own pace without serializing on one call path.
+ *
+ * Demuxing pauses when the queue of the next packet is full. Because the packets
+ * of both types are interleaved in the source, a consumer that falls far behind
+ * would then starve the other one, so a full queue may grow up to a hard limit
+ * while the other consumer is waiting for packets.
+ */
+
+static DispatchStream *other_stream(Dispatcher *d, DispatchStream *s)
+{
+	return s == &d->streams[DISPATCH_STREAM_AUDIO] ? &d->streams[DISPATCH_STREAM_VIDEO] : &d->streams[DISPATCH_STREAM_AUDIO];
+}
+
+static DispatchStream *packet_stream(Dispatcher *d, AVPacket *pkt)
+{
+	for (int i = 0; i < 2; i++) {
+		DispatchStream *s = &d->streams[i];
+		if (s->type != TYPE_NONE && s->stream->index == pkt->stream_index) {
+			return s;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Checks whether a packet can be appended to the queue. Must be called with the mutex held.
+ */
+static int queue_full(Dispatcher *d, DispatchStream *s)
+{
+	DispatchStream *other = other_stream(d, s);
+	int starving = other->type != TYPE_NONE && other->waiting && other->count == 0;
+
+	return s->count >= DISPATCH_QUEUE_LIMIT || (s->count >= DISPATCH_QUEUE_CAPACITY && !starving);
+}
+
+/*
+ * Returns a packet for reuse, or a new packet if there are none. Must be called with the mutex held.
+ */
+static AVPacket *take_packet(Dispatcher *d)
+{
+	return d->spare_count > 0 ? d->spare[--d->spare_count] : av_packet_alloc();
+}
+
+/*
+ * Unreferences a packet and keeps it for reuse. Must be called with the mutex held.
+ */
+static void recycle_packet(Dispatcher *d, AVPacket **packet)
+{
+	if (*packet == NULL) {
+		return;
+	}
+
+	if (d->spare_count < DISPATCH_SPARE_PACKETS) {
+		av_packet_unref(*packet);
+		d->spare[d->spare_count++] = *packet;
+		*packet = NULL;
+	}
+	else {
+		av_packet_free(packet);
+	}
+}
+
+static void queue_clear(Dispatcher *d, DispatchStream *s)
+{
+	while (s->count > 0) {
+		recycle_packet(d, &s->packets[s->head]);
+		s->head = (s->head + 1) % DISPATCH_QUEUE_LIMIT;
+		s->count--;
+	}
+	s->bytes = 0;
+}
+
+static void *dispatch_worker(void *arg)
+{
+	Dispatcher *d = arg;
+	ProxyInstance *pi = d->pi;
+	AVPacket *pkt = av_packet_alloc();
+	int ret;
+
+	mutex_lock(&d->mutex);
+
+	if (pkt == NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "cannot allocate the demux packet");
+		d->eof = 1;
+	}
+
+	while (1) {
+		DispatchStream *s;
+		AVPacket *packet = NULL;
+
+		while (!d->abort && (d->pause || d->eof)) {
+			d->paused = 1;
+			cond_broadcast(&d->cond);
+			cond_wait(&d->cond, &d->mutex);
+		}
+		d->paused = 0;
+		if (d->abort) {
+			break;
+		}
+
+		mutex_unlock(&d->mutex);
+
+		int64_t demux_start = timer_now_ns();
+		ret = av_read_frame(pi->fmt_ctx, pkt);
+		int64_t demux_end = timer_now_ns();
+		atomic_int64_fetch_add(&d->demux_ns, demux_end - demux_start);
+		if (pi->trace != NULL) {
+			trace_add(pi->trace, TRACE_DEMUX, demux_start, demux_end, ret >= 0 ? pkt->size : ret);
+		}
+
+		s = NULL;
+		if (ret >= 0) {
+			if (pi->io_read_packet == NULL) {
+				atomic_int64_store(&pi->input_ns, demux_end);
+			}
+			atomic_int64_fetch_add(&d->packets_demuxed, 1);
+			atomic_int64_fetch_add(&d->bytes_demuxed, pkt->size);
+
+			if ((s = packet_stream(d, pkt)) == NULL) {
+				atomic_int64_fetch_add(&d->packets_discarded, 1);
+				atomic_int64_fetch_add(&d->bytes_discarded, pkt->size);
+				av_packet_unref(pkt);
+			}
+		}
+
+		mutex_lock(&d->mutex);
+
+		if (s != NULL) {
+			if ((packet = take_packet(d)) == NULL) {
+				av_packet_unref(pkt);
+				ret = AVERROR(ENOMEM);
+			}
+			else {
+				av_packet_move_ref(packet, pkt);
+			}
+		}
+
+		if (ret < 0) {
+			if (ret != AVERROR_EOF) {
+				proxy_log(pi, PI_LOG_WARNING, "demuxing stopped (%s)", av_err2str(ret));
+			}
+			d->eof = 1;
+			cond_broadcast(&d->cond);
+			continue;
+		}
+		if (s == NULL) {
+			continue;
+		}
+
+		while (!d->abort && !d->pause && queue_full(d, s)) {
+			cond_wait(&d->cond, &d->mutex);
+		}
+		if (d->abort || d->pause) {
+			// The queues are cleared when pausing, the packet is outdated
+			recycle_packet(d, &packet);
+			continue;
+		}
+
+		s->packets[(s->head + s->count) % DISPATCH_QUEUE_LIMIT] = packet;
+		s->count++;
+		s->bytes += packet->size;
+		cond_broadcast(&d->cond);
+	}
+
+	d->paused = 1;
+	cond_broadcast(&d->cond);
+	mutex_unlock(&d->mutex);
+
+	av_packet_free(&pkt);
+
+	return NULL;
+}
+
+/*
+ * Takes the next packet of a stream, blocking while its queue is empty. Returns 0 if a packet
+ * was taken, 1 if the dispatcher is being paused, or -1 at the end of the input.
+ */
+static int get_packet(Dispatcher *d, DispatchStream *s, AVPacket **packet)
+{
+	int ret;
+
+	mutex_lock(&d->mutex);
+
+	s->waiting = 1;
+	cond_broadcast(&d->cond); // a demux thread blocked on the other queue may continue
+	while (s->count == 0 && !d->eof && !d->pause && !d->abort) {
+		cond_wait(&d->cond, &d->mutex);
+	}
+	s->waiting = 0;
+
+	if (d->pause) {
+		ret = 1;
+	}
+	else if (s->count > 0) {
+		*packet = s->packets[s->head];
+		s->head = (s->head + 1) % DISPATCH_QUEUE_LIMIT;
+		s->count--;
+		s->bytes -= (*packet)->size;
+		cond_broadcast(&d->cond);
+		ret = 0;
+	}
+	else {
+		ret = -1;
+	}
+
+	mutex_unlock(&d->mutex);
+
+	return ret;
+}
+
+static void wait_resumed(Dispatcher *d)
+{
+	mutex_lock(&d->mutex);
+	while (d->pause) {
+		cond_wait(&d->cond, &d->mutex);
+	}
+	mutex_unlock(&d->mutex);
+}
+
+/*
+ * Decodes the next frame of a stream into its frame. Must be called with the stream's
+ * decode_mutex held, which is temporarily released while the dispatcher is paused.
+ * Returns 0 if a frame was decoded, or a negative number at the end of the stream or on error.
+ */
+static int decode_frame(Dispatcher *d, DispatchStream *s)
+{
+	ProxyInstance *pi = d->pi;
+	AVPacket *packet;
+	int ret;
+
+	while (1) {
+		int64_t decode_start = timer_now_ns();
+		ret = avcodec_receive_frame(s->codec_ctx, s->frame);
+		int64_t decode_end = timer_now_ns();
+		atomic_int64_fetch_add(&s->decode_ns, decode_end - decode_start);
+
+		if (ret == 0) {
+			if (pi->trace != NULL) {
+				trace_add(pi->trace, TRACE_DECODE, decode_start, decode_end, s->type);
+			}
+			return 0;
+		}
+		else if (ret == AVERROR_EOF) {
+			return -1;
+		}
+		else if (ret != AVERROR(EAGAIN)) {
+			proxy_log(pi, PI_LOG_ERROR, "Error receiving decoded frame (%s)", av_err2str(ret));
+			return -1;
+		}
+
+		// More input required
+		if (s->eof_sent) {
+			return -1;
+		}
+
+		ret = get_packet(d, s, &packet);
+		if (ret > 0) {
+			// Let the seek flush the decoder, and continue with the packets after the seek
+			mutex_unlock(&s->decode_mutex);
+			wait_resumed(d);
+			mutex_lock(&s->decode_mutex);
+			continue;
+		}
+		else if (ret < 0) {
+			packet = NULL; // drain the decoder
+			s->eof_sent = 1;
+		}
+
+		decode_start = timer_now_ns();
+		ret = avcodec_send_packet(s->codec_ctx, packet);
+		decode_end = timer_now_ns();
+		atomic_int64_fetch_add(&s->decode_ns, decode_end - decode_start);
+		if (pi->trace != NULL) {
+			trace_add(pi->trace, TRACE_DECODE, decode_start, decode_end, packet != NULL ? packet->size : 0);
+		}
+		if (packet != NULL) {
+			mutex_lock(&d->mutex);
+			recycle_packet(d, &packet);
+			mutex_unlock(&d->mutex);
+		}
+
+		if (ret < 0 && ret != AVERROR_EOF) {
+			proxy_log(pi, PI_LOG_ERROR, "Error sending packet to decoder (%s)", av_err2str(ret));
+			return -1;
+		}
+	}
+}
+
+/*
+ * Starts demuxing an instance on a background thread. Returns NULL on error.
+ */
+Dispatcher *dispatch_start(ProxyInstance *pi)
+{
+	Dispatcher *d;
+	int types[2] = { TYPE_AUDIO, TYPE_VIDEO };
+
+	d = calloc(1, sizeof(Dispatcher));
+	if (d == NULL) {
+		return NULL;
+	}
+
+	d->pi = pi;
+	mutex_init(&d->mutex);
+	cond_init(&d->cond);
+	mutex_init(&d->seek_mutex);
+
+	for (int i = 0; i < 2; i++) {
+		DispatchStream *s = &d->streams[i];
+
+		mutex_init(&s->decode_mutex);
+		if (!(pi->mode & types[i])) {
+			continue;
+		}
+
+		s->type = types[i];
+		s->stream = s->type == TYPE_AUDIO ? pi->audio_stream : pi->video_stream;
+		s->codec_ctx = s->type == TYPE_AUDIO ? pi->audio_codec_ctx : pi->video_codec_ctx;
+		s->frame = av_frame_alloc();
+		s->packets = malloc(sizeof(AVPacket *) * DISPATCH_QUEUE_LIMIT);
+		if (s->frame == NULL || s->packets == NULL) {
+			d->abort = 1;
+		}
+	}
+
+	if (d->abort || thread_create(&d->thread, dispatch_worker, d) < 0) {
+		d->abort = 1; // there is no thread to stop
+		dispatch_stop(d);
+		return NULL;
+	}
+
+	return d;
+}
+
+/*
+ * Pauses demuxing and decoding, e.g. to seek the demuxer and flush the decoders. Returns
+ * when the demux thread is idle and no frames are being decoded, until dispatch_resume.
+ */
+void dispatch_pause(Dispatcher *d)
+{
+	mutex_lock(&d->seek_mutex);
+
+	mutex_lock(&d->mutex);
+	d->pause = 1;
+	cond_broadcast(&d->cond);
+	while (!d->paused) {
+		cond_wait(&d->cond, &d->mutex);
+	}
+	mutex_unlock(&d->mutex);
+
+	// Consumers waiting for packets release their decoder when they notice the pause
+	for (int i = 0; i < 2; i++) {
+		mutex_lock(&d->streams[i].decode_mutex);
+	}
+}
+
+/*
+ * Drops the queued packets and resumes demuxing from the current demuxer position.
+ */
+void dispatch_resume(Dispatcher *d)
+{
+	mutex_lock(&d->mutex);
+	for (int i = 0; i < 2; i++) {
+		queue_clear(d, &d->streams[i]);
+		d->streams[i].eof_sent = 0;
+	}
+	d->eof = 0;
+	d->pause = 0;
+	cond_broadcast(&d->cond);
+	mutex_unlock(&d->mutex);
+
+	for (int i = 0; i < 2; i++) {
+		mutex_unlock(&d->streams[i].decode_mutex);
+	}
+
+	mutex_unlock(&d->seek_mutex);
+}
+
+/*
+ * Stops the demux thread and frees the dispatcher. No frames must be read concurrently.
+ */
+void dispatch_stop(Dispatcher *d)
+{
+	mutex_lock(&d->mutex);
+	int running = !d->abort;
+	d->abort = 1;
+	cond_broadcast(&d->cond);
+	mutex_unlock(&d->mutex);
+
+	if (running) {
+		thread_join(d->thread);
+	}
+
+	for (int i = 0; i < 2; i++) {
+		DispatchStream *s = &d->streams[i];
+		if (s->packets != NULL) {
+			queue_clear(d, s);
+			free(s->packets);
+		}
+		av_frame_free(&s->frame);
+		mutex_destroy(&s->decode_mutex);
+	}
+	while (d->spare_count > 0) {
+		av_packet_free(&d->spare[--d->spare_count]);
+	}
+
+	mutex_destroy(&d->seek_mutex);
+	cond_destroy(&d->cond);
+	mutex_destroy(&d->mutex);
+	free(d);
+}
+
+int64_t dispatch_get_memory_usage(Dispatcher *d)
+{
+	int64_t size = sizeof(Dispatcher);
+
+	mutex_lock(&d->mutex);
+	size += sizeof(AVPacket) * d->spare_count;
+	for (int i = 0; i < 2; i++) {
+		DispatchStream *s = &d->streams[i];
+		if (s->type != TYPE_NONE) {
+			size += sizeof(AVPacket *) * DISPATCH_QUEUE_LIMIT + (sizeof(AVPacket) * s->count) + s->bytes + sizeof(AVFrame);
+		}
+	}
+	mutex_unlock(&d->mutex);
+
+	return size;
+}
+
+/*
+ * Adds the counters of the demux and consumer threads to the instance stats. They are
+ * kept apart from the instance stats because the threads update them concurrently.
+ */
+void dispatch_add_stats(Dispatcher *d, ProxyStats *stats)
+{
+	DispatchStream *audio = &d->streams[DISPATCH_STREAM_AUDIO];
+	DispatchStream *video = &d->streams[DISPATCH_STREAM_VIDEO];
+
+	stats->demux_ns += atomic_int64_load(&d->demux_ns);
+	stats->packets_demuxed += atomic_int64_load(&d->packets_demuxed);
+	stats->bytes_demuxed += atomic_int64_load(&d->bytes_demuxed);
+	stats->packets_discarded += atomic_int64_load(&d->packets_discarded);
+	stats->bytes_discarded += atomic_int64_load(&d->bytes_discarded);
+	stats->audio_frames_decoded += atomic_int64_load(&audio->frames_decoded);
+	stats->video_frames_decoded += atomic_int64_load(&video->frames_decoded);
+	stats->decode_ns += atomic_int64_load(&audio->decode_ns) + atomic_int64_load(&video->decode_ns); // can exceed the wall time, both types decode concurrently
+}
+
+void dispatch_reset_stats(Dispatcher *d)
+{
+	atomic_int64_store(&d->demux_ns, 0);
+	atomic_int64_store(&d->packets_demuxed, 0);
+	atomic_int64_store(&d->bytes_demuxed, 0);
+	atomic_int64_store(&d->packets_discarded, 0);
+	atomic_int64_store(&d->bytes_discarded, 0);
+	for (int i = 0; i < 2; i++) {
+		atomic_int64_store(&d->streams[i].frames_decoded, 0);
+		atomic_int64_store(&d->streams[i].decode_ns, 0);
+	}
+}
+
+/*
+ * Reads the next frame of the given type from an instance in MODE_DISPATCH. Audio and video
+ * frames can be read concurrently from different threads, each type is decoded on the thread
+ * that reads it. Frames of the same type must not be read concurrently. stream_seek can be
+ * called from any thread and repositions both types.
+ *
+ * Returns the number of samples (audio) or 1 (video) like stream_read_frame, or a negative
+ * number at the end of the stream or on error.
+ */
+int stream_read_typed_frame(ProxyInstance *pi, int type, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size)
+{
+	Dispatcher *d = pi->dispatch;
+	DispatchStream *s;
+	int ret;
+
+	if (d == NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "typed frame reading requires MODE_DISPATCH");
+		return -1;
+	}
+	if (type == TYPE_AUDIO && d->streams[DISPATCH_STREAM_AUDIO].type != TYPE_NONE) {
+		s = &d->streams[DISPATCH_STREAM_AUDIO];
+	}
+	else if (type == TYPE_VIDEO && d->streams[DISPATCH_STREAM_VIDEO].type != TYPE_NONE) {
+		s = &d->streams[DISPATCH_STREAM_VIDEO];
+	}
+	else {
+		proxy_log(pi, PI_LOG_ERROR, "unsupported read stream type %d", type);
+		return -1;
+	}
+
+	*timestamp = -1;
+
+	mutex_lock(&s->decode_mutex);
+
+	if (decode_frame(d, s) < 0) {
+		mutex_unlock(&s->decode_mutex);
+		return -1;
+	}
+
+	if (type == TYPE_AUDIO) {
+		ret = convert_audio_samples(pi, s->frame, output_buffer, output_buffer_size);
+		if (ret >= 0) {
+			update_position_and_get_timestamp(s->frame, pi->audio_output.format.sample_rate, s->stream->time_base,
+				ret, &pi->audio_output.sample_position, timestamp);
+			atomic_int64_fetch_add(&s->frames_decoded, 1);
+		}
+	}
+	else {
+		ret = convert_video_frame(pi, s->frame, output_buffer);
+		if (ret >= 0) {
+			ret = 1;
+			update_position_and_get_timestamp(s->frame, pi->video_output.format.frame_rate, s->stream->time_base,
+				ret, &pi->video_output.sample_position, timestamp);
+			pi->video_output.current_frame.keyframe = (s->frame->flags & AV_FRAME_FLAG_KEY) != 0;
+			pi->video_output.current_frame.pict_type = s->frame->pict_type;
+			pi->video_output.current_frame.interlaced = (s->frame->flags & AV_FRAME_FLAG_INTERLACED) != 0;
+			pi->video_output.current_frame.top_field_first = (s->frame->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST) != 0;
+			atomic_int64_fetch_add(&s->frames_decoded, 1);
+		}
+	}
+
+	mutex_unlock(&s->decode_mutex);
+
+	return ret < 0 ? -1 : ret;
+}
@@ -0,0 +1,88 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+// FFmpeg includes
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+
+#include "thread.h"
+
+#define DISPATCH_QUEUE_CAPACITY 64 // packets buffered per stream before demuxing pauses
+#define DISPATCH_QUEUE_LIMIT 1024 // packets buffered per stream while the consumer of the other stream is starving
+#define DISPATCH_SPARE_PACKETS 128 // decoded packets kept for reuse by the demux thread
+
+#define DISPATCH_STREAM_AUDIO 0
+#define DISPATCH_STREAM_VIDEO 1
+
+/*
+ * The packet queue and decoding state of one stream type. The decoder is only used by
+ * the thread that reads frames of this type, while holding decode_mutex.
+ */
+typedef struct DispatchStream {
+	int					type; // TYPE_AUDIO or TYPE_VIDEO, TYPE_NONE if the stream is not decoded
+	AVStream			*stream;
+	AVCodecContext		*codec_ctx;
+	AVFrame				*frame;
+	AVPacket			**packets; // ring of DISPATCH_QUEUE_LIMIT packets
+	int					head; // index of the oldest packet
+	int					count;
+	int64_t				bytes; // payload size of the queued packets
+	int					waiting; // the consumer is waiting for a packet
+	int					eof_sent; // the decoder has been sent the flush packet
+	volatile int64_t	decode_ns;
+	volatile int64_t	frames_decoded;
+	Mutex				decode_mutex;
+} DispatchStream;
+
+/*
+ * Demuxes an instance on a background thread and routes the packets to a queue per
+ * stream type, so that audio and video can be decoded and read independently.
+ */
+typedef struct Dispatcher {
+	struct ProxyInstance *pi;
+	DispatchStream		streams[2];
+	AVPacket			*spare[DISPATCH_SPARE_PACKETS]; // unreferenced packets for reuse
+	int					spare_count;
+	int					eof; // the demuxer reached the end of the input
+	int					pause; // demuxing and decoding are paused (e.g. to seek)
+	int					paused; // the demux thread is idle and does not access the demuxer
+	int					abort;
+	Mutex				mutex; // protects the queues and the flags above
+	Cond				cond;
+	Mutex				seek_mutex; // serializes concurrent seeks
+	Thread				thread;
+	volatile int64_t	demux_ns; // counters of the demux thread, added to the instance stats on request
+	volatile int64_t	packets_demuxed;
+	volatile int64_t	bytes_demuxed;
+	volatile int64_t	packets_discarded;
+	volatile int64_t	bytes_discarded;
+} Dispatcher;
+
+struct ProxyStats;
+
+Dispatcher *dispatch_start(struct ProxyInstance *pi);
+void dispatch_pause(Dispatcher *d);
+void dispatch_resume(Dispatcher *d);
+void dispatch_stop(Dispatcher *d);
+int64_t dispatch_get_memory_usage(Dispatcher *d);
+void dispatch_add_stats(Dispatcher *d, struct ProxyStats *stats);
+void dispatch_reset_stats(Dispatcher *d);
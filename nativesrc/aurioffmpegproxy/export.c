@@ -0,0 +1,538 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+
+#include "proxy.h"
+
+#include "libavutil/intreadwrite.h"
+
+/*
+ * Lossless export of time ranges by copying the compressed packets into new containers.
+ *
+ * The export runs on its own demuxer of the source, so the instance's decoding position is not
+ * affected. All ranges are exported in a single forward pass over the input, skipping the gaps
+ * between distant ranges by seeking. Packets are copied unchanged except at the cut edges:
+ *  - Video starts at the keyframe before the range start, because the frames of the open GOP
+ *    cannot be decoded without it. The frames before the start get negative timestamps, which
+ *    containers that support it (e.g. MP4 edit lists) hide on playback.
+ *  - PCM audio is cut at the exact sample by trimming the edge packets.
+ *  - Compressed audio edge frames are copied whole and marked with the number of samples to
+ *    skip at their start and end (AV_PKT_DATA_SKIP_SAMPLES), which the FFmpeg decoders apply,
+ *    and containers that can express it (e.g. Matroska, Ogg) persist.
+ * Re-encoding partial edge frames is deliberately avoided: a re-encoded frame only splices into a
+ * copied stream if the encoder reproduces the exact extradata and adds no priming samples, which
+ * is not the case for the common codecs.
+ */
+
+typedef struct ExportOutput {
+	const ExportRange	*range;
+	int64_t				start; // AV_TIME_BASE units
+	int64_t				end;
+	AVFormatContext		*oc;
+	int					state; // EXPORT_PENDING, EXPORT_ACTIVE, EXPORT_DONE
+	int					seeked; // whether the input has already been sought for this range
+	int					*stream_done; // per mapped stream, the end of the range has been reached
+	int					*keyframe_seen; // per mapped stream, decoding can start
+} ExportOutput;
+
+#define EXPORT_PENDING 0
+#define EXPORT_ACTIVE 1
+#define EXPORT_DONE 2
+
+/*
+ * Video packets since the last keyframe, to start an output at the keyframe before its start.
+ */
+typedef struct ExportGop {
+	AVPacket			**packets;
+	int					count;
+	int					capacity;
+} ExportGop;
+
+typedef struct Export {
+	ProxyInstance		*pi;
+	AVFormatContext		*ic;
+	int					*map; // input stream index -> mapped stream, -1 if not exported
+	AVStream			**streams; // mapped streams
+	ExportGop			*gops; // per mapped stream, only used for video
+	int					stream_count;
+	ExportOutput		*outputs; // sorted by start
+	int					output_count;
+} Export;
+
+static int compare_outputs(const void *a, const void *b)
+{
+	const ExportOutput *x = a, *y = b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+static void gop_clear(ExportGop *gop)
+{
+	for (int i = 0; i < gop->count; i++) {
+		av_packet_free(&gop->packets[i]);
+	}
+	gop->count = 0;
+}
+
+static int gop_add(ExportGop *gop, const AVPacket *pkt)
+{
+	if (pkt->flags & AV_PKT_FLAG_KEY) {
+		gop_clear(gop);
+	}
+	else if (gop->count == 0) {
+		return 0; // not decodable without the preceding keyframe
+	}
+
+	if (gop->count == gop->capacity) {
+		int capacity = gop->capacity > 0 ? gop->capacity * 2 : EXPORT_GOP_CAPACITY;
+		AVPacket **packets = realloc(gop->packets, sizeof(AVPacket *) * capacity);
+		if (packets == NULL) {
+			return -1;
+		}
+		gop->packets = packets;
+		gop->capacity = capacity;
+	}
+
+	if ((gop->packets[gop->count] = av_packet_clone(pkt)) == NULL) {
+		return -1;
+	}
+	gop->count++;
+
+	return 0;
+}
+
+static void add_stream(Export *ex, AVStream *stream)
+{
+	if (stream != NULL && ex->map[stream->index] < 0) {
+		ex->map[stream->index] = ex->stream_count;
+		ex->streams[ex->stream_count++] = stream;
+	}
+}
+
+static int open_output(Export *ex, ExportOutput *out)
+{
+	int ret;
+
+	if ((ret = avformat_alloc_output_context2(&out->oc, NULL, NULL, out->range->filename)) < 0) {
+		proxy_log(ex->pi, PI_LOG_ERROR, "export: unsupported output %s (%s)", out->range->filename, av_err2str(ret));
+		return ret;
+	}
+
+	for (int i = 0; i < ex->stream_count; i++) {
+		AVStream *stream = avformat_new_stream(out->oc, NULL);
+		if (stream == NULL) {
+			return AVERROR(ENOMEM);
+		}
+		if ((ret = avcodec_parameters_copy(stream->codecpar, ex->streams[i]->codecpar)) < 0) {
+			return ret;
+		}
+		stream->codecpar->codec_tag = 0; // the tag of the input container may be invalid in the output container
+		stream->time_base = ex->streams[i]->time_base;
+	}
+
+	if (!(out->oc->oformat->flags & AVFMT_NOFILE) && (ret = avio_open(&out->oc->pb, out->range->filename, AVIO_FLAG_WRITE)) < 0) {
+		proxy_log(ex->pi, PI_LOG_ERROR, "export: cannot write %s (%s)", out->range->filename, av_err2str(ret));
+		return ret;
+	}
+	if ((ret = avformat_write_header(out->oc, NULL)) < 0) {
+		proxy_log(ex->pi, PI_LOG_ERROR, "export: cannot write header of %s (%s)", out->range->filename, av_err2str(ret));
+		return ret;
+	}
+
+	out->state = EXPORT_ACTIVE;
+
+	return 0;
+}
+
+static int close_output(ExportOutput *out, int finish)
+{
+	int ret = 0;
+
+	if (out->oc == NULL) {
+		return 0;
+	}
+	if (finish && out->state == EXPORT_ACTIVE) {
+		ret = av_write_trailer(out->oc);
+	}
+	if (!(out->oc->oformat->flags & AVFMT_NOFILE)) {
+		avio_closep(&out->oc->pb);
+	}
+	avformat_free_context(out->oc);
+	out->oc = NULL;
+	out->state = EXPORT_DONE;
+
+	return ret;
+}
+
+/*
+ * Cuts the samples outside of the range from an audio edge packet. PCM is trimmed exactly,
+ * other codecs are marked with the samples that the decoder has to skip.
+ */
+static int trim_audio_packet(AVPacket *pkt, AVStream *stream, int64_t start, int64_t end)
+{
+	AVCodecParameters *par = stream->codecpar;
+	AVRational sample_tb = { 1, par->sample_rate };
+	int64_t head = FFMAX(start - pkt->pts, 0);
+	int64_t tail = FFMAX(pkt->pts + pkt->duration - end, 0);
+	int head_samples = (int)av_rescale_q(head, stream->time_base, sample_tb);
+	int tail_samples = (int)av_rescale_q(tail, stream->time_base, sample_tb);
+	int bits = av_get_exact_bits_per_sample(par->codec_id);
+
+	if (head_samples == 0 && tail_samples == 0) {
+		return 0;
+	}
+
+	if (bits > 0) {
+		int block_align = par->ch_layout.nb_channels * bits / 8;
+		int samples = pkt->size / block_align;
+
+		head_samples = FFMIN(head_samples, samples);
+		tail_samples = FFMIN(tail_samples, samples - head_samples);
+		pkt->data += head_samples * block_align;
+		pkt->size -= (head_samples + tail_samples) * block_align;
+		pkt->pts += av_rescale_q(head_samples, sample_tb, stream->time_base);
+		pkt->dts = pkt->pts;
+		pkt->duration = av_rescale_q(samples - head_samples - tail_samples, sample_tb, stream->time_base);
+	}
+	else {
+		uint8_t *skip = av_packet_new_side_data(pkt, AV_PKT_DATA_SKIP_SAMPLES, 10);
+		if (skip == NULL) {
+			return AVERROR(ENOMEM);
+		}
+		AV_WL32(skip, head_samples);
+		AV_WL32(skip + 4, tail_samples);
+	}
+
+	return 0;
+}
+
+/*
+ * Writes a packet of a mapped stream into an output, if it belongs to the output's range.
+ */
+static int write_packet(Export *ex, ExportOutput *out, int mapped, const AVPacket *packet)
+{
+	AVStream *stream = ex->streams[mapped];
+	int64_t start = av_rescale_q(out->start, AV_TIME_BASE_Q, stream->time_base);
+	int64_t end = av_rescale_q(out->end, AV_TIME_BASE_Q, stream->time_base);
+	int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+	int video = stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO;
+	AVPacket *pkt;
+	int ret;
+
+	if (out->stream_done[mapped] || ts == AV_NOPTS_VALUE) {
+		return 0;
+	}
+	if (ts >= end) {
+		// Reordered video frames can still be presented before the end
+		if (!video || packet->dts == AV_NOPTS_VALUE || packet->dts >= end) {
+			out->stream_done[mapped] = 1;
+		}
+		return 0;
+	}
+	if (!video && ts + packet->duration <= start) {
+		return 0;
+	}
+	if (video && !out->keyframe_seen[mapped]) {
+		if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+			return 0;
+		}
+		out->keyframe_seen[mapped] = 1;
+	}
+
+	if ((pkt = av_packet_clone(packet)) == NULL) {
+		return AVERROR(ENOMEM);
+	}
+	if (!video && pkt->pts != AV_NOPTS_VALUE && (ret = trim_audio_packet(pkt, stream, start, end)) < 0) {
+		av_packet_free(&pkt);
+		return ret;
+	}
+
+	if (pkt->pts != AV_NOPTS_VALUE) {
+		pkt->pts -= start;
+	}
+	if (pkt->dts != AV_NOPTS_VALUE) {
+		pkt->dts -= start;
+	}
+	pkt->stream_index = mapped;
+	pkt->pos = -1;
+	av_packet_rescale_ts(pkt, stream->time_base, out->oc->streams[mapped]->time_base);
+
+	ret = av_interleaved_write_frame(out->oc, pkt);
+	av_packet_free(&pkt);
+
+	return ret;
+}
+
+static int output_finished(Export *ex, ExportOutput *out)
+{
+	for (int i = 0; i < ex->stream_count; i++) {
+		if (!out->stream_done[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Starts an output and writes the buffered video packets that precede its start.
+ */
+static int activate_output(Export *ex, ExportOutput *out)
+{
+	int ret;
+
+	if ((ret = open_output(ex, out)) < 0) {
+		return ret;
+	}
+
+	for (int i = 0; i < ex->stream_count; i++) {
+		for (int j = 0; j < ex->gops[i].count; j++) {
+			if ((ret = write_packet(ex, out, i, ex->gops[i].packets[j])) < 0) {
+				return ret;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int run_export(Export *ex)
+{
+	AVPacket *pkt = av_packet_alloc();
+	int first_pending = 0, written = 0, ret = 0;
+
+	if (pkt == NULL) {
+		return AVERROR(ENOMEM);
+	}
+
+	while (first_pending < ex->output_count || written < ex->output_count) {
+		ExportOutput *next = first_pending < ex->output_count ? &ex->outputs[first_pending] : NULL;
+		int active = 0, mapped;
+		int64_t ts, ts_end;
+
+		for (int i = 0; i < ex->output_count; i++) {
+			active |= ex->outputs[i].state == EXPORT_ACTIVE;
+		}
+		if (!active && next == NULL) {
+			break;
+		}
+
+		if ((ret = av_read_frame(ex->ic, pkt)) < 0) {
+			ret = ret == AVERROR_EOF ? 0 : ret;
+			break;
+		}
+
+		mapped = ex->map[pkt->stream_index];
+		ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+		if (mapped < 0 || ts == AV_NOPTS_VALUE) {
+			av_packet_unref(pkt);
+			continue;
+		}
+		ts = av_rescale_q(ts, ex->streams[mapped]->time_base, AV_TIME_BASE_Q);
+		ts_end = ts + av_rescale_q(pkt->duration, ex->streams[mapped]->time_base, AV_TIME_BASE_Q);
+
+		// Skip a long gap to the next range
+		if (!active && next != NULL && !next->seeked && next->start - ts > (int64_t)EXPORT_SEEK_GAP * AV_TIME_BASE) {
+			next->seeked = 1;
+			av_packet_unref(pkt);
+			for (int i = 0; i < ex->stream_count; i++) {
+				gop_clear(&ex->gops[i]);
+			}
+			if ((ret = av_seek_frame(ex->ic, -1, next->start, AVSEEK_FLAG_BACKWARD)) < 0) {
+				break;
+			}
+			continue;
+		}
+
+		if (ex->streams[mapped]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && (ret = gop_add(&ex->gops[mapped], pkt)) < 0) {
+			break;
+		}
+
+		for (int i = 0; i < first_pending; i++) {
+			if (ex->outputs[i].state == EXPORT_ACTIVE && (ret = write_packet(ex, &ex->outputs[i], mapped, pkt)) < 0) {
+				goto end;
+			}
+		}
+
+		// Start all ranges that the packet reaches into. Video packets are written from the
+		// buffered GOP, which already contains the current packet.
+		while (next != NULL && (ts_end > next->start || ts >= next->start)) {
+			if ((ret = activate_output(ex, next)) < 0) {
+				goto end;
+			}
+			if (ex->streams[mapped]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO && (ret = write_packet(ex, next, mapped, pkt)) < 0) {
+				goto end;
+			}
+			first_pending++;
+			next = first_pending < ex->output_count ? &ex->outputs[first_pending] : NULL;
+		}
+
+		for (int i = 0; i < first_pending; i++) {
+			if (ex->outputs[i].state == EXPORT_ACTIVE && output_finished(ex, &ex->outputs[i])) {
+				if ((ret = close_output(&ex->outputs[i], 1)) < 0) {
+					goto end;
+				}
+				written++;
+			}
+		}
+
+		av_packet_unref(pkt);
+	}
+
+	// End of input, finish the active ranges
+	for (int i = 0; i < ex->output_count && ret >= 0; i++) {
+		if (ex->outputs[i].state == EXPORT_ACTIVE) {
+			if ((ret = close_output(&ex->outputs[i], 1)) == 0) {
+				written++;
+			}
+		}
+		else if (ex->outputs[i].state == EXPORT_PENDING) {
+			proxy_log(ex->pi, PI_LOG_WARNING, "export: range of %s is beyond the end of the input", ex->outputs[i].range->filename);
+		}
+	}
+
+end:
+	av_packet_free(&pkt);
+
+	return ret < 0 ? ret : written;
+}
+
+/*
+ * Exports time ranges of the streams decoded by a file mode instance (including selected tracks)
+ * into new files by copying the compressed packets, in a single pass over the input. The ranges
+ * are given in samples (TYPE_AUDIO) or frames (TYPE_VIDEO) like the seek positions, and may
+ * overlap. Returns the number of written files, or a negative number on error.
+ */
+int stream_export_ranges(ProxyInstance *pi, ExportRange *ranges, int count, int type)
+{
+	Export ex = { 0 };
+	AVStream *primary;
+	double rate;
+	int ret = -1;
+
+	if (pi->source_filename == NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "export requires an instance in file mode");
+		return -1;
+	}
+	if (pi->released && acquire_decoders(pi, 1) < 0) {
+		return -1;
+	}
+	if (type == TYPE_AUDIO && (pi->mode & TYPE_AUDIO)) {
+		primary = pi->audio_stream;
+		rate = pi->audio_output.format.sample_rate;
+	}
+	else if (type == TYPE_VIDEO && (pi->mode & TYPE_VIDEO)) {
+		primary = pi->video_stream;
+		rate = pi->video_output.format.frame_rate;
+	}
+	else {
+		proxy_log(pi, PI_LOG_ERROR, "export: unsupported stream type %d", type);
+		return -1;
+	}
+	if (count <= 0) {
+		return 0;
+	}
+
+	if ((ret = avformat_open_input(&ex.ic, pi->source_filename, NULL, NULL)) < 0) {
+		proxy_log(pi, PI_LOG_ERROR, "export: cannot open %s (%s)", pi->source_filename, av_err2str(ret));
+		return ret;
+	}
+	if ((ret = avformat_find_stream_info(ex.ic, NULL)) < 0) {
+		goto end;
+	}
+
+	ex.pi = pi;
+	ex.map = malloc(sizeof(int) * ex.ic->nb_streams);
+	ex.streams = malloc(sizeof(AVStream *) * ex.ic->nb_streams);
+	ex.gops = calloc(ex.ic->nb_streams, sizeof(ExportGop));
+	ex.outputs = calloc(count, sizeof(ExportOutput));
+	if (ex.map == NULL || ex.streams == NULL || ex.gops == NULL || ex.outputs == NULL) {
+		ret = AVERROR(ENOMEM);
+		goto end;
+	}
+
+	// The stream indices of the instance are valid in the new demuxer of the same file
+	for (unsigned int i = 0; i < ex.ic->nb_streams; i++) {
+		ex.map[i] = -1;
+	}
+	if (pi->mode & TYPE_VIDEO) {
+		add_stream(&ex, ex.ic->streams[pi->video_stream->index]);
+	}
+	if (pi->mode & TYPE_AUDIO) {
+		add_stream(&ex, ex.ic->streams[pi->audio_stream->index]);
+	}
+	for (int i = 0; pi->tracks != NULL && i < pi->tracks->count; i++) {
+		add_stream(&ex, ex.ic->streams[pi->tracks->tracks[i].stream->index]);
+	}
+
+	for (int i = 0; i < count; i++) {
+		ExportOutput *out = &ex.outputs[i];
+
+		out->range = &ranges[i];
+		out->start = av_rescale_q(samples_to_pts(rate, primary->time_base, ranges[i].start), primary->time_base, AV_TIME_BASE_Q);
+		out->end = av_rescale_q(samples_to_pts(rate, primary->time_base, ranges[i].end), primary->time_base, AV_TIME_BASE_Q);
+		out->stream_done = calloc(ex.stream_count, sizeof(int));
+		out->keyframe_seen = calloc(ex.stream_count, sizeof(int));
+		ex.output_count++;
+		if (out->stream_done == NULL || out->keyframe_seen == NULL) {
+			ret = AVERROR(ENOMEM);
+			goto end;
+		}
+		if (ranges[i].end <= ranges[i].start) {
+			proxy_log(pi, PI_LOG_ERROR, "export: empty range for %s", ranges[i].filename);
+			ret = -1;
+			goto end;
+		}
+	}
+	qsort(ex.outputs, ex.output_count, sizeof(ExportOutput), compare_outputs);
+
+	ret = run_export(&ex);
+	if (ret < 0 && ret != -1) {
+		proxy_log(pi, PI_LOG_ERROR, "export failed (%s)", av_err2str(ret));
+	}
+
+end:
+	for (int i = 0; i < ex.output_count; i++) {
+		close_output(&ex.outputs[i], 0);
+		free(ex.outputs[i].stream_done);
+		free(ex.outputs[i].keyframe_seen);
+	}
+	for (int i = 0; ex.gops != NULL && i < ex.stream_count; i++) {
+		gop_clear(&ex.gops[i]);
+		free(ex.gops[i].packets);
+	}
+	free(ex.outputs);
+	free(ex.gops);
+	free(ex.streams);
+	free(ex.map);
+	avformat_close_input(&ex.ic);
+
+	return ret;
+}
+
+/*
+ * Exports a single time range, see stream_export_ranges. Returns 0 on success, or a negative
+ * number on error.
+ */
+int stream_export_range(ProxyInstance *pi, int64_t start, int64_t end, int type, char *filename)
+{
+	ExportRange range = { start, end, filename };
+	int ret = stream_export_ranges(pi, &range, 1, type);
+
+	return ret == 1 ? 0 : ret < 0 ? ret : -1;
+}
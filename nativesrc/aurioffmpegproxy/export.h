@@ -0,0 +1,33 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#define EXPORT_SEEK_GAP 10 // seconds between ranges from which the input is skipped by seeking instead of reading
+#define EXPORT_GOP_CAPACITY 64 // initial capacity of the buffered video packets since the last keyframe
+
+/*
+ * A time range to export into a file by stream_export_ranges.
+ */
+typedef struct ExportRange {
+	int64_t				start; // in samples (audio) or frames (video) of the stream type passed to stream_export_ranges
+	int64_t				end; // exclusive
+	const char			*filename; // the container format is derived from the extension
+} ExportRange;
@@ -0,0 +1,168 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#include <string.h>
+
+#include "proxy.h"
+#include "fetch.h"
+
+static int compare_windows(const void *a, const void *b)
+{
+	const FetchWindow *wa = *(const FetchWindow **)a;
+	const FetchWindow *wb = *(const FetchWindow **)b;
+
+	return wa->position < wb->position ? -1 : wa->position > wb->position ? 1 : 0;
+}
+
+/*
+ * Reads many short windows of the audio stream at scattered positions in a single call, e.g.
+ * to verify fingerprint matches. The windows are processed in timeline order, regardless of
+ * their order in the array. A window that starts less than max_gap samples (a negative value
+ * selects FETCH_MAX_GAP) after the current decoding position is reached by decoding through
+ * the gap, otherwise the decoder is sought to the window start minus a pre-roll, snapped to
+ * the seek index if one has been created. Overlapping and adjacent windows are filled from
+ * the same decoded frames. The samples equal those of a sequential decoding pass.
+ *
+ * Returns the number of seeks that were necessary, or a negative number on error.
+ */
+int stream_read_windows(ProxyInstance *pi, FetchWindow *windows, int count, int64_t max_gap)
+{
+	FetchWindow **order;
+	uint8_t *done, *buffer;
+	int64_t timestamp, position, preroll, fill, seek_fill = AV_NOPTS_VALUE, target;
+	int block_size, buffer_size, samples, frame_type, attempts = 0, sought = 0, first = 0, seeks = 0, ret = 0;
+
+	if (!(pi->mode & TYPE_AUDIO)) {
+		proxy_log(pi, PI_LOG_ERROR, "window reading requires an audio stream");
+		return -1;
+	}
+	if (pi->mode & MODE_LIVE) {
+		proxy_log(pi, PI_LOG_ERROR, "window reading requires a seekable stream");
+		return -1;
+	}
+	if (pi->released && acquire_decoders(pi, 1) < 0) {
+		return -1;
+	}
+
+	if (max_gap < 0) {
+		max_gap = (int64_t)pi->audio_output.format.sample_rate * FETCH_MAX_GAP;
+	}
+	preroll = pi->audio_output.format.sample_rate / 5 + pi->audio_stream->codecpar->seek_preroll;
+
+	block_size = pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+	buffer_size = pi->audio_output.frame_size * block_size;
+	buffer = malloc(buffer_size);
+	order = malloc(sizeof(FetchWindow *) * count);
+	done = calloc(count, 1);
+	if (buffer == NULL || order == NULL || done == NULL) {
+		free(buffer);
+		free(order);
+		free(done);
+		return -1;
+	}
+
+	for (int i = 0; i < count; i++) {
+		order[i] = &windows[i];
+		windows[i].read = 0;
+	}
+	qsort(order, count, sizeof(FetchWindow *), compare_windows);
+
+	position = AV_NOPTS_VALUE; // the decoder position is unknown until the first seek
+	while (1) {
+		while (first < count && (done[first] || order[first]->read >= order[first]->length)) {
+			first++;
+		}
+		if (first == count) {
+			break;
+		}
+
+		// The next sample that is needed, all windows before have been completed
+		fill = order[first]->position + order[first]->read;
+
+		if (!sought && (position == AV_NOPTS_VALUE || fill < position || fill - position > max_gap)) {
+			/*
+			 * Seeks can end up behind the target (see stream_seek), in which case the
+			 * seek is repeated to an earlier position.
+			 */
+			if (fill == seek_fill) {
+				attempts++;
+			}
+			else {
+				seek_fill = fill;
+				attempts = 0;
+			}
+			if (attempts > FETCH_SEEK_RETRIES) {
+				proxy_log(pi, PI_LOG_WARNING, "window at %"PRId64" cannot be reached", order[first]->position);
+				done[first] = 1;
+				continue;
+			}
+
+			target = fill - preroll - attempts * (preroll + pi->audio_output.format.sample_rate);
+			if (pi->audio_seekindex != NULL) {
+				int64_t index_timestamp;
+				if (seekindex_find(pi->audio_seekindex, target, &index_timestamp) == 0) {
+					target = index_timestamp;
+				}
+			}
+			if (stream_seek(pi, FFMAX(target, 0), TYPE_AUDIO) < 0) {
+				ret = -1;
+				break;
+			}
+			seeks++;
+			sought = 1;
+		}
+
+		samples = stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type);
+		if (samples < 0) {
+			break; // end of stream, the remaining windows cannot be filled
+		}
+		if (frame_type != TYPE_AUDIO) {
+			continue;
+		}
+		position = timestamp + samples;
+		sought = 0;
+
+		// Copy the frame into all windows that continue within it
+		for (int i = first; i < count && order[i]->position < position; i++) {
+			FetchWindow *w = order[i];
+			int64_t from = w->position + w->read;
+			int64_t to = FFMIN(position, w->position + w->length);
+
+			if (done[i] || from < timestamp || from >= to) {
+				continue;
+			}
+
+			memcpy(w->buffer + (int64_t)w->read * block_size, buffer + (from - timestamp) * block_size, (to - from) * block_size);
+			w->read += (int)(to - from);
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (windows[i].read < windows[i].length) {
+			memset(windows[i].buffer + (int64_t)windows[i].read * block_size, 0, (int64_t)(windows[i].length - windows[i].read) * block_size);
+		}
+	}
+
+	free(buffer);
+	free(order);
+	free(done);
+
+	return ret < 0 ? ret : seeks;
+}
@@ -0,0 +1,34 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#define FETCH_MAX_GAP 1 // seconds between windows that are decoded through rather than sought over
+#define FETCH_SEEK_RETRIES 3
+
+/*
+ * A range of audio samples to read with stream_read_windows.
+ */
+typedef struct FetchWindow {
+	int64_t				position; // first sample of the window
+	int					length; // samples per channel
+	uint8_t				*buffer; // receives length samples in the output format
+	int					read; // samples that could be read, the rest of the buffer is zeroed
+} FetchWindow;
@@ -0,0 +1,133 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <string.h>
+
+#include "proxy.h"
+#include "timer.h"
+
+#include "libavutil/hash.h"
+#include "libavutil/intreadwrite.h"
+
+/*
+ * Computes a fingerprint of the compressed packets of the audio or video stream of a file mode
+ * instance, and returns 0 on success or a negative number on error.
+ *
+ * Only the packet payloads and sizes in decoding order enter the hash, so the fingerprint is
+ * independent of the container metadata, the timestamps and the position of the stream in the
+ * container, and identical for copies that were remuxed without changing the packetization.
+ * With an interval > 1, only every interval-th packet is hashed (the sampled packets are still
+ * selected by their sequence number, so the fingerprint remains stable across copies). The
+ * stream is read by a separate demuxer that discards all other streams, so the instance's
+ * decoding position is not affected and no packet is decoded.
+ */
+int stream_fingerprint(ProxyInstance *pi, int type, int interval, StreamFingerprint *fingerprint)
+{
+	AVFormatContext *ic = NULL;
+	struct AVHashContext *hash = NULL;
+	AVPacket *pkt = NULL;
+	AVStream *stream;
+	double rate;
+	int64_t duration = 0;
+	int index, ret;
+	int64_t start = timer_now_ns();
+
+	if (pi->source_filename == NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "fingerprint requires an instance in file mode");
+		return -1;
+	}
+	if (pi->released && acquire_decoders(pi, 1) < 0) {
+		return -1;
+	}
+	if (type == TYPE_AUDIO && (pi->mode & TYPE_AUDIO)) {
+		index = pi->audio_stream->index;
+		rate = pi->audio_output.format.sample_rate;
+	}
+	else if (type == TYPE_VIDEO && (pi->mode & TYPE_VIDEO)) {
+		index = pi->video_stream->index;
+		rate = pi->video_output.format.frame_rate;
+	}
+	else {
+		proxy_log(pi, PI_LOG_ERROR, "fingerprint: unsupported stream type %d", type);
+		return -1;
+	}
+	if (interval < 1) {
+		interval = 1;
+	}
+
+	memset(fingerprint, 0, sizeof(StreamFingerprint));
+
+	if ((ret = avformat_open_input(&ic, pi->source_filename, NULL, NULL)) < 0) {
+		proxy_log(pi, PI_LOG_ERROR, "fingerprint: cannot open %s (%s)", pi->source_filename, av_err2str(ret));
+		return ret;
+	}
+	if ((ret = avformat_find_stream_info(ic, NULL)) < 0) {
+		goto end;
+	}
+
+	// The stream indices of the instance are valid in the new demuxer of the same file
+	for (unsigned int i = 0; i < ic->nb_streams; i++) {
+		ic->streams[i]->discard = (int)i == index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+	}
+	stream = ic->streams[index];
+
+	if ((ret = av_hash_alloc(&hash, FINGERPRINT_HASH)) < 0) {
+		goto end;
+	}
+	if ((pkt = av_packet_alloc()) == NULL) {
+		ret = AVERROR(ENOMEM);
+		goto end;
+	}
+	av_hash_init(hash);
+
+	while ((ret = av_read_frame(ic, pkt)) >= 0) {
+		if (pkt->stream_index == index) {
+			if (fingerprint->packets % interval == 0) {
+				uint8_t size[4];
+
+				// The size separates the payloads, so that differently split data hashes differently
+				AV_WL32(size, pkt->size);
+				av_hash_update(hash, size, sizeof(size));
+				av_hash_update(hash, pkt->data, pkt->size);
+				fingerprint->hashed_packets++;
+			}
+			fingerprint->packets++;
+			duration += pkt->duration;
+		}
+		av_packet_unref(pkt);
+	}
+	if (ret != AVERROR_EOF) {
+		proxy_log(pi, PI_LOG_ERROR, "fingerprint: cannot read %s (%s)", pi->source_filename, av_err2str(ret));
+		goto end;
+	}
+
+	av_hash_final_bin(hash, fingerprint->digest, FINGERPRINT_SIZE);
+	fingerprint->duration = pts_to_samples(rate, stream->time_base, duration);
+	ret = 0;
+
+	proxy_log(pi, PI_LOG_DEBUG, "fingerprint: %"PRId64"/%"PRId64" packets hashed in %.1f ms",
+		fingerprint->hashed_packets, fingerprint->packets, (timer_now_ns() - start) / 1e6);
+
+end:
+	av_packet_free(&pkt);
+	av_hash_freep(&hash);
+	avformat_close_input(&ic);
+
+	return ret;
+}
@@ -0,0 +1,34 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#define FINGERPRINT_HASH "murmur3" // fast non-cryptographic 128 bit hash of libavutil
+#define FINGERPRINT_SIZE 16 // bytes
+
+/*
+ * Content fingerprint of a compressed stream, see stream_fingerprint.
+ */
+typedef struct StreamFingerprint {
+	uint8_t				digest[FINGERPRINT_SIZE];
+	int64_t				packets; // all packets of the stream
+	int64_t				hashed_packets;
+	int64_t				duration; // sum of the packet durations, in samples (audio) or frames (video)
+} StreamFingerprint;
@@ -0,0 +1,213 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#include <string.h>
+
+#include "framecache.h"
+
+#define INITIAL_CAPACITY 256
+
+FrameCache *framecache_create(int64_t budget) {
+	FrameCache *fc;
+
+	fc = malloc(sizeof(FrameCache));
+	if (fc == NULL) {
+		return NULL;
+	}
+
+	fc->entries = malloc(sizeof(FrameCacheEntry *) * INITIAL_CAPACITY);
+	if (fc->entries == NULL) {
+		free(fc);
+		return NULL;
+	}
+
+	fc->count = 0;
+	fc->capacity = INITIAL_CAPACITY;
+	fc->newest = NULL;
+	fc->oldest = NULL;
+	fc->size = 0;
+	fc->budget = budget;
+
+	return fc;
+}
+
+/*
+ * Returns the index of the first entry with a timestamp >= the given timestamp.
+ */
+static int lower_bound(FrameCache *fc, int64_t timestamp) {
+	int lo = 0, hi = fc->count;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (fc->entries[mid]->timestamp < timestamp) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static void lru_unlink(FrameCache *fc, FrameCacheEntry *entry) {
+	if (entry->newer != NULL) {
+		entry->newer->older = entry->older;
+	}
+	else {
+		fc->newest = entry->older;
+	}
+	if (entry->older != NULL) {
+		entry->older->newer = entry->newer;
+	}
+	else {
+		fc->oldest = entry->newer;
+	}
+}
+
+static void lru_push(FrameCache *fc, FrameCacheEntry *entry) {
+	entry->newer = NULL;
+	entry->older = fc->newest;
+	if (fc->newest != NULL) {
+		fc->newest->newer = entry;
+	}
+	fc->newest = entry;
+	if (fc->oldest == NULL) {
+		fc->oldest = entry;
+	}
+}
+
+static FrameCacheEntry *touch(FrameCache *fc, FrameCacheEntry *entry) {
+	lru_unlink(fc, entry);
+	lru_push(fc, entry);
+	return entry;
+}
+
+static void remove_entry(FrameCache *fc, FrameCacheEntry *entry) {
+	int i = lower_bound(fc, entry->timestamp);
+
+	memmove(&fc->entries[i], &fc->entries[i + 1], sizeof(FrameCacheEntry *) * (fc->count - i - 1));
+	fc->count--;
+	lru_unlink(fc, entry);
+	fc->size -= entry->size;
+	free(entry);
+}
+
+/*
+ * Returns the frame that starts at the given timestamp, or NULL if it is not cached.
+ */
+FrameCacheEntry *framecache_get(FrameCache *fc, int64_t timestamp) {
+	int i = lower_bound(fc, timestamp);
+
+	if (i < fc->count && fc->entries[i]->timestamp == timestamp) {
+		return touch(fc, fc->entries[i]);
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns the frame that contains the given timestamp, or NULL if it is not cached.
+ */
+FrameCacheEntry *framecache_find(FrameCache *fc, int64_t timestamp) {
+	int i = lower_bound(fc, timestamp);
+
+	if (i < fc->count && fc->entries[i]->timestamp == timestamp) {
+		return touch(fc, fc->entries[i]);
+	}
+	if (i > 0 && fc->entries[i - 1]->timestamp + fc->entries[i - 1]->length > timestamp) {
+		return touch(fc, fc->entries[i - 1]);
+	}
+
+	return NULL;
+}
+
+/*
+ * Copies a frame into the cache, evicting the least recently used frames if the budget
+ * is exceeded. A frame that is already cached is only marked as used. Returns 0 on
+ * success, or a negative number if the frame is not cached.
+ */
+int framecache_put(FrameCache *fc, int64_t timestamp, int length, const uint8_t *data, int size, const int *info) {
+	FrameCacheEntry *entry;
+	int i;
+
+	if (framecache_get(fc, timestamp) != NULL) {
+		return 0;
+	}
+
+	if (size > fc->budget) {
+		return -1;
+	}
+
+	while (fc->size + size > fc->budget) {
+		remove_entry(fc, fc->oldest);
+	}
+
+	if (fc->count == fc->capacity) {
+		FrameCacheEntry **entries = realloc(fc->entries, sizeof(FrameCacheEntry *) * fc->capacity * 2);
+		if (entries == NULL) {
+			return -1;
+		}
+		fc->entries = entries;
+		fc->capacity *= 2;
+	}
+
+	// The frame data is stored in the same allocation after the entry
+	entry = malloc(sizeof(FrameCacheEntry) + size);
+	if (entry == NULL) {
+		return -1;
+	}
+	entry->timestamp = timestamp;
+	entry->length = length;
+	entry->size = size;
+	entry->data = (uint8_t *)(entry + 1);
+	memcpy(entry->data, data, size);
+	if (info != NULL) {
+		memcpy(entry->info, info, sizeof(entry->info));
+	}
+	else {
+		memset(entry->info, 0, sizeof(entry->info));
+	}
+
+	i = lower_bound(fc, timestamp);
+	memmove(&fc->entries[i + 1], &fc->entries[i], sizeof(FrameCacheEntry *) * (fc->count - i));
+	fc->entries[i] = entry;
+	fc->count++;
+	fc->size += size;
+	lru_push(fc, entry);
+
+	return 0;
+}
+
+void framecache_clear(FrameCache *fc) {
+	for (int i = 0; i < fc->count; i++) {
+		free(fc->entries[i]);
+	}
+	fc->count = 0;
+	fc->newest = NULL;
+	fc->oldest = NULL;
+	fc->size = 0;
+}
+
+void framecache_free(FrameCache *fc) {
+	framecache_clear(fc);
+	free(fc->entries);
+	free(fc);
+}
@@ -0,0 +1,55 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#define FRAMECACHE_INFO_SIZE 4
+
+typedef struct FrameCacheEntry {
+	int64_t					timestamp;
+	int						length; // samples per channel for audio, 1 for video
+	int						size; // bytes
+	uint8_t					*data;
+	int						info[FRAMECACHE_INFO_SIZE]; // additional frame properties (e.g. video frame type)
+	struct FrameCacheEntry	*newer; // LRU list links
+	struct FrameCacheEntry	*older;
+} FrameCacheEntry;
+
+/*
+ * A cache of converted output frames, bounded by a byte budget and evicting the least
+ * recently used frames first. Frames are kept sorted by timestamp, so the frame that
+ * contains a timestamp can be looked up.
+ */
+typedef struct FrameCache {
+	FrameCacheEntry		**entries; // sorted by timestamp
+	int					count;
+	int					capacity;
+	FrameCacheEntry		*newest;
+	FrameCacheEntry		*oldest;
+	int64_t				size; // bytes of cached frame data
+	int64_t				budget;
+} FrameCache;
+
+FrameCache *framecache_create(int64_t budget);
+FrameCacheEntry *framecache_get(FrameCache *fc, int64_t timestamp);
+FrameCacheEntry *framecache_find(FrameCache *fc, int64_t timestamp);
+int framecache_put(FrameCache *fc, int64_t timestamp, int length, const uint8_t *data, int size, const int *info);
+void framecache_clear(FrameCache *fc);
+void framecache_free(FrameCache *fc);
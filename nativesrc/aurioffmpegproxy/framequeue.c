@@ -0,0 +1,268 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#include <string.h>
+
+#include "framequeue.h"
+#include "timer.h"
+
+/*
+ * Creates a queue that holds at most the given number of frames. Producers
+ * block in framequeue_put() while the queue is full, consumers block in
+ * framequeue_get() while it is empty.
+ */
+FrameQueue *framequeue_create(int capacity) {
+	FrameQueue *fq;
+
+	fq = malloc(sizeof(FrameQueue));
+	if (fq == NULL) {
+		return NULL;
+	}
+
+	fq->items = malloc(sizeof(FrameQueueItem) * capacity);
+	if (fq->items == NULL) {
+		free(fq);
+		return NULL;
+	}
+
+	fq->capacity = capacity;
+	fq->head = 0;
+	fq->count = 0;
+	fq->closed = 0;
+	fq->aborted = 0;
+	mutex_init(&fq->mutex);
+	cond_init(&fq->cond);
+
+	return fq;
+}
+
+/*
+ * Copies a frame into the queue, blocking while the queue is full. Returns 0 on
+ * success, or a negative number if the consumer aborted the queue or the
+ * frame could not be copied.
+ */
+int framequeue_put(FrameQueue *fq, int type, int64_t timestamp, int length, const uint8_t *data, int size) {
+	FrameQueueItem *item;
+	uint8_t *copy;
+
+	// Copy outside the lock to keep the critical section short
+	copy = malloc(size);
+	if (copy == NULL) {
+		return -1;
+	}
+	memcpy(copy, data, size);
+
+	mutex_lock(&fq->mutex);
+
+	while (fq->count == fq->capacity && !fq->aborted) {
+		cond_wait(&fq->cond, &fq->mutex);
+	}
+
+	if (fq->aborted) {
+		mutex_unlock(&fq->mutex);
+		free(copy);
+		return -2;
+	}
+
+	item = &fq->items[(fq->head + fq->count) % fq->capacity];
+	item->type = type;
+	item->timestamp = timestamp;
+	item->length = length;
+	item->size = size;
+	item->data = copy;
+	fq->count++;
+
+	cond_broadcast(&fq->cond);
+	mutex_unlock(&fq->mutex);
+
+	return 0;
+}
+
+/*
+ * Takes the oldest frame from the queue, blocking while the queue is empty.
+ * Returns 1 if a frame was taken, or 0 if the queue is closed (or aborted)
+ * and no more frames will arrive. The item's data must be released with
+ * framequeue_item_release().
+ */
+int framequeue_get(FrameQueue *fq, FrameQueueItem *item) {
+	mutex_lock(&fq->mutex);
+
+	while (fq->count == 0 && !fq->closed && !fq->aborted) {
+		cond_wait(&fq->cond, &fq->mutex);
+	}
+
+	if (fq->count == 0 || fq->aborted) {
+		mutex_unlock(&fq->mutex);
+		return 0;
+	}
+
+	*item = fq->items[fq->head];
+	fq->head = (fq->head + 1) % fq->capacity;
+	fq->count--;
+
+	cond_broadcast(&fq->cond);
+	mutex_unlock(&fq->mutex);
+
+	return 1;
+}
+
+/*
+ * Like framequeue_get(), but waits at most the given time for a frame. Returns 1 if
+ * a frame was taken, 0 if the queue is closed and empty or aborted, or -1 if no frame
+ * arrived in time.
+ */
+int framequeue_get_timeout(FrameQueue *fq, FrameQueueItem *item, int timeout_ms) {
+	int64_t deadline = timer_now_ns() + (int64_t)timeout_ms * 1000000;
+
+	mutex_lock(&fq->mutex);
+
+	while (fq->count == 0 && !fq->closed && !fq->aborted) {
+		int remaining_ms = (int)((deadline - timer_now_ns() + 999999) / 1000000);
+		if (remaining_ms <= 0 || cond_timedwait(&fq->cond, &fq->mutex, remaining_ms)) {
+			if (fq->count == 0 && !fq->closed && !fq->aborted) {
+				mutex_unlock(&fq->mutex);
+				return -1;
+			}
+		}
+	}
+
+	if (fq->count == 0 || fq->aborted) {
+		mutex_unlock(&fq->mutex);
+		return 0;
+	}
+
+	*item = fq->items[fq->head];
+	fq->head = (fq->head + 1) % fq->capacity;
+	fq->count--;
+
+	cond_broadcast(&fq->cond);
+	mutex_unlock(&fq->mutex);
+
+	return 1;
+}
+
+/*
+ * Copies a frame into the queue without blocking, growing the queue if it is full.
+ * This is for queues that are filled and drained by the same thread, where blocking
+ * would deadlock. Returns 0 on success, or a negative number on error.
+ */
+int framequeue_put_nowait(FrameQueue *fq, int type, int64_t timestamp, int length, const uint8_t *data, int size) {
+	int ret = 0;
+
+	mutex_lock(&fq->mutex);
+	if (fq->count == fq->capacity) {
+		FrameQueueItem *items = malloc(sizeof(FrameQueueItem) * fq->capacity * 2);
+		if (items == NULL) {
+			ret = -1;
+		}
+		else {
+			// Unwrap the ring into the new array
+			for (int i = 0; i < fq->count; i++) {
+				items[i] = fq->items[(fq->head + i) % fq->capacity];
+			}
+			free(fq->items);
+			fq->items = items;
+			fq->head = 0;
+			fq->capacity *= 2;
+		}
+	}
+	mutex_unlock(&fq->mutex);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	return framequeue_put(fq, type, timestamp, length, data, size);
+}
+
+/*
+ * Takes the oldest frame from the queue if there is one, without blocking.
+ * Returns 1 if a frame was taken, or 0 if the queue is empty.
+ */
+int framequeue_try_get(FrameQueue *fq, FrameQueueItem *item) {
+	int ret = 0;
+
+	mutex_lock(&fq->mutex);
+
+	if (fq->count > 0 && !fq->aborted) {
+		*item = fq->items[fq->head];
+		fq->head = (fq->head + 1) % fq->capacity;
+		fq->count--;
+		cond_broadcast(&fq->cond);
+		ret = 1;
+	}
+
+	mutex_unlock(&fq->mutex);
+
+	return ret;
+}
+
+void framequeue_item_release(FrameQueueItem *item) {
+	free(item->data);
+	item->data = NULL;
+}
+
+/*
+ * Signals that the producer will not add any more frames. Frames that are still
+ * queued can be taken until the queue is empty.
+ */
+void framequeue_close(FrameQueue *fq) {
+	mutex_lock(&fq->mutex);
+	fq->closed = 1;
+	cond_broadcast(&fq->cond);
+	mutex_unlock(&fq->mutex);
+}
+
+/*
+ * Signals that the consumer is not interested in any more frames, which unblocks
+ * a producer waiting for free space.
+ */
+void framequeue_abort(FrameQueue *fq) {
+	mutex_lock(&fq->mutex);
+	fq->aborted = 1;
+	cond_broadcast(&fq->cond);
+	mutex_unlock(&fq->mutex);
+}
+
+/*
+ * Drops all queued frames.
+ */
+void framequeue_clear(FrameQueue *fq) {
+	mutex_lock(&fq->mutex);
+	while (fq->count > 0) {
+		framequeue_item_release(&fq->items[fq->head]);
+		fq->head = (fq->head + 1) % fq->capacity;
+		fq->count--;
+	}
+	cond_broadcast(&fq->cond);
+	mutex_unlock(&fq->mutex);
+}
+
+/*
+ * Frees the queue and all frames that are still queued.
+ */
+void framequeue_free(FrameQueue *fq) {
+	framequeue_clear(fq);
+
+	cond_destroy(&fq->cond);
+	mutex_destroy(&fq->mutex);
+	free(fq->items);
+	free(fq);
+}
@@ -0,0 +1,58 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include "thread.h"
+
+typedef struct FrameQueueItem {
+	int					type; // TYPE_AUDIO or TYPE_VIDEO
+	int64_t				timestamp;
+	int					length; // samples per channel for audio, 1 for video
+	int					size; // bytes
+	uint8_t				*data;
+} FrameQueueItem;
+
+/*
+ * A bounded blocking FIFO of converted output frames, used to hand frames from a
+ * decoding thread to a consuming thread.
+ */
+typedef struct FrameQueue {
+	FrameQueueItem		*items;
+	int					capacity;
+	int					head; // index of the oldest item
+	int					count;
+	int					closed; // set by the producer when no more items will be added
+	int					aborted; // set by the consumer when it is not interested in more items
+	Mutex				mutex;
+	Cond				cond;
+} FrameQueue;
+
+FrameQueue *framequeue_create(int capacity);
+int framequeue_put(FrameQueue *fq, int type, int64_t timestamp, int length, const uint8_t *data, int size);
+int framequeue_put_nowait(FrameQueue *fq, int type, int64_t timestamp, int length, const uint8_t *data, int size);
+int framequeue_get(FrameQueue *fq, FrameQueueItem *item);
+int framequeue_get_timeout(FrameQueue *fq, FrameQueueItem *item, int timeout_ms);
+int framequeue_try_get(FrameQueue *fq, FrameQueueItem *item);
+void framequeue_item_release(FrameQueueItem *item);
+void framequeue_close(FrameQueue *fq);
+void framequeue_abort(FrameQueue *fq);
+void framequeue_clear(FrameQueue *fq);
+void framequeue_free(FrameQueue *fq);
@@ -0,0 +1,199 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "ipc.h"
+
+static int send_all(int fd, struct msghdr *msg)
+{
+	while (msg->msg_iovlen > 0) {
+		ssize_t sent = sendmsg(fd, msg, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		// The descriptor is passed with the first chunk
+		msg->msg_control = NULL;
+		msg->msg_controllen = 0;
+
+		while (msg->msg_iovlen > 0 && (size_t)sent >= msg->msg_iov->iov_len) {
+			sent -= msg->msg_iov->iov_len;
+			msg->msg_iov++;
+			msg->msg_iovlen--;
+		}
+		if (msg->msg_iovlen > 0) {
+			msg->msg_iov->iov_base = (uint8_t *)msg->msg_iov->iov_base + sent;
+			msg->msg_iov->iov_len -= sent;
+		}
+	}
+
+	return 0;
+}
+
+static int recv_all(int fd, void *buffer, int size, int *passed_fd)
+{
+	uint8_t *data = buffer;
+	union {
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(int))];
+	} control;
+
+	while (size > 0) {
+		struct iovec iov = { data, size };
+		struct msghdr msg = { 0 };
+		ssize_t received;
+
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		if (passed_fd != NULL) {
+			msg.msg_control = control.buffer;
+			msg.msg_controllen = sizeof(control.buffer);
+		}
+
+		received = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+		if (received < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (received == 0) {
+			return -1; // the other process closed the connection
+		}
+
+		if (passed_fd != NULL) {
+			struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+			if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+				memcpy(passed_fd, CMSG_DATA(cmsg), sizeof(int));
+			}
+		}
+
+		data += received;
+		size -= (int)received;
+	}
+
+	return 0;
+}
+
+/*
+ * Sends a message consisting of a fixed-size header and an optional payload, and passes
+ * a file descriptor along if pass_fd is >= 0. Returns 0 on success, or -1 on error.
+ */
+int ipc_send(int fd, const void *header, int header_size, const void *payload, int payload_size, int pass_fd)
+{
+	struct iovec iov[2];
+	struct msghdr msg = { 0 };
+	union {
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(int))];
+	} control;
+
+	iov[0].iov_base = (void *)header;
+	iov[0].iov_len = header_size;
+	iov[1].iov_base = (void *)payload;
+	iov[1].iov_len = payload_size;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = payload_size > 0 ? 2 : 1;
+
+	if (pass_fd >= 0) {
+		struct cmsghdr *cmsg;
+
+		memset(&control, 0, sizeof(control));
+		msg.msg_control = control.buffer;
+		msg.msg_controllen = sizeof(control.buffer);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+	}
+
+	return send_all(fd, &msg);
+}
+
+/*
+ * Receives a message sent with ipc_send. The header size must match, payloads larger than
+ * max_payload are rejected. payload_size must point to the payload size field of the header.
+ * A passed file descriptor is stored in passed_fd, which is left untouched otherwise.
+ * Returns 0 on success, or -1 on error or when the connection is closed.
+ */
+int ipc_recv(int fd, void *header, int header_size, void *payload, int max_payload, int *payload_size, int *passed_fd)
+{
+	if (recv_all(fd, header, header_size, passed_fd) < 0) {
+		return -1;
+	}
+	if (*payload_size < 0 || *payload_size > max_payload) {
+		return -1;
+	}
+
+	return recv_all(fd, payload, *payload_size, NULL);
+}
+
+/*
+ * Locks the ring. Returns 0 on success, or -1 if the other process died while holding
+ * the lock, in which case the ring must not be used anymore and the lock is not held.
+ */
+int ipc_lock(IpcRing *ring)
+{
+	int ret = pthread_mutex_lock(&ring->mutex);
+
+	if (ret == EOWNERDEAD) {
+		pthread_mutex_consistent(&ring->mutex);
+		ring->closed = 1;
+		pthread_mutex_unlock(&ring->mutex);
+		return -1;
+	}
+
+	return ret == 0 ? 0 : -1;
+}
+
+/*
+ * Waits on a condition of the locked ring for at most IPC_WAIT_MS, to give the caller
+ * the opportunity to check whether the other process is still alive. Returns 0 when
+ * signalled, 1 on timeout, or -1 as ipc_lock.
+ */
+int ipc_wait(IpcRing *ring, pthread_cond_t *cond)
+{
+	struct timespec deadline;
+	int ret;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += IPC_WAIT_MS * 1000000L;
+	deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+	deadline.tv_nsec %= 1000000000L;
+
+	ret = pthread_cond_timedwait(cond, &ring->mutex, &deadline);
+
+	if (ret == EOWNERDEAD) {
+		pthread_mutex_consistent(&ring->mutex);
+		ring->closed = 1;
+		pthread_mutex_unlock(&ring->mutex);
+		return -1;
+	}
+
+	return ret == ETIMEDOUT ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Protocol between the decode server (aurioffmpegproxy --server) and its clients (remote.h).
+ *
+ * Clients send small control messages over a Unix domain socket, each answered by a response.
+ * Decoded frames are not sent over the socket. Every opened instance has a ring buffer in shared
+ * memory, whose file descriptor is passed to the client with the response to IPC_OPEN. The
+ * server decodes ahead into the ring and the client copies the frames out of it, synchronized by
+ * a process-shared mutex and condition variables in the ring header.
+ */
+
+#define IPC_PROTOCOL_VERSION 1
+#define IPC_MAX_PAYLOAD 4096 // bytes, e.g. the filename of IPC_OPEN
+#define IPC_RING_FRAMES 8 // frames of the maximum size that fit into a ring
+#define IPC_RECORD_ALIGN 64 // bytes, records never wrap around the end of the ring
+#define IPC_WAIT_MS 100 // interval to check whether the other process is still alive while waiting
+
+enum IpcCommand {
+	IPC_OPEN = 1, // payload: filename, response: output configs and the ring (SCM_RIGHTS)
+	IPC_SEEK,
+	IPC_SEEKINDEX_CREATE,
+	IPC_CLOSE,
+};
+
+enum IpcRecordKind {
+	IPC_RECORD_FRAME = 1,
+	IPC_RECORD_PAD, // skip to the start of the ring
+	IPC_RECORD_END, // end of the stream or error, no more records until the next seek
+};
+
+typedef struct IpcRequest {
+	int32_t				version;
+	int32_t				command;
+	int32_t				instance;
+	int32_t				mode;
+	int32_t				type;
+	int32_t				payload_size;
+	int64_t				timestamp;
+} IpcRequest;
+
+/*
+ * Output configurations with the layout of ProxyInstance.audio_output and video_output.
+ */
+typedef struct IpcAudioOutput {
+	struct {
+		int32_t				sample_rate;
+		int32_t				sample_size;
+		int32_t				channels;
+	}					format;
+	int64_t				length;
+	int32_t				frame_size;
+	int64_t				sample_position;
+} IpcAudioOutput;
+
+typedef struct IpcVideoOutput {
+	struct {
+		int32_t				width;
+		int32_t				height;
+		double				frame_rate;
+		double				aspect_ratio;
+	}					format;
+	int64_t				length;
+	int32_t				frame_size;
+	struct {
+		int32_t				keyframe;
+		int32_t				pict_type;
+		int32_t				interlaced;
+		int32_t				top_field_first;
+	}					current_frame;
+	int64_t				sample_position;
+} IpcVideoOutput;
+
+typedef struct IpcResponse {
+	int32_t				status; // 0 or a negative number on error
+	int32_t				instance;
+	int32_t				payload_size; // e.g. the error message
+	int32_t				reserved;
+	int64_t				ring_size; // bytes of the shared memory of an opened instance
+	IpcAudioOutput		audio_output;
+	IpcVideoOutput		video_output;
+} IpcResponse;
+
+/*
+ * Header of a frame in the ring, followed by the frame data. A record starts and ends at
+ * a multiple of IPC_RECORD_ALIGN.
+ */
+typedef struct IpcRecord {
+	int32_t				kind;
+	int32_t				frame_type;
+	int32_t				length; // samples per channel for audio, 1 for video
+	int32_t				size; // bytes of frame data
+	int64_t				timestamp;
+	int64_t				sample_position; // output position of the frame type after the frame
+	int32_t				props[4]; // video frame properties, see IpcVideoOutput.current_frame
+	uint8_t				padding[IPC_RECORD_ALIGN - 48];
+} IpcRecord;
+
+/*
+ * Header of the shared memory of an instance, followed by the ring data. The positions are
+ * byte counters that only grow, a position's offset in the ring is position % capacity.
+ */
+typedef struct IpcRing {
+	pthread_mutex_t		mutex; // robust, to detect a process that died while holding it
+	pthread_cond_t		not_empty;
+	pthread_cond_t		not_full;
+	int64_t				capacity;
+	int64_t				write_pos;
+	int64_t				read_pos;
+	int32_t				closed; // the client is gone or the instance is being closed
+} IpcRing;
+
+static inline int64_t ipc_align(int64_t size)
+{
+	return (size + IPC_RECORD_ALIGN - 1) / IPC_RECORD_ALIGN * IPC_RECORD_ALIGN;
+}
+
+static inline int64_t ipc_ring_header_size(void)
+{
+	// The data starts at the next record boundary after the header
+	return ipc_align(sizeof(IpcRing));
+}
+
+static inline uint8_t *ipc_ring_data(IpcRing *ring)
+{
+	return (uint8_t *)ring + ipc_ring_header_size();
+}
+
+int ipc_send(int fd, const void *header, int header_size, const void *payload, int payload_size, int pass_fd);
+int ipc_recv(int fd, void *header, int header_size, void *payload, int max_payload, int *payload_size, int *passed_fd);
+int ipc_lock(IpcRing *ring);
+int ipc_wait(IpcRing *ring, pthread_cond_t *cond);
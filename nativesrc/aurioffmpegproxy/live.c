@@ -0,0 +1,197 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#include <string.h>
+
+#include "proxy.h"
+#include "live.h"
+#include "timer.h"
+
+/*
+ * Interrupt callback of live inputs, which aborts blocking demuxer reads when the
+ * instance is being closed.
+ */
+int live_interrupt(void *opaque)
+{
+	ProxyInstance *pi = opaque;
+
+	return pi->live != NULL && atomic_int_load(&pi->live->abort);
+}
+
+static void *live_worker(void *arg)
+{
+	LiveReader *live = arg;
+	ProxyInstance *pi = live->pi;
+	int64_t timestamp, latency;
+	int samples, frame_type;
+
+	while (!atomic_int_load(&live->abort)) {
+		samples = stream_read_frame(pi, &timestamp, live->buffer, live->buffer_size, &frame_type);
+		if (samples < 0) {
+			break;
+		}
+
+		// Time from the arrival of the most recent input data until the frame is ready
+		latency = timer_now_ns() - atomic_int64_load(&pi->input_ns);
+		pi->stats.live_frames++;
+		pi->stats.live_latency_ns += latency;
+		pi->stats.live_latency_max_ns = FFMAX(pi->stats.live_latency_max_ns, latency);
+
+		// The instance stats are only touched by this thread now, other threads read the copy
+		mutex_lock(&live->stats_mutex);
+		if (live->reset_stats) {
+			memset(&pi->stats, 0, sizeof(ProxyStats));
+			live->reset_stats = 0;
+		}
+		*live->stats = pi->stats;
+		mutex_unlock(&live->stats_mutex);
+
+		if (framequeue_put(live->queue, frame_type, timestamp, samples, live->buffer,
+			frame_type == TYPE_AUDIO
+				? samples * pi->audio_output.format.channels * pi->audio_output.format.sample_size
+				: pi->video_output.frame_size) < 0) {
+			break;
+		}
+	}
+
+	framequeue_close(live->queue);
+
+	return NULL;
+}
+
+static LiveReader *live_start(ProxyInstance *pi)
+{
+	LiveReader *live;
+
+	live = calloc(1, sizeof(LiveReader));
+	if (live == NULL) {
+		return NULL;
+	}
+
+	live->pi = pi;
+	live->buffer_size = FFMAX(
+		pi->mode & TYPE_AUDIO ? pi->audio_output.frame_size * pi->audio_output.format.channels * pi->audio_output.format.sample_size : 0,
+		pi->mode & TYPE_VIDEO ? pi->video_output.frame_size : 0);
+	live->buffer = malloc(live->buffer_size);
+	live->queue = framequeue_create(LIVE_QUEUE_CAPACITY);
+	live->stats = malloc(sizeof(ProxyStats));
+	mutex_init(&live->stats_mutex);
+
+	if (live->stats != NULL) {
+		*live->stats = pi->stats;
+	}
+
+	if (live->buffer == NULL || live->queue == NULL || live->stats == NULL || thread_create(&live->thread, live_worker, live) < 0) {
+		if (live->queue != NULL) {
+			framequeue_free(live->queue);
+		}
+		mutex_destroy(&live->stats_mutex);
+		free(live->stats);
+		free(live->buffer);
+		free(live);
+		return NULL;
+	}
+
+	return live;
+}
+
+/*
+ * Stops the background decoding. A source that blocks in its read callback must return
+ * for this to complete.
+ */
+void live_stop(LiveReader *live)
+{
+	atomic_int_store(&live->abort, 1);
+	framequeue_abort(live->queue); // unblocks the worker if the queue is full
+	thread_join(live->thread);
+
+	// The instance stats are owned by the calling thread again
+	if (live->reset_stats) {
+		memset(&live->pi->stats, 0, sizeof(ProxyStats));
+	}
+
+	framequeue_free(live->queue);
+	mutex_destroy(&live->stats_mutex);
+	free(live->stats);
+	free(live->buffer);
+	free(live);
+}
+
+/*
+ * Copies the instance stats as of the most recent frame of the worker.
+ */
+void live_get_stats(LiveReader *live, ProxyStats *stats)
+{
+	mutex_lock(&live->stats_mutex);
+	*stats = *live->stats;
+	mutex_unlock(&live->stats_mutex);
+}
+
+/*
+ * Resets the instance stats, which the worker does before it counts the next frame.
+ */
+void live_reset_stats(LiveReader *live)
+{
+	mutex_lock(&live->stats_mutex);
+	memset(live->stats, 0, sizeof(ProxyStats));
+	live->reset_stats = 1;
+	mutex_unlock(&live->stats_mutex);
+}
+
+/*
+ * Returns the next decoded frame of a live instance, waiting at most the given time for it.
+ * Decoding runs on a background thread from the first call on, so that frames become available
+ * as soon as the source delivers their data. Once this function has been called, stream_read_frame
+ * must not be used anymore on the instance.
+ *
+ * Returns the number of samples (audio) or 1 (video) like stream_read_frame, 0 if no frame was
+ * decoded within the timeout, or a negative number at the end of the stream or on error.
+ */
+int stream_read_frame_timeout(ProxyInstance *pi, int timeout_ms, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size, int *frame_type)
+{
+	FrameQueueItem item;
+	int ret;
+
+	if (pi->live == NULL && (pi->live = live_start(pi)) == NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "cannot start live decoding");
+		return -1;
+	}
+
+	ret = framequeue_get_timeout(pi->live->queue, &item, timeout_ms);
+	if (ret < 0) {
+		return 0;
+	}
+	else if (ret == 0) {
+		return -1;
+	}
+
+	if (item.size > output_buffer_size) {
+		proxy_log(pi, PI_LOG_WARNING, "output buffer too small, truncating frame (%d < %d bytes)", output_buffer_size, item.size);
+	}
+	memcpy(output_buffer, item.data, FFMIN(item.size, output_buffer_size));
+	*timestamp = item.timestamp;
+	*frame_type = item.type;
+	ret = item.type == TYPE_AUDIO
+		? FFMIN(item.size, output_buffer_size) / (pi->audio_output.format.channels * pi->audio_output.format.sample_size)
+		: item.length;
+	framequeue_item_release(&item);
+
+	return ret;
+}
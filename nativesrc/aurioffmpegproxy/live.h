@@ -0,0 +1,57 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include "thread.h"
+#include "framequeue.h"
+
+/*
+ * Input settings of MODE_LIVE, which trade the accuracy of the stream probing
+ * for a short delay until the first frame.
+ */
+#define LIVE_PROBESIZE 4096 // bytes
+#define LIVE_ANALYZEDURATION 100000 // 100 ms in AV_TIME_BASE units
+#define LIVE_IO_BUFFER_SIZE 4096 // bytes, smaller buffers hand data to the demuxer earlier
+
+#define LIVE_QUEUE_CAPACITY 64 // decoded frames buffered for the reader
+
+struct ProxyStats;
+
+/*
+ * Decodes a live stream on a background thread, so that frames can be read with a timeout
+ * regardless of how long the source blocks.
+ */
+typedef struct LiveReader {
+	struct ProxyInstance *pi;
+	FrameQueue			*queue;
+	uint8_t				*buffer;
+	int					buffer_size;
+	volatile int		abort;
+	Thread				thread;
+	Mutex				stats_mutex; // protects the fields below
+	struct ProxyStats	*stats; // copy of the instance stats, which the worker updates, for other threads
+	int					reset_stats; // the worker resets the instance stats with the next frame
+} LiveReader;
+
+int live_interrupt(void *opaque);
+void live_stop(LiveReader *live);
+void live_get_stats(LiveReader *live, struct ProxyStats *stats);
+void live_reset_stats(LiveReader *live);
@@ -0,0 +1,91 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "proxy.h"
+#include "thread.h"
+#include "timer.h"
+
+/*
+ * Process-wide like the frame buffer pools (see bufpool.c). It is accessed atomically,
+ * so the callback can be changed while other threads are logging.
+ */
+static void *volatile log_callback = NULL;
+
+/*
+ * Sets the callback that receives all log messages, or NULL to restore the default
+ * behavior, which prints errors and warnings to stderr and drops all other messages.
+ * The callback is called concurrently from all threads that use the library.
+ */
+void proxy_set_log_callback(LogCallback callback)
+{
+	atomic_ptr_store(&log_callback, (void *)callback);
+}
+
+/*
+ * Sets a callback that receives the log messages of the given instance instead of the
+ * global callback, or NULL to restore the global callback. It is called on the thread
+ * that uses the instance (which may be a background thread, e.g. with
+ * stream_read_frame_timeout) and must not be changed while the instance is in use.
+ * Messages that are logged while opening the instance cannot be captured; the error
+ * of a failed open is available through stream_get_error.
+ */
+void stream_set_log_callback(ProxyInstance* pi, InstanceLogCallback callback, void* opaque)
+{
+	pi->log_callback = callback;
+	pi->log_opaque = opaque;
+}
+
+/*
+ * Logs a message. The instance is optional; if it is given and records a trace, the
+ * message is also added to the trace timeline. Messages are only formatted if
+ * they end up somewhere, so debug messages on hot paths are cheap when nobody listens.
+ */
+void proxy_log(ProxyInstance* pi, int level, const char* fmt, ...)
+{
+	va_list args;
+	char message[LOG_MESSAGE_SIZE];
+	int traced = pi != NULL && pi->trace != NULL;
+	InstanceLogCallback instance_callback = pi != NULL ? pi->log_callback : NULL;
+	LogCallback callback = instance_callback == NULL ? (LogCallback)atomic_ptr_load(&log_callback) : NULL;
+
+	if (instance_callback == NULL && callback == NULL && level > PI_LOG_WARNING && !traced) {
+		return;
+	}
+
+	va_start(args, fmt);
+	vsnprintf(message, LOG_MESSAGE_SIZE, fmt, args);
+	va_end(args);
+
+	if (traced) {
+		trace_message(pi->trace, timer_now_ns(), message);
+	}
+
+	if (instance_callback != NULL) {
+		instance_callback(pi->log_opaque, level, message);
+	}
+	else if (callback != NULL) {
+		callback(level, message);
+	}
+	else if (level <= PI_LOG_WARNING) {
+		fprintf(stderr, "%s\n", message);
+	}
+}
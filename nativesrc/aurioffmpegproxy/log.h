@@ -0,0 +1,41 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+// Log levels, same values as the AV_LOG_* levels of FFmpeg
+#define PI_LOG_ERROR	16
+#define PI_LOG_WARNING	24
+#define PI_LOG_INFO		32
+#define PI_LOG_DEBUG	48
+
+#define LOG_MESSAGE_SIZE 500
+
+/*
+ * Receives log messages. The message is only valid during the call.
+ */
+typedef void (*LogCallback)(int level, const char* message);
+
+/*
+ * Receives the log messages of a single instance, see stream_set_log_callback.
+ */
+typedef void (*InstanceLogCallback)(void* opaque, int level, const char* message);
+
+struct ProxyInstance;
+
+void proxy_log(struct ProxyInstance* pi, int level, const char* fmt, ...);
@@ -0,0 +1,621 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "proxy.h"
+#include "thread.h"
+
+#include "libavutil/cpu.h"
+
+/*
+ * Loudness measurement according to EBU R128 / ITU-R BS.1770-4 (integrated loudness and
+ * true peak) and EBU Tech 3342 (loudness range).
+ *
+ * The samples are K-weighted by two biquads (high shelf and high pass) and their squares
+ * accumulated in 100 ms subblocks. The gating blocks (400 ms) and the short-term windows (3 s)
+ * are evaluated from the subblock energies after the scan. The recursive filters run for all
+ * channels in lockstep on separate state arrays, so the compiler can vectorize across channels,
+ * and the true-peak interpolation filter is a polyphase FIR whose dot products vectorize over
+ * the taps.
+ */
+
+#define LOUDNESS_ABSOLUTE_GATE -70.0 // LUFS
+#define LOUDNESS_RELATIVE_GATE -10.0 // LU below the absolutely gated loudness
+#define LOUDNESS_RANGE_GATE -20.0 // LU below the absolutely gated short-term loudness
+#define LOUDNESS_DENORMAL 1e-30 // filter states below this are flushed to zero
+
+typedef struct LoudnessMeter {
+	int					channels;
+	int					subblock_size; // samples per channel
+	int					subblock_fill;
+	double				weights[LOUDNESS_MAX_CHANNELS];
+
+	double				b[2][3]; // K-weighting biquads, a[0] is normalized to 1
+	double				a[2][3];
+	double				z[4][LOUDNESS_MAX_CHANNELS]; // transposed direct form II states of both stages
+	double				sum[LOUDNESS_MAX_CHANNELS]; // squared filtered samples of the current subblock
+
+	double				*energies; // channel-weighted mean square of each subblock
+	int					count;
+	int					capacity;
+
+	int					factor; // true-peak oversampling
+	float				coeffs[4][LOUDNESS_TRUEPEAK_TAPS];
+	float				*history; // 2 * LOUDNESS_TRUEPEAK_TAPS samples per channel, mirrored to be contiguous
+	int					history_pos;
+	float				true_peak;
+	float				sample_peak;
+
+	int64_t				length;
+} LoudnessMeter;
+
+static double energy_to_loudness(double energy)
+{
+	return energy > 0 ? -0.691 + 10 * log10(energy) : -HUGE_VAL;
+}
+
+static double loudness_to_energy(double loudness)
+{
+	return pow(10, (loudness + 0.691) / 10);
+}
+
+static double amplitude_to_db(double amplitude)
+{
+	return amplitude > 0 ? 20 * log10(amplitude) : -HUGE_VAL;
+}
+
+/*
+ * Calculates the K-weighting filter coefficients for the sample rate from the analog
+ * prototypes of BS.1770, as the standard only lists them for 48 kHz.
+ */
+static void init_kweighting(LoudnessMeter *m, int sample_rate)
+{
+	double f0, q, k, vh, vb, a0;
+
+	// Stage 1: high shelf, modeling the acoustic effect of the head
+	f0 = 1681.974450955533;
+	q = 0.7071752369554196;
+	k = tan(M_PI * f0 / sample_rate);
+	vh = pow(10, 3.999843853973347 / 20);
+	vb = pow(vh, 0.4996667741545416);
+	a0 = 1 + k / q + k * k;
+	m->b[0][0] = (vh + vb * k / q + k * k) / a0;
+	m->b[0][1] = 2 * (k * k - vh) / a0;
+	m->b[0][2] = (vh - vb * k / q + k * k) / a0;
+	m->a[0][0] = 1;
+	m->a[0][1] = 2 * (k * k - 1) / a0;
+	m->a[0][2] = (1 - k / q + k * k) / a0;
+
+	// Stage 2: high pass (RLB weighting)
+	f0 = 38.13547087602444;
+	q = 0.5003270373238773;
+	k = tan(M_PI * f0 / sample_rate);
+	a0 = 1 + k / q + k * k;
+	m->b[1][0] = 1;
+	m->b[1][1] = -2;
+	m->b[1][2] = 1;
+	m->a[1][0] = 1;
+	m->a[1][1] = 2 * (k * k - 1) / a0;
+	m->a[1][2] = (1 - k / q + k * k) / a0;
+}
+
+/*
+ * Designs the polyphase interpolation filter for the true-peak measurement, a Hann-windowed
+ * sinc low pass at the original Nyquist frequency. Each phase is normalized to unity gain.
+ */
+static void init_truepeak(LoudnessMeter *m, int sample_rate)
+{
+	int taps;
+
+	// BS.1770 requires at least 4x oversampling at 48 kHz, higher rates need less
+	m->factor = sample_rate < 96000 ? 4 : sample_rate < 192000 ? 2 : 1;
+	taps = m->factor * LOUDNESS_TRUEPEAK_TAPS;
+
+	for (int p = 0; p < m->factor; p++) {
+		double sum = 0;
+
+		for (int k = 0; k < LOUDNESS_TRUEPEAK_TAPS; k++) {
+			int n = p + m->factor * k;
+			double t = (n - (taps - 1) / 2.0) / m->factor;
+			double sinc = t == 0 ? 1 : sin(M_PI * t) / (M_PI * t);
+			double window = 0.5 * (1 - cos(2 * M_PI * (n + 1) / (taps + 1)));
+
+			m->coeffs[p][k] = (float)(sinc * window);
+			sum += m->coeffs[p][k];
+		}
+		for (int k = 0; k < LOUDNESS_TRUEPEAK_TAPS; k++) {
+			m->coeffs[p][k] = (float)(m->coeffs[p][k] / sum);
+		}
+	}
+}
+
+/*
+ * Sets the BS.1770 channel weights: LFE channels are excluded, and surround channels
+ * are weighted by +1.5 dB.
+ */
+static void init_weights(LoudnessMeter *m, const AVChannelLayout *layout)
+{
+	for (int c = 0; c < m->channels; c++) {
+		enum AVChannel channel = layout != NULL && layout->nb_channels == m->channels
+			? av_channel_layout_channel_from_index(layout, c) : AV_CHAN_NONE;
+
+		switch (channel) {
+		case AV_CHAN_LOW_FREQUENCY:
+		case AV_CHAN_LOW_FREQUENCY_2:
+			m->weights[c] = 0;
+			break;
+		case AV_CHAN_SIDE_LEFT:
+		case AV_CHAN_SIDE_RIGHT:
+		case AV_CHAN_BACK_LEFT:
+		case AV_CHAN_BACK_RIGHT:
+			m->weights[c] = 1.41;
+			break;
+		default:
+			m->weights[c] = 1;
+		}
+	}
+}
+
+static LoudnessMeter *meter_create(int sample_rate, int channels, const AVChannelLayout *layout)
+{
+	LoudnessMeter *m;
+
+	m = calloc(1, sizeof(LoudnessMeter));
+	if (m == NULL) {
+		return NULL;
+	}
+
+	m->channels = channels;
+	m->subblock_size = sample_rate / LOUDNESS_SUBBLOCK_RATE;
+	m->history = calloc(channels * 2 * LOUDNESS_TRUEPEAK_TAPS, sizeof(float));
+	if (m->history == NULL) {
+		free(m);
+		return NULL;
+	}
+
+	init_kweighting(m, sample_rate);
+	init_truepeak(m, sample_rate);
+	init_weights(m, layout);
+
+	return m;
+}
+
+static void meter_free(LoudnessMeter *m)
+{
+	free(m->energies);
+	free(m->history);
+	free(m);
+}
+
+static void kweight(LoudnessMeter *m, const float *samples, int count)
+{
+	const int channels = m->channels;
+	double *restrict z0 = m->z[0], *restrict z1 = m->z[1], *restrict z2 = m->z[2], *restrict z3 = m->z[3];
+	double *restrict sum = m->sum;
+	const double b00 = m->b[0][0], b01 = m->b[0][1], b02 = m->b[0][2], a01 = m->a[0][1], a02 = m->a[0][2];
+	const double a11 = m->a[1][1], a12 = m->a[1][2];
+
+	for (int i = 0; i < count; i++) {
+		const float *frame = samples + i * channels;
+
+		for (int c = 0; c < channels; c++) {
+			double x = frame[c];
+			double y = b00 * x + z0[c];
+
+			z0[c] = b01 * x - a01 * y + z1[c];
+			z1[c] = b02 * x - a02 * y;
+
+			// The high pass numerator is (1, -2, 1)
+			x = y;
+			y = x + z2[c];
+			z2[c] = -2 * x - a11 * y + z3[c];
+			z3[c] = x - a12 * y;
+
+			sum[c] += y * y;
+		}
+	}
+}
+
+static void truepeak(LoudnessMeter *m, const float *samples, int count)
+{
+	const int channels = m->channels;
+	float sample_peak = m->sample_peak, true_peak = m->true_peak;
+
+	for (int i = 0; i < count; i++) {
+		const float *frame = samples + i * channels;
+
+		m->history_pos = m->history_pos == 0 ? LOUDNESS_TRUEPEAK_TAPS - 1 : m->history_pos - 1;
+
+		for (int c = 0; c < channels; c++) {
+			float *history = m->history + c * 2 * LOUDNESS_TRUEPEAK_TAPS;
+			const float *x;
+			float value = fabsf(frame[c]);
+
+			if (value > sample_peak) {
+				sample_peak = value;
+			}
+			if (m->factor == 1) {
+				continue;
+			}
+
+			// Newest sample first, the window is contiguous thanks to the mirrored copy
+			history[m->history_pos] = frame[c];
+			history[m->history_pos + LOUDNESS_TRUEPEAK_TAPS] = frame[c];
+			x = history + m->history_pos;
+
+			for (int p = 0; p < m->factor; p++) {
+				const float *coeffs = m->coeffs[p];
+				float y = 0;
+
+				for (int k = 0; k < LOUDNESS_TRUEPEAK_TAPS; k++) {
+					y += coeffs[k] * x[k];
+				}
+				value = fabsf(y);
+				if (value > true_peak) {
+					true_peak = value;
+				}
+			}
+		}
+	}
+
+	m->sample_peak = sample_peak;
+	m->true_peak = true_peak;
+}
+
+static int finish_subblock(LoudnessMeter *m)
+{
+	double energy = 0;
+
+	if (m->count == m->capacity) {
+		int capacity = m->capacity > 0 ? m->capacity * 2 : 1024;
+		double *energies = realloc(m->energies, sizeof(double) * capacity);
+		if (energies == NULL) {
+			return -1;
+		}
+		m->energies = energies;
+		m->capacity = capacity;
+	}
+
+	for (int c = 0; c < m->channels; c++) {
+		energy += m->weights[c] * m->sum[c];
+		m->sum[c] = 0;
+	}
+	m->energies[m->count++] = energy / m->subblock_size;
+
+	// Decaying filter states would end up as slow denormals during silence
+	for (int s = 0; s < 4; s++) {
+		for (int c = 0; c < m->channels; c++) {
+			if (fabs(m->z[s][c]) < LOUDNESS_DENORMAL) {
+				m->z[s][c] = 0;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int meter_process(LoudnessMeter *m, const float *samples, int count)
+{
+	while (count > 0) {
+		int n = FFMIN(count, m->subblock_size - m->subblock_fill);
+
+		kweight(m, samples, n);
+		truepeak(m, samples, n);
+
+		m->subblock_fill += n;
+		if (m->subblock_fill == m->subblock_size) {
+			if (finish_subblock(m) < 0) {
+				return -1;
+			}
+			m->subblock_fill = 0;
+		}
+
+		samples += n * m->channels;
+		count -= n;
+		m->length += n;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the mean energy of the window of subblocks that ends with the given subblock.
+ */
+static double window_energy(LoudnessMeter *m, int last, int subblocks)
+{
+	double sum = 0;
+
+	for (int i = last - subblocks + 1; i <= last; i++) {
+		sum += m->energies[i];
+	}
+
+	return sum / subblocks;
+}
+
+/*
+ * Returns the mean energy of the windows above the absolute gate and above a relative gate
+ * below that mean, or 0 if all windows are gated.
+ */
+static double gated_energy(LoudnessMeter *m, int subblocks, double relative_gate, double *relative_threshold)
+{
+	double absolute_threshold = loudness_to_energy(LOUDNESS_ABSOLUTE_GATE);
+	double sum = 0, threshold;
+	int count = 0;
+
+	for (int i = subblocks - 1; i < m->count; i++) {
+		double energy = window_energy(m, i, subblocks);
+		if (energy > absolute_threshold) {
+			sum += energy;
+			count++;
+		}
+	}
+	if (count == 0) {
+		*relative_threshold = HUGE_VAL;
+		return 0;
+	}
+
+	threshold = loudness_to_energy(energy_to_loudness(sum / count) + relative_gate);
+	*relative_threshold = threshold;
+
+	sum = 0;
+	count = 0;
+	for (int i = subblocks - 1; i < m->count; i++) {
+		double energy = window_energy(m, i, subblocks);
+		if (energy > absolute_threshold && energy > threshold) {
+			sum += energy;
+			count++;
+		}
+	}
+
+	return count > 0 ? sum / count : 0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/*
+ * Computes the loudness range from the distribution of the gated short-term loudness values,
+ * as the difference between their 10th and 95th percentiles.
+ */
+static double loudness_range(LoudnessMeter *m)
+{
+	double threshold, range = 0;
+	double *values;
+	int count = 0;
+
+	gated_energy(m, LOUDNESS_SHORTTERM_SUBBLOCKS, LOUDNESS_RANGE_GATE, &threshold);
+	if (threshold == HUGE_VAL) {
+		return 0;
+	}
+
+	values = malloc(sizeof(double) * m->count);
+	if (values == NULL) {
+		return 0;
+	}
+	for (int i = LOUDNESS_SHORTTERM_SUBBLOCKS - 1; i < m->count; i++) {
+		double energy = window_energy(m, i, LOUDNESS_SHORTTERM_SUBBLOCKS);
+		if (energy > threshold && energy > loudness_to_energy(LOUDNESS_ABSOLUTE_GATE)) {
+			values[count++] = energy_to_loudness(energy);
+		}
+	}
+
+	if (count > 0) {
+		qsort(values, count, sizeof(double), compare_double);
+		range = values[(int)(0.95 * (count - 1) + 0.5)] - values[(int)(0.10 * (count - 1) + 0.5)];
+	}
+	free(values);
+
+	return range;
+}
+
+static void meter_finish(LoudnessMeter *m, LoudnessResult *result, float *shortterm, int shortterm_capacity)
+{
+	double threshold;
+
+	// A trailing partial subblock is too short to contribute to any gating block
+	result->integrated = energy_to_loudness(gated_energy(m, LOUDNESS_BLOCK_SUBBLOCKS, LOUDNESS_RELATIVE_GATE, &threshold));
+	result->range = loudness_range(m);
+	result->sample_peak = amplitude_to_db(m->sample_peak);
+	result->true_peak = amplitude_to_db(FFMAX(m->true_peak, m->sample_peak));
+	result->length = m->length;
+
+	result->shortterm_count = FFMAX(0, m->count - LOUDNESS_SHORTTERM_SUBBLOCKS + 1);
+	for (int i = 0; i < result->shortterm_count && i < shortterm_capacity; i++) {
+		shortterm[i] = (float)energy_to_loudness(window_energy(m, i + LOUDNESS_SHORTTERM_SUBBLOCKS - 1, LOUDNESS_SHORTTERM_SUBBLOCKS));
+	}
+}
+
+/*
+ * Decodes the audio stream from the start and measures its EBU R128 loudness. The short-term
+ * loudness curve, one value per 100 ms from the first complete 3 s window on, is written to
+ * shortterm if it is not NULL. Returns 0 on success, or a negative number on error. The
+ * instance is left at the end of the stream.
+ *
+ * Open the instance with TYPE_AUDIO only, a video stream would be decoded and discarded.
+ */
+int stream_loudness_scan(ProxyInstance *pi, LoudnessResult *result, float *shortterm, int shortterm_capacity)
+{
+	LoudnessMeter *m;
+	uint8_t *buffer = NULL;
+	float *samples = NULL;
+	int64_t timestamp;
+	int ret = 0, failed = 0, frame_type, channels, buffer_size, cache_bypass;
+
+	memset(result, 0, sizeof(LoudnessResult));
+
+	if (!(pi->mode & TYPE_AUDIO)) {
+		proxy_log(pi, PI_LOG_ERROR, "loudness scan requires an audio stream");
+		return result->status = -1;
+	}
+	if (pi->mode & MODE_ANALYSIS) {
+		proxy_log(pi, PI_LOG_ERROR, "loudness scan requires the full channels and sample rate");
+		return result->status = -1;
+	}
+	if (pi->released && acquire_decoders(pi, 1) < 0) {
+		return result->status = -1;
+	}
+
+	channels = pi->audio_output.format.channels;
+	if (channels > LOUDNESS_MAX_CHANNELS) {
+		proxy_log(pi, PI_LOG_ERROR, "loudness scan supports at most %d channels", LOUDNESS_MAX_CHANNELS);
+		return result->status = -1;
+	}
+
+	m = meter_create(pi->audio_output.format.sample_rate, channels, &pi->audio_codec_ctx->ch_layout);
+	if (m == NULL) {
+		return result->status = -1;
+	}
+
+	buffer_size = pi->audio_output.frame_size * channels * pi->audio_output.format.sample_size;
+	buffer = malloc(buffer_size);
+	if (pi->audio_output.format.sample_size == 2) {
+		samples = malloc(sizeof(float) * pi->audio_output.frame_size * channels);
+	}
+	if (buffer == NULL || (pi->audio_output.format.sample_size == 2 && samples == NULL)) {
+		ret = -1;
+		goto end;
+	}
+
+	// Do not flood the frame cache with the whole stream
+	cache_bypass = pi->cache_bypass;
+	pi->cache_bypass = 1;
+
+	if (!(pi->mode & MODE_LIVE)) {
+		stream_seek(pi, 0, TYPE_AUDIO);
+	}
+
+	while ((ret = stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type)) >= 0) {
+		if (frame_type != TYPE_AUDIO) {
+			continue;
+		}
+
+		if (samples != NULL) {
+			const int16_t *input = (const int16_t *)buffer;
+			for (int i = 0; i < ret * channels; i++) {
+				samples[i] = input[i] / 32768.0f;
+			}
+		}
+
+		if (meter_process(m, samples != NULL ? samples : (const float *)buffer, ret) < 0) {
+			failed = 1;
+			break;
+		}
+	}
+
+	pi->cache_bypass = cache_bypass;
+
+	// The end of the stream is the regular end of the scan
+	ret = failed || stream_has_error(pi) ? -1 : 0;
+	if (ret == 0) {
+		meter_finish(m, result, shortterm, shortterm_capacity);
+	}
+
+end:
+	free(samples);
+	free(buffer);
+	meter_free(m);
+
+	return result->status = ret;
+}
+
+typedef struct LoudnessBatch {
+	char				**filenames;
+	LoudnessResult		*results;
+	int					count;
+	volatile int64_t	next;
+} LoudnessBatch;
+
+static void *loudness_worker(void *arg)
+{
+	LoudnessBatch *batch = arg;
+	int64_t i;
+
+	while ((i = atomic_int64_fetch_add(&batch->next, 1)) < batch->count) {
+		ProxyInstance *pi = stream_open_file(TYPE_AUDIO, batch->filenames[i]);
+
+		if (stream_has_error(pi)) {
+			memset(&batch->results[i], 0, sizeof(LoudnessResult));
+			batch->results[i].status = -1;
+		}
+		else {
+			stream_loudness_scan(pi, &batch->results[i], NULL, 0);
+		}
+		stream_close(pi);
+	}
+
+	return NULL;
+}
+
+/*
+ * Scans the loudness of multiple files in parallel, each file on one of thread_count threads
+ * (the number of CPU cores if <= 0). Returns the number of files that could not be scanned,
+ * see the status of their results, or a negative number on error.
+ */
+int proxy_loudness_scan_files(char **filenames, int count, int thread_count, LoudnessResult *results)
+{
+	LoudnessBatch batch;
+	Thread *threads;
+	int started, failed = 0;
+
+	if (thread_count <= 0) {
+		thread_count = av_cpu_count();
+	}
+	thread_count = FFMIN(thread_count, count);
+	if (thread_count <= 0) {
+		return 0;
+	}
+
+	threads = malloc(sizeof(Thread) * thread_count);
+	if (threads == NULL) {
+		return -1;
+	}
+
+	batch.filenames = filenames;
+	batch.results = results;
+	batch.count = count;
+	batch.next = 0;
+
+	for (started = 0; started < thread_count; started++) {
+		if (thread_create(&threads[started], loudness_worker, &batch) < 0) {
+			break;
+		}
+	}
+	if (started == 0) {
+		// Scan on the calling thread
+		loudness_worker(&batch);
+	}
+	for (int i = 0; i < started; i++) {
+		thread_join(threads[i]);
+	}
+	free(threads);
+
+	for (int i = 0; i < count; i++) {
+		if (results[i].status < 0) {
+			failed++;
+		}
+	}
+
+	return failed;
+}
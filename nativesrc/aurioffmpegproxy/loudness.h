@@ -0,0 +1,41 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#define LOUDNESS_SUBBLOCK_RATE 10 // 100 ms steps of the gating blocks and the short-term curve
+#define LOUDNESS_BLOCK_SUBBLOCKS 4 // 400 ms gating blocks
+#define LOUDNESS_SHORTTERM_SUBBLOCKS 30 // 3 s short-term window
+#define LOUDNESS_TRUEPEAK_TAPS 12 // taps per phase of the true-peak interpolation filter
+#define LOUDNESS_MAX_CHANNELS 64
+
+/*
+ * EBU R128 measurements of an audio stream, see stream_loudness_scan. Levels of silent
+ * streams are -HUGE_VAL.
+ */
+typedef struct LoudnessResult {
+	double				integrated; // LUFS
+	double				range; // LU
+	double				true_peak; // dBTP
+	double				sample_peak; // dBFS
+	int64_t				length; // scanned samples per channel
+	int					shortterm_count; // values of the short-term curve, can exceed the requested capacity
+	int					status; // 0 on success, or a negative number if the file could not be scanned
+} LoudnessResult;
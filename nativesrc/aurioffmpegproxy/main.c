@@ -16,6 +16,9 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include "proxy.h"
+#if !defined(_WIN32)
+	#include "server.h"
+#endif
 
 #ifndef max
 #define max(a,b) (((a) > (b)) ? (a) : (b))
@@ -61,13 +64,27 @@ int main(int argc, char* argv[])
 
 	const int stream_mode = 1; // 0 =  file, 1 = buffered stream IO
 	FILE* f = NULL; // used for buffered stream IO
+#if defined(PROXY_AUDIO_ONLY)
+	int mode = TYPE_AUDIO;
+#else
 	int mode = TYPE_AUDIO | TYPE_VIDEO;
+#endif
 
 	if (argc < 2) {
 		fprintf(stderr, "No source file specified\n");
 		exit(1);
 	}
 
+#if !defined(_WIN32)
+	if (strcmp(argv[1], "--server") == 0) {
+		if (argc < 3) {
+			fprintf(stderr, "No socket path specified\n");
+			exit(1);
+		}
+		return server_run(argv[2]) < 0 ? 1 : 0;
+	}
+#endif
+
 	if (stream_mode) { // buffered stream IO
 		f = file_open(argv[1]);
 		if (!f) {
@@ -0,0 +1,424 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#include <string.h>
+
+#include "proxy.h"
+
+#include "libavutil/cpu.h"
+
+/*
+ * Mixing of multiple tracks into one output, for multitrack playback with a single call per
+ * output block. Each track is an audio instance at an offset on the output timeline with
+ * a gain, a balance and a mute switch. The balance follows the managed VolumeControlStream:
+ * a positive balance attenuates the left channel, a negative one the right channel.
+ *
+ * Tracks are decoded frame by frame as the output advances. Muted tracks are not decoded
+ * at all and are repositioned when they are unmuted, like all tracks after a mixer seek.
+ */
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define HAVE_X86 1
+	#include <emmintrin.h>
+	#if defined(__GNUC__)
+		#define TARGET_SSE2 __attribute__((target("sse2")))
+	#else
+		#define TARGET_SSE2
+	#endif
+#else
+	#define HAVE_X86 0
+#endif
+
+#define MIXER_INITIAL_CAPACITY 16
+
+static void mix_interleaved_c(float *output, const float *input, int samples, int channels, const float *gains)
+{
+	for (int i = 0; i < samples; i++) {
+		for (int c = 0; c < channels; c++) {
+			output[i * channels + c] += input[i * channels + c] * gains[c];
+		}
+	}
+}
+
+static void mix_mono_c(float *output, const float *input, int samples, int channels, const float *gains)
+{
+	for (int i = 0; i < samples; i++) {
+		for (int c = 0; c < channels; c++) {
+			output[i * channels + c] += input[i] * gains[c];
+		}
+	}
+}
+
+#if HAVE_X86
+
+/*
+ * With 1, 2 or 4 channels, the gains repeat within a vector of 4 samples.
+ */
+TARGET_SSE2 static void mix_interleaved_sse2(float *output, const float *input, int samples, int channels, const float *gains)
+{
+	int count = samples * channels;
+	int i = 0;
+
+	if (channels == 1 || channels == 2 || channels == 4) {
+		__m128 g = _mm_setr_ps(gains[0], gains[1 % channels], gains[2 % channels], gains[3 % channels]);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 v = _mm_mul_ps(_mm_loadu_ps(input + i), g);
+			_mm_storeu_ps(output + i, _mm_add_ps(_mm_loadu_ps(output + i), v));
+		}
+		for (; i < count; i++) {
+			output[i] += input[i] * gains[i % channels];
+		}
+		return;
+	}
+
+	mix_interleaved_c(output, input, samples, channels, gains);
+}
+
+TARGET_SSE2 static void mix_mono_sse2(float *output, const float *input, int samples, int channels, const float *gains)
+{
+	int i = 0;
+
+	if (channels == 1) {
+		mix_interleaved_sse2(output, input, samples, channels, gains);
+		return;
+	}
+	else if (channels == 2) {
+		__m128 g = _mm_setr_ps(gains[0], gains[1], gains[0], gains[1]);
+
+		for (; i + 4 <= samples; i += 4) {
+			__m128 v = _mm_loadu_ps(input + i);
+			__m128 lo = _mm_mul_ps(_mm_unpacklo_ps(v, v), g);
+			__m128 hi = _mm_mul_ps(_mm_unpackhi_ps(v, v), g);
+			_mm_storeu_ps(output + 2 * i, _mm_add_ps(_mm_loadu_ps(output + 2 * i), lo));
+			_mm_storeu_ps(output + 2 * i + 4, _mm_add_ps(_mm_loadu_ps(output + 2 * i + 4), hi));
+		}
+	}
+
+	mix_mono_c(output + (size_t)i * channels, input + i, samples - i, channels, gains);
+}
+
+#endif
+
+static void update_gains(Mixer *m, MixerTrack *t)
+{
+	for (int c = 0; c < m->channels; c++) {
+		t->gains[c] = t->gain;
+	}
+
+	if (m->channels == 2) {
+		if (t->pan > 0) {
+			t->gains[0] *= 1 - t->pan;
+		}
+		else if (t->pan < 0) {
+			t->gains[1] *= 1 + t->pan;
+		}
+	}
+}
+
+/*
+ * Creates a mixer that outputs interleaved float samples with the given sample rate and
+ * number of channels. Returns NULL on error.
+ */
+Mixer *mixer_create(int sample_rate, int channels)
+{
+	Mixer *m;
+	int cpu_flags = av_get_cpu_flags();
+
+	if (sample_rate <= 0 || channels <= 0 || channels > MIXER_MAX_CHANNELS) {
+		return NULL;
+	}
+
+	m = calloc(1, sizeof(Mixer));
+	if (m == NULL) {
+		return NULL;
+	}
+
+	m->sample_rate = sample_rate;
+	m->channels = channels;
+	m->interleaved_kernel = mix_interleaved_c;
+	m->mono_kernel = mix_mono_c;
+#if HAVE_X86
+	if (cpu_flags & AV_CPU_FLAG_SSE2) {
+		m->interleaved_kernel = mix_interleaved_sse2;
+		m->mono_kernel = mix_mono_sse2;
+	}
+#endif
+	(void)cpu_flags;
+
+	return m;
+}
+
+/*
+ * Adds an audio instance as a track that starts at the given output position, with unity gain
+ * and centered balance. The instance must have the sample rate of the mixer, and either its
+ * channel count or a single channel. It stays owned by the caller, must stay open while the
+ * mixer exists, and must not be read otherwise in the meantime. Returns the index of the track,
+ * or a negative number on error.
+ */
+int mixer_add_track(Mixer *m, ProxyInstance *pi, int64_t offset)
+{
+	MixerTrack *t;
+	int channels, sample_size;
+
+	if (!(pi->mode & TYPE_AUDIO)) {
+		proxy_log(pi, PI_LOG_ERROR, "mixer tracks require an audio stream");
+		return -1;
+	}
+
+	channels = pi->audio_output.format.channels;
+	sample_size = pi->audio_output.format.sample_size;
+	if (pi->audio_output.format.sample_rate != m->sample_rate) {
+		proxy_log(pi, PI_LOG_ERROR, "mixer track sample rate %d differs from the mixer sample rate %d",
+			pi->audio_output.format.sample_rate, m->sample_rate);
+		return -1;
+	}
+	if (channels != m->channels && channels != 1) {
+		proxy_log(pi, PI_LOG_ERROR, "mixer track with %d channels cannot be mixed into %d channels", channels, m->channels);
+		return -1;
+	}
+
+	if (m->count == m->capacity) {
+		int capacity = m->capacity > 0 ? m->capacity * 2 : MIXER_INITIAL_CAPACITY;
+		MixerTrack *tracks = realloc(m->tracks, sizeof(MixerTrack) * capacity);
+		if (tracks == NULL) {
+			return -1;
+		}
+		m->tracks = tracks;
+		m->capacity = capacity;
+	}
+
+	t = &m->tracks[m->count];
+	memset(t, 0, sizeof(MixerTrack));
+	t->pi = pi;
+	t->offset = offset;
+	t->gain = 1;
+	t->channels = channels;
+	t->kernel = channels == 1 && m->channels > 1 ? m->mono_kernel : m->interleaved_kernel;
+	t->buffer_size = pi->audio_output.frame_size * channels * sample_size;
+	t->buffer = malloc(t->buffer_size);
+	if (sample_size == 2) {
+		t->samples = malloc(sizeof(float) * pi->audio_output.frame_size * channels);
+	}
+	else {
+		t->samples = (float *)t->buffer;
+	}
+	if (t->buffer == NULL || t->samples == NULL) {
+		if (t->samples != (float *)t->buffer) {
+			free(t->samples);
+		}
+		free(t->buffer);
+		return -1;
+	}
+	update_gains(m, t);
+
+	// The instance may have been read before
+	t->resync = 1;
+
+	return m->count++;
+}
+
+/*
+ * Sets the placement and the levels of a track. Returns 0 on success, or a negative number
+ * if the track does not exist.
+ */
+int mixer_set_track(Mixer *m, int track, int64_t offset, float gain, float pan, int mute)
+{
+	MixerTrack *t;
+
+	if (track < 0 || track >= m->count) {
+		return -1;
+	}
+
+	t = &m->tracks[track];
+	if (offset != t->offset) {
+		t->offset = offset;
+		t->frame_length = 0;
+		t->resync = 1;
+	}
+	t->gain = gain;
+	t->pan = pan < -1 ? -1 : pan > 1 ? 1 : pan;
+	t->mute = mute;
+	update_gains(m, t);
+
+	return 0;
+}
+
+/*
+ * Decodes the next frame of a track into its float buffer. Returns 0 on success, or
+ * a negative number at the end of the track.
+ */
+static int read_track_frame(MixerTrack *t)
+{
+	int64_t timestamp;
+	int ret, frame_type;
+
+	do {
+		ret = stream_read_frame(t->pi, &timestamp, t->buffer, t->buffer_size, &frame_type);
+		if (ret < 0) {
+			t->eof = 1;
+			t->frame_length = 0;
+			return -1;
+		}
+	} while (frame_type != TYPE_AUDIO);
+
+	if (t->samples != (float *)t->buffer) {
+		const int16_t *input = (const int16_t *)t->buffer;
+		for (int i = 0; i < ret * t->channels; i++) {
+			t->samples[i] = input[i] / 32768.0f;
+		}
+	}
+
+	t->frame_start = t->offset + timestamp;
+	t->frame_length = ret;
+
+	return 0;
+}
+
+/*
+ * Repositions a track to the output position, unless its decoded frame already covers it.
+ */
+static void resync_track(MixerTrack *t, int64_t position)
+{
+	t->resync = 0;
+
+	if (t->frame_length > 0 && t->frame_start <= position && position < t->frame_start + t->frame_length) {
+		return;
+	}
+
+	stream_seek(t->pi, position > t->offset ? position - t->offset : 0, TYPE_AUDIO);
+	t->frame_length = 0;
+	t->eof = 0;
+}
+
+static void mix_track(Mixer *m, MixerTrack *t, float *output, int64_t start, int samples)
+{
+	int64_t position = start, end = start + samples;
+
+	if (t->resync) {
+		resync_track(t, start);
+	}
+
+	while (position < end && !t->eof) {
+		int64_t frame_end = t->frame_start + t->frame_length;
+
+		if (position < t->offset) {
+			// The track has not started yet
+			position = t->offset < end ? t->offset : end;
+		}
+		else if (t->frame_length > 0 && t->frame_start <= position && position < frame_end) {
+			int64_t to = frame_end < end ? frame_end : end;
+			int skip = (int)(position - t->frame_start);
+
+			t->kernel(output + (position - start) * m->channels, t->samples + (size_t)skip * t->channels,
+				(int)(to - position), m->channels, t->gains);
+			position = to;
+		}
+		else if (t->frame_length > 0 && t->frame_start > position) {
+			// A gap in the track (or a seek that ended behind the target) is silent
+			position = t->frame_start < end ? t->frame_start : end;
+		}
+		else {
+			read_track_frame(t);
+		}
+	}
+}
+
+/*
+ * Mixes the next samples of all tracks into the output, which receives `samples` samples per
+ * channel, and advances the mixer. Returns the number of samples until the end of the longest
+ * track (as far as the track lengths are known), which is less than requested at the end.
+ */
+int mixer_read(Mixer *m, float *output, int samples)
+{
+	int64_t length;
+
+	memset(output, 0, sizeof(float) * samples * m->channels);
+
+	for (int i = 0; i < m->count; i++) {
+		MixerTrack *t = &m->tracks[i];
+
+		if (t->mute) {
+			// Muted tracks are skipped and repositioned when they are unmuted
+			t->resync = 1;
+			continue;
+		}
+		mix_track(m, t, output, m->position, samples);
+	}
+
+	length = mixer_get_length(m);
+	if (length != AV_NOPTS_VALUE && m->position + samples > length) {
+		samples = (int)FFMAX(length - m->position, 0);
+	}
+	m->position += samples;
+
+	return samples;
+}
+
+/*
+ * Sets the output position. The tracks are repositioned on the next read.
+ */
+int mixer_seek(Mixer *m, int64_t position)
+{
+	if (position < 0) {
+		return -1;
+	}
+
+	m->position = position;
+	for (int i = 0; i < m->count; i++) {
+		m->tracks[i].resync = 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the end of the longest track, or AV_NOPTS_VALUE if the length of a track is unknown.
+ */
+int64_t mixer_get_length(Mixer *m)
+{
+	int64_t length = 0;
+
+	for (int i = 0; i < m->count; i++) {
+		MixerTrack *t = &m->tracks[i];
+
+		if (t->pi->audio_output.length == AV_NOPTS_VALUE) {
+			return AV_NOPTS_VALUE;
+		}
+		length = FFMAX(length, t->offset + t->pi->audio_output.length);
+	}
+
+	return length;
+}
+
+/*
+ * Frees the mixer. The track instances are not closed.
+ */
+void mixer_free(Mixer *m)
+{
+	for (int i = 0; i < m->count; i++) {
+		if (m->tracks[i].samples != (float *)m->tracks[i].buffer) {
+			free(m->tracks[i].samples);
+		}
+		free(m->tracks[i].buffer);
+	}
+	free(m->tracks);
+	free(m);
+}
@@ -0,0 +1,61 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#define MIXER_MAX_CHANNELS 64
+
+/*
+ * Adds `samples` samples per channel of a track to the interleaved output, scaled by the
+ * per-output-channel gains. Mono tracks are added to all output channels.
+ */
+typedef void (*MixKernel)(float *output, const float *input, int samples, int channels, const float *gains);
+
+typedef struct MixerTrack {
+	struct ProxyInstance *pi;
+	int64_t				offset; // output position where the track starts
+	float				gain;
+	float				pan; // balance of stereo output, -1 (left only) .. 1 (right only)
+	int					mute;
+	float				gains[MIXER_MAX_CHANNELS]; // per output channel, from gain and pan
+	MixKernel			kernel;
+	int					channels;
+	uint8_t				*buffer; // decoding buffer
+	int					buffer_size;
+	float				*samples; // decoded frame as float, points to buffer for float output
+	int64_t				frame_start; // output position of the decoded frame
+	int					frame_length; // samples per channel, 0 if none
+	int					eof;
+	int					resync; // the instance needs to be seeked to the mixer position
+} MixerTrack;
+
+/*
+ * Decodes and mixes multiple audio instances into one float output, see mixer_create.
+ */
+typedef struct Mixer {
+	int					sample_rate;
+	int					channels;
+	int64_t				position; // next output sample
+	MixerTrack			*tracks;
+	int					count;
+	int					capacity;
+	MixKernel			interleaved_kernel;
+	MixKernel			mono_kernel;
+} Mixer;
@@ -0,0 +1,349 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#if !defined(_WIN32)
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+#endif
+
+#include "proxy.h"
+#include "thread.h"
+
+/*
+ * Progressive decoding of an audio stream into a memory-mapped PCM cache file.
+ *
+ * A worker thread decodes the stream with its own instance and writes the samples to
+ * their position in the mapped file. After each frame, it publishes the number of
+ * contiguous samples that are available (the high-water mark). Readers access the
+ * mapping directly as long as they stay below the high-water mark, without taking a
+ * lock, and only wait for the worker when they read ahead of it.
+ *
+ * The file is sized from the estimated stream length with some headroom. Samples
+ * beyond that are dropped with a warning, because the mapping cannot grow while
+ * readers access it.
+ */
+
+struct PcmCache {
+	char				*filename;
+	char				*cache_filename;
+	int					block_size; // bytes per sample frame (all channels)
+	int64_t				origin; // timestamp of the first cached sample
+	int64_t				capacity; // in samples
+	uint8_t				*data;
+	volatile int64_t	available; // high-water mark in samples, published after the samples are written
+	volatile int		done; // 1 when decoding has finished, negative on error
+	volatile int		abort;
+	Mutex				mutex; // only used to wait for the worker
+	Cond				cond;
+	Thread				thread;
+#if defined(_WIN32)
+	HANDLE				file;
+	HANDLE				mapping;
+#else
+	int					fd;
+#endif
+};
+
+static int map_file(PcmCache *pc, int64_t size)
+{
+#if defined(_WIN32)
+	pc->file = CreateFileA(pc->cache_filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+	if (pc->file == INVALID_HANDLE_VALUE) {
+		return -1;
+	}
+	pc->mapping = CreateFileMappingA(pc->file, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, NULL);
+	if (pc->mapping == NULL) {
+		CloseHandle(pc->file);
+		return -1;
+	}
+	pc->data = MapViewOfFile(pc->mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+	if (pc->data == NULL) {
+		CloseHandle(pc->mapping);
+		CloseHandle(pc->file);
+		return -1;
+	}
+#else
+	pc->fd = open(pc->cache_filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (pc->fd < 0) {
+		return -1;
+	}
+	// Extends the file without allocating it, the pages are filled as the samples are written
+	if (ftruncate(pc->fd, (off_t)size) < 0) {
+		close(pc->fd);
+		return -1;
+	}
+	pc->data = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, pc->fd, 0);
+	if (pc->data == MAP_FAILED) {
+		pc->data = NULL;
+		close(pc->fd);
+		return -1;
+	}
+#endif
+
+	return 0;
+}
+
+static void unmap_file(PcmCache *pc)
+{
+#if defined(_WIN32)
+	UnmapViewOfFile(pc->data);
+	CloseHandle(pc->mapping);
+	CloseHandle(pc->file);
+#else
+	munmap(pc->data, (size_t)(pc->capacity * pc->block_size));
+	close(pc->fd);
+#endif
+	remove(pc->cache_filename);
+}
+
+/*
+ * Publishes a new high-water mark, or the end of decoding, and wakes up waiting readers.
+ */
+static void publish(PcmCache *pc, int64_t available, int done)
+{
+	mutex_lock(&pc->mutex);
+	if (available >= 0) {
+		atomic_int64_store(&pc->available, available);
+	}
+	if (done != 0) {
+		atomic_int_store(&pc->done, done);
+	}
+	cond_broadcast(&pc->cond);
+	mutex_unlock(&pc->mutex);
+}
+
+static void *pcmcache_worker(void *arg)
+{
+	PcmCache *pc = arg;
+	ProxyInstance *pi;
+	uint8_t *buffer = NULL;
+	int buffer_size, samples, frame_type;
+	int64_t timestamp, available = 0;
+	int ret = 1;
+
+	pi = stream_open_file(TYPE_AUDIO, pc->filename);
+	if (stream_has_error(pi) || pi->audio_output.format.channels * pi->audio_output.format.sample_size != pc->block_size) {
+		ret = -1;
+		goto end;
+	}
+
+	buffer_size = pi->audio_output.frame_size * pc->block_size;
+	buffer = malloc(buffer_size);
+	if (buffer == NULL) {
+		ret = -1;
+		goto end;
+	}
+
+	while (!atomic_int_load(&pc->abort)) {
+		int64_t from, to;
+
+		samples = stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type);
+		if (samples < 0) {
+			break;
+		}
+
+		// Clip the frame to the cache, e.g. dropping the codec delay before the stream start
+		from = FFMAX(timestamp - pc->origin, 0);
+		to = FFMIN(timestamp - pc->origin + samples, pc->capacity);
+		if (to > from) {
+			memcpy(pc->data + from * pc->block_size, buffer + (from - (timestamp - pc->origin)) * pc->block_size, (size_t)((to - from) * pc->block_size));
+		}
+
+		if (to > available) {
+			available = to;
+			publish(pc, available, 0);
+		}
+
+		if (timestamp - pc->origin + samples > pc->capacity) {
+			proxy_log(pi, PI_LOG_WARNING, "pcm cache: stream exceeds the estimated length, truncating at %"PRId64" samples", pc->capacity);
+			break;
+		}
+	}
+
+end:
+	free(buffer);
+	if (pi != NULL) {
+		stream_close(pi);
+	}
+	publish(pc, -1, ret);
+
+	return NULL;
+}
+
+/*
+ * Starts decoding the audio stream of a file mode instance into the given cache file in
+ * the background. The cache is readable through stream_pcmcache_read while decoding
+ * continues, and removed when it is stopped or the instance is closed. Returns 0 on
+ * success, or a negative number on error.
+ */
+int stream_pcmcache_start(ProxyInstance *pi, char *cache_filename)
+{
+	PcmCache *pc;
+	int64_t length;
+
+	if (pi->source_filename == NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "pcm cache requires an instance in file mode");
+		return -1;
+	}
+	if (!(pi->mode & TYPE_AUDIO)) {
+		proxy_log(pi, PI_LOG_ERROR, "pcm cache requires an audio stream");
+		return -1;
+	}
+	if (pi->audio_output.length == AV_NOPTS_VALUE) {
+		proxy_log(pi, PI_LOG_ERROR, "pcm cache requires a known stream length");
+		return -1;
+	}
+	if (pi->released && acquire_decoders(pi, 1) < 0) {
+		return -1;
+	}
+
+	stream_pcmcache_stop(pi);
+
+	pc = calloc(1, sizeof(PcmCache));
+	if (pc == NULL) {
+		return -1;
+	}
+
+	length = pi->audio_output.length;
+	pc->filename = pi->source_filename;
+	pc->cache_filename = strdup(cache_filename);
+	pc->block_size = pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+	pc->origin = pi->audio_stream->start_time != AV_NOPTS_VALUE
+		? pts_to_samples(pi->audio_output.format.sample_rate, pi->audio_stream->time_base, pi->audio_stream->start_time)
+		: 0;
+	// The length is estimated from the container and can be off, e.g. for VBR streams without an index
+	pc->capacity = length + length / 8 + pi->audio_output.format.sample_rate;
+
+	if (pc->cache_filename == NULL || map_file(pc, pc->capacity * pc->block_size) < 0) {
+		proxy_log(pi, PI_LOG_ERROR, "pcm cache: cannot map %s", cache_filename);
+		free(pc->cache_filename);
+		free(pc);
+		return -1;
+	}
+
+	mutex_init(&pc->mutex);
+	cond_init(&pc->cond);
+
+	if (thread_create(&pc->thread, pcmcache_worker, pc) < 0) {
+		proxy_log(pi, PI_LOG_ERROR, "pcm cache: cannot create thread");
+		mutex_destroy(&pc->mutex);
+		cond_destroy(&pc->cond);
+		unmap_file(pc);
+		free(pc->cache_filename);
+		free(pc);
+		return -1;
+	}
+
+	pi->pcmcache = pc;
+
+	return 0;
+}
+
+/*
+ * Returns the number of samples from the stream start that are cached and readable without
+ * waiting, or a negative number if no cache has been started.
+ */
+int64_t stream_pcmcache_available(ProxyInstance *pi)
+{
+	if (pi->pcmcache == NULL) {
+		return -1;
+	}
+
+	return atomic_int64_load(&pi->pcmcache->available);
+}
+
+/*
+ * Returns 0 while the cache is being decoded, 1 when it is complete, or a negative number
+ * if decoding failed or no cache has been started.
+ */
+int stream_pcmcache_status(ProxyInstance *pi)
+{
+	if (pi->pcmcache == NULL) {
+		return -1;
+	}
+
+	return atomic_int_load(&pi->pcmcache->done);
+}
+
+/*
+ * Copies samples from the given position (relative to the stream start) into the buffer,
+ * waiting for the decoder if they have not been decoded yet. Returns the number of copied
+ * samples, which is only less than requested at the end of the stream, or a negative
+ * number on error.
+ */
+int stream_pcmcache_read(ProxyInstance *pi, int64_t position, uint8_t *buffer, int samples)
+{
+	PcmCache *pc = pi->pcmcache;
+	int64_t available, end;
+
+	if (pc == NULL || position < 0 || samples < 0) {
+		return -1;
+	}
+
+	end = FFMIN(position + samples, pc->capacity);
+	available = atomic_int64_load(&pc->available);
+
+	if (available < end) {
+		// Ahead of the decoder, wait until it catches up or finishes
+		mutex_lock(&pc->mutex);
+		while ((available = atomic_int64_load(&pc->available)) < end && atomic_int_load(&pc->done) == 0) {
+			cond_wait(&pc->cond, &pc->mutex);
+		}
+		mutex_unlock(&pc->mutex);
+
+		if (available < end && atomic_int_load(&pc->done) < 0) {
+			return -1;
+		}
+		end = FFMIN(end, available);
+	}
+
+	if (end <= position) {
+		return 0;
+	}
+
+	memcpy(buffer, pc->data + position * pc->block_size, (size_t)((end - position) * pc->block_size));
+
+	return (int)(end - position);
+}
+
+/*
+ * Stops the background decoding and removes the cache file.
+ */
+void stream_pcmcache_stop(ProxyInstance *pi)
+{
+	PcmCache *pc = pi->pcmcache;
+
+	if (pc == NULL) {
+		return;
+	}
+
+	atomic_int_store(&pc->abort, 1);
+	thread_join(pc->thread);
+
+	mutex_destroy(&pc->mutex);
+	cond_destroy(&pc->cond);
+	unmap_file(pc);
+	free(pc->cache_filename);
+	free(pc);
+	pi->pcmcache = NULL;
+}
@@ -23,9 +23,42 @@
 		#define snprintf _snprintf // support for "snprintf" http://stackoverflow.com/questions/2915672
 	#endif
 	#define _CRT_SECURE_NO_WARNINGS // disable _snprintf compile warning, disable fopen compile error
+	#define strdup _strdup // POSIX name is deprecated
 #endif
 
 #include "proxy.h"
+#include "timer.h"
+
+#include "libavutil/cpu.h"
+
+static int pi_init(ProxyInstance** pi);
+static void pi_free(ProxyInstance** pi);
+static void pi_set_error(ProxyInstance* pi, const char* fmt, ...);
+static int pi_has_error(ProxyInstance* pi);
+
+static void info(ProxyInstance* pi);
+static int open_codec_context(AVFormatContext* fmt_ctx, AVCodecContext** codec_ctx, int type, int flags, AVDictionary** options);
+static void configure_live_input(ProxyInstance* pi);
+static int decode_audio_packet(ProxyInstance* pi, int* got_audio_frame, int cached);
+static int decode_video_packet(ProxyInstance* pi, int* got_video_frame, int cached);
+static int determine_target_format(AVCodecContext* audio_codec_ctx);
+static int read_frame(ProxyInstance* pi, int64_t* timestamp, uint8_t* output_buffer, int output_buffer_size, int* frame_type);
+static int decode_frame(ProxyInstance* pi, int64_t* timestamp, uint8_t* output_buffer, int output_buffer_size, int* frame_type);
+static int open_input(ProxyInstance* pi);
+static int open_decoders(ProxyInstance* pi);
+static int copy_stream_info(AVFormatContext* fmt_ctx, AVFormatContext* source_ctx);
+static AVFormatContext* save_stream_info(AVFormatContext* fmt_ctx);
+static void close_input(ProxyInstance* pi);
+static int lowmem_supported(ProxyInstance* pi);
+static void lowmem_negotiate_frame_size(ProxyInstance* pi);
+static void release_decoders(ProxyInstance* pi);
+static int cache_read_frame(ProxyInstance* pi, int64_t* timestamp, uint8_t* output_buffer, int output_buffer_size, int* frame_type);
+static int seek_decoder(ProxyInstance* pi, int64_t timestamp, int type);
+static int seek_decoder_exact(ProxyInstance* pi, int64_t position, int type);
+static int64_t seek_preroll(ProxyInstance* pi);
+static int io_read_packet(void* opaque, uint8_t* buf, int buf_size);
+static int64_t io_seek(void* opaque, int64_t offset, int whence);
+static inline void pi_trace(ProxyInstance* pi, TraceEventType type, int64_t start, int64_t end, int64_t arg);
 
 /**
 * Simple proxy layer to read audio streams through FFmpeg.
@@ -60,6 +93,7 @@ ProxyInstance *stream_open_file(int mode, char *filename)
 {
 	ProxyInstance *pi;
 	int ret = 0;
+	int64_t open_start = timer_now_ns();
 
 	if ((ret = pi_init(&pi)) < 0) {
 		pi_set_error(pi, "Could not initialize proxy instance (%d)", ret);
@@ -67,13 +101,76 @@ ProxyInstance *stream_open_file(int mode, char *filename)
 	}
 
 	pi->mode = mode;
+	pi->source_filename = strdup(filename);
+	if (mode & MODE_TRACE) {
+		pi->trace = trace_create(TRACE_DEFAULT_CAPACITY);
+	}
 
-	if (avformat_open_input(&pi->fmt_ctx, filename, NULL, NULL) < 0) {
+	if (open_input(pi) < 0) {
 		pi_set_error(pi, "Could not open source file %s", filename);
 		return pi;
 	}
 
-	return stream_open(pi);
+	pi = stream_open(pi);
+	pi_trace(pi, TRACE_OPEN, open_start, timer_now_ns(), 0);
+
+	return pi;
+}
+
+/*
+ * Opens an additional instance of the file of a file mode instance, e.g. to read the file at
+ * several positions at once. The clone has its own demuxer and decoder state, but skips the
+ * probing of the file by taking over the stream info of the source, and shares the seek indices
+ * of the source. The clone is independent of the source and can outlive it, but must not be
+ * created while the source is used on another thread.
+ */
+ProxyInstance *stream_clone(ProxyInstance *source)
+{
+	ProxyInstance *pi;
+	int ret = 0;
+	int64_t open_start = timer_now_ns();
+
+	if ((ret = pi_init(&pi)) < 0) {
+		pi_set_error(pi, "Could not initialize proxy instance (%d)", ret);
+		return pi;
+	}
+
+	if (source->source_filename == NULL || pi_has_error(source)) {
+		pi_set_error(pi, "Only an open file mode instance can be cloned");
+		return pi;
+	}
+
+	pi->mode = source->mode;
+	pi->source_filename = strdup(source->source_filename);
+	pi->input_format = source->input_format;
+	pi->log_callback = source->log_callback;
+	pi->log_opaque = source->log_opaque;
+	if (pi->mode & MODE_TRACE) {
+		pi->trace = trace_create(TRACE_DEFAULT_CAPACITY);
+	}
+
+	if (open_input(pi) < 0) {
+		pi_set_error(pi, "Could not open source file %s", pi->source_filename);
+		return pi;
+	}
+
+	// A released source provides the stream info it has kept for reopening
+	pi->info_source = source;
+	pi = stream_open(pi);
+	pi->info_source = NULL;
+
+	if (!pi_has_error(pi)) {
+		if (source->audio_seekindex != NULL) {
+			pi->audio_seekindex = seekindex_ref(source->audio_seekindex);
+		}
+		if (source->video_seekindex != NULL) {
+			pi->video_seekindex = seekindex_ref(source->video_seekindex);
+		}
+	}
+
+	pi_trace(pi, TRACE_OPEN, open_start, timer_now_ns(), 0);
+
+	return pi;
 }
 
 /*
@@ -91,10 +188,8 @@ ProxyInstance *stream_open_bufferedio(int mode,
 	char* filename)
 {
 	ProxyInstance *pi;
-	const int buffer_size = 32 * 1024;
-	char *buffer;
-	AVIOContext *io_ctx;
 	int ret;
+	int64_t open_start = timer_now_ns();
 
 	if ((ret = pi_init(&pi)) < 0) {
 		pi_set_error(pi, "Could not initialize proxy instance (%d)", ret);
@@ -102,28 +197,23 @@ ProxyInstance *stream_open_bufferedio(int mode,
 	}
 
 	pi->mode = mode;
+	if (mode & MODE_TRACE) {
+		pi->trace = trace_create(TRACE_DEFAULT_CAPACITY);
+	}
+	pi->io_opaque = opaque;
+	pi->io_read_packet = read_packet;
+	pi->io_seek = seek;
+	pi->io_filename = filename != NULL ? strdup(filename) : NULL;
 
-	// Allocate IO buffer for the AVIOContext. 
-	// Must later be freed by av_free() from AVIOContext.buffer (which could be the same or a replacement buffer).
-	buffer = av_malloc(buffer_size + AV_INPUT_BUFFER_PADDING_SIZE);
-
-	// Allocate the AVIOContext. Must later be freed by av_free().
-	io_ctx = avio_alloc_context(buffer, buffer_size, 0 /* not writeable */, opaque, read_packet, NULL /* no write_packet needed */, seek);
-
-	// Allocate and configure AVFormatContext. Must later bee freed by avformat_close_input().
-	pi->fmt_ctx = avformat_alloc_context();
-	pi->fmt_ctx->pb = io_ctx;
-
-	// NOTE format does not need to be probed manually, FFmpeg does the probing itself and does not crash anymore
-
-	if ((ret = avformat_open_input(&pi->fmt_ctx, filename, NULL, NULL)) < 0) {
+	if ((ret = open_input(pi)) < 0) {
 		pi_set_error(pi, "Could not open source stream: %s", av_err2str(ret));
 		return pi;
 	}
 
-	// NOTE AVFMT_FLAG_CUSTOM_IO is automatically set by avformat_open_input, can be checked when closing the stream to free allocated resources
+	pi = stream_open(pi);
+	pi_trace(pi, TRACE_OPEN, open_start, timer_now_ns(), 0);
 
-	return stream_open(pi);
+	return pi;
 }
 
 /*
@@ -132,9 +222,7 @@ ProxyInstance *stream_open_bufferedio(int mode,
  */
 ProxyInstance *stream_open(ProxyInstance *pi)
 {
-	int ret;
-
-	if (pi->mode == TYPE_NONE) {
+	if ((pi->mode & TYPE_MASK) == TYPE_NONE) {
 		pi_set_error(pi, "no mode specified");
 		return pi;
 	}
@@ -144,51 +232,50 @@ ProxyInstance *stream_open(ProxyInstance *pi)
 		return pi;
 	}
 
-	if (avformat_find_stream_info(pi->fmt_ctx, NULL) < 0) {
-		pi_set_error(pi, "Could not find stream information");
+	if ((pi->mode & MODE_LOWMEM) && !lowmem_supported(pi)) {
+		pi->mode &= ~MODE_LOWMEM;
+	}
+
+	if ((pi->mode & MODE_DISPATCH) && (pi->mode & (MODE_LIVE | MODE_LOWMEM))) {
+		pi_set_error(pi, "dispatch mode cannot be combined with live or low-footprint mode");
+		return pi;
+	}
+
+	if (open_decoders(pi) < 0) {
 		return pi;
 	}
 
 	//av_dump_format(pi->fmt_ctx, 0, filename, 0);
 
-	//info(pi->fmt_ctx);
+	//info(pi);
 
 	if (pi->mode & TYPE_AUDIO) {
-		// open audio stream
-		if ((ret = open_codec_context(pi->fmt_ctx, &pi->audio_codec_ctx, AVMEDIA_TYPE_AUDIO)) < 0) {
-			pi_set_error(pi, "Cannot find audio stream");
-			return pi;
-		}
-
-		pi->audio_stream = pi->fmt_ctx->streams[ret];
-
-		/* initialize sample format converter */
-		// http://stackoverflow.com/a/15372417
-		pi->swr = swr_alloc();
-		av_opt_set_chlayout(pi->swr, "in_chlayout", &pi->audio_codec_ctx->ch_layout, 0);
-		av_opt_set_chlayout(pi->swr, "out_chlayout", &pi->audio_codec_ctx->ch_layout, 0);
-		av_opt_set_int(pi->swr, "in_sample_rate", pi->audio_codec_ctx->sample_rate, 0);
-		av_opt_set_int(pi->swr, "out_sample_rate", pi->audio_codec_ctx->sample_rate, 0);
-		av_opt_set_sample_fmt(pi->swr, "in_sample_fmt", pi->audio_codec_ctx->sample_fmt, 0);
-		av_opt_set_sample_fmt(pi->swr, "out_sample_fmt", determine_target_format(pi->audio_codec_ctx), 0);
-		swr_init(pi->swr);
-	
-
 		/* set output properties */
 
-		pi->audio_output.format.sample_rate = pi->audio_codec_ctx->sample_rate;
-		pi->audio_output.format.sample_size = av_get_bytes_per_sample(determine_target_format(pi->audio_codec_ctx));
-		pi->audio_output.format.channels = pi->audio_codec_ctx->ch_layout.nb_channels;
+		if (pi->analysis != NULL) {
+			pi->audio_output.format.sample_rate = pi->analysis->out_sample_rate;
+			pi->audio_output.format.sample_size = sizeof(float);
+			pi->audio_output.format.channels = 1;
+			proxy_log(pi, PI_LOG_INFO, "analysis decoding of %s: decoder reductions 0x%x",
+				pi->audio_codec_ctx->codec->name, pi->analysis->path);
+		}
+		else {
+			pi->audio_output.format.sample_rate = pi->audio_codec_ctx->sample_rate;
+			pi->audio_output.format.sample_size = get_output_sample_size(pi->audio_codec_ctx);
+			pi->audio_output.format.channels = pi->audio_codec_ctx->ch_layout.nb_channels;
+		}
 
 		if (DEBUG) {
-			printf("audio_output.format: %d sample_rate, %d sample_size, %d channels\n",
+			proxy_log(pi, PI_LOG_DEBUG, "audio_output.format: %d sample_rate, %d sample_size, %d channels",
 				pi->audio_output.format.sample_rate,
 				pi->audio_output.format.sample_size,
 				pi->audio_output.format.channels);
 		}
 
 		pi->audio_output.length =
-			pi->audio_stream->duration != AV_NOPTS_VALUE
+			pi->mode & MODE_LIVE
+				? AV_NOPTS_VALUE // a live stream has no end, the duration is meaningless
+			: pi->audio_stream->duration != AV_NOPTS_VALUE
 				? pts_to_samples(pi->audio_output.format.sample_rate, pi->audio_stream->time_base, pi->audio_stream->duration)
 			: pi->fmt_ctx->duration != AV_NOPTS_VALUE
 				? pts_to_samples(pi->audio_output.format.sample_rate, AV_TIME_BASE_Q, pi->fmt_ctx->duration)
@@ -205,38 +292,22 @@ ProxyInstance *stream_open(ProxyInstance *pi)
 		* program that calls this library manage the buffer.
 		*
 		* For now, a frame size of 1 second should be big enough to fit all occurring frame sizes (frame
-		* sizes were always smaller during tests).
+		* sizes were always smaller during tests). In MODE_LOWMEM, the frame size is negotiated from
+		* the first frames instead (see lowmem_negotiate_frame_size).
 		*/
 		pi->audio_output.frame_size = pi->audio_output.format.sample_rate; // 1 sec default frame size
 
 		if (DEBUG) {
-			printf("output: %"PRId64" length, %d frame_size\n", pi->audio_output.length, pi->audio_output.frame_size);
+			proxy_log(pi, PI_LOG_DEBUG, "output: %"PRId64" length, %d frame_size", pi->audio_output.length, pi->audio_output.frame_size);
 		}
 
 		if (pi->audio_codec_ctx->codec->capabilities & AV_CODEC_CAP_DELAY) {
 			// When CODEC_CAP_DELAY is set, there is a delay between input and output of the decoder
-			printf("warning: cap delay!\n");
+			proxy_log(pi, PI_LOG_INFO, "warning: cap delay! (audio decoder %s)", pi->audio_codec_ctx->codec->name);
 		}
 	}
 
 	if (pi->mode & TYPE_VIDEO) {
-		// open audio stream
-		if ((ret = open_codec_context(pi->fmt_ctx, &pi->video_codec_ctx, AVMEDIA_TYPE_VIDEO)) < 0) {
-			pi_set_error(pi, "Cannot find video stream");
-			return pi;
-		}
-
-		pi->video_stream = pi->fmt_ctx->streams[ret];
-
-		/* Initialize video frame converter */
-		// PIX_FMT_BGR24 format needed by C# for correct color interpretation (PixelFormat.Format24bppRgb)
-		pi->sws = sws_getContext(pi->video_codec_ctx->width, pi->video_codec_ctx->height, pi->video_codec_ctx->pix_fmt, 
-			pi->video_codec_ctx->width, pi->video_codec_ctx->height, AV_PIX_FMT_BGR24, SWS_BICUBIC, NULL, NULL, NULL);
-		if (pi->sws == NULL) {
-			pi_set_error(pi, "error creating swscontext");
-			return pi;
-		}
-
 		/* set output properties */
 
 		pi->video_output.format.width = pi->video_codec_ctx->width;
@@ -245,25 +316,189 @@ ProxyInstance *stream_open(ProxyInstance *pi)
 		pi->video_output.format.aspect_ratio = av_q2d(pi->video_codec_ctx->sample_aspect_ratio);
 
 		if (DEBUG) {
-			printf("video_output.format: %d width, %d height, %f frame_rate, %f aspect_ratio\n",
+			proxy_log(pi, PI_LOG_DEBUG, "video_output.format: %d width, %d height, %f frame_rate, %f aspect_ratio",
 				pi->video_output.format.width,
 				pi->video_output.format.height,
 				pi->video_output.format.frame_rate,
 				pi->video_output.format.aspect_ratio);
 		}
 
-		pi->video_output.length = pi->video_stream->duration != AV_NOPTS_VALUE ?
+		pi->video_output.length = !(pi->mode & MODE_LIVE) && pi->video_stream->duration != AV_NOPTS_VALUE ?
 			pts_to_samples(pi->video_output.format.frame_rate, pi->video_stream->time_base, pi->video_stream->duration) : AV_NOPTS_VALUE;
 
 		pi->video_output.frame_size = pi->video_output.format.width * pi->video_output.format.height * 4; // TODO determine real size
 
 		if (DEBUG) {
-			printf("output: %"PRId64" length, %d frame_size\n", pi->video_output.length, pi->video_output.frame_size);
+			proxy_log(pi, PI_LOG_DEBUG, "output: %"PRId64" length, %d frame_size", pi->video_output.length, pi->video_output.frame_size);
 		}
 
 		if (pi->video_codec_ctx->codec->capabilities & AV_CODEC_CAP_DELAY) {
 			// When CODEC_CAP_DELAY is set, there is a delay between input and output of the decoder
-			printf("warning: cap delay!\n");
+			proxy_log(pi, PI_LOG_INFO, "warning: cap delay! (video decoder %s)", pi->video_codec_ctx->codec->name);
+		}
+	}
+
+	if (pi->mode & MODE_LOWMEM) {
+		// Keep only the instance description until the first read
+		lowmem_negotiate_frame_size(pi);
+		release_decoders(pi);
+	}
+
+	if (pi->mode & MODE_DISPATCH && (pi->dispatch = dispatch_start(pi)) == NULL) {
+		pi_set_error(pi, "cannot start the demux thread");
+		return pi;
+	}
+
+	return pi;
+}
+
+/*
+ * Opens the demuxer of the instance's source, which is either the file or the buffered IO
+ * callbacks. Returns 0 on success, or a negative AVERROR on error.
+ */
+static int open_input(ProxyInstance *pi)
+{
+	int ret;
+
+	if (pi->io_read_packet != NULL) {
+		const int buffer_size = pi->mode & MODE_LIVE ? LIVE_IO_BUFFER_SIZE : pi->mode & MODE_LOWMEM ? LOWMEM_IO_BUFFER_SIZE : 32 * 1024;
+		char *buffer;
+		AVIOContext *io_ctx;
+
+		// Allocate IO buffer for the AVIOContext. 
+		// Must later be freed by av_free() from AVIOContext.buffer (which could be the same or a replacement buffer).
+		buffer = av_malloc(buffer_size + AV_INPUT_BUFFER_PADDING_SIZE);
+
+		// Allocate the AVIOContext. Must later be freed by av_free().
+		// The callbacks are routed through the instance to collect I/O statistics.
+		io_ctx = avio_alloc_context(buffer, buffer_size, 0 /* not writeable */, pi, io_read_packet, NULL /* no write_packet needed */, pi->io_seek != NULL ? io_seek : NULL);
+
+		// Allocate and configure AVFormatContext. Must later bee freed by avformat_close_input().
+		pi->fmt_ctx = avformat_alloc_context();
+		pi->fmt_ctx->pb = io_ctx;
+
+		// NOTE format does not need to be probed manually, FFmpeg does the probing itself and does not crash anymore
+		// NOTE AVFMT_FLAG_CUSTOM_IO is automatically set by avformat_open_input, can be checked when closing the stream to free allocated resources
+	}
+	else if (pi->mode & MODE_LIVE) {
+		pi->fmt_ctx = avformat_alloc_context();
+	}
+
+	if (pi->mode & MODE_LIVE) {
+		configure_live_input(pi);
+	}
+
+	ret = avformat_open_input(&pi->fmt_ctx, pi->io_read_packet != NULL ? pi->io_filename : pi->source_filename, pi->input_format, NULL);
+	if (ret >= 0) {
+		// Remember the demuxer to skip the format probing when the input is reopened or cloned
+		pi->input_format = pi->fmt_ctx->iformat;
+	}
+
+	return ret;
+}
+
+/*
+ * Probes the opened input and opens the decoders and converters of the instance's streams.
+ * Returns 0 on success, or a negative number on error, which is set on the instance.
+ */
+static int open_decoders(ProxyInstance *pi)
+{
+	int ret;
+	const char *error;
+	int64_t probe_start;
+	int codec_flags = pi->mode & MODE_LIVE ? AV_CODEC_FLAG_LOW_DELAY : 0;
+	AVFormatContext *info_ctx = NULL;
+
+	// Known stream info of the same source makes probing unnecessary
+	if (pi->stream_info != NULL) {
+		info_ctx = pi->stream_info;
+	}
+	else if (pi->info_source != NULL) {
+		info_ctx = pi->info_source->released ? pi->info_source->stream_info : pi->info_source->fmt_ctx;
+	}
+
+	probe_start = timer_now_ns();
+	if (info_ctx == NULL || (ret = copy_stream_info(pi->fmt_ctx, info_ctx)) < 0) {
+		ret = avformat_find_stream_info(pi->fmt_ctx, NULL);
+	}
+	pi_trace(pi, TRACE_PROBE, probe_start, timer_now_ns(), pi->fmt_ctx->nb_streams);
+	if (ret < 0) {
+		pi_set_error(pi, "Could not find stream information");
+		return -1;
+	}
+
+	if (pi->mode & MODE_LOWMEM && pi->stream_info == NULL) {
+		// Keep the stream info, every reopening of the released input would have to probe it again otherwise
+		pi->stream_info = save_stream_info(pi->fmt_ctx);
+	}
+
+	if (pi->mode & TYPE_AUDIO) {
+		AVDictionary *options = NULL;
+		int decoder_path = ANALYSIS_PATH_FULL;
+
+		if (pi->mode & MODE_ANALYSIS && (ret = av_find_best_stream(pi->fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0)) >= 0) {
+			// Let the decoder skip the work that does not contribute to the analysis output
+			decoder_path = analysis_decoder_options(pi->fmt_ctx->streams[ret]->codecpar, &options);
+		}
+
+		// open audio stream
+		ret = open_codec_context(pi->fmt_ctx, &pi->audio_codec_ctx, AVMEDIA_TYPE_AUDIO, codec_flags, &options);
+		av_dict_free(&options);
+		if (ret < 0) {
+			pi_set_error(pi, "Cannot find audio stream");
+			return -1;
+		}
+
+		pi->audio_stream = pi->fmt_ctx->streams[ret];
+
+		if (pi->mode & MODE_ANALYSIS) {
+			/* initialize the analysis converter, which replaces the sample format converter */
+			if (pi->analysis == NULL) {
+				pi->analysis = analysis_create(FFMIN(pi->audio_codec_ctx->sample_rate, ANALYSIS_SAMPLE_RATE), decoder_path);
+				if (pi->analysis == NULL) {
+					pi_set_error(pi, "Cannot create the analysis converter");
+					return -1;
+				}
+			}
+		}
+		else {
+			/* initialize sample format converter */
+			pi->swr = create_audio_converter(pi->audio_codec_ctx);
+			pi->convert = select_audio_converter(pi->audio_codec_ctx);
+		}
+	}
+
+	if (pi->mode & TYPE_VIDEO) {
+		// open video stream
+		if ((ret = open_codec_context(pi->fmt_ctx, &pi->video_codec_ctx, AVMEDIA_TYPE_VIDEO, codec_flags, NULL)) < 0) {
+			pi_set_error(pi, "Cannot find video stream");
+			return -1;
+		}
+
+		pi->video_stream = pi->fmt_ctx->streams[ret];
+
+		/* Initialize video frame converter */
+		pi->swsf = swsload_get(&error);
+		if (pi->swsf == NULL) {
+			pi_set_error(pi, "%s", error);
+			return -1;
+		}
+		// PIX_FMT_BGR24 format needed by C# for correct color interpretation (PixelFormat.Format24bppRgb)
+		pi->sws = pi->swsf->get_context(pi->video_codec_ctx->width, pi->video_codec_ctx->height, pi->video_codec_ctx->pix_fmt, 
+			pi->video_codec_ctx->width, pi->video_codec_ctx->height, AV_PIX_FMT_BGR24, SWS_BICUBIC, NULL, NULL, NULL);
+		if (pi->sws == NULL) {
+			pi_set_error(pi, "error creating swscontext");
+			return -1;
+		}
+	}
+
+	if (pi->mode & MODE_LOWMEM) {
+		// Do not let the demuxer keep state of streams that are not decoded
+		for (unsigned int i = 0; i < pi->fmt_ctx->nb_streams; i++) {
+			AVStream *stream = pi->fmt_ctx->streams[i];
+			if (stream != pi->audio_stream && stream != pi->video_stream) {
+				stream->discard = AVDISCARD_ALL;
+			}
 		}
 	}
 
@@ -274,7 +509,102 @@ ProxyInstance *stream_open(ProxyInstance *pi)
 
 	pi->frame = av_frame_alloc();
 
-	return pi;
+	return 0;
+}
+
+/*
+ * Takes over the stream info that has been probed from the same source, which makes probing
+ * unnecessary. Returns 0 on success, or a negative number if the demuxer does not present the
+ * same streams as the source.
+ */
+static int copy_stream_info(AVFormatContext *fmt_ctx, AVFormatContext *source_ctx)
+{
+	if (source_ctx == NULL || source_ctx->nb_streams != fmt_ctx->nb_streams) {
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+		AVStream *stream = fmt_ctx->streams[i];
+		AVStream *source_stream = source_ctx->streams[i];
+
+		if (stream->codecpar->codec_type != source_stream->codecpar->codec_type
+			|| stream->codecpar->codec_id != source_stream->codecpar->codec_id) {
+			return -1;
+		}
+		if (avcodec_parameters_copy(stream->codecpar, source_stream->codecpar) < 0) {
+			return -1;
+		}
+		stream->time_base = source_stream->time_base;
+		stream->start_time = source_stream->start_time;
+		stream->duration = source_stream->duration;
+		stream->r_frame_rate = source_stream->r_frame_rate;
+		stream->avg_frame_rate = source_stream->avg_frame_rate;
+		stream->sample_aspect_ratio = source_stream->sample_aspect_ratio;
+	}
+
+	fmt_ctx->start_time = source_ctx->start_time;
+	fmt_ctx->duration = source_ctx->duration;
+	fmt_ctx->bit_rate = source_ctx->bit_rate;
+
+	return 0;
+}
+
+/*
+ * Copies the stream info of an opened input into a format context without input, from which
+ * copy_stream_info can restore it. Returns NULL on error.
+ */
+static AVFormatContext *save_stream_info(AVFormatContext *fmt_ctx)
+{
+	AVFormatContext *info_ctx = avformat_alloc_context();
+
+	if (info_ctx == NULL) {
+		return NULL;
+	}
+
+	for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+		AVStream *stream = avformat_new_stream(info_ctx, NULL);
+		if (stream == NULL) {
+			avformat_free_context(info_ctx);
+			return NULL;
+		}
+		stream->codecpar->codec_type = fmt_ctx->streams[i]->codecpar->codec_type;
+		stream->codecpar->codec_id = fmt_ctx->streams[i]->codecpar->codec_id;
+	}
+
+	if (copy_stream_info(info_ctx, fmt_ctx) < 0) {
+		avformat_free_context(info_ctx);
+		return NULL;
+	}
+
+	return info_ctx;
+}
+
+/*
+ * Closes the decoders, converters and the demuxer of the instance.
+ */
+static void close_input(ProxyInstance *pi)
+{
+	if (pi->fmt_ctx != NULL && (pi->fmt_ctx->flags & AVFMT_FLAG_CUSTOM_IO) != 0) {
+		// buffered stream IO mode
+		av_free(pi->fmt_ctx->pb->buffer);
+		av_free(pi->fmt_ctx->pb);
+	}
+	if (pi->sws != NULL) {
+		pi->swsf->free_context(pi->sws);
+		pi->sws = NULL;
+	}
+	av_packet_free(&pi->pkt);
+	av_frame_free(&pi->frame);
+	swr_free(&pi->swr);
+	pi->convert = NULL;
+	if (pi->analysis != NULL) {
+		analysis_reset(pi->analysis); // the reopened decoder starts over
+	}
+	avcodec_free_context(&pi->audio_codec_ctx);
+	avcodec_free_context(&pi->video_codec_ctx);
+	avformat_close_input(&pi->fmt_ctx);
+	pi->audio_stream = NULL;
+	pi->video_stream = NULL;
 }
 
 void *stream_get_output_config(ProxyInstance *pi, int type)
@@ -295,6 +625,7 @@ void *stream_get_output_config(ProxyInstance *pi, int type)
 int stream_read_frame_any(ProxyInstance *pi, int *got_frame, int *frame_type)
 {
 	int ret = 0;
+	int samples = 0;
 	int cached = 0;
 
 	*got_frame = 0;
@@ -302,7 +633,20 @@ int stream_read_frame_any(ProxyInstance *pi, int *got_frame, int *frame_type)
 
 	// if packet is empty, read new packet from stream
 	if (pi->pkt->size == 0) {
-		if ((ret = av_read_frame(pi->fmt_ctx, pi->pkt)) < 0) {
+		int64_t demux_start = timer_now_ns();
+		ret = av_read_frame(pi->fmt_ctx, pi->pkt);
+		int64_t demux_end = timer_now_ns();
+		pi->stats.demux_ns += demux_end - demux_start;
+		pi_trace(pi, TRACE_DEMUX, demux_start, demux_end, ret >= 0 ? pi->pkt->size : ret);
+
+		if (ret >= 0) {
+			if (pi->io_read_packet == NULL) {
+				atomic_int64_store(&pi->input_ns, demux_end);
+			}
+			pi->stats.packets_demuxed++;
+			pi->stats.bytes_demuxed += pi->pkt->size;
+		}
+		else {
 			// probably EOF, check for cached frames (e.g. SHN)
 			// TODO This means AV_CODEC_CAP_DELAY is likely set, handle accordingly:
 			// - Ideally stop reading, but continue feeding null packets and decoding.
@@ -311,20 +655,24 @@ int stream_read_frame_any(ProxyInstance *pi, int *got_frame, int *frame_type)
 			pi->pkt->data = NULL;
 			pi->pkt->size = 0;
 			cached = 1;
-			if (DEBUG) fprintf(stderr, "Reaching packet EOF, setting cached flag\n");
+			if (DEBUG) proxy_log(pi, PI_LOG_DEBUG, "Reaching packet EOF, setting cached flag");
 		}
 
 		if (DEBUG && ret == AVERROR_EOF) {
-			fprintf(stderr, "Packet EOF\n");
+			proxy_log(pi, PI_LOG_DEBUG, "Packet EOF");
 		}
 
 		if (pi->mode & TYPE_AUDIO && (pi->pkt->stream_index == pi->audio_stream->index || cached)) {
-			if (DEBUG && cached) fprintf(stderr, "Feeding empty EOF packet to audio decoder\n");
+			if (DEBUG && cached) proxy_log(pi, PI_LOG_DEBUG, "Feeding empty EOF packet to audio decoder");
+			int64_t decode_start = timer_now_ns();
 			ret = avcodec_send_packet(pi->audio_codec_ctx, pi->pkt);
+			int64_t decode_end = timer_now_ns();
+			pi->stats.decode_ns += decode_end - decode_start;
+			pi_trace(pi, TRACE_DECODE, decode_start, decode_end, pi->pkt->size);
 			if (ret < 0) {
-				fprintf(stderr, "Error sending audio packet to decoder (%s)\n", av_err2str(ret));
+				proxy_log(pi, PI_LOG_ERROR, "Error sending audio packet to decoder (%s)", av_err2str(ret));
 				if (ret == AVERROR_EOF) {
-					fprintf(stderr, "Audio EOF coming up??\n");
+					proxy_log(pi, PI_LOG_WARNING, "Audio EOF coming up??");
 				}
 				else {
 					return ret;
@@ -332,12 +680,16 @@ int stream_read_frame_any(ProxyInstance *pi, int *got_frame, int *frame_type)
 			}
 		}
 		else if (pi->mode & TYPE_VIDEO && (pi->pkt->stream_index == pi->video_stream->index || cached)) {
-			if (DEBUG && cached) fprintf(stderr, "Feeding empty EOF packet to video decoder\n");
+			if (DEBUG && cached) proxy_log(pi, PI_LOG_DEBUG, "Feeding empty EOF packet to video decoder");
+			int64_t decode_start = timer_now_ns();
 			ret = avcodec_send_packet(pi->video_codec_ctx, pi->pkt);
+			int64_t decode_end = timer_now_ns();
+			pi->stats.decode_ns += decode_end - decode_start;
+			pi_trace(pi, TRACE_DECODE, decode_start, decode_end, pi->pkt->size);
 			if (ret < 0) {
-				fprintf(stderr, "Error sending video packet to decoder (%s)\n", av_err2str(ret));
+				proxy_log(pi, PI_LOG_ERROR, "Error sending video packet to decoder (%s)", av_err2str(ret));
 				if (ret == AVERROR_EOF) {
-					fprintf(stderr, "Video EOF coming up??\n");
+					proxy_log(pi, PI_LOG_WARNING, "Video EOF coming up??");
 				}
 				else {
 					return ret;
@@ -346,22 +698,30 @@ int stream_read_frame_any(ProxyInstance *pi, int *got_frame, int *frame_type)
 		}
 		else {
 			// Skip to next packet by signalling that the packet was completely read
+			pi->stats.packets_discarded++;
+			pi->stats.bytes_discarded += pi->pkt->size;
 			pi->pkt->size = 0;
 		}
 	}
 
+	int64_t decode_start = timer_now_ns();
 	if (pi->mode & TYPE_AUDIO) {
 		ret = decode_audio_packet(pi, got_frame, cached);
 		if (*got_frame) {
 			*frame_type = TYPE_AUDIO;
+			pi->stats.audio_frames_decoded++;
 		}
 	}
 	if (!*got_frame && pi->mode & TYPE_VIDEO) {
 		ret = decode_video_packet(pi, got_frame, cached);
 		if (*got_frame) {
 			*frame_type = TYPE_VIDEO;
+			pi->stats.video_frames_decoded++;
 		}
 	}
+	int64_t decode_end = timer_now_ns();
+	pi->stats.decode_ns += decode_end - decode_start;
+	pi_trace(pi, TRACE_DECODE, decode_start, decode_end, *frame_type);
 	
 	
 	if (ret < 0) {
@@ -378,11 +738,11 @@ int stream_read_frame_any(ProxyInstance *pi, int *got_frame, int *frame_type)
 		pi->pkt->size = 0;
 	}
 
-	if (*frame_type == TYPE_AUDIO && convert_audio_samples(pi) < 0) {
+	if (*frame_type == TYPE_AUDIO && (samples = convert_audio_samples(pi, pi->frame, pi->output_buffer, pi->output_buffer_size)) < 0) {
 		av_packet_unref(pi->pkt);
 		return -1; // conversion failed, signal EOF
 	}
-	else if (*frame_type == TYPE_VIDEO && convert_video_frame(pi) < 0) {
+	else if (*frame_type == TYPE_VIDEO && convert_video_frame(pi, pi->frame, pi->output_buffer) < 0) {
 		av_packet_unref(pi->pkt);
 		return -1; // conversion failed, signal EOF
 	}
@@ -405,7 +765,7 @@ int stream_read_frame_any(ProxyInstance *pi, int *got_frame, int *frame_type)
 	 * All "sizes" in the API are in samples, none in bytes.
 	 */
 	if (*frame_type == TYPE_AUDIO) {
-		return pi->frame->nb_samples;
+		return samples; // differs from the decoded samples in MODE_ANALYSIS
 	}
 	else if (*frame_type == TYPE_VIDEO) {
 		return 1; // signal decoding of 1 frame
@@ -450,6 +810,63 @@ void update_position_and_get_timestamp(AVFrame *frame, double sample_rate, AVRat
  * Read the next desired frame, skipping other frame types in between.
  */
 int stream_read_frame(ProxyInstance *pi, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size, int *frame_type)
+{
+	if (pi->dispatch != NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "frames of a dispatch mode instance must be read with stream_read_typed_frame");
+		return -1;
+	}
+
+	pi->last_access_ns = timer_now_ns();
+
+	if (pi->cache != NULL && !pi->cache_bypass) {
+		return cache_read_frame(pi, timestamp, output_buffer, output_buffer_size, frame_type);
+	}
+
+	return read_frame(pi, timestamp, output_buffer, output_buffer_size, frame_type);
+}
+
+/*
+ * Decodes the next desired frame, reopening released decoders and dropping the samples
+ * before pi->skip_until that have already been returned before the decoder was
+ * repositioned internally.
+ */
+static int read_frame(ProxyInstance *pi, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size, int *frame_type)
+{
+	int ret;
+
+	if (pi->released && acquire_decoders(pi, 1) < 0) {
+		return -1;
+	}
+
+	while (1) {
+		ret = decode_frame(pi, timestamp, output_buffer, output_buffer_size, frame_type);
+		if (ret <= 0 || pi->skip_until == AV_NOPTS_VALUE || *frame_type != pi->skip_type) {
+			return ret;
+		}
+
+		if (*timestamp + ret <= pi->skip_until) {
+			continue; // already returned
+		}
+
+		if (*timestamp < pi->skip_until && *frame_type == TYPE_AUDIO) {
+			// Drop the leading samples that have already been returned
+			int block_size = pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+			int skip = (int)(pi->skip_until - *timestamp);
+			memmove(output_buffer, output_buffer + skip * block_size, (ret - skip) * block_size);
+			*timestamp = pi->skip_until;
+			ret -= skip;
+		}
+
+		pi->skip_until = AV_NOPTS_VALUE;
+
+		return ret;
+	}
+}
+
+/*
+ * Decodes the next desired frame.
+ */
+static int decode_frame(ProxyInstance *pi, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size, int *frame_type)
 {
 	int ret;
 	int got_frame;
@@ -464,6 +881,10 @@ int stream_read_frame(ProxyInstance *pi, int64_t *timestamp, uint8_t *output_buf
 			if (*frame_type == TYPE_AUDIO) {
 				update_position_and_get_timestamp(pi->frame, pi->audio_output.format.sample_rate, pi->audio_stream->time_base,
 					ret, &pi->audio_output.sample_position, timestamp);
+				if (pi->primed_position == INT64_MAX && ret > 0) {
+					// The first frame after a seek, the decoder reaches a steady state after the pre-roll
+					pi->primed_position = *timestamp + seek_preroll(pi);
+				}
 			}
 			else if (*frame_type == TYPE_VIDEO) {
 				update_position_and_get_timestamp(pi->frame, pi->video_output.format.frame_rate, pi->video_stream->time_base,
@@ -473,16 +894,82 @@ int stream_read_frame(ProxyInstance *pi, int64_t *timestamp, uint8_t *output_buf
 				pi->video_output.current_frame.interlaced = (pi->frame->flags & AV_FRAME_FLAG_INTERLACED) != 0;
 				pi->video_output.current_frame.top_field_first = (pi->frame->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST) != 0;
 			}
+
+			// Count the frames that need to be decoded after a seek until the seek target is reached
+			if (pi->seek_target != AV_NOPTS_VALUE && got_frame && *frame_type == pi->seek_target_type) {
+				if (*timestamp + FFMAX(ret, 1) <= pi->seek_target) {
+					pi->stats.seek_preroll_frames++;
+				}
+				else {
+					pi->seek_target = AV_NOPTS_VALUE;
+				}
+			}
+
 			return ret;
 		}
 	}
 }
 
-void stream_seek(ProxyInstance *pi, int64_t timestamp, int type)
+int stream_seek(ProxyInstance *pi, int64_t timestamp, int type)
+{
+	if (pi->mode & MODE_LIVE) {
+		proxy_log(pi, PI_LOG_WARNING, "cannot seek in a live stream");
+		return -1;
+	}
+
+	if (pi->dispatch != NULL) {
+		// Stop demuxing and decoding of both types while the demuxer is repositioned
+		int ret;
+		dispatch_pause(pi->dispatch);
+		pi->stats.seeks++;
+		ret = seek_decoder(pi, timestamp, type);
+		pi->seek_target = AV_NOPTS_VALUE; // preroll frames are not counted
+		dispatch_resume(pi->dispatch);
+		return ret;
+	}
+
+	pi->stats.seeks++;
+	pi->last_access_ns = timer_now_ns();
+
+	if (pi->reverse != NULL) {
+		// Reverse reading continues backwards from the seek target
+		reverse_reset(pi->reverse, timestamp);
+	}
+
+	if (pi->cache != NULL && !pi->cache_bypass && type == (pi->mode & TYPE_MASK)) {
+		FrameCacheEntry *entry = framecache_find(pi->cache, timestamp);
+
+		if (entry != NULL) {
+			// Serve the following reads from the cache, the decoder is positioned on the first miss
+			pi->cache_next = entry->timestamp;
+			pi->cache_synced = 0;
+			pi->seek_target = AV_NOPTS_VALUE;
+			return 0;
+		}
+
+		pi->cache_synced = 1;
+	}
+
+	return seek_decoder(pi, timestamp, type);
+}
+
+/*
+ * Positions the demuxer and decoder before the given timestamp. Returns 0 on success,
+ * or a negative number on error.
+ */
+static int seek_decoder(ProxyInstance *pi, int64_t timestamp, int type)
 {
 	AVStream *seek_stream;
 	double sample_rate;
 	SeekIndex *seekindex;
+	int64_t target = timestamp;
+	int64_t seek_start = timer_now_ns();
+	int ret;
+
+	if (pi->released && acquire_decoders(pi, 0) < 0) {
+		return -1;
+	}
+	pi->skip_until = AV_NOPTS_VALUE;
 
 	if (pi->mode & TYPE_AUDIO && type == TYPE_AUDIO) {
 		seek_stream = pi->audio_stream;
@@ -495,8 +982,8 @@ void stream_seek(ProxyInstance *pi, int64_t timestamp, int type)
 		seekindex = pi->video_seekindex;
 	}
 	else {
-		fprintf(stderr, "unsupported seek stream type %d\n", type);
-		exit(1);
+		proxy_log(pi, PI_LOG_ERROR, "unsupported seek stream type %d", type);
+		return -1;
 	}
 
 	// convert sample time to time_base time
@@ -505,8 +992,9 @@ void stream_seek(ProxyInstance *pi, int64_t timestamp, int type)
 	if (seekindex != NULL) {
 		int64_t index_timestamp;
 		if (seekindex_find(seekindex, timestamp, &index_timestamp) == 0) {
-			printf("adjusting seek timestamp by index: %"PRId64" -> %"PRId64"\n", timestamp, index_timestamp);
+			proxy_log(pi, PI_LOG_DEBUG, "adjusting seek timestamp by index: %"PRId64" -> %"PRId64, timestamp, index_timestamp);
 			timestamp = index_timestamp;
+			pi->stats.seeks_index_adjusted++;
 		}
 	}
 
@@ -537,23 +1025,81 @@ void stream_seek(ProxyInstance *pi, int64_t timestamp, int type)
 	// first packet. When opening a file and reading the packets, the first packet
 	// is read, but when seeking, the first packet cannot be reached and the first
 	// read packet is actually the second packet.
-	av_seek_frame(pi->fmt_ctx, seek_stream->index, timestamp, AVSEEK_FLAG_BACKWARD);
-	
-	// flush codec
-	if (pi->mode & TYPE_AUDIO) avcodec_flush_buffers(pi->audio_codec_ctx);
+	ret = av_seek_frame(pi->fmt_ctx, seek_stream->index, timestamp, AVSEEK_FLAG_BACKWARD);
+	if (ret < 0) {
+		// Not an error, the decoder continues at the current position like before the seek
+		proxy_log(pi, PI_LOG_WARNING, "seek to %"PRId64" failed (%s)", timestamp, av_err2str(ret));
+	}
+
+	// flush codec
+	if (pi->mode & TYPE_AUDIO) avcodec_flush_buffers(pi->audio_codec_ctx);
+	if (pi->analysis != NULL) analysis_reset(pi->analysis);
 	if (pi->mode & TYPE_VIDEO) avcodec_flush_buffers(pi->video_codec_ctx);
+	if (pi->tracks != NULL) tracks_flush(pi->tracks);
 
 	// avcodec_flush_buffers invalidates the packet reference
 	pi->pkt->data = NULL;
 	pi->pkt->size = 0;
+
+	pi->seek_target = target;
+	pi->seek_target_type = type;
+	pi->primed_position = INT64_MAX;
+	pi_trace(pi, TRACE_SEEK, seek_start, timer_now_ns(), target);
+
+	return 0;
+}
+
+/*
+ * Positions the decoder to continue exactly at the given position, e.g. where reading stopped
+ * before the decoder was repositioned internally. For audio, decoding starts a pre-roll earlier
+ * to bring the decoder into a steady state (e.g. MDCT overlap, MP3 bit reservoir), and
+ * read_frame drops the samples before the position. Returns 0 on success, or a negative
+ * number on error.
+ */
+static int seek_decoder_exact(ProxyInstance *pi, int64_t position, int type)
+{
+	int64_t target = position;
+
+	if (type == TYPE_AUDIO) {
+		target -= seek_preroll(pi);
+		if (target < 0 && position >= 0) {
+			target = 0; // do not seek before the start of the stream
+		}
+	}
+
+	if (seek_decoder(pi, target, type) < 0) {
+		return -1;
+	}
+	pi->skip_until = position;
+	pi->skip_type = type;
+
+	return 0;
+}
+
+/*
+ * Returns the number of audio samples to decode before a position to get primed output at
+ * it, the same pre-roll that segmented decoding and the window fetches use.
+ */
+static int64_t seek_preroll(ProxyInstance *pi)
+{
+	return pi->audio_output.format.sample_rate / 5 + pi->audio_stream->codecpar->seek_preroll;
 }
 
 void stream_seekindex_create(ProxyInstance *pi, int type) {
+	if (pi->dispatch != NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "seek index creation is not supported in dispatch mode");
+		return;
+	}
+
 	// Remove previous index
 	stream_seekindex_remove(pi, type);
 
+	// Do not flood the frame cache with the whole stream
+	int cache_bypass = pi->cache_bypass;
+	pi->cache_bypass = 1;
+
 	// Seek to beginning of stream
-	stream_seek(pi, 0, pi->mode == TYPE_VIDEO ? TYPE_VIDEO : TYPE_AUDIO);
+	stream_seek(pi, 0, (pi->mode & TYPE_MASK) == TYPE_VIDEO ? TYPE_VIDEO : TYPE_AUDIO);
 
 	if (type & TYPE_AUDIO) {
 		pi->audio_seekindex = seekindex_build();
@@ -586,6 +1132,9 @@ void stream_seekindex_create(ProxyInstance *pi, int type) {
 	if (type & TYPE_VIDEO) {
 		seekindex_build_finalize(pi->video_seekindex);
 	}
+
+	pi->cache_bypass = cache_bypass;
+	pi->cache_synced = 1;
 }
 
 void stream_seekindex_remove(ProxyInstance *pi, int type) {
@@ -599,6 +1148,402 @@ void stream_seekindex_remove(ProxyInstance *pi, int type) {
 	}
 }
 
+/*
+ * Enables a cache of decoded output frames with the given budget in bytes, or disables it
+ * with a budget of 0. Seeks into cached regions, and the reads that follow, are served from
+ * the cache without seeking and decoding, as long as the frames are cached. This speeds up
+ * editing workloads that visit the same regions over and over. Audio that is decoded after a
+ * seek is only cached once the decoder has decoded a pre-roll, so cached frames are identical
+ * to a continuous decode. The cache is only supported for instances that decode a single type.
+ * Returns 0 on success, or a negative number on error.
+ */
+int stream_cache_enable(ProxyInstance *pi, int64_t budget)
+{
+	int type = pi->mode & TYPE_MASK;
+
+	if (pi->cache != NULL) {
+		framecache_free(pi->cache);
+		pi->cache = NULL;
+	}
+
+	if (budget <= 0) {
+		return 0;
+	}
+
+	if (type != TYPE_AUDIO && type != TYPE_VIDEO) {
+		proxy_log(pi, PI_LOG_ERROR, "frame cache requires an instance that decodes a single type");
+		return -1;
+	}
+	if (pi->dispatch != NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "frame cache is not supported in dispatch mode");
+		return -1;
+	}
+
+	if ((pi->cache = framecache_create(budget)) == NULL) {
+		return -2;
+	}
+	pi->cache_synced = 1;
+
+	return 0;
+}
+
+/*
+ * Reads the next frame through the frame cache. After a seek that hit the cache, frames are
+ * served from the cache for as long as they are cached. At the first frame that is not cached,
+ * the decoder is positioned a pre-roll before it, and decoding continues seamlessly from there,
+ * adding decoded frames to the cache.
+ */
+static int cache_read_frame(ProxyInstance *pi, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size, int *frame_type)
+{
+	int type = pi->mode & TYPE_MASK;
+	int block_size = type == TYPE_AUDIO ? pi->audio_output.format.channels * pi->audio_output.format.sample_size : 0;
+	int ret;
+
+	if (!pi->cache_synced) {
+		FrameCacheEntry *entry = framecache_get(pi->cache, pi->cache_next);
+
+		if (entry != NULL && entry->size <= output_buffer_size) {
+			memcpy(output_buffer, entry->data, entry->size);
+			*timestamp = entry->timestamp;
+			*frame_type = type;
+
+			if (type == TYPE_AUDIO) {
+				pi->audio_output.sample_position = entry->timestamp + entry->length;
+			}
+			else {
+				pi->video_output.sample_position = entry->timestamp + entry->length;
+				pi->video_output.current_frame.keyframe = entry->info[0];
+				pi->video_output.current_frame.pict_type = entry->info[1];
+				pi->video_output.current_frame.interlaced = entry->info[2];
+				pi->video_output.current_frame.top_field_first = entry->info[3];
+			}
+
+			pi->cache_next = entry->timestamp + entry->length;
+			pi->stats.cache_hits++;
+
+			return entry->length;
+		}
+
+		// Resume decoding at the first frame that is not cached, the frames before have already been served from the cache
+		pi->stats.cache_misses++;
+		if (seek_decoder_exact(pi, pi->cache_next, type) < 0) {
+			return -1;
+		}
+		pi->cache_synced = 1;
+	}
+
+	ret = read_frame(pi, timestamp, output_buffer, output_buffer_size, frame_type);
+	if (ret <= 0) {
+		return ret;
+	}
+
+	if (type == TYPE_AUDIO) {
+		// Audio that is decoded without pre-roll after a seek differs from a continuous decode
+		if (*timestamp >= pi->primed_position) {
+			framecache_put(pi->cache, *timestamp, ret, output_buffer, ret * block_size, NULL);
+		}
+	}
+	else {
+		int info[FRAMECACHE_INFO_SIZE] = {
+			pi->video_output.current_frame.keyframe,
+			pi->video_output.current_frame.pict_type,
+			pi->video_output.current_frame.interlaced,
+			pi->video_output.current_frame.top_field_first,
+		};
+		framecache_put(pi->cache, *timestamp, ret, output_buffer, FFMIN(output_buffer_size, pi->video_output.frame_size), info);
+	}
+
+	return ret;
+}
+
+/*
+ * Checks whether the instance can release its decoders and demuxer and reopen them later, which
+ * requires a seekable source and a single decoded stream.
+ */
+static int lowmem_supported(ProxyInstance *pi)
+{
+	int type = pi->mode & TYPE_MASK;
+
+	if (pi->mode & MODE_LIVE || (pi->io_read_packet != NULL && pi->io_seek == NULL)) {
+		proxy_log(pi, PI_LOG_WARNING, "low-footprint mode requires a seekable source, ignoring");
+		return 0;
+	}
+	if (type != TYPE_AUDIO && type != TYPE_VIDEO) {
+		proxy_log(pi, PI_LOG_WARNING, "low-footprint mode requires a single stream type, ignoring");
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Replaces the default audio frame size of 1 second with the size that the stream actually
+ * needs, which is determined from the frames at the beginning of the stream. Because frames
+ * can vary in size (e.g. Vorbis, Opus), the largest probed frame is doubled as headroom.
+ * A frame that nevertheless exceeds the frame size ends decoding with an error.
+ */
+static void lowmem_negotiate_frame_size(ProxyInstance *pi)
+{
+	int max_samples = pi->audio_stream != NULL ? pi->audio_stream->codecpar->frame_size : 0;
+	int got_frame, frame_type;
+	uint8_t *buffer;
+
+	if (!(pi->mode & TYPE_AUDIO)) {
+		return;
+	}
+
+	buffer = malloc((size_t)pi->audio_output.frame_size * pi->audio_output.format.channels * pi->audio_output.format.sample_size);
+	if (buffer == NULL) {
+		return;
+	}
+
+	pi->output_buffer = buffer;
+	pi->output_buffer_size = pi->audio_output.frame_size * pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+	for (int frames = 0; frames < LOWMEM_PROBE_FRAMES; ) {
+		int ret = stream_read_frame_any(pi, &got_frame, &frame_type);
+		if (ret < 0) {
+			break;
+		}
+		if (got_frame) {
+			max_samples = FFMAX(max_samples, ret);
+			frames++;
+		}
+	}
+	pi->output_buffer = NULL;
+	pi->output_buffer_size = 0;
+	free(buffer);
+
+	if (max_samples > 0) {
+		pi->audio_output.frame_size = FFMIN(max_samples * 2, pi->audio_output.frame_size);
+	}
+}
+
+/*
+ * Closes the decoders and the demuxer, keeping only the description of the instance and the
+ * stream info. They are reopened by acquire_decoders on the next read or seek, without probing
+ * the source again.
+ */
+static void release_decoders(ProxyInstance *pi)
+{
+	int type = pi->mode & TYPE_MASK;
+
+	if (pi->released) {
+		return;
+	}
+
+	// Remember the position to continue reading from, unless nothing has been read yet
+	if (pi->resume_position != AV_NOPTS_VALUE || pi->last_access_ns != 0) {
+		pi->resume_position = type == TYPE_AUDIO ? pi->audio_output.sample_position : pi->video_output.sample_position;
+	}
+
+	close_input(pi);
+	pi->released = 1;
+}
+
+/*
+ * Reopens the released demuxer and decoders. With resume, the decoder is positioned at the
+ * read position where the instance was released, after decoding a pre-roll. Returns 0 on
+ * success, or a negative number on error.
+ */
+int acquire_decoders(ProxyInstance *pi, int resume)
+{
+	int type = pi->mode & TYPE_MASK;
+	int ret;
+
+	if (pi->io_read_packet != NULL) {
+		// The demuxer expects the source at its start
+		pi->io_seek(pi->io_opaque, 0, SEEK_SET);
+	}
+
+	if ((ret = open_input(pi)) < 0) {
+		pi_set_error(pi, "Could not reopen source: %s", av_err2str(ret));
+		return -1;
+	}
+	if (open_decoders(pi) < 0) {
+		return -1;
+	}
+	pi->released = 0;
+	pi->primed_position = INT64_MIN; // decoding starts at the beginning of the stream
+
+	if (resume && pi->resume_position != AV_NOPTS_VALUE) {
+		// Continue with primed output, the samples before the position have already been returned
+		if (seek_decoder_exact(pi, pi->resume_position, type) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the ANALYSIS_PATH_* flags of the reductions that an instance in MODE_ANALYSIS uses,
+ * or a negative number if the instance is not in analysis mode. The decoder reductions are
+ * known after opening, the resampling and mixing after the first decoded frame.
+ */
+int stream_get_analysis_path(ProxyInstance *pi)
+{
+	if (pi->analysis == NULL) {
+		return -1;
+	}
+
+	return pi->analysis->path;
+}
+
+/*
+ * Releases the decoders and the demuxer of a low-footprint instance (MODE_LOWMEM), which
+ * reduces its memory use to a few KB. They are transparently reopened by the next read or
+ * seek, and reading continues at the same position. Returns 1 if the instance has been
+ * released, or 0 if it cannot be released.
+ */
+int stream_release(ProxyInstance *pi)
+{
+	if (!(pi->mode & MODE_LOWMEM) || pi->tracks != NULL || pi->live != NULL || pi_has_error(pi)) {
+		return 0;
+	}
+
+	release_decoders(pi);
+
+	return 1;
+}
+
+/*
+ * Releases a low-footprint instance like stream_release, but only if it has not been read or
+ * sought for the given time. Meant to be called periodically for all open instances.
+ */
+int stream_release_idle(ProxyInstance *pi, int idle_ms)
+{
+	if (pi->released || timer_now_ns() - pi->last_access_ns < (int64_t)idle_ms * 1000000) {
+		return 0;
+	}
+
+	return stream_release(pi);
+}
+
+/*
+ * Returns the memory in bytes that is currently held by the buffers of the instance. The
+ * internal state of the FFmpeg demuxer and decoders is not accessible and not included.
+ */
+int64_t stream_get_memory_usage(ProxyInstance *pi)
+{
+	int64_t size = sizeof(ProxyInstance);
+
+	if (pi->fmt_ctx != NULL && pi->fmt_ctx->pb != NULL) {
+		size += pi->fmt_ctx->pb->buffer_size;
+	}
+	if (pi->pkt != NULL) {
+		size += sizeof(AVPacket) + (pi->pkt->buf != NULL ? pi->pkt->buf->size : 0);
+	}
+	if (pi->frame != NULL) {
+		size += sizeof(AVFrame);
+		for (int i = 0; i < AV_NUM_DATA_POINTERS && pi->frame->buf[i] != NULL; i++) {
+			size += pi->frame->buf[i]->size;
+		}
+	}
+	if (pi->stream_info != NULL) {
+		size += sizeof(AVFormatContext);
+		for (unsigned int i = 0; i < pi->stream_info->nb_streams; i++) {
+			size += sizeof(AVStream) + sizeof(AVCodecParameters) + pi->stream_info->streams[i]->codecpar->extradata_size;
+		}
+	}
+	if (pi->audio_seekindex != NULL) {
+		size += sizeof(SeekIndex) + pi->audio_seekindex->size * sizeof(int64_t);
+	}
+	if (pi->video_seekindex != NULL) {
+		size += sizeof(SeekIndex) + pi->video_seekindex->size * sizeof(int64_t);
+	}
+	if (pi->cache != NULL) {
+		size += sizeof(FrameCache) + pi->cache->capacity * sizeof(FrameCacheEntry *) + pi->cache->size
+			+ pi->cache->count * sizeof(FrameCacheEntry);
+	}
+	if (pi->trace != NULL) {
+		size += sizeof(Trace) + pi->trace->capacity * sizeof(TraceEvent);
+	}
+	if (pi->tracks != NULL) {
+		size += sizeof(TrackSet) + pi->tracks->count * sizeof(AudioTrack) + pi->tracks->buffer_size;
+	}
+	if (pi->dispatch != NULL) {
+		size += dispatch_get_memory_usage(pi->dispatch);
+	}
+	if (pi->reverse != NULL) {
+		size += sizeof(ReverseReader) + pi->reverse->capacity * sizeof(ReverseFrame) + pi->reverse->size + pi->reverse->buffer_size;
+	}
+
+	return size;
+}
+
+/*
+ * Copies the cumulative performance counters of the instance into the given struct.
+ */
+void stream_get_stats(ProxyInstance *pi, ProxyStats *stats)
+{
+	if (pi->live != NULL) {
+		live_get_stats(pi->live, stats); // counted by the live worker
+		return;
+	}
+	*stats = pi->stats;
+	if (pi->dispatch != NULL) {
+		dispatch_add_stats(pi->dispatch, stats); // counted per thread, demuxing and decoding run concurrently
+	}
+}
+
+void stream_reset_stats(ProxyInstance *pi)
+{
+	if (pi->live != NULL) {
+		live_reset_stats(pi->live);
+		return;
+	}
+	memset(&pi->stats, 0, sizeof(ProxyStats));
+	if (pi->dispatch != NULL) {
+		dispatch_reset_stats(pi->dispatch);
+	}
+}
+
+/*
+ * Starts recording a trace event timeline that keeps the given number of most recent
+ * events (0 for the default capacity), replacing a previously recorded timeline.
+ * Returns 0 on success, or a negative number if the trace buffer cannot be allocated.
+ */
+int stream_trace_start(ProxyInstance *pi, int capacity)
+{
+	stream_trace_stop(pi);
+	pi->trace = trace_create(capacity);
+
+	return pi->trace != NULL ? 0 : -1;
+}
+
+void stream_trace_stop(ProxyInstance *pi)
+{
+	if (pi->trace != NULL) {
+		trace_free(pi->trace);
+		pi->trace = NULL;
+	}
+}
+
+/*
+ * Writes the recorded timeline to a file in the Chrome trace event format. Returns the
+ * number of written events, or a negative number if tracing is disabled or the file
+ * cannot be written.
+ */
+int stream_trace_dump(ProxyInstance *pi, char *filename)
+{
+	FILE *f;
+	int count;
+
+	if (pi->trace == NULL) {
+		return -1;
+	}
+
+	if ((f = fopen(filename, "w")) == NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "Could not open trace file %s", filename);
+		return -2;
+	}
+
+	count = trace_dump(pi->trace, f, pi->source_filename);
+	fclose(f);
+
+	return count;
+}
+
 void stream_close(ProxyInstance *pi)
 {
 	pi_free(&pi);
@@ -627,18 +1572,51 @@ static int pi_init(ProxyInstance **pi) {
 
 	_pi->state = PI_STATE_OK;
 	_pi->error_message = NULL;
+	_pi->source_filename = NULL;
 	_pi->fmt_ctx = NULL;
+	_pi->input_format = NULL;
+	_pi->info_source = NULL;
+	_pi->stream_info = NULL;
 	_pi->audio_stream = NULL;
 	_pi->video_stream = NULL;
 	_pi->audio_codec_ctx = NULL;
 	_pi->video_codec_ctx = NULL;
+	_pi->pkt = NULL;
 	_pi->frame = NULL;
 	_pi->swr = NULL;
+	_pi->convert = NULL;
 	_pi->sws = NULL;
 	_pi->output_buffer_size = 0;
 	_pi->output_buffer = NULL;
 	_pi->audio_seekindex = NULL;
 	_pi->video_seekindex = NULL;
+	_pi->io_opaque = NULL;
+	_pi->io_read_packet = NULL;
+	_pi->io_seek = NULL;
+	_pi->io_filename = NULL;
+	memset(&_pi->stats, 0, sizeof(ProxyStats));
+	_pi->seek_target = AV_NOPTS_VALUE;
+	_pi->seek_target_type = TYPE_NONE;
+	_pi->trace = NULL;
+	_pi->log_callback = NULL;
+	_pi->log_opaque = NULL;
+	_pi->tracks = NULL;
+	_pi->cache = NULL;
+	_pi->cache_next = AV_NOPTS_VALUE;
+	_pi->cache_synced = 1;
+	_pi->cache_bypass = 0;
+	_pi->primed_position = INT64_MIN;
+	_pi->pcmcache = NULL;
+	_pi->live = NULL;
+	_pi->dispatch = NULL;
+	_pi->reverse = NULL;
+	_pi->input_ns = 0;
+	_pi->released = 0;
+	_pi->resume_position = AV_NOPTS_VALUE;
+	_pi->last_access_ns = 0;
+	_pi->skip_until = AV_NOPTS_VALUE;
+	_pi->skip_type = TYPE_NONE;
+	_pi->analysis = NULL;
 
 	return 0;
 }
@@ -649,26 +1627,41 @@ static int pi_init(ProxyInstance **pi) {
 static void pi_free(ProxyInstance **pi) {
 	ProxyInstance *_pi = *pi;
 
+	if (_pi->live != NULL) {
+		live_stop(_pi->live);
+		_pi->live = NULL;
+	}
+	if (_pi->dispatch != NULL) {
+		dispatch_stop(_pi->dispatch);
+		_pi->dispatch = NULL;
+	}
+	if (_pi->reverse != NULL) {
+		reverse_free(_pi->reverse);
+		_pi->reverse = NULL;
+	}
+	stream_pcmcache_stop(_pi);
 	stream_seekindex_remove(_pi, TYPE_AUDIO | TYPE_VIDEO);
+	stream_trace_stop(_pi);
+	if (_pi->tracks != NULL) {
+		tracks_free(_pi->tracks);
+	}
+	if (_pi->cache != NULL) {
+		framecache_free(_pi->cache);
+	}
 
 	/* close & free FFmpeg stuff */
-	if (_pi->fmt_ctx != NULL && (_pi->fmt_ctx->flags & AVFMT_FLAG_CUSTOM_IO) != 0) {
-		// buffered stream IO mode
-		av_free(_pi->fmt_ctx->pb->buffer);
-		av_free(_pi->fmt_ctx->pb);
+	close_input(_pi);
+	if (_pi->stream_info != NULL) {
+		avformat_free_context(_pi->stream_info);
 	}
-	if (_pi->mode & TYPE_VIDEO) {
-		sws_freeContext(_pi->sws);
+	if (_pi->analysis != NULL) {
+		analysis_free(_pi->analysis);
 	}
-	av_packet_free(&_pi->pkt);
-	av_frame_free(&_pi->frame);
-	swr_free(&_pi->swr);
-	avcodec_free_context(&_pi->audio_codec_ctx);
-	avcodec_free_context(&_pi->video_codec_ctx);
-	avformat_close_input(&_pi->fmt_ctx);
 
 	/* free instance data */
 	free(_pi->error_message);
+	free(_pi->source_filename);
+	free(_pi->io_filename);
 	free(_pi);
 }
 
@@ -687,8 +1680,8 @@ static void pi_set_error(ProxyInstance *pi, const char* fmt, ...)
 	pi->state = PI_STATE_ERROR;
 	pi->error_message = error_message;
 
-	// Also print error to error output
-	fprintf(stderr, "%s\n", pi->error_message);
+	// Also log the error
+	proxy_log(pi, PI_LOG_ERROR, "%s", pi->error_message);
 }
 
 static int pi_has_error(ProxyInstance *pi)
@@ -699,123 +1692,184 @@ static int pi_has_error(ProxyInstance *pi)
 	return 0;
 }
 
-static void info(AVFormatContext *fmt_ctx)
+static void info(ProxyInstance *pi)
 {
-	printf("%d stream(s) found:\n", fmt_ctx->nb_streams);
+	AVFormatContext *fmt_ctx = pi->fmt_ctx;
+
+	proxy_log(pi, PI_LOG_DEBUG, "%d stream(s) found:", fmt_ctx->nb_streams);
 
 	for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
 		// print stream info
 		// http://ffmpeg.org/doxygen/trunk/structAVStream.html
 		AVStream *stream = fmt_ctx->streams[i];
 
-		printf("STREAM INDEX %d\n", stream->index);
-		printf("  frame rate: .......... %d/%d (real base frame rate)\n", stream->r_frame_rate.num, stream->r_frame_rate.den);
-		printf("  time base: ........... %d/%d\n", stream->time_base.num, stream->time_base.den);
-		printf("  start time: .......... %"PRId64"\n", stream->start_time);
-		printf("  duration: ............ %"PRId64"\n", stream->duration);
-		printf("  number of frames: .... %"PRId64"\n", stream->nb_frames);
-		printf("  sample aspect ratio: . %d:%d\n", stream->sample_aspect_ratio.num, stream->sample_aspect_ratio.den);
-		printf("  calculated length: ... %s\n", av_ts2timestr(stream->duration, &stream->time_base));
+		proxy_log(pi, PI_LOG_DEBUG, "STREAM INDEX %d", stream->index);
+		proxy_log(pi, PI_LOG_DEBUG, "  frame rate: .......... %d/%d (real base frame rate)", stream->r_frame_rate.num, stream->r_frame_rate.den);
+		proxy_log(pi, PI_LOG_DEBUG, "  time base: ........... %d/%d", stream->time_base.num, stream->time_base.den);
+		proxy_log(pi, PI_LOG_DEBUG, "  start time: .......... %"PRId64, stream->start_time);
+		proxy_log(pi, PI_LOG_DEBUG, "  duration: ............ %"PRId64, stream->duration);
+		proxy_log(pi, PI_LOG_DEBUG, "  number of frames: .... %"PRId64, stream->nb_frames);
+		proxy_log(pi, PI_LOG_DEBUG, "  sample aspect ratio: . %d:%d", stream->sample_aspect_ratio.num, stream->sample_aspect_ratio.den);
+		proxy_log(pi, PI_LOG_DEBUG, "  calculated length: ... %s", av_ts2timestr(stream->duration, &stream->time_base));
 
 		// print codec context info
 		// https://ffmpeg.org/doxygen/trunk/structAVCodecParameters.html
 		AVCodecParameters* codecpar = fmt_ctx->streams[i]->codecpar;
 
-		printf("  CODEC CONTEXT:\n");
-		printf("    average bit rate: .. %"PRId64"\n", codecpar->bit_rate);
-		printf("    width: ............. %d\n", codecpar->width);
-		printf("    height: ............ %d\n", codecpar->height);
-		printf("    sample rate: ....... %d\n", codecpar->sample_rate);
-		printf("    channels: .......... %d\n", codecpar->ch_layout.nb_channels);
-		printf("    codec type: ........ %d\n", codecpar->codec_type);
-		printf("    codec id: .......... %d\n", codecpar->codec_id);
-		printf("    codec tag: ......... %c%c%c%c (fourcc)\n", codecpar->codec_tag, codecpar->codec_tag >> 8, codecpar->codec_tag >> 16, codecpar->codec_tag >> 24);
-		printf("    sample aspect ratio: %d:%d\n", codecpar->sample_aspect_ratio.num, codecpar->sample_aspect_ratio.den);
+		proxy_log(pi, PI_LOG_DEBUG, "  CODEC CONTEXT:");
+		proxy_log(pi, PI_LOG_DEBUG, "    average bit rate: .. %"PRId64, codecpar->bit_rate);
+		proxy_log(pi, PI_LOG_DEBUG, "    width: ............. %d", codecpar->width);
+		proxy_log(pi, PI_LOG_DEBUG, "    height: ............ %d", codecpar->height);
+		proxy_log(pi, PI_LOG_DEBUG, "    sample rate: ....... %d", codecpar->sample_rate);
+		proxy_log(pi, PI_LOG_DEBUG, "    channels: .......... %d", codecpar->ch_layout.nb_channels);
+		proxy_log(pi, PI_LOG_DEBUG, "    codec type: ........ %d", codecpar->codec_type);
+		proxy_log(pi, PI_LOG_DEBUG, "    codec id: .......... %d", codecpar->codec_id);
+		proxy_log(pi, PI_LOG_DEBUG, "    codec tag: ......... %c%c%c%c (fourcc)", codecpar->codec_tag, codecpar->codec_tag >> 8, codecpar->codec_tag >> 16, codecpar->codec_tag >> 24);
+		proxy_log(pi, PI_LOG_DEBUG, "    sample aspect ratio: %d:%d", codecpar->sample_aspect_ratio.num, codecpar->sample_aspect_ratio.den);
 
 		// print codec info
 		// http://ffmpeg.org/doxygen/trunk/structAVCodec.html
 		const AVCodec* codec = avcodec_find_decoder(codecpar->codec_id);
 
 		if (!codec) {
-			printf("cannot find decoder for CODEC_ID %d\n", codecpar->codec_id);
+			proxy_log(pi, PI_LOG_DEBUG, "cannot find decoder for CODEC_ID %d", codecpar->codec_id);
 		}
 		else {
-			printf("  CODEC:\n");
-			printf("    name: .............. %s\n", codec->name);
-			printf("    name (long): ....... %s\n", codec->long_name);
-			printf("    type: .............. %d\n", codec->type);
-			printf("    id:   .............. %d\n", codec->id);
+			proxy_log(pi, PI_LOG_DEBUG, "  CODEC:");
+			proxy_log(pi, PI_LOG_DEBUG, "    name: .............. %s", codec->name);
+			proxy_log(pi, PI_LOG_DEBUG, "    name (long): ....... %s", codec->long_name);
+			proxy_log(pi, PI_LOG_DEBUG, "    type: .............. %d", codec->type);
+			proxy_log(pi, PI_LOG_DEBUG, "    id:   .............. %d", codec->id);
 		}
 
-		printf("stream %d: %s - %s [%d/%d]\n", i, av_get_media_type_string(codecpar->codec_type), avcodec_get_name(codecpar->codec_id), codecpar->codec_type, codecpar->codec_id);
-		printf("\n");
+		proxy_log(pi, PI_LOG_DEBUG, "stream %d: %s - %s [%d/%d]", i, av_get_media_type_string(codecpar->codec_type), avcodec_get_name(codecpar->codec_id), codecpar->codec_type, codecpar->codec_id);
 	}
 }
 
-static int open_codec_context(AVFormatContext *fmt_ctx, AVCodecContext **codec_ctx, int type)
+static int open_codec_context(AVFormatContext *fmt_ctx, AVCodecContext **codec_ctx, int type, int flags, AVDictionary **options)
 {
 	int stream_idx;
-	AVStream *stream = NULL;
-	AVCodecContext *context = NULL;
-	const AVCodec *codec = NULL;
-	AVDictionary *opts = NULL;
+	int ret;
 
 	/* Find stream of given type */
 	stream_idx = av_find_best_stream(fmt_ctx, type, -1, -1, NULL, 0);
 
 	if (stream_idx < 0) {
-		fprintf(stderr, "Could not find stream\n");
+		proxy_log(NULL, PI_LOG_ERROR, "Could not find stream");
 		return -1;
 	}
-	else {
-		stream = fmt_ctx->streams[stream_idx];
 
-		/* find decoder for the stream */
-		codec = avcodec_find_decoder(stream->codecpar->codec_id);
-		if (!codec) {
-			fprintf(stderr, "Failed to find codec\n");
-			return -2;
-		}
+	if ((ret = open_stream_codec_context(fmt_ctx->streams[stream_idx], codec_ctx, flags, options)) < 0) {
+		return ret;
+	}
 
-		context = avcodec_alloc_context3(codec);
-		if (!context) {
-			fprintf(stderr, "Failed to create codec context\n");
-			return -3;
-		}
+	return stream_idx;
+}
 
-		if (avcodec_parameters_to_context(context, stream->codecpar) < 0) {
-			fprintf(stderr, "Failed to populate codec context\n");
-			return -4;
-		}
+/*
+ * Opens a decoder for the given stream with additional AV_CODEC_FLAG_* flags and optional decoder
+ * options, which are left with the unused options. Returns 0 on success, or a negative number on
+ * error.
+ */
+int open_stream_codec_context(AVStream *stream, AVCodecContext **codec_ctx, int flags, AVDictionary **options)
+{
+	AVCodecContext *context = NULL;
+	const AVCodec *codec = NULL;
+	AVDictionary *opts = NULL;
 
-		/* Init the decoder */
-		if (avcodec_open2(context, codec, &opts) < 0) {
-			fprintf(stderr, "Failed to open codec\n");
-			return -5;
-		}
+	/* find decoder for the stream */
+	codec = avcodec_find_decoder(stream->codecpar->codec_id);
+	if (!codec) {
+		proxy_log(NULL, PI_LOG_ERROR, "Failed to find codec");
+		return -2;
+	}
 
-		if (DEBUG) {
-			if (type == AVMEDIA_TYPE_AUDIO) {
-				printf("audio sampleformat: %s, planar: %d, channels: %d, raw bitdepth: %d, bitdepth: %d\n",
-					av_get_sample_fmt_name(context->sample_fmt),
-					av_sample_fmt_is_planar(context->sample_fmt),
-					context->ch_layout.nb_channels,
-					context->bits_per_raw_sample,
-					av_get_bytes_per_sample(context->sample_fmt) * 8);
-			}
-			else if (type == AVMEDIA_TYPE_VIDEO) {
-				printf("video sampleformat: raw bitdepth: %d\n",
-					context->bits_per_raw_sample);
-			}
+	context = avcodec_alloc_context3(codec);
+	if (!context) {
+		proxy_log(NULL, PI_LOG_ERROR, "Failed to create codec context");
+		return -3;
+	}
+
+	if (avcodec_parameters_to_context(context, stream->codecpar) < 0) {
+		proxy_log(NULL, PI_LOG_ERROR, "Failed to populate codec context");
+		avcodec_free_context(&context);
+		return -4;
+	}
+
+	context->flags |= flags;
+
+	// Allocate the frames from the shared buffer pools, if the decoder supports custom allocators
+	if (codec->capabilities & AV_CODEC_CAP_DR1) {
+		context->get_buffer2 = bufpool_get_buffer2;
+	}
+
+	/* Init the decoder */
+	if (avcodec_open2(context, codec, options != NULL ? options : &opts) < 0) {
+		proxy_log(NULL, PI_LOG_ERROR, "Failed to open codec");
+		avcodec_free_context(&context);
+		av_dict_free(&opts);
+		return -5;
+	}
+	av_dict_free(&opts);
+
+	if (DEBUG) {
+		if (context->codec_type == AVMEDIA_TYPE_AUDIO) {
+			proxy_log(NULL, PI_LOG_DEBUG, "audio sampleformat: %s, planar: %d, channels: %d, raw bitdepth: %d, bitdepth: %d",
+				av_get_sample_fmt_name(context->sample_fmt),
+				av_sample_fmt_is_planar(context->sample_fmt),
+				context->ch_layout.nb_channels,
+				context->bits_per_raw_sample,
+				av_get_bytes_per_sample(context->sample_fmt) * 8);
+		}
+		else if (context->codec_type == AVMEDIA_TYPE_VIDEO) {
+			proxy_log(NULL, PI_LOG_DEBUG, "video sampleformat: raw bitdepth: %d",
+				context->bits_per_raw_sample);
 		}
 	}
 
 	*codec_ctx = context;
 
-	return stream_idx;
+	return 0;
+}
+
+/*
+ * Creates the converter from the decoder's sample format to the interleaved output format
+ * of this decoding layer.
+ */
+SwrContext *create_audio_converter(AVCodecContext *audio_codec_ctx)
+{
+	// http://stackoverflow.com/a/15372417
+	SwrContext *swr = swr_alloc();
+	av_opt_set_chlayout(swr, "in_chlayout", &audio_codec_ctx->ch_layout, 0);
+	av_opt_set_chlayout(swr, "out_chlayout", &audio_codec_ctx->ch_layout, 0);
+	av_opt_set_int(swr, "in_sample_rate", audio_codec_ctx->sample_rate, 0);
+	av_opt_set_int(swr, "out_sample_rate", audio_codec_ctx->sample_rate, 0);
+	av_opt_set_sample_fmt(swr, "in_sample_fmt", audio_codec_ctx->sample_fmt, 0);
+	av_opt_set_sample_fmt(swr, "out_sample_fmt", determine_target_format(audio_codec_ctx), 0);
+	swr_init(swr);
+
+	return swr;
+}
+
+/*
+ * Returns a fast path for the sample conversion of the given decoder, or NULL if the
+ * conversion requires swresample. The fast paths honor the CPU flags forced through
+ * av_force_cpu_flags, e.g. to compare them against each other.
+ */
+SampleConverter select_audio_converter(AVCodecContext *audio_codec_ctx)
+{
+	return convert_select(audio_codec_ctx->sample_fmt, determine_target_format(audio_codec_ctx),
+		audio_codec_ctx->ch_layout.nb_channels, av_get_cpu_flags());
+}
+
+/*
+ * Returns the size in bytes of an output sample of the given decoder.
+ */
+int get_output_sample_size(AVCodecContext *audio_codec_ctx)
+{
+	return av_get_bytes_per_sample(determine_target_format(audio_codec_ctx));
 }
 
-static int audio_frame_count = 0;
 /*
  * Decodes an audio frame and returns 1 if a frame was decoded, 0 if no frame was decoded,
  * or a negative error code (it is basically the result of avcodec_receive_frame).
@@ -835,11 +1889,11 @@ static int decode_audio_packet(ProxyInstance *pi, int *got_audio_frame, int cach
 		}
 		else if (ret == AVERROR_EOF) {
 			// That's it, no more frames
-			if (DEBUG) fprintf(stderr, "Audio frame EOF\n");
+			if (DEBUG) proxy_log(pi, PI_LOG_DEBUG, "Audio frame EOF");
 			return 0;
 		}
 		else {
-			fprintf(stderr, "Error receiving decoded audio frame (%s)\n", av_err2str(ret));
+			proxy_log(pi, PI_LOG_ERROR, "Error receiving decoded audio frame (%s)", av_err2str(ret));
 			return ret;
 		}
 	}
@@ -848,21 +1902,20 @@ static int decode_audio_packet(ProxyInstance *pi, int *got_audio_frame, int cach
 	}
 
 	if (*got_audio_frame && DEBUG) {
-		printf("packet dts:%s pts:%s duration:%s\n",
+		proxy_log(pi, PI_LOG_DEBUG, "packet dts:%s pts:%s duration:%s",
 			av_ts2timestr(pi->pkt->dts, &pi->audio_stream->time_base),
 			av_ts2timestr(pi->pkt->pts, &pi->audio_stream->time_base),
 			av_ts2timestr(pi->pkt->duration, &pi->audio_stream->time_base));
 
-		printf("audio_frame%s n:%d nb_samples:%d pts:%s\n",
+		proxy_log(pi, PI_LOG_DEBUG, "audio_frame%s n:%"PRId64" nb_samples:%d pts:%s",
 			cached ? "(cached)" : "",
-			audio_frame_count++, pi->frame->nb_samples,
+			pi->stats.audio_frames_decoded, pi->frame->nb_samples,
 			av_ts2timestr(pi->frame->pts, &pi->audio_stream->time_base));
 	}
 
 	return 1;
 }
 
-static int video_frame_count = 0;
 /*
 * Same as decode_audio_packet, but for video.
 */
@@ -881,11 +1934,11 @@ static int decode_video_packet(ProxyInstance *pi, int *got_video_frame, int cach
 		}
 		else if (ret == AVERROR_EOF) {
 			// That's it, no more frames
-			if (DEBUG) fprintf(stderr, "Video frame EOF\n");
+			if (DEBUG) proxy_log(pi, PI_LOG_DEBUG, "Video frame EOF");
 			return 0;
 		}
 		else {
-			fprintf(stderr, "Error receiving decoded video frame (%s)\n", av_err2str(ret));
+			proxy_log(pi, PI_LOG_ERROR, "Error receiving decoded video frame (%s)", av_err2str(ret));
 			return ret;
 		}
 	}
@@ -894,63 +1947,105 @@ static int decode_video_packet(ProxyInstance *pi, int *got_video_frame, int cach
 	}
 
 	if (*got_video_frame && DEBUG) {
-		printf("packet dts:%s pts:%s duration:%s\n",
+		proxy_log(pi, PI_LOG_DEBUG, "packet dts:%s pts:%s duration:%s",
 			av_ts2timestr(pi->pkt->dts, &pi->video_stream->time_base),
 			av_ts2timestr(pi->pkt->pts, &pi->video_stream->time_base),
 			av_ts2timestr(pi->pkt->duration, &pi->video_stream->time_base));
 
-		printf("video_frame%s n:%d pts:%s\n",
+		proxy_log(pi, PI_LOG_DEBUG, "video_frame%s n:%"PRId64" pts:%s",
 			cached ? "(cached)" : "",
-			video_frame_count++,
+			pi->stats.video_frames_decoded,
 			av_ts2timestr(pi->frame->pts, &pi->video_stream->time_base));
 	}
 
 	return 1;
 }
 
-static int convert_audio_samples(ProxyInstance *pi) {
+/*
+ * Converts a decoded audio frame into the output format. Returns the number of converted
+ * samples, or a negative number on error.
+ */
+int convert_audio_samples(ProxyInstance *pi, AVFrame *frame, uint8_t *output_buffer, int output_buffer_size)
+{
+	if (pi->analysis != NULL) {
+		int64_t start = timer_now_ns();
+		int ret = analysis_convert(pi->analysis, frame, pi->audio_stream->time_base, output_buffer, output_buffer_size);
+		int64_t end = timer_now_ns();
+		pi->stats.swr_ns += end - start;
+		pi_trace(pi, TRACE_CONVERT, start, end, TYPE_AUDIO);
+		if (ret == -2) {
+			proxy_log(pi, PI_LOG_ERROR, "output buffer too small (%d)", output_buffer_size);
+		}
+		else if (ret < 0) {
+			proxy_log(pi, PI_LOG_ERROR, "Could not convert input samples");
+		}
+		return ret;
+	}
+
 	/* prepare/update sample format conversion buffer */
-	int output_buffer_size_needed = pi->frame->nb_samples * pi->frame->ch_layout.nb_channels * av_get_bytes_per_sample(pi->audio_codec_ctx->sample_fmt);
-	if (pi->output_buffer_size < output_buffer_size_needed) {
-		fprintf(stderr, "output buffer too small (%d < %d)\n", pi->output_buffer_size, output_buffer_size_needed);
+	int output_buffer_size_needed = frame->nb_samples * frame->ch_layout.nb_channels * pi->audio_output.format.sample_size;
+	if (output_buffer_size < output_buffer_size_needed) {
+		// Do not write beyond the caller's buffer, e.g. when a frame exceeds a negotiated frame size
+		proxy_log(pi, PI_LOG_ERROR, "output buffer too small (%d < %d)", output_buffer_size, output_buffer_size_needed);
+		return -1;
 	}
 
 	/* convert samples to target format */
 #ifdef __GNUC__
 #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
 #endif
-	int ret = swr_convert(pi->swr, &pi->output_buffer, pi->frame->nb_samples, pi->frame->extended_data, pi->frame->nb_samples);
+	int64_t start = timer_now_ns();
+	int ret;
+	if (pi->convert != NULL) {
+		pi->convert(output_buffer, (const uint8_t **)frame->extended_data, frame->ch_layout.nb_channels, frame->nb_samples);
+		ret = frame->nb_samples;
+	}
+	else {
+		ret = swr_convert(pi->swr, &output_buffer, frame->nb_samples, frame->extended_data, frame->nb_samples);
+	}
+	int64_t end = timer_now_ns();
+	pi->stats.swr_ns += end - start;
+	pi_trace(pi, TRACE_CONVERT, start, end, TYPE_AUDIO);
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
 #endif
 	if (ret < 0) {
-		fprintf(stderr, "Could not convert input samples\n");
+		proxy_log(pi, PI_LOG_ERROR, "Could not convert input samples");
 	}
-	else if (ret != pi->frame->nb_samples) {
-		fprintf(stderr, "Output sample count != input sample count (%d != %d)\n", ret, pi->frame->nb_samples);
+	else if (ret != frame->nb_samples) {
+		proxy_log(pi, PI_LOG_WARNING, "Output sample count != input sample count (%d != %d)", ret, frame->nb_samples);
 	}
 
 	return ret; // if >= 0, the number of samples converted
 }
 
-static int convert_video_frame(ProxyInstance *pi) {
+/*
+ * Converts a decoded video frame into the output format. Returns the height of the output
+ * frame, or a negative number on error.
+ */
+int convert_video_frame(ProxyInstance *pi, AVFrame *frame, uint8_t *output_buffer)
+{
 	/* convert frame to target format */
 	/* Instead of writing the converted image into the AVPicture and then transferring it to the output 
 	 * buffer, it gets directly written into the output buffer to save the memory transfer. The additional
 	 * variable is required because sws_scale expects an array of buffers, with the first buffer allocated.
 	 * The AVPicture could actually be completely omitted by passing an array  int linesize[1] = { rgbstride },
 	 * with e.g. rgbstride = 960 for a 320px wide picture. */
-	uint8_t *output_buffer_workaround = pi->output_buffer;
-	int rgbstride[1] = { pi->frame->linesize[0] * 3 };
+	uint8_t *output_buffer_workaround = output_buffer;
+	int rgbstride[1] = { frame->linesize[0] * 3 };
 #ifdef __GNUC__
 #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
 #endif
-	int ret = sws_scale(pi->sws, pi->frame->data, pi->frame->linesize, 0, pi->video_codec_ctx->height, &output_buffer_workaround, rgbstride);
+	int64_t start = timer_now_ns();
+	int ret = pi->swsf->scale(pi->sws, frame->data, frame->linesize, 0, pi->video_codec_ctx->height, &output_buffer_workaround, rgbstride);
+	int64_t end = timer_now_ns();
+	pi->stats.sws_ns += end - start;
+	pi_trace(pi, TRACE_CONVERT, start, end, TYPE_VIDEO);
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
 #endif
 	if (ret < 0) {
-		fprintf(stderr, "Could not convert frame\n");
+		proxy_log(pi, PI_LOG_ERROR, "Could not convert frame");
 	}
 
 	// VERY VERBOSE DEBUG: print monochromatic scaled down frame picture to console
@@ -959,7 +2054,7 @@ static int convert_video_frame(ProxyInstance *pi) {
 
 		for (int y = 0; y < pi->video_codec_ctx->height; y += pi->video_codec_ctx->height / 20) {
 			for (int x = 0; x < pi->video_codec_ctx->width; x += pi->video_codec_ctx->width / 64) {
-				printf("%c", QUANT_STEPS[(pi->output_buffer[y * rgbstride[0] + x * 3 /* blue channel */]) / 40]);
+				printf("%c", QUANT_STEPS[(output_buffer[y * rgbstride[0] + x * 3 /* blue channel */]) / 40]);
 			}
 			printf("\n");
 		}
@@ -969,6 +2064,65 @@ static int convert_video_frame(ProxyInstance *pi) {
 	return ret; // if >= 0, the height of the output frame
 }
 
+/*
+ * Minimizes the input delay of a live source: the stream is probed from as little data as
+ * possible, and demuxed packets are passed on without buffering. Must be called before the
+ * input is opened.
+ */
+static void configure_live_input(ProxyInstance *pi)
+{
+	pi->fmt_ctx->probesize = LIVE_PROBESIZE;
+	pi->fmt_ctx->max_analyze_duration = LIVE_ANALYZEDURATION;
+	pi->fmt_ctx->flags |= AVFMT_FLAG_NOBUFFER | AVFMT_FLAG_FLUSH_PACKETS;
+	pi->fmt_ctx->interrupt_callback.callback = live_interrupt;
+	pi->fmt_ctx->interrupt_callback.opaque = pi;
+}
+
+/*
+ * Buffered IO callbacks that forward to the caller's callbacks and measure them.
+ */
+static int io_read_packet(void *opaque, uint8_t *buf, int buf_size)
+{
+	ProxyInstance *pi = opaque;
+	int64_t start = timer_now_ns();
+	int ret = pi->io_read_packet(pi->io_opaque, buf, buf_size);
+	int64_t end = timer_now_ns();
+
+	pi->stats.io_read_ns += end - start;
+	pi_trace(pi, TRACE_IO_READ, start, end, ret);
+	pi->stats.io_reads++;
+	if (ret > 0) {
+		pi->stats.io_read_bytes += ret;
+		atomic_int64_store(&pi->input_ns, end);
+	}
+
+	return ret;
+}
+
+static int64_t io_seek(void *opaque, int64_t offset, int whence)
+{
+	ProxyInstance *pi = opaque;
+	int64_t start = timer_now_ns();
+	int64_t ret = pi->io_seek(pi->io_opaque, offset, whence);
+	int64_t end = timer_now_ns();
+
+	pi->stats.io_seek_ns += end - start;
+	pi->stats.io_seeks++;
+	pi_trace(pi, TRACE_IO_SEEK, start, end, offset);
+
+	return ret;
+}
+
+/*
+ * Adds an event to the trace timeline if tracing is enabled.
+ */
+static inline void pi_trace(ProxyInstance *pi, TraceEventType type, int64_t start, int64_t end, int64_t arg)
+{
+	if (pi->trace != NULL) {
+		trace_add(pi->trace, type, start, end, arg);
+	}
+}
+
 /* 
  * Determines the always interleaved sample format to be output from this decoding layer.
  */
@@ -990,7 +2144,7 @@ static int determine_target_format(AVCodecContext *audio_codec_ctx)
 		return AV_SAMPLE_FMT_FLT;
 	}
 	else {
-		fprintf(stderr, "unsupported sample format %d/%d/%s, fallback to default\n", 
+		proxy_log(NULL, PI_LOG_WARNING, "unsupported sample format %d/%d/%s, fallback to default", 
 			raw_bitdepth, bitdepth, 
 			av_get_sample_fmt_name(audio_codec_ctx->sample_fmt));
 	}
@@ -998,15 +2152,3 @@ static int determine_target_format(AVCodecContext *audio_codec_ctx)
 	// default format
 	return AV_SAMPLE_FMT_FLT;
 }
-
-// TODO eventually switch to av_rescale_q/av_inv_q (with sample_rate as AVRational)
-
-static inline int64_t pts_to_samples(double sample_rate, AVRational time_base, int64_t time)
-{
-	return (int64_t)round((av_q2d(time_base) * time) * sample_rate);
-}
-
-static inline int64_t samples_to_pts(double sample_rate, AVRational time_base, int64_t time)
-{
-	return (int64_t)round(time / av_q2d(time_base) / sample_rate);
-}
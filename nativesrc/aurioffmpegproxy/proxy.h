@@ -25,19 +25,70 @@
 #include "libavutil/timestamp.h"
 #include "libswresample/swresample.h"
 #include "libavutil/opt.h"
-#include "libswscale/swscale.h"
 
 #include "seekindex.h"
+#include "convert.h"
+#include "framecache.h"
+#include "pcmcache.h"
+#include "live.h"
+#include "trace.h"
+#include "tracks.h"
+#include "log.h"
+#include "align.h"
+#include "export.h"
+#include "fingerprint.h"
+#include "dispatch.h"
+#include "fetch.h"
+#include "reverse.h"
+#include "bufpool.h"
+#include "loudness.h"
+#include "swsload.h"
+#include "mixer.h"
+#include "analysis.h"
+#include "concat.h"
+
+/*
+ * Cumulative performance counters of an instance. Times are in nanoseconds.
+ */
+typedef struct ProxyStats {
+	int64_t				packets_demuxed;
+	int64_t				bytes_demuxed;
+	int64_t				packets_discarded; // demuxed packets of streams that are not decoded
+	int64_t				bytes_discarded;
+	int64_t				audio_frames_decoded;
+	int64_t				video_frames_decoded;
+	int64_t				demux_ns;
+	int64_t				decode_ns;
+	int64_t				swr_ns; // audio sample conversion, by swresample or a fast path
+	int64_t				sws_ns;
+	int64_t				seeks;
+	int64_t				seeks_index_adjusted; // seeks where the target was adjusted by the seek index
+	int64_t				seek_preroll_frames; // frames decoded after a seek that end before the seek target
+	int64_t				io_reads; // read callbacks in buffered IO mode
+	int64_t				io_read_bytes;
+	int64_t				io_read_ns;
+	int64_t				io_seeks; // seek callbacks in buffered IO mode
+	int64_t				io_seek_ns;
+	int64_t				cache_hits; // frames served from the frame cache
+	int64_t				cache_misses; // reads after a cached seek that had to resume decoding
+	int64_t				live_frames; // frames decoded by stream_read_frame_timeout
+	int64_t				live_latency_ns; // sum over live frames of the time from the latest input data to the decoded frame
+	int64_t				live_latency_max_ns;
+} ProxyStats;
 
 /*
  * This struct holds all data necessary to manage an "instance" of a decoder,
  * and most importantly to run several decoders in parallel.
  */
 typedef struct ProxyInstance {
-	int					mode; // contains the desired packet types to decode
+	int					mode; // contains the desired packet types to decode and optional MODE_* flags
 	int					state;
 	char* error_message; // in case of state == PI_STATE_ERROR
+	char* source_filename; // in file mode, the opened file (allows opening additional instances of the same source)
 	AVFormatContext* fmt_ctx;
+	const AVInputFormat* input_format; // demuxer of the source if known in advance, skips the format probing
+	struct ProxyInstance* info_source; // while opening a clone, the instance to take the stream info from instead of probing
+	AVFormatContext* stream_info; // in MODE_LOWMEM, the probed stream info to restore when the released input is reopened
 	AVStream* audio_stream;
 	AVStream* video_stream;
 	AVCodecContext* audio_codec_ctx;
@@ -45,13 +96,49 @@ typedef struct ProxyInstance {
 	AVPacket* pkt;
 	AVFrame* frame;
 	SwrContext* swr;
+	SampleConverter convert; // fast path for the sample conversion, NULL if swr is needed
 	struct SwsContext* sws;
+	const SwsFunctions* swsf;
 	int					output_buffer_size;
 	uint8_t* output_buffer;
 	int64_t				frame_pts;
 	SeekIndex* audio_seekindex;
 	SeekIndex* video_seekindex;
 
+	// buffered IO mode: the caller's callbacks, wrapped to collect statistics
+	void* io_opaque;
+	int					(*io_read_packet)(void* opaque, uint8_t* buf, int buf_size);
+	int64_t				(*io_seek)(void* opaque, int64_t offset, int whence);
+	char* io_filename; // format hint, to reopen the input after it has been released
+
+	ProxyStats			stats;
+	int64_t				seek_target; // sample position of the last seek, AV_NOPTS_VALUE once it has been reached
+	int					seek_target_type;
+	Trace* trace; // event timeline, NULL when tracing is disabled
+	InstanceLogCallback	log_callback; // overrides the global log callback for this instance
+	void* log_opaque;
+	TrackSet* tracks; // audio tracks decoded in a single pass, NULL if none are selected
+
+	// decoded frame cache, see stream_cache_enable
+	FrameCache* cache;
+	int64_t				cache_next; // timestamp of the next frame to serve from the cache
+	int					cache_synced; // whether the decoder is positioned to decode the next frame
+	int					cache_bypass; // temporarily disables the cache (e.g. while building a seek index)
+	int64_t				primed_position; // audio before this position lacks the decoder pre-roll after a seek, INT64_MAX until the first frame
+	PcmCache* pcmcache; // progressively decoded PCM cache file, see stream_pcmcache_start
+	LiveReader* live; // background decoding of stream_read_frame_timeout, NULL until the first call
+	Dispatcher* dispatch; // background demuxing of MODE_DISPATCH, see stream_read_typed_frame
+	Analysis* analysis; // reduced-cost audio decoding of MODE_ANALYSIS, NULL otherwise
+	ReverseReader* reverse; // block of frames of stream_read_frame_reverse, NULL until the first call
+	volatile int64_t	input_ns; // arrival time of the most recent input data
+
+	// low-footprint mode, see MODE_LOWMEM
+	int					released; // decoders and demuxer are closed until the next read or seek
+	int64_t				resume_position; // read position when released, AV_NOPTS_VALUE if not read yet
+	int64_t				last_access_ns; // time of the last read or seek, to detect idle instances
+	int64_t				skip_until; // drop decoded samples before this position, AV_NOPTS_VALUE if none
+	int					skip_type;
+
 	struct {
 		struct {
 			int					sample_rate;
@@ -94,34 +181,109 @@ typedef struct ProxyInstance {
 #define TYPE_NONE  0x00
 #define TYPE_AUDIO 0x01
 #define TYPE_VIDEO 0x02
+#define TYPE_MASK  (TYPE_AUDIO | TYPE_VIDEO)
+
+#define MODE_TRACE 0x0100 // record a trace event timeline from opening on, see stream_trace_dump
+#define MODE_LIVE  0x0200 // low-latency input from a live, non-seekable source, see stream_read_frame_timeout
+#define MODE_LOWMEM 0x0400 // minimal memory footprint for many open instances, see stream_release
+#define MODE_DISPATCH 0x0800 // demux on a background thread, read audio and video independently, see stream_read_typed_frame
+#define MODE_ANALYSIS 0x1000 // reduced-cost mono audio for analysis, see stream_get_analysis_path
+
+#define LOWMEM_IO_BUFFER_SIZE 4096 // bytes
+#define LOWMEM_PROBE_FRAMES 8 // frames decoded at opening to negotiate the output frame size
 
 #define PI_STATE_OK 0
 #define PI_STATE_ERROR -1
 
+#define SEGMENT_ORDERED 0x01 // deliver all segments in timeline order on the calling thread
+
+/*
+ * Receives the decoded samples of a segment. Returning a non-zero value aborts decoding.
+ */
+typedef int (*SegmentSink)(void* opaque, int segment, int64_t timestamp, uint8_t* buffer, int samples);
+
 EXPORT ProxyInstance* stream_open_file(int mode, char* filename);
+EXPORT ProxyInstance* stream_clone(ProxyInstance* source);
 EXPORT ProxyInstance* stream_open_bufferedio(int mode, void* opaque, int(*read_packet)(void* opaque, uint8_t* buf, int buf_size), int64_t(*seek)(void* opaque, int64_t offset, int whence), char* filename);
 ProxyInstance* stream_open(ProxyInstance* pi);
 EXPORT void* stream_get_output_config(ProxyInstance* pi, int type);
 int stream_read_frame_any(ProxyInstance* pi, int* got_frame, int* frame_type);
 EXPORT int stream_read_frame(ProxyInstance* pi, int64_t* timestamp, uint8_t* output_buffer, int output_buffer_size, int* frame_type);
-EXPORT void stream_seek(ProxyInstance* pi, int64_t timestamp, int type);
+EXPORT int stream_read_frame_timeout(ProxyInstance* pi, int timeout_ms, int64_t* timestamp, uint8_t* output_buffer, int output_buffer_size, int* frame_type);
+EXPORT int stream_read_frame_reverse(ProxyInstance* pi, int64_t* timestamp, uint8_t* output_buffer, int output_buffer_size, int* frame_type);
+EXPORT int stream_read_typed_frame(ProxyInstance* pi, int type, int64_t* timestamp, uint8_t* output_buffer, int output_buffer_size);
+EXPORT int stream_seek(ProxyInstance* pi, int64_t timestamp, int type);
 EXPORT void stream_seekindex_create(ProxyInstance* pi, int type);
 EXPORT void stream_seekindex_remove(ProxyInstance* pi, int type);
+EXPORT int stream_cache_enable(ProxyInstance* pi, int64_t budget);
+EXPORT int stream_pcmcache_start(ProxyInstance* pi, char* cache_filename);
+EXPORT int64_t stream_pcmcache_available(ProxyInstance* pi);
+EXPORT int stream_pcmcache_status(ProxyInstance* pi);
+EXPORT int stream_pcmcache_read(ProxyInstance* pi, int64_t position, uint8_t* buffer, int samples);
+EXPORT void stream_pcmcache_stop(ProxyInstance* pi);
+EXPORT int stream_decode_segmented(ProxyInstance* pi, int segment_count, int64_t preroll, int flags, void* opaque, SegmentSink sink);
+EXPORT int stream_align(ProxyInstance* source, int64_t source_position, ProxyInstance* target, int64_t target_position,
+	int64_t length, int64_t max_lag, int rate, AlignResult* result);
+EXPORT int stream_export_range(ProxyInstance* pi, int64_t start, int64_t end, int type, char* filename);
+EXPORT int stream_export_ranges(ProxyInstance* pi, ExportRange* ranges, int count, int type);
+EXPORT int stream_read_windows(ProxyInstance* pi, FetchWindow* windows, int count, int64_t max_gap);
+EXPORT int stream_fingerprint(ProxyInstance* pi, int type, int interval, StreamFingerprint* fingerprint);
+EXPORT int stream_loudness_scan(ProxyInstance* pi, LoudnessResult* result, float* shortterm, int shortterm_capacity);
+EXPORT int stream_get_analysis_path(ProxyInstance* pi);
+EXPORT int stream_release(ProxyInstance* pi);
+EXPORT int stream_release_idle(ProxyInstance* pi, int idle_ms);
+EXPORT int64_t stream_get_memory_usage(ProxyInstance* pi);
+EXPORT void stream_get_stats(ProxyInstance* pi, ProxyStats* stats);
+EXPORT void stream_reset_stats(ProxyInstance* pi);
+EXPORT int stream_get_audio_streams(ProxyInstance* pi, int* stream_indices, int max_count);
+EXPORT int stream_select_tracks(ProxyInstance* pi, int* stream_indices, int count);
+EXPORT void* stream_get_track_output_config(ProxyInstance* pi, int track);
+EXPORT int stream_read_any_track_frame(ProxyInstance* pi, int* track, int64_t* timestamp, uint8_t* output_buffer, int output_buffer_size);
+EXPORT int stream_read_track_frame(ProxyInstance* pi, int track, int64_t* timestamp, uint8_t* output_buffer, int output_buffer_size);
+EXPORT int stream_trace_start(ProxyInstance* pi, int capacity);
+EXPORT void stream_trace_stop(ProxyInstance* pi);
+EXPORT int stream_trace_dump(ProxyInstance* pi, char* filename);
+EXPORT void proxy_set_log_callback(LogCallback callback);
+EXPORT void proxy_get_bufpool_stats(BufferPoolStats* stats);
+EXPORT void proxy_trim_bufpool(void);
+EXPORT int proxy_loudness_scan_files(char** filenames, int count, int thread_count, LoudnessResult* results);
+EXPORT Mixer* mixer_create(int sample_rate, int channels);
+EXPORT int mixer_add_track(Mixer* mixer, ProxyInstance* pi, int64_t offset);
+EXPORT int mixer_set_track(Mixer* mixer, int track, int64_t offset, float gain, float pan, int mute);
+EXPORT int mixer_read(Mixer* mixer, float* output, int samples);
+EXPORT int mixer_seek(Mixer* mixer, int64_t position);
+EXPORT int64_t mixer_get_length(Mixer* mixer);
+EXPORT void mixer_free(Mixer* mixer);
+EXPORT Concat* concat_open(int mode, char** filenames, int count);
+EXPORT void* concat_get_output_config(Concat* c);
+EXPORT int concat_read_frame(Concat* c, int64_t* timestamp, uint8_t* output_buffer, int output_buffer_size);
+EXPORT int concat_seek(Concat* c, int64_t position);
+EXPORT int64_t concat_get_length(Concat* c);
+EXPORT void concat_close(Concat* c);
+EXPORT void stream_set_log_callback(ProxyInstance* pi, InstanceLogCallback callback, void* opaque);
 EXPORT void stream_close(ProxyInstance* pi);
 EXPORT int stream_has_error(ProxyInstance* pi);
 EXPORT char* stream_get_error(ProxyInstance* pi);
 
-static int pi_init(ProxyInstance** pi);
-static void pi_free(ProxyInstance** pi);
-static void pi_set_error(ProxyInstance* pi, const char* fmt, ...);
-static int pi_has_error(ProxyInstance* pi);
-
-static void info(AVFormatContext* fmt_ctx);
-static int open_codec_context(AVFormatContext* fmt_ctx, AVCodecContext** codec_ctx, int type);
-static int decode_audio_packet(ProxyInstance* pi, int* got_audio_frame, int cached);
-static int decode_video_packet(ProxyInstance* pi, int* got_video_frame, int cached);
-static int convert_audio_samples(ProxyInstance* pi);
-static int convert_video_frame(ProxyInstance* pi);
-static int determine_target_format(AVCodecContext* audio_codec_ctx);
-static inline int64_t pts_to_samples(double sample_rate, AVRational time_base, int64_t time);
-static inline int64_t samples_to_pts(double sample_rate, AVRational time_base, int64_t time);
\ No newline at end of file
+// Internal helpers shared between the modules
+int open_stream_codec_context(AVStream* stream, AVCodecContext** codec_ctx, int flags, AVDictionary** options);
+SwrContext* create_audio_converter(AVCodecContext* audio_codec_ctx);
+SampleConverter select_audio_converter(AVCodecContext* audio_codec_ctx);
+int get_output_sample_size(AVCodecContext* audio_codec_ctx);
+int convert_audio_samples(ProxyInstance* pi, AVFrame* frame, uint8_t* output_buffer, int output_buffer_size);
+int convert_video_frame(ProxyInstance* pi, AVFrame* frame, uint8_t* output_buffer);
+int acquire_decoders(ProxyInstance* pi, int resume);
+void update_position_and_get_timestamp(AVFrame* frame, double sample_rate, AVRational time_base,
+	int num_samples_read, int64_t* sample_position, int64_t* timestamp);
+
+// TODO eventually switch to av_rescale_q/av_inv_q (with sample_rate as AVRational)
+
+static inline int64_t pts_to_samples(double sample_rate, AVRational time_base, int64_t time)
+{
+	return (int64_t)round((av_q2d(time_base) * time) * sample_rate);
+}
+
+static inline int64_t samples_to_pts(double sample_rate, AVRational time_base, int64_t time)
+{
+	return (int64_t)round(time / av_q2d(time_base) / sample_rate);
+}
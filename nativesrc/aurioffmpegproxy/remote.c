@@ -0,0 +1,339 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE // POLLRDHUP
+#endif
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "remote.h"
+
+/*
+ * Connects to a decode server listening on the given socket path. Returns NULL on error.
+ */
+RemoteConnection *remote_connect(char *socket_path)
+{
+	RemoteConnection *rc;
+	struct sockaddr_un address;
+	int fd;
+
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		return NULL;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+	if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	rc = malloc(sizeof(RemoteConnection));
+	if (rc == NULL) {
+		close(fd);
+		return NULL;
+	}
+	rc->fd = fd;
+	mutex_init(&rc->mutex);
+
+	return rc;
+}
+
+/*
+ * Closes the connection. The server closes all instances that are still open on it.
+ */
+void remote_disconnect(RemoteConnection *rc)
+{
+	close(rc->fd);
+	mutex_destroy(&rc->mutex);
+	free(rc);
+}
+
+/*
+ * Sends a request and waits for its response. The error message of a failed request is
+ * stored in the instance. Returns 0 on success, or a negative number on error.
+ */
+static int exchange(RemoteInstance *ri, IpcRequest *request, const char *payload, IpcResponse *response, int *passed_fd)
+{
+	int ret;
+
+	request->version = IPC_PROTOCOL_VERSION;
+	request->instance = ri->id;
+	request->payload_size = payload != NULL ? (int)strlen(payload) : 0;
+	if (request->payload_size > IPC_MAX_PAYLOAD) {
+		snprintf(ri->error_message, sizeof(ri->error_message), "request payload too large");
+		return -1;
+	}
+
+	mutex_lock(&ri->connection->mutex);
+	ret = ipc_send(ri->connection->fd, request, sizeof(IpcRequest), payload, request->payload_size, -1);
+	if (ret == 0) {
+		ret = ipc_recv(ri->connection->fd, response, sizeof(IpcResponse), ri->error_message, IPC_MAX_PAYLOAD, &response->payload_size, passed_fd);
+	}
+	mutex_unlock(&ri->connection->mutex);
+
+	if (ret < 0) {
+		snprintf(ri->error_message, sizeof(ri->error_message), "connection to the decode server lost");
+		return -1;
+	}
+
+	if (response->status < 0) {
+		ri->error_message[response->payload_size] = '\0';
+		return response->status;
+	}
+
+	ri->error_message[0] = '\0';
+	ri->audio_output = response->audio_output;
+	ri->video_output.sample_position = response->video_output.sample_position;
+
+	return response->status;
+}
+
+/*
+ * Checks whether the server is still alive while waiting for a frame. A readable socket does not
+ * tell, because the connection can be shared with other threads, whose responses may be pending,
+ * so only a hangup of the server side counts.
+ */
+static int server_alive(RemoteConnection *rc)
+{
+#if defined(POLLRDHUP)
+	struct pollfd pfd = { rc->fd, POLLRDHUP, 0 };
+#else
+	struct pollfd pfd = { rc->fd, 0, 0 }; // POLLHUP and POLLERR are always reported
+#endif
+
+	return poll(&pfd, 1, 0) <= 0;
+}
+
+/*
+ * Opens a file in the server. Like stream_open_file, an instance is returned in any case,
+ * which must be checked with remote_stream_has_error and closed with remote_stream_close.
+ */
+RemoteInstance *remote_stream_open_file(RemoteConnection *rc, int mode, char *filename)
+{
+	RemoteInstance *ri;
+	IpcRequest req;
+	IpcResponse response;
+	int fd = -1;
+
+	ri = calloc(1, sizeof(RemoteInstance));
+	if (ri == NULL) {
+		return NULL;
+	}
+	ri->connection = rc;
+
+	memset(&req, 0, sizeof(req));
+	req.command = IPC_OPEN;
+	req.mode = mode;
+	if (exchange(ri, &req, filename, &response, &fd) < 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		if (ri->error_message[0] == '\0') {
+			snprintf(ri->error_message, sizeof(ri->error_message), "cannot open %s", filename);
+		}
+		return ri;
+	}
+
+	ri->id = response.instance;
+	ri->video_output = response.video_output;
+
+	if (fd < 0) {
+		snprintf(ri->error_message, sizeof(ri->error_message), "no shared memory received");
+		return ri;
+	}
+	ri->map_size = response.ring_size;
+	ri->ring = mmap(NULL, ri->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ri->ring == MAP_FAILED) {
+		ri->ring = NULL;
+		snprintf(ri->error_message, sizeof(ri->error_message), "cannot map shared memory: %s", strerror(errno));
+	}
+
+	return ri;
+}
+
+void *remote_stream_get_output_config(RemoteInstance *ri, int type)
+{
+	if (type == TYPE_AUDIO) {
+		return &ri->audio_output;
+	}
+	else if (type == TYPE_VIDEO) {
+		return &ri->video_output;
+	}
+
+	return NULL;
+}
+
+/*
+ * Reads the next frame from the instance's ring, waiting until the server has decoded it.
+ * Returns the same as stream_read_frame.
+ */
+int remote_stream_read_frame(RemoteInstance *ri, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size, int *frame_type)
+{
+	IpcRing *ring = ri->ring;
+	IpcRecord *record;
+	int64_t offset;
+	int size;
+
+	if (ring == NULL) {
+		return -1;
+	}
+
+	if (ipc_lock(ring) < 0) {
+		goto died;
+	}
+	while (1) {
+		int ret;
+
+		if (ring->closed) {
+			pthread_mutex_unlock(&ring->mutex);
+			goto died;
+		}
+		if (ring->read_pos == ring->write_pos) {
+			ret = ipc_wait(ring, &ring->not_empty);
+			if (ret < 0) {
+				goto died;
+			}
+			if (ret == 1 && !server_alive(ri->connection)) {
+				pthread_mutex_unlock(&ring->mutex);
+				goto died;
+			}
+			continue;
+		}
+
+		offset = ring->read_pos % ring->capacity;
+		record = (IpcRecord *)(ipc_ring_data(ring) + offset);
+		if (record->kind != IPC_RECORD_PAD) {
+			break;
+		}
+		ring->read_pos += ring->capacity - offset;
+		pthread_cond_broadcast(&ring->not_full);
+	}
+	pthread_mutex_unlock(&ring->mutex);
+
+	// The end record stays in the ring, so that all further reads fail until the next seek
+	if (record->kind == IPC_RECORD_END) {
+		return -1;
+	}
+
+	// The server does not touch the record before read_pos is advanced
+	size = record->size < output_buffer_size ? record->size : output_buffer_size;
+	memcpy(output_buffer, record + 1, size);
+	*timestamp = record->timestamp;
+	*frame_type = record->frame_type;
+	if (record->frame_type == TYPE_AUDIO) {
+		ri->audio_output.sample_position = record->sample_position;
+	}
+	else {
+		ri->video_output.sample_position = record->sample_position;
+		ri->video_output.current_frame.keyframe = record->props[0];
+		ri->video_output.current_frame.pict_type = record->props[1];
+		ri->video_output.current_frame.interlaced = record->props[2];
+		ri->video_output.current_frame.top_field_first = record->props[3];
+	}
+	if (record->frame_type == TYPE_AUDIO && size < record->size) {
+		size /= ri->audio_output.format.channels * ri->audio_output.format.sample_size; // samples of a truncated frame
+	}
+	else {
+		size = record->length;
+	}
+
+	if (ipc_lock(ring) < 0) {
+		goto died;
+	}
+	ring->read_pos += ipc_align(sizeof(IpcRecord) + record->size);
+	pthread_cond_broadcast(&ring->not_full);
+	pthread_mutex_unlock(&ring->mutex);
+
+	return size;
+
+died:
+	snprintf(ri->error_message, sizeof(ri->error_message), "decode server died");
+	return -1;
+}
+
+int remote_stream_seek(RemoteInstance *ri, int64_t timestamp, int type)
+{
+	IpcRequest req;
+	IpcResponse response;
+
+	memset(&req, 0, sizeof(req));
+	req.command = IPC_SEEK;
+	req.timestamp = timestamp;
+	req.type = type;
+
+	return exchange(ri, &req, NULL, &response, NULL);
+}
+
+/*
+ * Creates a seek index in the server. Like stream_seekindex_create, this leaves the instance
+ * at the end of the stream.
+ */
+void remote_stream_seekindex_create(RemoteInstance *ri, int type)
+{
+	IpcRequest req;
+	IpcResponse response;
+
+	memset(&req, 0, sizeof(req));
+	req.command = IPC_SEEKINDEX_CREATE;
+	req.type = type;
+
+	exchange(ri, &req, NULL, &response, NULL);
+}
+
+void remote_stream_close(RemoteInstance *ri)
+{
+	IpcRequest req;
+	IpcResponse response;
+
+	if (ri->id > 0) {
+		memset(&req, 0, sizeof(req));
+		req.command = IPC_CLOSE;
+		exchange(ri, &req, NULL, &response, NULL);
+	}
+	if (ri->ring != NULL) {
+		munmap(ri->ring, ri->map_size);
+	}
+	free(ri);
+}
+
+int remote_stream_has_error(RemoteInstance *ri)
+{
+	return ri->error_message[0] != '\0';
+}
+
+char *remote_stream_get_error(RemoteInstance *ri)
+{
+	return ri->error_message;
+}
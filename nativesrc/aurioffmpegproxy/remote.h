@@ -0,0 +1,65 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include "ipc.h"
+#include "thread.h"
+
+/*
+ * Client of the decode server (see server.h), mirroring the file mode subset of the stream_*
+ * API for instances that are decoded in the server process. The client does not depend on
+ * FFmpeg. An instance must only be used by one thread at a time, a connection can be shared
+ * by the instances of multiple threads.
+ *
+ * When the server dies, the calls return errors and the instances can only be closed.
+ */
+
+#define REMOTE_EXPORT __attribute__ ((visibility ("default")))
+
+// Same as in proxy.h
+#define TYPE_AUDIO 0x01
+#define TYPE_VIDEO 0x02
+
+typedef struct RemoteConnection {
+	int					fd;
+	Mutex				mutex; // serializes request/response exchanges
+} RemoteConnection;
+
+typedef struct RemoteInstance {
+	RemoteConnection	*connection;
+	int					id;
+	IpcRing				*ring;
+	int64_t				map_size;
+	IpcAudioOutput		audio_output; // layout of ProxyInstance.audio_output
+	IpcVideoOutput		video_output; // layout of ProxyInstance.video_output
+	char				error_message[IPC_MAX_PAYLOAD + 1];
+} RemoteInstance;
+
+REMOTE_EXPORT RemoteConnection* remote_connect(char* socket_path);
+REMOTE_EXPORT void remote_disconnect(RemoteConnection* rc);
+REMOTE_EXPORT RemoteInstance* remote_stream_open_file(RemoteConnection* rc, int mode, char* filename);
+REMOTE_EXPORT void* remote_stream_get_output_config(RemoteInstance* ri, int type);
+REMOTE_EXPORT int remote_stream_read_frame(RemoteInstance* ri, int64_t* timestamp, uint8_t* output_buffer, int output_buffer_size, int* frame_type);
+REMOTE_EXPORT int remote_stream_seek(RemoteInstance* ri, int64_t timestamp, int type);
+REMOTE_EXPORT void remote_stream_seekindex_create(RemoteInstance* ri, int type);
+REMOTE_EXPORT void remote_stream_close(RemoteInstance* ri);
+REMOTE_EXPORT int remote_stream_has_error(RemoteInstance* ri);
+REMOTE_EXPORT char* remote_stream_get_error(RemoteInstance* ri);
@@ -0,0 +1,279 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#include <string.h>
+
+#include "proxy.h"
+#include "reverse.h"
+
+/*
+ * Reverse playback.
+ *
+ * Stepping backwards with a seek and a forward read per frame decodes most frames over
+ * and over again, because each seek goes back to a keyframe (or pre-roll) well before the
+ * target. Instead, a block before the current position (a GOP of video, or a second of
+ * audio) is decoded forward once, kept, and emitted frame by frame in reverse order. Then
+ * the previous block is decoded, starting from where the seek index (if created) and the
+ * demuxer can enter the stream. Reverse playback therefore costs about as much as forward
+ * decoding, plus one seek per block.
+ */
+
+static void clear_frames(ReverseReader *r)
+{
+	for (int i = 0; i < r->count; i++) {
+		free(r->frames[i].data);
+	}
+	r->count = 0;
+	r->size = 0;
+}
+
+static int add_frame(ReverseReader *r, int64_t timestamp, int length, const uint8_t *data, int size, const int *info)
+{
+	ReverseFrame *frame;
+
+	if (r->type == TYPE_VIDEO && r->count == REVERSE_MAX_FRAMES) {
+		// Keep the end of a long GOP, its beginning is decoded again for the next block
+		free(r->frames[0].data);
+		r->size -= r->frames[0].size;
+		memmove(&r->frames[0], &r->frames[1], sizeof(ReverseFrame) * (r->count - 1));
+		r->count--;
+	}
+
+	if (r->count == r->capacity) {
+		int capacity = r->capacity > 0 ? r->capacity * 2 : 16;
+		ReverseFrame *frames = realloc(r->frames, sizeof(ReverseFrame) * capacity);
+		if (frames == NULL) {
+			return -1;
+		}
+		r->frames = frames;
+		r->capacity = capacity;
+	}
+
+	frame = &r->frames[r->count];
+	frame->data = malloc(size);
+	if (frame->data == NULL) {
+		return -1;
+	}
+	memcpy(frame->data, data, size);
+	frame->timestamp = timestamp;
+	frame->length = length;
+	frame->size = size;
+	if (info != NULL) {
+		memcpy(frame->info, info, sizeof(frame->info));
+	}
+	r->count++;
+	r->size += size;
+
+	return 0;
+}
+
+/*
+ * Decodes the block of frames that ends at the current position. Returns the number of
+ * frames in the block, 0 at the beginning of the stream, or a negative number on error.
+ */
+static int decode_block(ProxyInstance *pi, ReverseReader *r)
+{
+	AVStream *stream = r->type == TYPE_AUDIO ? pi->audio_stream : pi->video_stream;
+	double rate = r->type == TYPE_AUDIO ? pi->audio_output.format.sample_rate : pi->video_output.format.frame_rate;
+	int block_size = r->type == TYPE_AUDIO ? pi->audio_output.format.channels * pi->audio_output.format.sample_size : 0;
+	int64_t end = r->position;
+	int64_t origin, window, target, timestamp;
+	int samples, frame_type;
+
+	origin = stream->start_time != AV_NOPTS_VALUE ? pts_to_samples(rate, stream->time_base, stream->start_time) : 0;
+
+	for (int attempt = 0; attempt <= REVERSE_SEEK_RETRIES; attempt++) {
+		int late = 0;
+
+		if (end <= origin) {
+			return 0;
+		}
+
+		/*
+		 * Audio frames all are entry points, the block covers a fixed window before the end and
+		 * the decoder is sought a pre-roll before it. Video blocks start at the keyframe that the
+		 * seek ends up at.
+		 */
+		if (r->type == TYPE_AUDIO) {
+			int64_t preroll = pi->audio_output.format.sample_rate / 5 + stream->codecpar->seek_preroll;
+			window = FFMAX(end - (int64_t)pi->audio_output.format.sample_rate * REVERSE_BLOCK, origin);
+			target = window - preroll - attempt * (preroll + pi->audio_output.format.sample_rate);
+		}
+		else {
+			window = origin;
+			target = end - 1 - attempt * REVERSE_MAX_FRAMES;
+		}
+
+		// Resets the reader, the end of the block is kept locally
+		if (stream_seek(pi, FFMAX(target, 0), r->type) < 0) {
+			return -1;
+		}
+
+		while ((samples = stream_read_frame(pi, &timestamp, r->buffer, r->buffer_size, &frame_type)) >= 0) {
+			if (frame_type != r->type) {
+				continue;
+			}
+			if (timestamp >= end) {
+				break;
+			}
+
+			if (r->type == TYPE_AUDIO) {
+				// Trim the frame to the block, the pre-roll belongs to the previous block
+				int64_t from = FFMAX(timestamp, window);
+				int64_t to = FFMIN(timestamp + samples, end);
+
+				if (r->count == 0 && timestamp > window) {
+					late = 1;
+					break;
+				}
+				if (from < to && add_frame(r, from, (int)(to - from), r->buffer + (from - timestamp) * block_size,
+					(int)(to - from) * block_size, NULL) < 0) {
+					return -1;
+				}
+			}
+			else {
+				int info[REVERSE_INFO_SIZE] = {
+					pi->video_output.current_frame.keyframe,
+					pi->video_output.current_frame.pict_type,
+					pi->video_output.current_frame.interlaced,
+					pi->video_output.current_frame.top_field_first,
+				};
+				if (add_frame(r, timestamp, 1, r->buffer, r->buffer_size, info) < 0) {
+					return -1;
+				}
+			}
+		}
+
+		if (!late && r->count > 0) {
+			r->position = r->frames[0].timestamp;
+			return r->count;
+		}
+
+		// The seek ended up behind the block, retry from an earlier position
+		clear_frames(r);
+	}
+
+	proxy_log(pi, PI_LOG_WARNING, "reverse block before %"PRId64" cannot be reached", end);
+
+	return -1;
+}
+
+void reverse_reset(ReverseReader *r, int64_t position)
+{
+	clear_frames(r);
+	r->position = position;
+}
+
+void reverse_free(ReverseReader *r)
+{
+	clear_frames(r);
+	free(r->frames);
+	free(r->buffer);
+	free(r);
+}
+
+/*
+ * Reads the frame before the current position, and steps the position back to its start.
+ * Reverse reading starts at the position of the last seek, or at the current reading position
+ * if there was no seek, e.g. seek to the length of the stream to play it backwards from the
+ * end. The samples of an audio frame are returned in reverse order. After reading in reverse,
+ * a seek is required to continue reading forward. Only instances that decode a single type
+ * are supported.
+ *
+ * Returns the number of samples (audio) or 1 (video) like stream_read_frame, or a negative
+ * number at the beginning of the stream or on error.
+ */
+int stream_read_frame_reverse(ProxyInstance *pi, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size, int *frame_type)
+{
+	ReverseReader *r = pi->reverse;
+	int type = pi->mode & TYPE_MASK;
+	ReverseFrame *frame;
+	int length;
+
+	if (type != TYPE_AUDIO && type != TYPE_VIDEO) {
+		proxy_log(pi, PI_LOG_ERROR, "reverse reading requires an instance that decodes a single type");
+		return -1;
+	}
+	if (pi->mode & (MODE_LIVE | MODE_DISPATCH)) {
+		proxy_log(pi, PI_LOG_ERROR, "reverse reading is not supported in live or dispatch mode");
+		return -1;
+	}
+	if (pi->released && acquire_decoders(pi, 1) < 0) {
+		return -1;
+	}
+
+	if (r == NULL) {
+		r = calloc(1, sizeof(ReverseReader));
+		if (r == NULL) {
+			return -1;
+		}
+		r->type = type;
+		r->buffer_size = type == TYPE_AUDIO
+			? pi->audio_output.frame_size * pi->audio_output.format.channels * pi->audio_output.format.sample_size
+			: pi->video_output.frame_size;
+		r->buffer = malloc(r->buffer_size);
+		if (r->buffer == NULL) {
+			free(r);
+			return -1;
+		}
+		r->position = pi->seek_target != AV_NOPTS_VALUE && pi->seek_target_type == type
+			? pi->seek_target
+			: type == TYPE_AUDIO ? pi->audio_output.sample_position : pi->video_output.sample_position;
+		pi->reverse = r;
+	}
+
+	if (r->count == 0 && decode_block(pi, r) <= 0) {
+		return -1;
+	}
+
+	frame = &r->frames[--r->count];
+	r->size -= frame->size;
+
+	if (frame->size > output_buffer_size) {
+		proxy_log(pi, PI_LOG_WARNING, "output buffer too small, truncating frame (%d < %d bytes)", output_buffer_size, frame->size);
+	}
+
+	if (type == TYPE_AUDIO) {
+		int block_size = pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+		length = FFMIN(frame->length, output_buffer_size / block_size);
+
+		// Reverse the samples, keeping the channels of each sample in order
+		for (int i = 0; i < length; i++) {
+			memcpy(output_buffer + i * block_size, frame->data + (frame->length - 1 - i) * block_size, block_size);
+		}
+		pi->audio_output.sample_position = frame->timestamp;
+		*timestamp = frame->timestamp + frame->length - length; // the samples at the start of a truncated frame are dropped
+	}
+	else {
+		length = frame->length;
+		memcpy(output_buffer, frame->data, FFMIN(frame->size, output_buffer_size));
+		pi->video_output.sample_position = frame->timestamp;
+		pi->video_output.current_frame.keyframe = frame->info[0];
+		pi->video_output.current_frame.pict_type = frame->info[1];
+		pi->video_output.current_frame.interlaced = frame->info[2];
+		pi->video_output.current_frame.top_field_first = frame->info[3];
+		*timestamp = frame->timestamp;
+	}
+
+	*frame_type = type;
+	free(frame->data);
+
+	return length;
+}
@@ -0,0 +1,52 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#define REVERSE_BLOCK 1 // seconds of audio decoded per block
+#define REVERSE_MAX_FRAMES 32 // video frames kept per block, longer GOPs are decoded in several passes
+#define REVERSE_SEEK_RETRIES 3
+#define REVERSE_INFO_SIZE 4
+
+typedef struct ReverseFrame {
+	int64_t				timestamp;
+	int					length; // samples per channel for audio, 1 for video
+	int					size; // bytes
+	uint8_t				*data;
+	int					info[REVERSE_INFO_SIZE]; // video frame properties
+} ReverseFrame;
+
+/*
+ * A block of frames that has been decoded forward and is emitted in reverse order,
+ * see stream_read_frame_reverse.
+ */
+typedef struct ReverseReader {
+	int					type;
+	int64_t				position; // start of the current block, where the previous block ends
+	ReverseFrame		*frames; // in timeline order, emitted from the end
+	int					count;
+	int					capacity;
+	int64_t				size; // bytes of the frames
+	uint8_t				*buffer; // decoding buffer
+	int					buffer_size;
+} ReverseReader;
+
+void reverse_reset(ReverseReader *r, int64_t position);
+void reverse_free(ReverseReader *r);
@@ -24,6 +24,7 @@
 #include <inttypes.h>
 
 #include "seekindex.h"
+#include "thread.h"
 
 #define BUILDER_INDEX_SIZE 100
 
@@ -52,6 +53,7 @@ SeekIndex *seekindex_build() {
 
 	// Set initial values
 	si->index = NULL;
+	si->references = 1;
 
 	// Add the first builder
 	si->builder_first = builder_create();
@@ -148,8 +150,7 @@ int seekindex_find(SeekIndex *si, int64_t timestamp, int64_t *index_timestamp) {
 	size_t left, right, mid;
 
 	if (si->index == NULL) {
-		fprintf(stderr, "index not finalized\n");
-		return -1;
+		return -1; // index not finalized
 	}
 
 	// Init binary search boundaries
@@ -190,9 +191,29 @@ int seekindex_find(SeekIndex *si, int64_t timestamp, int64_t *index_timestamp) {
 }
 
 /*
- * Frees all memory of the index.
+ * Adds a reference to a finalized index, e.g. to share it with another decoder
+ * instance of the same stream. A finalized index is immutable and can be used
+ * by multiple threads concurrently. Every reference must be released with
+ * seekindex_free(). Returns NULL if the index is not finalized.
+ */
+SeekIndex *seekindex_ref(SeekIndex *si) {
+	if (si->index == NULL) {
+		return NULL; // index not finalized
+	}
+
+	atomic_int64_fetch_add(&si->references, 1);
+
+	return si;
+}
+
+/*
+ * Releases a reference to the index, and frees all memory of the index when
+ * the last reference is released.
 */
 void seekindex_free(SeekIndex *si) {
+	if (atomic_int64_fetch_add(&si->references, -1) > 1) {
+		return;
+	}
 	if (si->builder_first != NULL) {
 		builder_free(si->builder_first);
 	}
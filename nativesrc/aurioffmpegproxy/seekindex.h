@@ -32,12 +32,15 @@ typedef struct SeekIndex {
 							  // fields required for building the index
 	SeekIndexBuildHelper	*builder_first; // the first index build helper
 	SeekIndexBuildHelper	*builder_current; // the current ibh, so we don't have to go through all references at every insert
+
+	volatile int64_t		references; // the index is shared between instances of the same stream, see seekindex_ref
 } SeekIndex;
 
 SeekIndex *seekindex_build();
 void seekindex_build_add(SeekIndex *si, int64_t timestamp);
 void seekindex_build_finalize(SeekIndex *si);
 int seekindex_find(SeekIndex *si, int64_t timestamp, int64_t *index_timestamp);
+SeekIndex *seekindex_ref(SeekIndex *si);
 void seekindex_free(SeekIndex *si);
 void seekindex_test();
 void seekindex_debugoutput(SeekIndex *si);
\ No newline at end of file
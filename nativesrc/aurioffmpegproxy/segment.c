@@ -0,0 +1,302 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+
+#include "proxy.h"
+#include "thread.h"
+#include "framequeue.h"
+
+#include "libavutil/cpu.h"
+
+/*
+ * Parallel decoding of a single audio stream.
+ *
+ * The stream is split into consecutive time segments, and each segment is decoded
+ * by an independent instance (with its own demuxer and decoder) on its own thread.
+ * Each instance seeks to its segment start minus a pre-roll, decodes and discards
+ * the pre-roll to bring the decoder into a steady state (e.g. MDCT overlap, MP3 bit
+ * reservoir), and then trims the decoded frames to the exact segment boundaries.
+ * The concatenation of all segments is therefore sample-exact with a sequential
+ * decoding pass.
+ */
+
+#define SEGMENT_QUEUE_CAPACITY 256 // frames buffered per segment in ordered mode
+#define SEGMENT_SEEK_RETRIES 3
+
+typedef struct SegmentTask {
+	int					index;
+	char				*filename;
+	SeekIndex			*seekindex; // optional, shared with the segment's instance
+	int64_t				origin; // first sample of the stream
+	int64_t				start; // first sample of the segment
+	int64_t				end; // first sample after the segment
+	int64_t				preroll;
+	int					seek; // whether the segment needs to seek to its start (not required for the first segment)
+	FrameQueue			*queue; // ordered mode: frames are handed to the calling thread
+	SegmentSink			sink; // unordered mode: frames are directly delivered from the segment thread
+	void				*opaque;
+	volatile int		*abort;
+	int					ret;
+	Thread				thread;
+} SegmentTask;
+
+static int segment_deliver(SegmentTask *task, int64_t timestamp, uint8_t *buffer, int samples, int block_size)
+{
+	if (task->queue != NULL) {
+		return framequeue_put(task->queue, TYPE_AUDIO, timestamp, samples, buffer, samples * block_size);
+	}
+
+	return task->sink(task->opaque, task->index, timestamp, buffer, samples) == 0 ? 0 : -1;
+}
+
+static void *segment_worker(void *arg)
+{
+	SegmentTask *task = arg;
+	ProxyInstance *pi;
+	uint8_t *buffer = NULL;
+	int buffer_size, block_size;
+	int64_t timestamp, seek_target;
+	int samples, frame_type;
+
+	pi = stream_open_file(TYPE_AUDIO, task->filename);
+	if (stream_has_error(pi)) {
+		task->ret = -1;
+		goto end;
+	}
+
+	if (task->seekindex != NULL) {
+		pi->audio_seekindex = seekindex_ref(task->seekindex);
+	}
+
+	block_size = pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+	buffer_size = pi->audio_output.frame_size * block_size;
+	buffer = malloc(buffer_size);
+	if (buffer == NULL) {
+		task->ret = -1;
+		goto end;
+	}
+
+	/*
+	 * Position the decoder before the pre-roll. Seeks can end up behind the target
+	 * (see stream_seek), in which case the seek is repeated to an earlier position.
+	 * A seek that lands within the pre-roll is a miss too, because the decoder would
+	 * not reach a steady state before the segment start. Only the stream start needs
+	 * no pre-roll.
+	 */
+	if (task->seek) {
+		seek_target = task->start - task->preroll;
+		for (int attempt = 0; ; attempt++) {
+			stream_seek(pi, seek_target, TYPE_AUDIO);
+			samples = stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type);
+			if (samples < 0 || timestamp <= FFMAX(task->start - task->preroll, task->origin)) {
+				break;
+			}
+			if (attempt == SEGMENT_SEEK_RETRIES) {
+				proxy_log(pi, PI_LOG_WARNING, "segment %d: seek target %"PRId64" missed", task->index, task->start);
+				task->ret = -2;
+				goto end;
+			}
+			seek_target -= task->preroll + pi->audio_output.format.sample_rate;
+		}
+	}
+	else {
+		samples = stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type);
+	}
+
+	// Decode and deliver the samples within the segment boundaries
+	while (samples >= 0 && !atomic_int_load(task->abort)) {
+		int64_t frame_end = timestamp + samples;
+
+		if (frame_end > task->start && timestamp < task->end) {
+			int64_t from = FFMAX(timestamp, task->start);
+			int64_t to = FFMIN(frame_end, task->end);
+
+			if (segment_deliver(task, from, buffer + (from - timestamp) * block_size, (int)(to - from), block_size) < 0) {
+				atomic_int_store(task->abort, 1);
+				break;
+			}
+		}
+
+		if (frame_end >= task->end) {
+			break;
+		}
+
+		samples = stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type);
+	}
+
+end:
+	if (task->ret < 0) {
+		atomic_int_store(task->abort, 1); // a gap in the output is not acceptable, stop all segments
+	}
+	if (task->queue != NULL) {
+		framequeue_close(task->queue);
+	}
+	free(buffer);
+	stream_close(pi);
+
+	return NULL;
+}
+
+/*
+ * Decodes the audio stream of a file mode instance in parallel segments and returns 0 on success,
+ * 1 if the sink aborted decoding, or a negative number on error.
+ *
+ * The segment boundaries are evenly distributed over the stream length, and snapped to the
+ * frame timestamps of the seek index if one has been created. Each segment decodes `preroll`
+ * samples before its start that are not delivered (a negative value selects a default).
+ *
+ * By default, the sink is called concurrently from the segment threads, each segment in
+ * timeline order on its own thread. With SEGMENT_ORDERED, all segments are delivered in timeline
+ * order on the calling thread, with each segment buffering up to SEGMENT_QUEUE_CAPACITY frames
+ * ahead of the consumer (which limits parallelism when the sink is slower than decoding).
+ */
+int stream_decode_segmented(ProxyInstance *pi, int segment_count, int64_t preroll, int flags, void *opaque, SegmentSink sink)
+{
+	SegmentTask *tasks;
+	volatile int aborted = 0;
+	int64_t origin, length, boundary;
+	int count, ret = 0;
+
+	if (pi->source_filename == NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "segmented decoding requires an instance in file mode");
+		return -1;
+	}
+	if (!(pi->mode & TYPE_AUDIO)) {
+		proxy_log(pi, PI_LOG_ERROR, "segmented decoding requires an audio stream");
+		return -1;
+	}
+	if (pi->audio_output.length == AV_NOPTS_VALUE) {
+		proxy_log(pi, PI_LOG_ERROR, "segmented decoding requires a known stream length");
+		return -1;
+	}
+	if (pi->released && acquire_decoders(pi, 1) < 0) {
+		return -1;
+	}
+
+	if (segment_count <= 0) {
+		segment_count = av_cpu_count();
+	}
+	if (preroll < 0) {
+		preroll = pi->audio_output.format.sample_rate / 5 + pi->audio_stream->codecpar->seek_preroll;
+	}
+
+	origin = pi->audio_stream->start_time != AV_NOPTS_VALUE
+		? pts_to_samples(pi->audio_output.format.sample_rate, pi->audio_stream->time_base, pi->audio_stream->start_time)
+		: 0;
+	length = pi->audio_output.length;
+
+	tasks = malloc(sizeof(SegmentTask) * segment_count);
+	if (tasks == NULL) {
+		return -1;
+	}
+
+	// Determine segment boundaries, skipping empty segments (e.g. from snapping to a sparse index)
+	count = 0;
+	for (int i = 0; i < segment_count; i++) {
+		SegmentTask *task;
+
+		boundary = origin + length * i / segment_count;
+		if (i > 0 && pi->audio_seekindex != NULL) {
+			int64_t index_timestamp;
+			if (seekindex_find(pi->audio_seekindex, boundary, &index_timestamp) == 0) {
+				boundary = index_timestamp;
+			}
+		}
+		if (count > 0 && boundary <= tasks[count - 1].start) {
+			continue;
+		}
+
+		task = &tasks[count];
+		task->index = count;
+		task->filename = pi->source_filename;
+		task->seekindex = pi->audio_seekindex;
+		task->origin = origin;
+		task->start = count == 0 ? INT64_MIN : boundary; // do not trim anything before the first segment
+		task->end = INT64_MAX; // set below by the succeeding segment
+		task->preroll = preroll;
+		task->seek = count > 0;
+		task->queue = NULL;
+		task->sink = sink;
+		task->opaque = opaque;
+		task->abort = &aborted;
+		task->ret = 0;
+
+		if (count > 0) {
+			tasks[count - 1].end = boundary;
+		}
+		count++;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (flags & SEGMENT_ORDERED) {
+			tasks[i].queue = framequeue_create(SEGMENT_QUEUE_CAPACITY);
+		}
+		if (thread_create(&tasks[i].thread, segment_worker, &tasks[i]) < 0) {
+			proxy_log(pi, PI_LOG_ERROR, "segment %d: cannot create thread", i);
+			atomic_int_store(&aborted, 1);
+			count = i; // only join the started threads
+			ret = -1;
+			if (tasks[i].queue != NULL) {
+				framequeue_free(tasks[i].queue);
+			}
+			break;
+		}
+	}
+
+	if (flags & SEGMENT_ORDERED) {
+		// Drain the segment queues in timeline order
+		for (int i = 0; i < count; i++) {
+			FrameQueueItem item;
+
+			while (framequeue_get(tasks[i].queue, &item)) {
+				if (!atomic_int_load(&aborted) && sink(opaque, i, item.timestamp, item.data, item.length) != 0) {
+					atomic_int_store(&aborted, 1);
+				}
+				framequeue_item_release(&item);
+			}
+
+			if (atomic_int_load(&aborted)) {
+				// Unblock all segment threads waiting for queue space
+				for (int j = i; j < count; j++) {
+					framequeue_abort(tasks[j].queue);
+				}
+				break;
+			}
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		thread_join(tasks[i].thread);
+		if (tasks[i].ret < 0) {
+			ret = tasks[i].ret;
+		}
+		if (tasks[i].queue != NULL) {
+			framequeue_free(tasks[i].queue);
+		}
+	}
+
+	free(tasks);
+
+	if (ret == 0 && atomic_int_load(&aborted)) {
+		ret = 1;
+	}
+
+	return ret;
+}
@@ -0,0 +1,576 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "proxy.h"
+#include "thread.h"
+#include "ipc.h"
+#include "server.h"
+
+/*
+ * The server accepts client connections on a Unix domain socket and serves each connection
+ * on its own thread. A connection can open any number of instances. Every instance has a
+ * worker thread that decodes ahead into the instance's shared memory ring until the ring is
+ * full, so a client usually finds the next frame already decoded. Seeks pause the worker,
+ * reposition the instance and restart the ring empty.
+ */
+
+typedef struct ServerInstance {
+	ProxyInstance		*pi;
+	IpcRing				*ring;
+	int64_t				map_size;
+	int					shm_fd;
+	int					max_record; // bytes of the largest record, header included
+	Thread				thread;
+	Mutex				mutex;
+	Cond				cond;
+	volatile int		pause;
+	volatile int		paused;
+	volatile int		end; // the end record has been written
+	volatile int		abort;
+} ServerInstance;
+
+typedef struct Connection {
+	int					fd;
+	ServerInstance		**instances; // indexed by instance id - 1, NULL when closed
+	int					count;
+	Thread				thread;
+	char				error[IPC_MAX_PAYLOAD];
+	volatile int		done;
+	struct Connection	*next;
+} Connection;
+
+static volatile int64_t shm_counter = 0;
+
+static void *instance_worker(void *arg)
+{
+	ServerInstance *si = arg;
+	IpcRing *ring = si->ring;
+	uint8_t *data = ipc_ring_data(ring);
+	int64_t capacity = ring->capacity;
+
+	while (1) {
+		IpcRecord *record;
+		int64_t offset, timestamp;
+		int ret, frame_type, size;
+
+		// Pause for control requests, and after the end until the next seek
+		mutex_lock(&si->mutex);
+		while ((si->pause || si->end) && !si->abort) {
+			si->paused = 1;
+			cond_broadcast(&si->cond);
+			cond_wait(&si->cond, &si->mutex);
+		}
+		si->paused = 0;
+		if (si->abort) {
+			mutex_unlock(&si->mutex);
+			break;
+		}
+		mutex_unlock(&si->mutex);
+
+		// Wait for contiguous space for the largest possible record
+		if (ipc_lock(ring) < 0) {
+			break;
+		}
+		while (1) {
+			int64_t free_space = capacity - (ring->write_pos - ring->read_pos);
+
+			offset = ring->write_pos % capacity;
+			if (ring->closed || atomic_int_load(&si->pause)) {
+				break;
+			}
+			if (capacity - offset < si->max_record) {
+				// The record does not fit before the end of the ring, continue at its start
+				if (free_space >= capacity - offset) {
+					record = (IpcRecord *)(data + offset);
+					record->kind = IPC_RECORD_PAD;
+					ring->write_pos += capacity - offset;
+					pthread_cond_broadcast(&ring->not_empty);
+					continue;
+				}
+			}
+			else if (free_space >= si->max_record) {
+				break;
+			}
+			if (ipc_wait(ring, &ring->not_full) < 0) {
+				goto end; // the client died while holding the lock
+			}
+		}
+		if (ring->closed) {
+			pthread_mutex_unlock(&ring->mutex);
+			break;
+		}
+		pthread_mutex_unlock(&ring->mutex);
+		if (atomic_int_load(&si->pause)) {
+			continue;
+		}
+
+		// Decode directly into the reserved space, the client does not read behind write_pos
+		record = (IpcRecord *)(data + offset);
+		ret = stream_read_frame(si->pi, &timestamp, (uint8_t *)(record + 1), si->max_record - (int)sizeof(IpcRecord), &frame_type);
+
+		memset(record, 0, sizeof(IpcRecord));
+		size = 0;
+		if (ret < 0) {
+			record->kind = IPC_RECORD_END;
+			mutex_lock(&si->mutex);
+			si->end = 1;
+			mutex_unlock(&si->mutex);
+		}
+		else {
+			record->kind = IPC_RECORD_FRAME;
+			record->frame_type = frame_type;
+			record->length = ret;
+			record->timestamp = timestamp;
+			if (frame_type == TYPE_AUDIO) {
+				size = ret * si->pi->audio_output.format.channels * si->pi->audio_output.format.sample_size;
+				record->sample_position = si->pi->audio_output.sample_position;
+			}
+			else {
+				size = si->pi->video_output.frame_size;
+				record->sample_position = si->pi->video_output.sample_position;
+				record->props[0] = si->pi->video_output.current_frame.keyframe;
+				record->props[1] = si->pi->video_output.current_frame.pict_type;
+				record->props[2] = si->pi->video_output.current_frame.interlaced;
+				record->props[3] = si->pi->video_output.current_frame.top_field_first;
+			}
+			record->size = size;
+		}
+
+		if (ipc_lock(ring) < 0) {
+			break;
+		}
+		ring->write_pos += ipc_align(sizeof(IpcRecord) + size);
+		pthread_cond_broadcast(&ring->not_empty);
+		pthread_mutex_unlock(&ring->mutex);
+	}
+
+end:
+	// Do not block control requests after the worker stopped
+	mutex_lock(&si->mutex);
+	si->paused = 1;
+	cond_broadcast(&si->cond);
+	mutex_unlock(&si->mutex);
+
+	return NULL;
+}
+
+/*
+ * Stops the worker of an instance at a frame boundary, so that the instance can be
+ * accessed from the connection thread.
+ */
+static void instance_pause(ServerInstance *si)
+{
+	mutex_lock(&si->mutex);
+	si->pause = 1;
+	mutex_unlock(&si->mutex);
+
+	// Wake the worker if it waits for space in the ring
+	if (ipc_lock(si->ring) == 0) {
+		pthread_cond_broadcast(&si->ring->not_full);
+		pthread_mutex_unlock(&si->ring->mutex);
+	}
+
+	mutex_lock(&si->mutex);
+	while (!si->paused) {
+		cond_wait(&si->cond, &si->mutex);
+	}
+	mutex_unlock(&si->mutex);
+}
+
+/*
+ * Discards the decoded frames in the ring after the instance has been repositioned, and
+ * resumes decoding ahead. The client must not read from the ring in the meantime.
+ */
+static void instance_restart(ServerInstance *si)
+{
+	if (ipc_lock(si->ring) == 0) {
+		si->ring->read_pos = 0;
+		si->ring->write_pos = 0;
+		pthread_mutex_unlock(&si->ring->mutex);
+	}
+
+	mutex_lock(&si->mutex);
+	si->pause = 0;
+	si->end = 0;
+	cond_broadcast(&si->cond);
+	mutex_unlock(&si->mutex);
+}
+
+static int ring_create(ServerInstance *si, int64_t capacity)
+{
+	pthread_mutexattr_t mutex_attr;
+	pthread_condattr_t cond_attr;
+	char name[64];
+
+	// The name is only needed until the memory is mapped, the descriptor is passed to the client
+	snprintf(name, sizeof(name), "/aurioffmpegproxy-%d-%lld", (int)getpid(), (long long)atomic_int64_fetch_add(&shm_counter, 1));
+	si->shm_fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (si->shm_fd < 0) {
+		return -1;
+	}
+	shm_unlink(name);
+
+	si->map_size = ipc_ring_header_size() + capacity;
+	if (ftruncate(si->shm_fd, si->map_size) < 0) {
+		return -1;
+	}
+	si->ring = mmap(NULL, si->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, si->shm_fd, 0);
+	if (si->ring == MAP_FAILED) {
+		si->ring = NULL;
+		return -1;
+	}
+
+	pthread_mutexattr_init(&mutex_attr);
+	pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&si->ring->mutex, &mutex_attr);
+	pthread_mutexattr_destroy(&mutex_attr);
+
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+	pthread_cond_init(&si->ring->not_empty, &cond_attr);
+	pthread_cond_init(&si->ring->not_full, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+
+	si->ring->capacity = capacity;
+	si->ring->write_pos = 0;
+	si->ring->read_pos = 0;
+	si->ring->closed = 0;
+
+	return 0;
+}
+
+static void instance_free(ServerInstance *si)
+{
+	if (si->ring != NULL) {
+		mutex_lock(&si->mutex);
+		si->abort = 1;
+		cond_broadcast(&si->cond);
+		mutex_unlock(&si->mutex);
+
+		// The lock fails if the client died while holding it, the worker then stops by itself
+		if (ipc_lock(si->ring) == 0) {
+			si->ring->closed = 1;
+			pthread_cond_broadcast(&si->ring->not_full);
+			pthread_cond_broadcast(&si->ring->not_empty);
+			pthread_mutex_unlock(&si->ring->mutex);
+		}
+		thread_join(si->thread);
+
+		munmap(si->ring, si->map_size);
+	}
+	if (si->shm_fd >= 0) {
+		close(si->shm_fd);
+	}
+	cond_destroy(&si->cond);
+	mutex_destroy(&si->mutex);
+	stream_close(si->pi);
+	free(si);
+}
+
+static ServerInstance *instance_create(ProxyInstance *pi)
+{
+	ServerInstance *si;
+	int max_frame = 0;
+
+	si = calloc(1, sizeof(ServerInstance));
+	if (si == NULL) {
+		return NULL;
+	}
+	si->pi = pi;
+	si->shm_fd = -1;
+	mutex_init(&si->mutex);
+	cond_init(&si->cond);
+
+	if (pi->mode & TYPE_AUDIO) {
+		max_frame = pi->audio_output.frame_size * pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+	}
+	if ((pi->mode & TYPE_VIDEO) && pi->video_output.frame_size > max_frame) {
+		max_frame = pi->video_output.frame_size;
+	}
+	si->max_record = (int)ipc_align(sizeof(IpcRecord) + max_frame);
+
+	if (ring_create(si, (int64_t)si->max_record * IPC_RING_FRAMES) < 0) {
+		instance_free(si);
+		return NULL;
+	}
+
+	if (thread_create(&si->thread, instance_worker, si) < 0) {
+		munmap(si->ring, si->map_size);
+		si->ring = NULL;
+		instance_free(si);
+		return NULL;
+	}
+
+	return si;
+}
+
+static void set_output_configs(IpcResponse *response, ProxyInstance *pi)
+{
+	response->audio_output.format.sample_rate = pi->audio_output.format.sample_rate;
+	response->audio_output.format.sample_size = pi->audio_output.format.sample_size;
+	response->audio_output.format.channels = pi->audio_output.format.channels;
+	response->audio_output.length = pi->audio_output.length;
+	response->audio_output.frame_size = pi->audio_output.frame_size;
+	response->audio_output.sample_position = pi->audio_output.sample_position;
+
+	response->video_output.format.width = pi->video_output.format.width;
+	response->video_output.format.height = pi->video_output.format.height;
+	response->video_output.format.frame_rate = pi->video_output.format.frame_rate;
+	response->video_output.format.aspect_ratio = pi->video_output.format.aspect_ratio;
+	response->video_output.length = pi->video_output.length;
+	response->video_output.frame_size = pi->video_output.frame_size;
+	response->video_output.sample_position = pi->video_output.sample_position;
+}
+
+static ServerInstance *get_instance(Connection *c, int id)
+{
+	if (id < 1 || id > c->count) {
+		return NULL;
+	}
+	return c->instances[id - 1];
+}
+
+static int add_instance(Connection *c, ServerInstance *si)
+{
+	ServerInstance **instances;
+
+	for (int i = 0; i < c->count; i++) {
+		if (c->instances[i] == NULL) {
+			c->instances[i] = si;
+			return i + 1;
+		}
+	}
+
+	instances = realloc(c->instances, sizeof(ServerInstance *) * (c->count + 1));
+	if (instances == NULL) {
+		return -1;
+	}
+	c->instances = instances;
+	c->instances[c->count++] = si;
+
+	return c->count;
+}
+
+/*
+ * Handles a request and fills the response. Returns the error message to send along, or NULL.
+ */
+static const char *handle_request(Connection *c, IpcRequest *request, char *payload, IpcResponse *response, int *pass_fd)
+{
+	ServerInstance *si = NULL;
+	ProxyInstance *pi;
+
+	if (request->version != IPC_PROTOCOL_VERSION) {
+		response->status = -1;
+		return "protocol version mismatch";
+	}
+
+	if (request->command != IPC_OPEN) {
+		si = get_instance(c, request->instance);
+		if (si == NULL) {
+			response->status = -1;
+			return "invalid instance";
+		}
+	}
+
+	switch (request->command) {
+	case IPC_OPEN:
+		if (request->mode & MODE_DISPATCH) {
+			response->status = -1;
+			return "dispatch mode is not supported by the decode server";
+		}
+
+		payload[request->payload_size] = '\0';
+		pi = stream_open_file(request->mode, payload);
+		if (stream_has_error(pi)) {
+			snprintf(c->error, sizeof(c->error), "%s", stream_get_error(pi));
+			stream_close(pi);
+			response->status = -1;
+			return c->error;
+		}
+		set_output_configs(response, pi);
+
+		si = instance_create(pi);
+		if (si == NULL) {
+			response->status = -1;
+			return "cannot create the shared memory ring";
+		}
+		response->instance = add_instance(c, si);
+		if (response->instance < 0) {
+			instance_free(si);
+			response->status = -1;
+			return "out of memory";
+		}
+		response->ring_size = si->map_size;
+		*pass_fd = si->shm_fd;
+		break;
+
+	case IPC_SEEK:
+		instance_pause(si);
+		response->status = stream_seek(si->pi, request->timestamp, request->type);
+		set_output_configs(response, si->pi);
+		instance_restart(si);
+		break;
+
+	case IPC_SEEKINDEX_CREATE:
+		// Leaves the instance at the end, like the in-process call
+		instance_pause(si);
+		stream_seekindex_create(si->pi, request->type);
+		set_output_configs(response, si->pi);
+		instance_restart(si);
+		break;
+
+	case IPC_CLOSE:
+		c->instances[request->instance - 1] = NULL;
+		instance_free(si);
+		break;
+
+	default:
+		response->status = -1;
+		return "unknown command";
+	}
+
+	return NULL;
+}
+
+static void *connection_worker(void *arg)
+{
+	Connection *c = arg;
+	IpcRequest request;
+	IpcResponse response;
+	char payload[IPC_MAX_PAYLOAD + 1];
+
+	while (ipc_recv(c->fd, &request, sizeof(request), payload, IPC_MAX_PAYLOAD, &request.payload_size, NULL) == 0) {
+		const char *error;
+		int pass_fd = -1;
+
+		memset(&response, 0, sizeof(response));
+		error = handle_request(c, &request, payload, &response, &pass_fd);
+		response.payload_size = error != NULL ? (int)strlen(error) : 0;
+
+		if (ipc_send(c->fd, &response, sizeof(response), error, response.payload_size, pass_fd) < 0) {
+			break;
+		}
+	}
+
+	// The client disconnected (or died), close its instances
+	for (int i = 0; i < c->count; i++) {
+		if (c->instances[i] != NULL) {
+			instance_free(c->instances[i]);
+		}
+	}
+	free(c->instances);
+	close(c->fd);
+	atomic_int_store(&c->done, 1);
+
+	return NULL;
+}
+
+/*
+ * Serves clients on a Unix domain socket at the given path until the process is terminated.
+ * Returns a negative number if the socket cannot be set up.
+ */
+int server_run(const char *socket_path)
+{
+	struct sockaddr_un address;
+	Connection *connections = NULL;
+	int fd;
+
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "socket path too long: %s\n", socket_path);
+		return -1;
+	}
+
+	// Writes to disconnected clients must fail instead of terminating the server
+	signal(SIGPIPE, SIG_IGN);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+	unlink(socket_path); // a stale socket of a previous server
+
+	if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, SERVER_BACKLOG) < 0) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+
+	while (1) {
+		Connection *c, **link;
+		int client_fd = accept(fd, NULL, NULL);
+
+		if (client_fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			perror("accept");
+			break;
+		}
+
+		// Reap the threads of closed connections
+		link = &connections;
+		while (*link != NULL) {
+			c = *link;
+			if (atomic_int_load(&c->done)) {
+				thread_join(c->thread);
+				*link = c->next;
+				free(c);
+			}
+			else {
+				link = &c->next;
+			}
+		}
+
+		c = calloc(1, sizeof(Connection));
+		if (c == NULL) {
+			close(client_fd);
+			continue;
+		}
+		c->fd = client_fd;
+		if (thread_create(&c->thread, connection_worker, c) < 0) {
+			close(client_fd);
+			free(c);
+			continue;
+		}
+		c->next = connections;
+		connections = c;
+	}
+
+	close(fd);
+	unlink(socket_path);
+
+	return -1;
+}
@@ -0,0 +1,471 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/* Compatibility settings for the MSVC compiler */
+#ifdef _MSC_VER
+	#define _CRT_SECURE_NO_WARNINGS // disable fopen compile error
+#endif
+
+/**
+ * Stress test for concurrent use of the FFmpeg proxy.
+ *
+ * Runs hundreds of instances at the same time on their own threads, each opening, decoding,
+ * seeking, releasing and closing instances of the same few files in a random order, while the
+ * global log callback is swapped in the background. Full decodes are checked against a
+ * sequential reference pass, so any shared state between instances shows up as a checksum
+ * mismatch (or a crash). Invalid requests (unsupported seek types, missing files) must be
+ * reported as errors and leave the process running.
+ *
+ * Usage: aurioffmpegproxy_stress [-d workdir] [-j threads] [-n jobs] [-t seconds] [-s seed] [file...]
+ *
+ * Exits with 0 if all checks passed, and 1 otherwise.
+ */
+
+// System includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "proxy.h"
+#include "thread.h"
+#include "timer.h"
+#include "synthmedia.h"
+
+#include "libavutil/avutil.h"
+
+#define STRESS_MAX_FILES 16
+#define STRESS_SEEKS 20
+
+typedef struct StressMedia {
+	const char			*filename;
+	enum AVCodecID		audio_codec;
+	enum AVCodecID		video_codec;
+} StressMedia;
+
+static const StressMedia stress_media[] = {
+	{ "stress_flac.flac", AV_CODEC_ID_FLAC, AV_CODEC_ID_NONE },
+	{ "stress_pcm.wav", AV_CODEC_ID_PCM_S16LE, AV_CODEC_ID_NONE },
+	{ "stress_mp3.mp3", AV_CODEC_ID_MP3, AV_CODEC_ID_NONE },
+	{ "stress_aac.m4a", AV_CODEC_ID_AAC, AV_CODEC_ID_NONE },
+	{ "stress_h264_aac.mp4", AV_CODEC_ID_AAC, AV_CODEC_ID_H264 },
+};
+
+typedef enum StressScenario {
+	SCENARIO_DECODE, // decode completely and compare with the reference
+	SCENARIO_SEEK, // random seeks with short reads
+	SCENARIO_LOWMEM, // low-footprint instance that is released halfway
+	SCENARIO_INVALID_SEEK, // unsupported seek type must fail and leave the instance usable
+	SCENARIO_MISSING_FILE, // opening a missing file must fail without side effects
+	SCENARIO_COUNT
+} StressScenario;
+
+static const char *scenario_names[] = { "decode", "seek", "lowmem", "invalid_seek", "missing_file" };
+
+typedef struct Reference {
+	char				filename[1024];
+	int64_t				samples;
+	uint64_t			checksum;
+} Reference;
+
+typedef struct Stress {
+	Reference			references[STRESS_MAX_FILES];
+	int					reference_count;
+	int					threads;
+	int64_t				jobs;
+	uint32_t			seed;
+	char				missing_filename[1024];
+
+	// the start gate releases all threads at once, so that all instances really overlap
+	Mutex				gate_mutex;
+	Cond				gate_cond;
+	int					gate_waiting;
+
+	volatile int64_t	next_job;
+	volatile int64_t	failures;
+	volatile int64_t	jobs_done[SCENARIO_COUNT];
+	volatile int64_t	instances_open;
+	volatile int64_t	instances_open_max;
+	volatile int64_t	global_messages;
+	volatile int64_t	instance_messages;
+	volatile int		done;
+} Stress;
+
+typedef struct Job {
+	Stress				*stress;
+	int64_t				number;
+	volatile int64_t	messages; // messages received through the instance callback
+} Job;
+
+/*
+ * FNV-1a, to compare decoded output without keeping it around.
+ */
+static uint64_t checksum_update(uint64_t hash, const uint8_t *data, int size) {
+	for (int i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+#define CHECKSUM_INIT 0xCBF29CE484222325ULL
+
+static void fail(Stress *stress, const Job *job, const char *fmt, const char *detail) {
+	atomic_int64_fetch_add(&stress->failures, 1);
+	fprintf(stderr, "job %"PRId64": ", job != NULL ? job->number : -1);
+	fprintf(stderr, fmt, detail);
+	fprintf(stderr, "\n");
+}
+
+/*
+ * Both global callbacks only count, the test is about their concurrent invocation.
+ */
+static Stress *log_stress;
+
+static void global_log_a(int level, const char *message) {
+	(void)level;
+	if (message[0] != '\0') {
+		atomic_int64_fetch_add(&log_stress->global_messages, 1);
+	}
+}
+
+static void global_log_b(int level, const char *message) {
+	(void)level;
+	(void)message;
+	atomic_int64_fetch_add(&log_stress->global_messages, 1);
+}
+
+static void instance_log(void *opaque, int level, const char *message) {
+	Job *job = opaque;
+	(void)level;
+	(void)message;
+	atomic_int64_fetch_add(&job->messages, 1);
+	atomic_int64_fetch_add(&job->stress->instance_messages, 1);
+}
+
+static void *log_switcher(void *arg) {
+	Stress *stress = arg;
+	int toggle = 0;
+
+	mutex_lock(&stress->gate_mutex);
+	while (!atomic_int_load(&stress->done)) {
+		proxy_set_log_callback(toggle ? global_log_a : global_log_b);
+		toggle = !toggle;
+		cond_timedwait(&stress->gate_cond, &stress->gate_mutex, 1);
+	}
+	mutex_unlock(&stress->gate_mutex);
+
+	return NULL;
+}
+
+static ProxyInstance *open_instance(Stress *stress, int mode, const char *filename) {
+	ProxyInstance *pi = stream_open_file(mode, (char *)filename);
+	int64_t open = atomic_int64_fetch_add(&stress->instances_open, 1) + 1;
+	int64_t max = atomic_int64_load(&stress->instances_open_max);
+
+	// A racy maximum is good enough, it is only reported
+	if (open > max) {
+		atomic_int64_store(&stress->instances_open_max, open);
+	}
+
+	return pi;
+}
+
+static void close_instance(Stress *stress, ProxyInstance *pi) {
+	stream_close(pi);
+	atomic_int64_fetch_add(&stress->instances_open, -1);
+}
+
+static int audio_buffer_size(ProxyInstance *pi) {
+	return pi->audio_output.frame_size * pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+}
+
+/*
+ * Decodes the remaining audio and returns the number of samples, or a negative number on error.
+ */
+static int64_t decode_rest(ProxyInstance *pi, uint8_t *buffer, int buffer_size, uint64_t *checksum, int64_t limit) {
+	int64_t samples = 0, timestamp;
+	int block_size = pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+	int ret, frame_type;
+
+	while (samples < limit && (ret = stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type)) >= 0) {
+		if (checksum != NULL) {
+			*checksum = checksum_update(*checksum, buffer, ret * block_size);
+		}
+		samples += ret;
+	}
+
+	return stream_has_error(pi) ? -1 : samples;
+}
+
+static int create_reference(Reference *reference) {
+	ProxyInstance *pi = stream_open_file(TYPE_AUDIO, reference->filename);
+	uint8_t *buffer;
+	int buffer_size;
+
+	if (stream_has_error(pi)) {
+		stream_close(pi);
+		return -1;
+	}
+
+	buffer_size = audio_buffer_size(pi);
+	buffer = malloc(buffer_size);
+	reference->checksum = CHECKSUM_INIT;
+	reference->samples = decode_rest(pi, buffer, buffer_size, &reference->checksum, INT64_MAX);
+
+	free(buffer);
+	stream_close(pi);
+
+	return reference->samples < 0 ? -1 : 0;
+}
+
+static void run_job(Job *job) {
+	Stress *stress = job->stress;
+	uint32_t prng = stress->seed ^ (uint32_t)(job->number * 2654435761u);
+	StressScenario scenario;
+	Reference *reference;
+	ProxyInstance *pi;
+	uint8_t *buffer;
+	int buffer_size, frame_type;
+	int64_t timestamp, samples;
+	uint64_t checksum;
+
+	if (prng == 0) {
+		prng = 1;
+	}
+	scenario = synth_prng_next(&prng) % SCENARIO_COUNT;
+	reference = &stress->references[synth_prng_next(&prng) % stress->reference_count];
+
+	if (scenario == SCENARIO_MISSING_FILE) {
+		pi = open_instance(stress, TYPE_AUDIO, stress->missing_filename);
+		if (!stream_has_error(pi)) {
+			fail(stress, job, "opening the missing file %s succeeded", stress->missing_filename);
+		}
+		close_instance(stress, pi);
+		atomic_int64_fetch_add(&stress->jobs_done[scenario], 1);
+		return;
+	}
+
+	pi = open_instance(stress, scenario == SCENARIO_LOWMEM ? TYPE_AUDIO | MODE_LOWMEM : TYPE_AUDIO, reference->filename);
+	if (stream_has_error(pi)) {
+		fail(stress, job, "cannot open %s", reference->filename);
+		close_instance(stress, pi);
+		return;
+	}
+
+	// Every other instance logs through its own callback
+	if (job->number % 2) {
+		stream_set_log_callback(pi, instance_log, job);
+	}
+
+	buffer_size = audio_buffer_size(pi);
+	buffer = malloc(buffer_size);
+
+	switch (scenario) {
+		case SCENARIO_DECODE:
+			checksum = CHECKSUM_INIT;
+			samples = decode_rest(pi, buffer, buffer_size, &checksum, INT64_MAX);
+			if (samples != reference->samples || checksum != reference->checksum) {
+				fail(stress, job, "decoded output of %s differs from the reference", reference->filename);
+			}
+			break;
+
+		case SCENARIO_SEEK:
+			for (int i = 0; i < STRESS_SEEKS; i++) {
+				int64_t target = (int64_t)(synth_prng_uniform(&prng) * reference->samples);
+				if (stream_seek(pi, target, TYPE_AUDIO) < 0) {
+					fail(stress, job, "seek failed in %s", reference->filename);
+					break;
+				}
+				if (stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type) < 0 && stream_has_error(pi)) {
+					fail(stress, job, "read after seek failed in %s", reference->filename);
+					break;
+				}
+			}
+			break;
+
+		case SCENARIO_LOWMEM:
+			// Released instances resume at the read position with a primed decoder, the output must not change
+			checksum = CHECKSUM_INIT;
+			samples = decode_rest(pi, buffer, buffer_size, &checksum, reference->samples / 2);
+			if (samples >= 0 && (pi->mode & MODE_LOWMEM) && !stream_release(pi)) {
+				fail(stress, job, "cannot release %s", reference->filename);
+			}
+			if (samples >= 0) {
+				int64_t rest = decode_rest(pi, buffer, buffer_size, &checksum, INT64_MAX);
+				samples = rest < 0 ? rest : samples + rest;
+			}
+			if (samples != reference->samples || checksum != reference->checksum) {
+				fail(stress, job, "low-footprint decoded output of %s differs from the reference", reference->filename);
+			}
+			break;
+
+		case SCENARIO_INVALID_SEEK:
+			if (stream_seek(pi, 0, TYPE_VIDEO) >= 0) {
+				fail(stress, job, "unsupported seek in %s succeeded", reference->filename);
+			}
+			if (stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type) < 0) {
+				fail(stress, job, "instance of %s unusable after a failed seek", reference->filename);
+			}
+			else if (job->number % 2 && atomic_int64_load(&job->messages) == 0) {
+				fail(stress, job, "failed seek in %s was not logged to the instance callback", reference->filename);
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	free(buffer);
+	close_instance(stress, pi);
+	atomic_int64_fetch_add(&stress->jobs_done[scenario], 1);
+}
+
+static void *stress_worker(void *arg) {
+	Stress *stress = arg;
+	Job job;
+	int64_t number;
+
+	mutex_lock(&stress->gate_mutex);
+	if (++stress->gate_waiting == stress->threads) {
+		cond_broadcast(&stress->gate_cond);
+	}
+	while (stress->gate_waiting < stress->threads) {
+		cond_wait(&stress->gate_cond, &stress->gate_mutex);
+	}
+	mutex_unlock(&stress->gate_mutex);
+
+	while ((number = atomic_int64_fetch_add(&stress->next_job, 1)) < stress->jobs) {
+		job.stress = stress;
+		job.number = number;
+		job.messages = 0;
+		run_job(&job);
+	}
+
+	return NULL;
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: aurioffmpegproxy_stress [-d workdir] [-j threads] [-n jobs] [-t seconds] [-s seed] [file...]\n");
+	fprintf(stderr, "Without files, synthetic media is generated in the workdir.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static Stress stress;
+	const char *workdir = ".";
+	int duration = 5;
+	int first_file = argc;
+	Thread *threads, switcher;
+	int started = 0;
+	int64_t start;
+
+	stress.threads = 256;
+	stress.jobs = 2048;
+	stress.seed = 0x2545F491;
+
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] != '-' || i + 1 >= argc) {
+			first_file = i;
+			break;
+		}
+		switch (argv[i][1]) {
+			case 'd': workdir = argv[++i]; break;
+			case 'j': stress.threads = FFMAX(atoi(argv[++i]), 1); break;
+			case 'n': stress.jobs = FFMAX(atoll(argv[++i]), 1); break;
+			case 't': duration = FFMAX(atoi(argv[++i]), 1); break;
+			case 's': stress.seed = (uint32_t)strtoul(argv[++i], NULL, 0); break;
+			default: usage(); return 1;
+		}
+	}
+
+	if (first_file < argc) {
+		for (int i = first_file; i < argc && stress.reference_count < STRESS_MAX_FILES; i++) {
+			snprintf(stress.references[stress.reference_count++].filename, 1024, "%s", argv[i]);
+		}
+	}
+	else {
+		for (int i = 0; i < (int)(sizeof(stress_media) / sizeof(stress_media[0])); i++) {
+			Reference *reference = &stress.references[stress.reference_count];
+			int ret;
+
+			snprintf(reference->filename, sizeof(reference->filename), "%s/%s", workdir, stress_media[i].filename);
+			if ((ret = synth_generate_media(reference->filename, stress_media[i].audio_codec, stress_media[i].video_codec, duration, stress.seed)) < 0) {
+				fprintf(stderr, "skipping %s: %s\n", reference->filename, av_err2str(ret));
+				continue;
+			}
+			stress.reference_count++;
+		}
+	}
+	snprintf(stress.missing_filename, sizeof(stress.missing_filename), "%s/stress_missing.wav", workdir);
+
+	// Sequential reference pass
+	for (int i = 0; i < stress.reference_count; i++) {
+		if (create_reference(&stress.references[i]) < 0) {
+			fprintf(stderr, "cannot decode %s\n", stress.references[i].filename);
+			return 1;
+		}
+		printf("reference %s: %"PRId64" samples, checksum %016"PRIx64"\n",
+			stress.references[i].filename, stress.references[i].samples, stress.references[i].checksum);
+	}
+	if (stress.reference_count == 0) {
+		fprintf(stderr, "no media to test\n");
+		return 1;
+	}
+
+	mutex_init(&stress.gate_mutex);
+	cond_init(&stress.gate_cond);
+	log_stress = &stress;
+	threads = malloc(sizeof(Thread) * stress.threads);
+
+	start = timer_now_ns();
+	thread_create(&switcher, log_switcher, &stress);
+	for (started = 0; started < stress.threads; started++) {
+		if (thread_create(&threads[started], stress_worker, &stress) < 0) {
+			fprintf(stderr, "cannot create thread %d\n", started);
+			break;
+		}
+	}
+	if (started < stress.threads) {
+		// Open the gate for the threads that have been started
+		mutex_lock(&stress.gate_mutex);
+		stress.threads = started;
+		cond_broadcast(&stress.gate_cond);
+		mutex_unlock(&stress.gate_mutex);
+		atomic_int64_fetch_add(&stress.failures, 1);
+	}
+	for (int i = 0; i < started; i++) {
+		thread_join(threads[i]);
+	}
+	atomic_int_store(&stress.done, 1);
+	thread_join(switcher);
+	proxy_set_log_callback(NULL);
+
+	printf("%d threads, %"PRId64" jobs in %.2f s, up to %"PRId64" instances open at once\n",
+		started, stress.jobs, (timer_now_ns() - start) / 1e9, stress.instances_open_max);
+	for (int i = 0; i < SCENARIO_COUNT; i++) {
+		printf("  %-14s %"PRId64"\n", scenario_names[i], stress.jobs_done[i]);
+	}
+	printf("log messages: %"PRId64" global, %"PRId64" per instance\n", stress.global_messages, stress.instance_messages);
+	printf("%s: %"PRId64" failures\n", stress.failures == 0 ? "PASSED" : "FAILED", stress.failures);
+
+	free(threads);
+	cond_destroy(&stress.gate_cond);
+	mutex_destroy(&stress.gate_mutex);
+
+	return stress.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#if defined(PROXY_LAZY_SWSCALE)
+	#if defined(_WIN32)
+		#include <windows.h>
+	#else
+		#include <dlfcn.h>
+	#endif
+#endif
+
+#include "swsload.h"
+#include "thread.h"
+
+#define SWSLOAD_STRINGIFY(s) SWSLOAD_TOSTRING(s)
+#define SWSLOAD_TOSTRING(s) #s
+
+#if defined(PROXY_AUDIO_ONLY)
+
+const SwsFunctions *swsload_get(const char **error)
+{
+	*error = "video is not supported by this audio-only build";
+	return NULL;
+}
+
+#elif defined(PROXY_LAZY_SWSCALE)
+
+#if defined(_WIN32)
+	#define SWSLOAD_LIBRARY "swscale-" SWSLOAD_STRINGIFY(LIBSWSCALE_VERSION_MAJOR) ".dll"
+	#define swsload_open() LoadLibraryA(SWSLOAD_LIBRARY)
+	#define swsload_symbol(handle, name) ((void *)GetProcAddress(handle, name))
+	#define swsload_close(handle) FreeLibrary(handle)
+	typedef HMODULE SwsLibrary;
+#else
+	#define SWSLOAD_LIBRARY "libswscale.so." SWSLOAD_STRINGIFY(LIBSWSCALE_VERSION_MAJOR)
+	#define swsload_open() dlopen(SWSLOAD_LIBRARY, RTLD_NOW | RTLD_LOCAL)
+	#define swsload_symbol(handle, name) dlsym(handle, name)
+	#define swsload_close(handle) dlclose(handle)
+	typedef void *SwsLibrary;
+#endif
+
+static SwsFunctions *volatile functions;
+static volatile int failed;
+
+/*
+ * Loads the library on the first call. Concurrent first calls each load it, and all but
+ * the first to publish their function table release their reference again.
+ */
+const SwsFunctions *swsload_get(const char **error)
+{
+	SwsFunctions *loaded;
+	SwsLibrary library;
+
+	loaded = atomic_ptr_load((void *volatile *)&functions);
+	if (loaded != NULL) {
+		return loaded;
+	}
+	if (atomic_int_load(&failed)) {
+		*error = "cannot load " SWSLOAD_LIBRARY;
+		return NULL;
+	}
+
+	library = swsload_open();
+	if (library == NULL) {
+		atomic_int_store(&failed, 1);
+		*error = "cannot load " SWSLOAD_LIBRARY;
+		return NULL;
+	}
+
+	loaded = malloc(sizeof(SwsFunctions));
+	if (loaded == NULL) {
+		swsload_close(library);
+		*error = "out of memory";
+		return NULL;
+	}
+	*(void **)&loaded->get_context = swsload_symbol(library, "sws_getContext");
+	*(void **)&loaded->free_context = swsload_symbol(library, "sws_freeContext");
+	*(void **)&loaded->scale = swsload_symbol(library, "sws_scale");
+	if (loaded->get_context == NULL || loaded->free_context == NULL || loaded->scale == NULL) {
+		free(loaded);
+		swsload_close(library);
+		atomic_int_store(&failed, 1);
+		*error = "cannot load " SWSLOAD_LIBRARY;
+		return NULL;
+	}
+
+	// The winning library reference stays loaded for the lifetime of the process
+	if (atomic_ptr_compare_exchange((void *volatile *)&functions, NULL, loaded) != NULL) {
+		free(loaded);
+		swsload_close(library);
+	}
+
+	return atomic_ptr_load((void *volatile *)&functions);
+}
+
+#else
+
+static const SwsFunctions functions = {
+	sws_getContext,
+	sws_freeContext,
+	sws_scale,
+};
+
+const SwsFunctions *swsload_get(const char **error)
+{
+	(void)error;
+	return &functions;
+}
+
+#endif
@@ -0,0 +1,52 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+// FFmpeg includes
+#include "libavutil/pixfmt.h"
+
+/*
+ * Access to the libswscale functions that convert decoded video frames.
+ *
+ * By default, libswscale is linked like the other FFmpeg libraries. Builds with
+ * PROXY_LAZY_SWSCALE (CMake option AURIO_LAZY_SWSCALE) do not link it, but load it on the first
+ * open of a video stream, so audio-only processes do not pay for loading and relocating it.
+ * Builds with PROXY_AUDIO_ONLY (CMake option AURIO_AUDIO_ONLY) have no video support at all.
+ */
+
+#if !defined(PROXY_AUDIO_ONLY)
+	// FFmpeg includes
+	#include "libswscale/swscale.h"
+#else
+	struct SwsContext;
+	typedef struct SwsFilter SwsFilter;
+	#define SWS_BICUBIC 4 // as in libswscale, for the video paths that are never reached
+#endif
+
+typedef struct SwsFunctions {
+	struct SwsContext	*(*get_context)(int src_w, int src_h, enum AVPixelFormat src_format, int dst_w, int dst_h, enum AVPixelFormat dst_format,
+							int flags, SwsFilter *src_filter, SwsFilter *dst_filter, const double *param);
+	void				(*free_context)(struct SwsContext *context);
+	int					(*scale)(struct SwsContext *context, const uint8_t *const src_slice[], const int src_stride[], int src_slice_y, int src_slice_h,
+							uint8_t *const dst[], const int dst_stride[]);
+} SwsFunctions;
+
+const SwsFunctions *swsload_get(const char **error);
@@ -0,0 +1,329 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/**
+ * Synthetic test media for the benchmark and the stress test, encoded with the
+ * libavcodec encoders. All signals are derived from a seed, so files are repeatable.
+ */
+
+// System includes
+#include <math.h>
+
+#include "synthmedia.h"
+
+#include "libavformat/avformat.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/opt.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*
+ * xorshift32, a tiny deterministic PRNG so that results do not depend on the C library's rand().
+ */
+uint32_t synth_prng_next(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+double synth_prng_uniform(uint32_t *state) {
+	return synth_prng_next(state) / 4294967296.0;
+}
+
+typedef struct OutputTrack {
+	AVStream			*stream;
+	AVCodecContext		*enc;
+	AVFrame				*frame;
+	int64_t				next_pts; // in encoder time base
+	int64_t				end_pts;
+} OutputTrack;
+
+static int encode_and_write(AVFormatContext *oc, OutputTrack *track, AVFrame *frame, AVPacket *pkt) {
+	int ret = avcodec_send_frame(track->enc, frame);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	while (1) {
+		ret = avcodec_receive_packet(track->enc, pkt);
+		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+			return 0;
+		}
+		else if (ret < 0) {
+			return ret;
+		}
+
+		av_packet_rescale_ts(pkt, track->enc->time_base, track->stream->time_base);
+		pkt->stream_index = track->stream->index;
+		if ((ret = av_interleaved_write_frame(oc, pkt)) < 0) {
+			return ret;
+		}
+	}
+}
+
+static int open_audio_track(AVFormatContext *oc, OutputTrack *track, enum AVCodecID codec_id, int64_t start, int64_t length) {
+	const AVCodec *codec = avcodec_find_encoder(codec_id);
+	AVChannelLayout stereo = AV_CHANNEL_LAYOUT_STEREO;
+	int ret;
+
+	if (codec == NULL) {
+		return AVERROR_ENCODER_NOT_FOUND;
+	}
+
+	track->stream = avformat_new_stream(oc, NULL);
+	track->enc = avcodec_alloc_context3(codec);
+	track->enc->sample_fmt = codec->sample_fmts ? codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+	track->enc->sample_rate = SYNTH_SAMPLE_RATE;
+	track->enc->bit_rate = 128000;
+	track->enc->time_base = (AVRational){ 1, SYNTH_SAMPLE_RATE };
+	av_channel_layout_copy(&track->enc->ch_layout, &stereo);
+	if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
+		track->enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	}
+	if (codec_id == AV_CODEC_ID_AAC) {
+		// The noise that the decoder substitutes for PNS bands depends on a random state that a
+		// seek does not restore, which would prevent comparing seeks with a sequential decode
+		av_opt_set_int(track->enc->priv_data, "aac_pns", 0, 0);
+	}
+
+	if ((ret = avcodec_open2(track->enc, codec, NULL)) < 0) {
+		return ret;
+	}
+
+	track->stream->time_base = track->enc->time_base;
+	avcodec_parameters_from_context(track->stream->codecpar, track->enc);
+
+	track->frame = av_frame_alloc();
+	track->frame->format = track->enc->sample_fmt;
+	track->frame->sample_rate = track->enc->sample_rate;
+	track->frame->nb_samples = track->enc->frame_size > 0 ? track->enc->frame_size : 1024;
+	av_channel_layout_copy(&track->frame->ch_layout, &track->enc->ch_layout);
+	if ((ret = av_frame_get_buffer(track->frame, 0)) < 0) {
+		return ret;
+	}
+
+	track->next_pts = start;
+	track->end_pts = start + length;
+
+	return 0;
+}
+
+static int open_video_track(AVFormatContext *oc, OutputTrack *track, enum AVCodecID codec_id, int duration) {
+	const AVCodec *codec = avcodec_find_encoder(codec_id);
+	int ret;
+
+	if (codec == NULL) {
+		return AVERROR_ENCODER_NOT_FOUND;
+	}
+	if (codec->pix_fmts != NULL && codec->pix_fmts[0] != AV_PIX_FMT_YUV420P) {
+		return AVERROR(ENOSYS); // the pattern generator only writes YUV420P
+	}
+
+	track->stream = avformat_new_stream(oc, NULL);
+	track->enc = avcodec_alloc_context3(codec);
+	track->enc->width = SYNTH_VIDEO_WIDTH;
+	track->enc->height = SYNTH_VIDEO_HEIGHT;
+	track->enc->pix_fmt = AV_PIX_FMT_YUV420P;
+	track->enc->time_base = (AVRational){ 1, SYNTH_VIDEO_FPS };
+	track->enc->framerate = (AVRational){ SYNTH_VIDEO_FPS, 1 };
+	track->enc->gop_size = SYNTH_VIDEO_FPS * 2; // a keyframe every 2 seconds makes seeking non-trivial
+	track->enc->max_b_frames = 0;
+	track->enc->bit_rate = 500000;
+	if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
+		track->enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	}
+
+	if ((ret = avcodec_open2(track->enc, codec, NULL)) < 0) {
+		return ret;
+	}
+
+	track->stream->time_base = track->enc->time_base;
+	avcodec_parameters_from_context(track->stream->codecpar, track->enc);
+
+	track->frame = av_frame_alloc();
+	track->frame->format = track->enc->pix_fmt;
+	track->frame->width = track->enc->width;
+	track->frame->height = track->enc->height;
+	if ((ret = av_frame_get_buffer(track->frame, 0)) < 0) {
+		return ret;
+	}
+
+	track->next_pts = 0;
+	track->end_pts = (int64_t)duration * SYNTH_VIDEO_FPS;
+
+	return 0;
+}
+
+static void write_sample(AVFrame *frame, int channel, int index, double value) {
+	int channels = frame->ch_layout.nb_channels;
+	int planar = av_sample_fmt_is_planar(frame->format);
+	uint8_t *plane = planar ? frame->extended_data[channel] : frame->extended_data[0];
+	int offset = planar ? index : index * channels + channel;
+
+	switch (av_get_packed_sample_fmt(frame->format)) {
+		case AV_SAMPLE_FMT_S16: ((int16_t *)plane)[offset] = (int16_t)(value * 32767); break;
+		case AV_SAMPLE_FMT_S32: ((int32_t *)plane)[offset] = (int32_t)(value * 2147483647.0); break;
+		case AV_SAMPLE_FMT_FLT: ((float *)plane)[offset] = (float)value; break;
+		case AV_SAMPLE_FMT_DBL: ((double *)plane)[offset] = value; break;
+		default: break;
+	}
+}
+
+/*
+ * Fills the next audio frame with a slow sine sweep plus a little noise, which keeps
+ * the encoders busy with a realistic amount of spectral content.
+ */
+static void fill_audio_frame(OutputTrack *track, uint32_t *prng) {
+	AVFrame *frame = track->frame;
+
+	av_frame_make_writable(frame);
+	for (int i = 0; i < frame->nb_samples; i++) {
+		double t = (double)(track->next_pts + i) / SYNTH_SAMPLE_RATE;
+		double frequency = 220 + 40 * t;
+		for (int ch = 0; ch < frame->ch_layout.nb_channels; ch++) {
+			double value = 0.4 * sin(2 * M_PI * frequency * t * (ch + 1)) + 0.05 * (synth_prng_uniform(prng) * 2 - 1);
+			write_sample(frame, ch, i, value);
+		}
+	}
+	frame->pts = track->next_pts;
+	track->next_pts += frame->nb_samples;
+}
+
+static void fill_video_frame(OutputTrack *track) {
+	AVFrame *frame = track->frame;
+	int n = (int)track->next_pts;
+
+	av_frame_make_writable(frame);
+	for (int y = 0; y < frame->height; y++) {
+		for (int x = 0; x < frame->width; x++) {
+			frame->data[0][y * frame->linesize[0] + x] = (uint8_t)(x + y + n * 3);
+		}
+	}
+	for (int y = 0; y < frame->height / 2; y++) {
+		for (int x = 0; x < frame->width / 2; x++) {
+			frame->data[1][y * frame->linesize[1] + x] = (uint8_t)(128 + y + n * 2);
+			frame->data[2][y * frame->linesize[2] + x] = (uint8_t)(64 + x + n * 5);
+		}
+	}
+	frame->pts = track->next_pts++;
+}
+
+static void close_track(OutputTrack *track) {
+	avcodec_free_context(&track->enc);
+	av_frame_free(&track->frame);
+}
+
+/*
+ * Encodes the audio samples [start, start + length) and, if a video codec is given, `duration`
+ * seconds of video from the start.
+ */
+static int generate(const char *filename, enum AVCodecID audio_codec, enum AVCodecID video_codec, int duration,
+	int64_t start, int64_t length, uint32_t seed) {
+	AVFormatContext *oc = NULL;
+	OutputTrack audio = { 0 }, video = { 0 };
+	AVPacket *pkt = NULL;
+	uint32_t prng = seed;
+	int has_video = video_codec != AV_CODEC_ID_NONE;
+	int ret;
+
+	if ((ret = avformat_alloc_output_context2(&oc, NULL, NULL, filename)) < 0) {
+		return ret;
+	}
+
+	if (has_video && (ret = open_video_track(oc, &video, video_codec, duration)) < 0) {
+		goto end;
+	}
+	if ((ret = open_audio_track(oc, &audio, audio_codec, start, length)) < 0) {
+		goto end;
+	}
+
+	if (!(oc->oformat->flags & AVFMT_NOFILE) && (ret = avio_open(&oc->pb, filename, AVIO_FLAG_WRITE)) < 0) {
+		goto end;
+	}
+	if ((ret = avformat_write_header(oc, NULL)) < 0) {
+		goto end;
+	}
+
+	pkt = av_packet_alloc();
+
+	// Interleave the tracks by always encoding the one that is behind
+	while (1) {
+		int audio_done = audio.next_pts >= audio.end_pts;
+		int video_done = !has_video || video.next_pts >= video.end_pts;
+
+		if (audio_done && video_done) {
+			break;
+		}
+
+		if (!video_done && (audio_done || av_compare_ts(video.next_pts, video.enc->time_base, audio.next_pts, audio.enc->time_base) <= 0)) {
+			fill_video_frame(&video);
+			ret = encode_and_write(oc, &video, video.frame, pkt);
+		}
+		else {
+			fill_audio_frame(&audio, &prng);
+			ret = encode_and_write(oc, &audio, audio.frame, pkt);
+		}
+
+		if (ret < 0) {
+			goto end;
+		}
+	}
+
+	// Flush encoders
+	if (has_video && (ret = encode_and_write(oc, &video, NULL, pkt)) < 0) {
+		goto end;
+	}
+	if ((ret = encode_and_write(oc, &audio, NULL, pkt)) < 0) {
+		goto end;
+	}
+
+	ret = av_write_trailer(oc);
+
+end:
+	av_packet_free(&pkt);
+	close_track(&audio);
+	close_track(&video);
+	if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+		avio_closep(&oc->pb);
+	}
+	avformat_free_context(oc);
+
+	return ret;
+}
+
+/*
+ * Encodes a synthetic media file and returns 0 on success, or a negative AVERROR (e.g.
+ * AVERROR_ENCODER_NOT_FOUND if the FFmpeg build does not include a required encoder).
+ */
+int synth_generate_media(const char *filename, enum AVCodecID audio_codec, enum AVCodecID video_codec, int duration, uint32_t seed) {
+	return generate(filename, audio_codec, video_codec, duration, 0, (int64_t)duration * SYNTH_SAMPLE_RATE, seed);
+}
+
+/*
+ * Encodes an audio-only file with `length` samples whose timestamps begin at sample `start`,
+ * like a chunk of a longer recording. The container must keep the timestamps (e.g. NUT).
+ * Returns 0 on success, or a negative AVERROR.
+ */
+int synth_generate_chunk(const char *filename, enum AVCodecID audio_codec, int64_t start, int64_t length, uint32_t seed) {
+	return generate(filename, audio_codec, AV_CODEC_ID_NONE, 0, start, length, seed);
+}
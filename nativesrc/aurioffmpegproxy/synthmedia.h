@@ -0,0 +1,34 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include "libavcodec/avcodec.h"
+
+#define SYNTH_SAMPLE_RATE 48000
+#define SYNTH_VIDEO_WIDTH 320
+#define SYNTH_VIDEO_HEIGHT 240
+#define SYNTH_VIDEO_FPS 25
+
+uint32_t synth_prng_next(uint32_t *state);
+double synth_prng_uniform(uint32_t *state);
+
+int synth_generate_media(const char *filename, enum AVCodecID audio_codec, enum AVCodecID video_codec, int duration, uint32_t seed);
+int synth_generate_chunk(const char *filename, enum AVCodecID audio_codec, int64_t start, int64_t length, uint32_t seed);
@@ -0,0 +1,759 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/* Compatibility settings for the MSVC compiler */
+#ifdef _MSC_VER
+	#define _CRT_SECURE_NO_WARNINGS // disable fopen compile error
+#endif
+
+/**
+ * Functional tests for the FFmpeg proxy.
+ *
+ * Each test checks the results of a part of the proxy against a reference, e.g. the fast
+ * paths against the generic FFmpeg implementation, or a random access pattern against a
+ * sequential decoding pass. All inputs are derived from a fixed seed, so runs are repeatable.
+ *
+ * Usage: aurioffmpegproxy_test [-d workdir] [-t seconds] [-s seed] [test...]
+ *
+ * Runs the given tests, or all tests. Synthetic media is generated in the workdir when a test
+ * first needs it, media with an encoder that the FFmpeg build does not include is skipped.
+ * Exits with 0 if all checks passed, and 1 otherwise.
+ */
+
+// System includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "proxy.h"
+#include "convert.h"
+#include "synthmedia.h"
+
+#include "libavutil/avutil.h"
+#include "libavutil/cpu.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/opt.h"
+#include "libswresample/swresample.h"
+
+typedef struct TestMedia {
+	const char			*filename;
+	enum AVCodecID		audio_codec;
+} TestMedia;
+
+static const TestMedia test_media[] = {
+	{ "test_flac.flac", AV_CODEC_ID_FLAC },
+	{ "test_pcm.wav", AV_CODEC_ID_PCM_S16LE },
+	{ "test_mp3.mp3", AV_CODEC_ID_MP3 },
+	{ "test_aac.m4a", AV_CODEC_ID_AAC },
+};
+
+#define TEST_MEDIA_COUNT (int)(sizeof(test_media) / sizeof(test_media[0]))
+
+typedef struct Test {
+	const char			*workdir;
+	int					duration; // of the generated media in seconds
+	uint32_t			seed;
+	int					failures;
+	const char			*name; // of the running test
+	int					media_state[TEST_MEDIA_COUNT]; // 0 if not generated yet, 1 if available, -1 if skipped
+} Test;
+
+static void fail(Test *test, const char *fmt, ...) {
+	va_list args;
+
+	test->failures++;
+	fprintf(stderr, "%s: ", test->name);
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+}
+
+/*
+ * xorshift32, so that the inputs do not depend on the C library's rand().
+ */
+static uint32_t prng_next(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/*
+ * Returns the path of a generated media file in `path`, generating it on first use. Returns 0
+ * on success, or a negative number if the media cannot be generated with this FFmpeg build.
+ */
+static int media_path(Test *test, int media, char *path, int path_size) {
+	int ret;
+
+	snprintf(path, path_size, "%s/%s", test->workdir, test_media[media].filename);
+
+	if (test->media_state[media] == 0) {
+		ret = synth_generate_media(path, test_media[media].audio_codec, AV_CODEC_ID_NONE, test->duration, test->seed);
+		if (ret < 0) {
+			printf("skipping %s: %s\n", path, av_err2str(ret));
+		}
+		test->media_state[media] = ret < 0 ? -1 : 1;
+	}
+
+	return test->media_state[media] > 0 ? 0 : -1;
+}
+
+/*
+ * FNV-1a, to compare decoded output without keeping it around.
+ */
+static uint64_t checksum_update(uint64_t hash, const uint8_t *data, int size) {
+	for (int i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+#define CHECKSUM_INIT 0xCBF29CE484222325ULL
+
+/*
+ * A run of decoded audio.
+ */
+typedef struct Decoded {
+	int64_t				start; // timestamp of the first frame
+	int64_t				samples;
+	uint64_t			checksum;
+} Decoded;
+
+static void decoded_init(Decoded *decoded) {
+	decoded->start = AV_NOPTS_VALUE;
+	decoded->samples = 0;
+	decoded->checksum = CHECKSUM_INIT;
+}
+
+/*
+ * Decodes audio frames until at least `limit` samples have been decoded or the stream ends,
+ * and adds them to the decoded run. Every frame must continue the previous one without a gap
+ * or an overlap. Returns 0 on success, or a negative number on error.
+ */
+static int decode_audio(Test *test, ProxyInstance *pi, int64_t limit, Decoded *decoded) {
+	int block_size = pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+	int buffer_size = pi->audio_output.frame_size * block_size;
+	uint8_t *buffer = malloc(buffer_size);
+	int64_t timestamp, samples = 0;
+	int ret, frame_type;
+
+	while (samples < limit && (ret = stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type)) >= 0) {
+		if (decoded->start == AV_NOPTS_VALUE) {
+			decoded->start = timestamp;
+		}
+		else if (timestamp != decoded->start + decoded->samples) {
+			fail(test, "%s: frame at %"PRId64" does not continue the previous frame, which ends at %"PRId64,
+				pi->source_filename, timestamp, decoded->start + decoded->samples);
+			free(buffer);
+			return -1;
+		}
+		decoded->checksum = checksum_update(decoded->checksum, buffer, ret * block_size);
+		decoded->samples += ret;
+		samples += ret;
+	}
+
+	free(buffer);
+
+	if (stream_has_error(pi)) {
+		fail(test, "%s: decoding failed: %s", pi->source_filename, stream_get_error(pi));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Decodes a file sequentially with a fresh instance, as reference for other access patterns.
+ */
+static int decode_reference(Test *test, const char *filename, Decoded *reference) {
+	ProxyInstance *pi = stream_open_file(TYPE_AUDIO, (char *)filename);
+	int ret = -1;
+
+	decoded_init(reference);
+	if (stream_has_error(pi)) {
+		fail(test, "cannot open %s: %s", filename, stream_get_error(pi));
+	}
+	else {
+		ret = decode_audio(test, pi, INT64_MAX, reference);
+	}
+	stream_close(pi);
+
+	return ret;
+}
+
+static void compare_decoded(Test *test, const char *filename, const char *what, const Decoded *decoded, const Decoded *reference) {
+	if (decoded->start != reference->start || decoded->samples != reference->samples) {
+		fail(test, "%s: %s decodes %"PRId64" samples from %"PRId64", the reference %"PRId64" samples from %"PRId64,
+			filename, what, decoded->samples, decoded->start, reference->samples, reference->start);
+	}
+	else if (decoded->checksum != reference->checksum) {
+		fail(test, "%s: %s decodes different samples than the reference", filename, what);
+	}
+}
+
+/*
+ * Sample converters (convert.c)
+ *
+ * Every kernel that convert_select can return is run against the scalar kernel and against
+ * swresample, which they replace, with channel counts that do not fill a vector and sample
+ * counts that leave tails of all lengths. The output must be bit-identical, and the kernels
+ * must not write past the end of the output.
+ */
+
+typedef struct ConvertFormats {
+	enum AVSampleFormat	in_fmt;
+	enum AVSampleFormat	out_fmt;
+} ConvertFormats;
+
+typedef struct ConvertVariant {
+	const char			*name;
+	int					cpu_flags;
+} ConvertVariant;
+
+static const ConvertFormats convert_formats[] = {
+	{ AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S16 },
+	{ AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S16 },
+	{ AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_FLT },
+	{ AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_FLT },
+	{ AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_FLT },
+	{ AV_SAMPLE_FMT_S32P, AV_SAMPLE_FMT_FLT },
+};
+
+static const ConvertVariant convert_variants[] = {
+	{ "c", 0 },
+	{ "sse2", AV_CPU_FLAG_SSE2 },
+	{ "avx2", AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_AVX2 },
+};
+
+static const int convert_channels[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 17 };
+static const int convert_samples[] = { 0, 1, 3, 7, 8, 9, 15, 16, 17, 31, 33, 1021 };
+
+#define CONVERT_CANARY 0xA5 // fills the output past its end to detect overruns
+#define CONVERT_SLACK 64 // bytes
+
+static void fill_input(uint8_t *data, enum AVSampleFormat fmt, int count, uint32_t *prng) {
+	for (int i = 0; i < count; i++) {
+		switch (av_get_packed_sample_fmt(fmt)) {
+			case AV_SAMPLE_FMT_S16: ((int16_t *)data)[i] = (int16_t)prng_next(prng); break;
+			case AV_SAMPLE_FMT_S32: ((int32_t *)data)[i] = (int32_t)prng_next(prng); break;
+			// Finite values only, NaN payloads are not guaranteed to survive a conversion
+			case AV_SAMPLE_FMT_FLT: ((float *)data)[i] = (float)(prng_next(prng) / 2147483648.0 - 1.0); break;
+			default: break;
+		}
+	}
+
+	// Include the extremes, which are the first to break in a scaling conversion
+	if (count >= 2 && av_get_packed_sample_fmt(fmt) == AV_SAMPLE_FMT_S32) {
+		((int32_t *)data)[0] = INT32_MIN;
+		((int32_t *)data)[1] = INT32_MAX;
+	}
+	else if (count >= 2 && av_get_packed_sample_fmt(fmt) == AV_SAMPLE_FMT_S16) {
+		((int16_t *)data)[0] = INT16_MIN;
+		((int16_t *)data)[1] = INT16_MAX;
+	}
+}
+
+static int convert_swr(const ConvertFormats *formats, int channels, int samples, const uint8_t **src, uint8_t *dst) {
+	SwrContext *swr = swr_alloc();
+	AVChannelLayout layout;
+	int ret;
+
+	av_channel_layout_default(&layout, channels);
+	av_opt_set_chlayout(swr, "in_chlayout", &layout, 0);
+	av_opt_set_chlayout(swr, "out_chlayout", &layout, 0);
+	av_opt_set_int(swr, "in_sample_rate", 48000, 0);
+	av_opt_set_int(swr, "out_sample_rate", 48000, 0);
+	av_opt_set_sample_fmt(swr, "in_sample_fmt", formats->in_fmt, 0);
+	av_opt_set_sample_fmt(swr, "out_sample_fmt", formats->out_fmt, 0);
+
+	if ((ret = swr_init(swr)) >= 0) {
+		ret = swr_convert(swr, &dst, samples, src, samples);
+	}
+
+	swr_free(&swr);
+	av_channel_layout_uninit(&layout);
+
+	return ret;
+}
+
+static void test_convert_case(Test *test, const ConvertFormats *formats, int channels, int samples, uint32_t *prng) {
+	int planar = av_sample_fmt_is_planar(formats->in_fmt);
+	int in_size = av_get_bytes_per_sample(formats->in_fmt);
+	int out_bytes = samples * channels * av_get_bytes_per_sample(formats->out_fmt);
+	int planes = planar ? channels : 1;
+	int plane_samples = planar ? samples : samples * channels;
+	uint8_t *inputs[CONVERT_MAX_CHANNELS];
+	const uint8_t *src[CONVERT_MAX_CHANNELS];
+	uint8_t *reference, *output;
+	SampleConverter scalar;
+
+	for (int p = 0; p < planes; p++) {
+		// Shift the data by one sample to exercise unaligned loads
+		inputs[p] = malloc((size_t)(plane_samples + 1) * in_size);
+		fill_input(inputs[p] + in_size, formats->in_fmt, plane_samples, prng);
+		src[p] = inputs[p] + in_size;
+	}
+	reference = malloc(out_bytes + CONVERT_SLACK);
+	output = malloc(out_bytes + CONVERT_SLACK);
+
+	scalar = convert_select(formats->in_fmt, formats->out_fmt, channels, 0);
+	if (scalar == NULL) {
+		fail(test, "no converter for %s -> %s with %d channels", av_get_sample_fmt_name(formats->in_fmt),
+			av_get_sample_fmt_name(formats->out_fmt), channels);
+		goto end;
+	}
+
+	if (convert_swr(formats, channels, samples, src, reference) != samples) {
+		fail(test, "swresample failed for %s -> %s", av_get_sample_fmt_name(formats->in_fmt), av_get_sample_fmt_name(formats->out_fmt));
+		goto end;
+	}
+
+	for (int v = 0; v < (int)(sizeof(convert_variants) / sizeof(convert_variants[0])); v++) {
+		const ConvertVariant *variant = &convert_variants[v];
+		SampleConverter kernel;
+
+		if ((av_get_cpu_flags() & variant->cpu_flags) != variant->cpu_flags) {
+			continue; // not supported by this CPU
+		}
+
+		kernel = convert_select(formats->in_fmt, formats->out_fmt, channels, variant->cpu_flags);
+		memset(output, CONVERT_CANARY, out_bytes + CONVERT_SLACK);
+		kernel(output, src, channels, samples);
+
+		if (memcmp(output, reference, out_bytes) != 0) {
+			fail(test, "%s kernel for %s -> %s differs from swresample (%d channels, %d samples)", variant->name,
+				av_get_sample_fmt_name(formats->in_fmt), av_get_sample_fmt_name(formats->out_fmt), channels, samples);
+		}
+		for (int i = out_bytes; i < out_bytes + CONVERT_SLACK; i++) {
+			if (output[i] != CONVERT_CANARY) {
+				fail(test, "%s kernel for %s -> %s writes past the output (%d channels, %d samples)", variant->name,
+					av_get_sample_fmt_name(formats->in_fmt), av_get_sample_fmt_name(formats->out_fmt), channels, samples);
+				break;
+			}
+		}
+
+		if (kernel != scalar) {
+			// The scalar kernel must agree as well, it converts the tails of the vector kernels
+			memset(output, CONVERT_CANARY, out_bytes + CONVERT_SLACK);
+			scalar(output, src, channels, samples);
+			if (memcmp(output, reference, out_bytes) != 0) {
+				fail(test, "scalar kernel for %s -> %s differs from swresample (%d channels, %d samples)",
+					av_get_sample_fmt_name(formats->in_fmt), av_get_sample_fmt_name(formats->out_fmt), channels, samples);
+			}
+		}
+	}
+
+end:
+	for (int p = 0; p < planes; p++) {
+		free(inputs[p]);
+	}
+	free(reference);
+	free(output);
+}
+
+static void test_convert(Test *test) {
+	uint32_t prng = test->seed;
+
+	for (int f = 0; f < (int)(sizeof(convert_formats) / sizeof(convert_formats[0])); f++) {
+		for (int c = 0; c < (int)(sizeof(convert_channels) / sizeof(convert_channels[0])); c++) {
+			for (int s = 0; s < (int)(sizeof(convert_samples) / sizeof(convert_samples[0])); s++) {
+				test_convert_case(test, &convert_formats[f], convert_channels[c], convert_samples[s], &prng);
+			}
+		}
+	}
+}
+
+/*
+ * Frame cache (stream_cache_enable)
+ *
+ * Reads half of a file into the cache, seeks back to the start, and reads the whole file,
+ * which is served from the cache up to the half and continues with the decoder from there.
+ * The output must be identical to a sequential decode, without a gap or discontinuity where
+ * the cached run ends. A second pass must be served from the cache completely, and frames
+ * decoded right after a seek, without pre-roll, must not be cached.
+ */
+
+#define TEST_CACHE_BUDGET (64 * 1024 * 1024) // bytes, large enough to cache the generated media
+
+static void test_cache_media(Test *test, const char *filename) {
+	ProxyInstance *pi;
+	ProxyStats stats;
+	Decoded reference, decoded;
+	int64_t hits;
+
+	if (decode_reference(test, filename, &reference) < 0) {
+		return;
+	}
+
+	pi = stream_open_file(TYPE_AUDIO, (char *)filename);
+	if (stream_has_error(pi) || stream_cache_enable(pi, TEST_CACHE_BUDGET) < 0) {
+		fail(test, "%s: cannot open with a frame cache", filename);
+		stream_close(pi);
+		return;
+	}
+
+	decoded_init(&decoded);
+	if (decode_audio(test, pi, reference.samples / 2, &decoded) < 0) {
+		goto end;
+	}
+
+	// Served from the cache up to the half, then decoded
+	stream_seek(pi, reference.start, TYPE_AUDIO);
+	decoded_init(&decoded);
+	if (decode_audio(test, pi, INT64_MAX, &decoded) < 0) {
+		goto end;
+	}
+	compare_decoded(test, filename, "a read across the end of the cached run", &decoded, &reference);
+
+	stream_get_stats(pi, &stats);
+	if (stats.cache_hits == 0 || stats.cache_misses != 1) {
+		fail(test, "%s: expected cache hits and 1 miss, got %"PRId64" hits and %"PRId64" misses",
+			filename, stats.cache_hits, stats.cache_misses);
+	}
+	hits = stats.cache_hits;
+
+	// Everything is cached now, including the frames decoded after the miss
+	stream_seek(pi, reference.start, TYPE_AUDIO);
+	decoded_init(&decoded);
+	if (decode_audio(test, pi, INT64_MAX, &decoded) < 0) {
+		goto end;
+	}
+	compare_decoded(test, filename, "a read from the cache", &decoded, &reference);
+
+	// Only the read at the end of the stream, where there is nothing to serve, misses
+	stream_get_stats(pi, &stats);
+	if (stats.cache_misses != 2 || stats.cache_hits <= hits) {
+		fail(test, "%s: the second pass was not served from the cache (%"PRId64" misses)", filename, stats.cache_misses);
+	}
+
+	// Frames that are decoded right after a seek lack the pre-roll and must not be cached
+	stream_cache_enable(pi, TEST_CACHE_BUDGET); // clears the cache
+	stream_seek(pi, reference.start + reference.samples / 2, TYPE_AUDIO);
+	decoded_init(&decoded);
+	if (decode_audio(test, pi, pi->audio_output.format.sample_rate, &decoded) < 0) {
+		goto end;
+	}
+	stream_get_stats(pi, &stats);
+	hits = stats.cache_hits;
+	stream_seek(pi, reference.start + reference.samples / 2, TYPE_AUDIO);
+	decoded_init(&decoded);
+	if (decode_audio(test, pi, 1, &decoded) < 0) {
+		goto end;
+	}
+	stream_get_stats(pi, &stats);
+	if (stats.cache_hits != hits) {
+		fail(test, "%s: frames decoded without pre-roll have been cached", filename);
+	}
+
+end:
+	stream_close(pi);
+}
+
+static void test_cache(Test *test) {
+	char path[1024];
+
+	for (int i = 0; i < TEST_MEDIA_COUNT; i++) {
+		if (media_path(test, i, path, sizeof(path)) == 0) {
+			test_cache_media(test, path);
+		}
+	}
+}
+
+/*
+ * Gapless concatenation (concat_open)
+ *
+ * Concatenates three chunks. The second continues the timeline of the first and repeats its
+ * last half second, which must be trimmed, and the third has an independent timeline and is
+ * appended. The concatenated stream must match the references of the chunks, when read
+ * sequentially and when read after seeks next to and onto the source boundaries.
+ */
+
+typedef struct TestChunk {
+	const char			*filename;
+	int64_t				start; // samples
+	int64_t				length;
+} TestChunk;
+
+static const TestChunk test_chunks[] = {
+	{ "test_concat_1.nut", 0, 3 * SYNTH_SAMPLE_RATE },
+	{ "test_concat_2.nut", 5 * SYNTH_SAMPLE_RATE / 2, 3 * SYNTH_SAMPLE_RATE },
+	{ "test_concat_3.nut", 0, 2 * SYNTH_SAMPLE_RATE },
+};
+
+#define TEST_CHUNK_COUNT (int)(sizeof(test_chunks) / sizeof(test_chunks[0]))
+#define TEST_CONCAT_READ (SYNTH_SAMPLE_RATE / 2) // samples read after each seek
+
+/*
+ * The part of a chunk in the concatenated timeline.
+ */
+typedef struct ConcatPart {
+	char				path[1024];
+	int64_t				start; // first sample in the timeline of the chunk
+	int64_t				length;
+	int64_t				offset; // in the concatenated timeline
+} ConcatPart;
+
+/*
+ * Adds the samples [from, to) of a sequential decode of a file to the checksum and the sample
+ * count of a run, without continuity checks, so that runs can span several files.
+ */
+static int append_reference(Test *test, const char *filename, int64_t from, int64_t to, Decoded *decoded) {
+	ProxyInstance *pi = stream_open_file(TYPE_AUDIO, (char *)filename);
+	int block_size, buffer_size, ret, frame_type;
+	int64_t timestamp;
+	uint8_t *buffer;
+
+	if (stream_has_error(pi)) {
+		fail(test, "cannot open %s: %s", filename, stream_get_error(pi));
+		stream_close(pi);
+		return -1;
+	}
+
+	block_size = pi->audio_output.format.channels * pi->audio_output.format.sample_size;
+	buffer_size = pi->audio_output.frame_size * block_size;
+	buffer = malloc(buffer_size);
+
+	while ((ret = stream_read_frame(pi, &timestamp, buffer, buffer_size, &frame_type)) >= 0 && timestamp < to) {
+		int64_t start = FFMAX(timestamp, from), end = FFMIN(timestamp + ret, to);
+		if (end > start) {
+			decoded->checksum = checksum_update(decoded->checksum, buffer + (start - timestamp) * block_size, (int)(end - start) * block_size);
+			decoded->samples += end - start;
+		}
+	}
+
+	free(buffer);
+	stream_close(pi);
+
+	return 0;
+}
+
+/*
+ * Builds the expected run of the concatenated samples [from, to) from the references of the chunks.
+ */
+static int concat_expected(Test *test, const ConcatPart *parts, int64_t from, int64_t to, Decoded *expected) {
+	decoded_init(expected);
+	expected->start = from;
+
+	for (int i = 0; i < TEST_CHUNK_COUNT; i++) {
+		const ConcatPart *part = &parts[i];
+		int64_t start = FFMAX(from, part->offset), end = FFMIN(to, part->offset + part->length);
+
+		if (end > start && append_reference(test, part->path, part->start + (start - part->offset),
+			part->start + (end - part->offset), expected) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Reads the concatenated stream from the current position and adds up to `limit` samples from
+ * `from` on to the decoded run. The first frame must contain `from` (after a seek, it may start
+ * earlier), and every frame must continue the previous one.
+ */
+static int read_concat(Test *test, Concat *c, int64_t from, int64_t limit, Decoded *decoded) {
+	int buffer_size = c->output.frame_size * c->block_size;
+	uint8_t *buffer = malloc(buffer_size);
+	int64_t timestamp, next = from, to = from > INT64_MAX - limit ? INT64_MAX : from + limit;
+	int ret, first = 1;
+
+	decoded_init(decoded);
+
+	while (decoded->samples < limit && (ret = concat_read_frame(c, &timestamp, buffer, buffer_size)) >= 0) {
+		int64_t start = FFMAX(timestamp, from), end = FFMIN(timestamp + ret, to);
+
+		if (first && timestamp > from) {
+			fail(test, "the first frame after a seek to %"PRId64" starts at %"PRId64, from, timestamp);
+			free(buffer);
+			return -1;
+		}
+		if (!first && timestamp != next) {
+			fail(test, "frame at %"PRId64" does not continue the previous frame, which ends at %"PRId64, timestamp, next);
+			free(buffer);
+			return -1;
+		}
+		first = 0;
+		next = timestamp + ret;
+
+		if (end > start) {
+			if (decoded->start == AV_NOPTS_VALUE) {
+				decoded->start = start;
+			}
+			decoded->checksum = checksum_update(decoded->checksum, buffer + (start - timestamp) * c->block_size, (int)(end - start) * c->block_size);
+			decoded->samples += end - start;
+		}
+	}
+
+	free(buffer);
+
+	return 0;
+}
+
+static void test_concat(Test *test) {
+	ConcatPart parts[TEST_CHUNK_COUNT];
+	char *filenames[TEST_CHUNK_COUNT];
+	Decoded references[TEST_CHUNK_COUNT], expected, decoded;
+	Concat *c;
+	int64_t positions[5], length = 0, previous_end = 0;
+	int ret;
+
+	for (int i = 0; i < TEST_CHUNK_COUNT; i++) {
+		snprintf(parts[i].path, sizeof(parts[i].path), "%s/%s", test->workdir, test_chunks[i].filename);
+		filenames[i] = parts[i].path;
+		ret = synth_generate_chunk(parts[i].path, AV_CODEC_ID_PCM_S16LE, test_chunks[i].start, test_chunks[i].length, test->seed + i);
+		if (ret < 0) {
+			printf("skipping %s: %s\n", parts[i].path, av_err2str(ret));
+			return;
+		}
+		if (decode_reference(test, parts[i].path, &references[i]) < 0) {
+			return;
+		}
+		if (references[i].start != test_chunks[i].start) {
+			fail(test, "%s: the chunk starts at %"PRId64" instead of %"PRId64, parts[i].path, references[i].start, test_chunks[i].start);
+			return;
+		}
+	}
+
+	// The second chunk is trimmed to begin where the first ends, the third is appended completely
+	for (int i = 0; i < TEST_CHUNK_COUNT; i++) {
+		int64_t end = references[i].start + references[i].samples;
+		parts[i].start = i == 1 ? previous_end : references[i].start;
+		parts[i].length = end - parts[i].start;
+		parts[i].offset = length;
+		length += parts[i].length;
+		previous_end = end;
+	}
+
+	c = concat_open(TYPE_AUDIO, filenames, TEST_CHUNK_COUNT);
+	if (c == NULL) {
+		fail(test, "cannot concatenate the chunks");
+		return;
+	}
+	if (concat_get_length(c) != length) {
+		fail(test, "the concatenated length is %"PRId64" instead of %"PRId64, concat_get_length(c), length);
+	}
+
+	// Sequential read of the whole stream
+	if (read_concat(test, c, 0, INT64_MAX, &decoded) == 0 && concat_expected(test, parts, 0, length, &expected) == 0) {
+		compare_decoded(test, "the concatenated chunks", "a sequential read", &decoded, &expected);
+	}
+
+	// Seeks before the trimmed boundary, onto it, before the appended chunk, into it, and back to the start
+	positions[0] = parts[1].offset - 1000;
+	positions[1] = parts[1].offset;
+	positions[2] = parts[2].offset - 1000;
+	positions[3] = parts[2].offset + 1;
+	positions[4] = 0;
+	for (int i = 0; i < (int)(sizeof(positions) / sizeof(positions[0])); i++) {
+		char what[64];
+
+		snprintf(what, sizeof(what), "a read after a seek to %"PRId64, positions[i]);
+		if (concat_seek(c, positions[i]) < 0) {
+			fail(test, "cannot seek to %"PRId64, positions[i]);
+			continue;
+		}
+		if (read_concat(test, c, positions[i], TEST_CONCAT_READ, &decoded) == 0
+			&& concat_expected(test, parts, positions[i], FFMIN(positions[i] + TEST_CONCAT_READ, length), &expected) == 0) {
+			compare_decoded(test, "the concatenated chunks", what, &decoded, &expected);
+		}
+	}
+
+	concat_close(c);
+}
+
+typedef struct TestCase {
+	const char			*name;
+	void				(*run)(Test *test);
+} TestCase;
+
+static const TestCase test_cases[] = {
+	{ "convert", test_convert },
+	{ "cache", test_cache },
+	{ "concat", test_concat },
+};
+
+static void usage(void) {
+	fprintf(stderr, "usage: aurioffmpegproxy_test [-d workdir] [-t seconds] [-s seed] [test...]\n");
+	fprintf(stderr, "tests:");
+	for (int i = 0; i < (int)(sizeof(test_cases) / sizeof(test_cases[0])); i++) {
+		fprintf(stderr, " %s", test_cases[i].name);
+	}
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	Test test = { 0 };
+	int first_test = argc;
+
+	test.workdir = ".";
+	test.duration = 5;
+	test.seed = 0x2545F491;
+
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] != '-' || i + 1 >= argc) {
+			first_test = i;
+			break;
+		}
+		switch (argv[i][1]) {
+			case 'd': test.workdir = argv[++i]; break;
+			case 't': test.duration = FFMAX(atoi(argv[++i]), 1); break;
+			case 's': test.seed = (uint32_t)strtoul(argv[++i], NULL, 0); break;
+			default: usage(); return 1;
+		}
+	}
+	if (test.seed == 0) {
+		test.seed = 1; // xorshift gets stuck at 0
+	}
+	for (int j = first_test; j < argc; j++) {
+		int known = 0;
+		for (int i = 0; i < (int)(sizeof(test_cases) / sizeof(test_cases[0])); i++) {
+			known |= strcmp(argv[j], test_cases[i].name) == 0;
+		}
+		if (!known) {
+			usage();
+			return 1;
+		}
+	}
+
+	for (int i = 0; i < (int)(sizeof(test_cases) / sizeof(test_cases[0])); i++) {
+		int selected = first_test == argc;
+		int failures;
+
+		for (int j = first_test; j < argc; j++) {
+			selected |= strcmp(argv[j], test_cases[i].name) == 0;
+		}
+		if (!selected) {
+			continue;
+		}
+
+		test.name = test_cases[i].name;
+		failures = test.failures;
+		test_cases[i].run(&test);
+		printf("%-10s %s\n", test.name, test.failures == failures ? "passed" : "FAILED");
+	}
+
+	printf("%s: %d failures\n", test.failures == 0 ? "PASSED" : "FAILED", test.failures);
+
+	return test.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#if !defined(_WIN32)
+	#include <errno.h>
+	#include <sched.h>
+	#include <time.h>
+#endif
+
+#include "thread.h"
+
+#if defined(_WIN32)
+
+#include <process.h>
+
+/*
+ * Win32 threads have a different entry point signature than pthreads, so the
+ * function and its argument are passed through this helper to a trampoline.
+ */
+typedef struct ThreadStart {
+	void				*(*func)(void *arg);
+	void				*arg;
+} ThreadStart;
+
+static unsigned __stdcall thread_trampoline(void *arg) {
+	ThreadStart start = *(ThreadStart *)arg;
+	free(arg);
+	start.func(start.arg);
+	return 0;
+}
+
+int thread_create(Thread *thread, void *(*func)(void *arg), void *arg) {
+	ThreadStart *start = malloc(sizeof(ThreadStart));
+
+	if (start == NULL) {
+		return -1;
+	}
+
+	start->func = func;
+	start->arg = arg;
+
+	*thread = (HANDLE)_beginthreadex(NULL, 0, thread_trampoline, start, 0, NULL);
+	if (*thread == 0) {
+		free(start);
+		return -1;
+	}
+
+	return 0;
+}
+
+int thread_join(Thread thread) {
+	if (WaitForSingleObject(thread, INFINITE) != WAIT_OBJECT_0) {
+		return -1;
+	}
+	CloseHandle(thread);
+	return 0;
+}
+
+/*
+ * Returns a number that identifies the calling thread while it is running.
+ */
+int64_t thread_current_id(void) {
+	return GetCurrentThreadId();
+}
+
+void thread_yield(void) {
+	SwitchToThread();
+}
+
+void mutex_init(Mutex *mutex) { InitializeCriticalSection(mutex); }
+void mutex_destroy(Mutex *mutex) { DeleteCriticalSection(mutex); }
+void mutex_lock(Mutex *mutex) { EnterCriticalSection(mutex); }
+void mutex_unlock(Mutex *mutex) { LeaveCriticalSection(mutex); }
+
+void cond_init(Cond *cond) { InitializeConditionVariable(cond); }
+void cond_destroy(Cond *cond) { /* nothing to do on Win32 */ }
+void cond_wait(Cond *cond, Mutex *mutex) { SleepConditionVariableCS(cond, mutex, INFINITE); }
+
+/*
+ * Waits at most the given time for the condition. Returns 0 when woken up, or 1 on timeout.
+ */
+int cond_timedwait(Cond *cond, Mutex *mutex, int timeout_ms) {
+	return SleepConditionVariableCS(cond, mutex, timeout_ms) ? 0 : 1;
+}
+void cond_signal(Cond *cond) { WakeConditionVariable(cond); }
+void cond_broadcast(Cond *cond) { WakeAllConditionVariable(cond); }
+
+#else
+
+int thread_create(Thread *thread, void *(*func)(void *arg), void *arg) {
+	return pthread_create(thread, NULL, func, arg) == 0 ? 0 : -1;
+}
+
+int thread_join(Thread thread) {
+	return pthread_join(thread, NULL) == 0 ? 0 : -1;
+}
+
+int64_t thread_current_id(void) {
+	return (int64_t)(uintptr_t)pthread_self();
+}
+
+void thread_yield(void) {
+	sched_yield();
+}
+
+void mutex_init(Mutex *mutex) { pthread_mutex_init(mutex, NULL); }
+void mutex_destroy(Mutex *mutex) { pthread_mutex_destroy(mutex); }
+void mutex_lock(Mutex *mutex) { pthread_mutex_lock(mutex); }
+void mutex_unlock(Mutex *mutex) { pthread_mutex_unlock(mutex); }
+
+void cond_init(Cond *cond) { pthread_cond_init(cond, NULL); }
+void cond_destroy(Cond *cond) { pthread_cond_destroy(cond); }
+void cond_wait(Cond *cond, Mutex *mutex) { pthread_cond_wait(cond, mutex); }
+
+int cond_timedwait(Cond *cond, Mutex *mutex, int timeout_ms) {
+	struct timespec deadline;
+
+	// The default condition clock is the realtime clock
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	return pthread_cond_timedwait(cond, mutex, &deadline) == ETIMEDOUT ? 1 : 0;
+}
+void cond_signal(Cond *cond) { pthread_cond_signal(cond); }
+void cond_broadcast(Cond *cond) { pthread_cond_broadcast(cond); }
+
+#endif
@@ -0,0 +1,79 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Minimal threading primitives, mapped to the Win32 API on Windows and to
+ * pthreads everywhere else. FFmpeg does not export its internal thread
+ * wrappers, and C11 threads are not available on all supported compilers.
+ */
+
+#if defined(_WIN32)
+	#include <windows.h>
+	typedef HANDLE				Thread;
+	typedef CRITICAL_SECTION	Mutex;
+	typedef CONDITION_VARIABLE	Cond;
+#else
+	#include <pthread.h>
+	typedef pthread_t			Thread;
+	typedef pthread_mutex_t		Mutex;
+	typedef pthread_cond_t		Cond;
+#endif
+
+int thread_create(Thread *thread, void *(*func)(void *arg), void *arg);
+int thread_join(Thread thread);
+void thread_yield(void);
+int64_t thread_current_id(void);
+
+void mutex_init(Mutex *mutex);
+void mutex_destroy(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+
+void cond_init(Cond *cond);
+void cond_destroy(Cond *cond);
+void cond_wait(Cond *cond, Mutex *mutex);
+int cond_timedwait(Cond *cond, Mutex *mutex, int timeout_ms);
+void cond_signal(Cond *cond);
+void cond_broadcast(Cond *cond);
+
+/*
+ * Atomic access to values that are shared between threads (e.g. abort flags, counters).
+ */
+#if defined(_MSC_VER)
+	static __inline int atomic_int_load(volatile int *value) { return (int)InterlockedCompareExchange((volatile LONG *)value, 0, 0); }
+	static __inline void atomic_int_store(volatile int *value, int new_value) { InterlockedExchange((volatile LONG *)value, new_value); }
+	static __inline int64_t atomic_int64_load(volatile int64_t *value) { return InterlockedCompareExchange64(value, 0, 0); }
+	static __inline void atomic_int64_store(volatile int64_t *value, int64_t new_value) { InterlockedExchange64(value, new_value); }
+	static __inline int64_t atomic_int64_fetch_add(volatile int64_t *value, int64_t increment) { return InterlockedExchangeAdd64(value, increment); }
+	static __inline void *atomic_ptr_load(void *volatile *value) { return InterlockedCompareExchangePointer(value, NULL, NULL); }
+	static __inline void atomic_ptr_store(void *volatile *value, void *new_value) { InterlockedExchangePointer(value, new_value); }
+	static __inline void *atomic_ptr_compare_exchange(void *volatile *value, void *expected, void *new_value) { return InterlockedCompareExchangePointer(value, new_value, expected); }
+#else
+	static inline int atomic_int_load(volatile int *value) { return __atomic_load_n(value, __ATOMIC_ACQUIRE); }
+	static inline void atomic_int_store(volatile int *value, int new_value) { __atomic_store_n(value, new_value, __ATOMIC_RELEASE); }
+	static inline int64_t atomic_int64_load(volatile int64_t *value) { return __atomic_load_n(value, __ATOMIC_ACQUIRE); }
+	static inline void atomic_int64_store(volatile int64_t *value, int64_t new_value) { __atomic_store_n(value, new_value, __ATOMIC_RELEASE); }
+	static inline int64_t atomic_int64_fetch_add(volatile int64_t *value, int64_t increment) { return __atomic_fetch_add(value, increment, __ATOMIC_ACQ_REL); }
+	static inline void *atomic_ptr_load(void *volatile *value) { return __atomic_load_n(value, __ATOMIC_ACQUIRE); }
+	static inline void atomic_ptr_store(void *volatile *value, void *new_value) { __atomic_store_n(value, new_value, __ATOMIC_RELEASE); }
+	static inline void *atomic_ptr_compare_exchange(void *volatile *value, void *expected, void *new_value) { __atomic_compare_exchange_n(value, &expected, new_value, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); return expected; }
+#endif
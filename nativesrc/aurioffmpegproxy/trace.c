@@ -0,0 +1,192 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "thread.h"
+#include "timer.h"
+
+static const char *trace_event_names[] = {
+	"open",
+	"probe",
+	"demux",
+	"decode",
+	"convert",
+	"seek",
+	"io_read",
+	"io_seek",
+	"log",
+};
+
+/*
+ * Creates a trace buffer that keeps the given number of most recent events. The
+ * capacity is rounded up to the next power of two.
+ */
+Trace *trace_create(int capacity) {
+	Trace *trace;
+	int64_t rounded = 1;
+
+	if (capacity <= 0) {
+		capacity = TRACE_DEFAULT_CAPACITY;
+	}
+	while (rounded < capacity) {
+		rounded <<= 1;
+	}
+
+	trace = malloc(sizeof(Trace));
+	if (trace == NULL) {
+		return NULL;
+	}
+
+	trace->events = calloc((size_t)rounded, sizeof(TraceEvent));
+	if (trace->events == NULL) {
+		free(trace);
+		return NULL;
+	}
+
+	trace->capacity = rounded;
+	trace->next = 0;
+	trace->origin_ns = timer_now_ns();
+
+	return trace;
+}
+
+/*
+ * Reserves the slot for the next event and marks it as being written.
+ */
+static TraceEvent *trace_reserve(Trace *trace, int64_t *number) {
+	TraceEvent *event;
+
+	*number = atomic_int64_fetch_add(&trace->next, 1);
+	event = &trace->events[*number & (trace->capacity - 1)];
+	atomic_int64_store(&event->sequence, 0);
+
+	return event;
+}
+
+/*
+ * Records an event that spans the given time range.
+ */
+void trace_add(Trace *trace, TraceEventType type, int64_t start_ns, int64_t end_ns, int64_t arg) {
+	TraceEvent *event;
+	int64_t number;
+
+	event = trace_reserve(trace, &number);
+	event->type = type;
+	event->start_ns = start_ns;
+	event->end_ns = end_ns;
+	event->arg = arg;
+	event->thread = thread_current_id();
+	event->message[0] = '\0';
+	atomic_int64_store(&event->sequence, number + 1);
+}
+
+/*
+ * Records an instant event with a message, which is truncated to fit into the event.
+ */
+void trace_message(Trace *trace, int64_t time_ns, const char *message) {
+	TraceEvent *event;
+	int64_t number;
+
+	event = trace_reserve(trace, &number);
+	event->type = TRACE_LOG;
+	event->start_ns = time_ns;
+	event->end_ns = time_ns;
+	event->arg = 0;
+	event->thread = thread_current_id();
+	strncpy(event->message, message, TRACE_MESSAGE_SIZE - 1);
+	event->message[TRACE_MESSAGE_SIZE - 1] = '\0';
+	atomic_int64_store(&event->sequence, number + 1);
+}
+
+static void write_json_string(FILE *f, const char *s) {
+	fputc('"', f);
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\') {
+			fprintf(f, "\\%c", *s);
+		}
+		else if ((unsigned char)*s < 0x20) {
+			fprintf(f, "\\u%04x", (unsigned char)*s);
+		}
+		else {
+			fputc(*s, f);
+		}
+	}
+	fputc('"', f);
+}
+
+/*
+ * Writes the buffered events in the Chrome trace event format, which can be loaded
+ * into chrome://tracing or Perfetto. Events that are overwritten while dumping are
+ * skipped. Returns the number of written events.
+ */
+int trace_dump(Trace *trace, FILE *f, const char *name) {
+	TraceEvent event;
+	int64_t next, first, number, sequence;
+	int count = 0;
+
+	next = atomic_int64_load(&trace->next);
+	first = next > trace->capacity ? next - trace->capacity : 0;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":");
+	write_json_string(f, name != NULL ? name : "aurioffmpegproxy");
+	fprintf(f, "}}");
+
+	for (number = first; number < next; number++) {
+		TraceEvent *slot = &trace->events[number & (trace->capacity - 1)];
+
+		// Copy the slot and check that it has not been rewritten in the meantime
+		sequence = atomic_int64_load(&slot->sequence);
+		if (sequence != number + 1) {
+			continue;
+		}
+		memcpy(&event, slot, sizeof(TraceEvent));
+		if (atomic_int64_load(&slot->sequence) != sequence) {
+			continue;
+		}
+
+		if (event.type == TRACE_LOG) {
+			fprintf(f, ",\n{\"name\":\"log\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%lld,\"ts\":%.3f,\"args\":{\"message\":",
+				(long long)event.thread, (event.start_ns - trace->origin_ns) / 1000.0);
+			write_json_string(f, event.message);
+			fprintf(f, "}}");
+		}
+		else {
+			fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lld,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"arg\":%lld}}",
+				trace_event_names[event.type],
+				(long long)event.thread,
+				(event.start_ns - trace->origin_ns) / 1000.0,
+				(event.end_ns - event.start_ns) / 1000.0,
+				(long long)event.arg);
+		}
+		count++;
+	}
+
+	fprintf(f, "\n]}\n");
+
+	return count;
+}
+
+void trace_free(Trace *trace) {
+	free(trace->events);
+	free(trace);
+}
@@ -0,0 +1,65 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define TRACE_DEFAULT_CAPACITY 8192 // events, must be a power of two
+#define TRACE_MESSAGE_SIZE 80
+
+typedef enum TraceEventType {
+	TRACE_OPEN,
+	TRACE_PROBE,
+	TRACE_DEMUX,
+	TRACE_DECODE,
+	TRACE_CONVERT,
+	TRACE_SEEK,
+	TRACE_IO_READ,
+	TRACE_IO_SEEK,
+	TRACE_LOG, // instant event with a message
+} TraceEventType;
+
+typedef struct TraceEvent {
+	volatile int64_t	sequence; // number of the event stored in this slot + 1, 0 while empty or being written
+	int64_t				start_ns;
+	int64_t				end_ns;
+	int64_t				arg; // event specific value, e.g. a byte count or stream index
+	int64_t				thread; // id of the recording thread
+	TraceEventType		type;
+	char				message[TRACE_MESSAGE_SIZE];
+} TraceEvent;
+
+/*
+ * A fixed-size ring buffer of trace events that keeps the most recent events.
+ * Writers reserve slots with an atomic counter and never block, so events can be
+ * recorded from any thread while another thread dumps the buffer.
+ */
+typedef struct Trace {
+	TraceEvent			*events;
+	int64_t				capacity;
+	volatile int64_t	next; // number of the next event to be written
+	int64_t				origin_ns; // timestamp of the trace creation, the zero point of the timeline
+} Trace;
+
+Trace *trace_create(int capacity);
+void trace_add(Trace *trace, TraceEventType type, int64_t start_ns, int64_t end_ns, int64_t arg);
+void trace_message(Trace *trace, int64_t time_ns, const char *message);
+int trace_dump(Trace *trace, FILE *f, const char *name);
+void trace_free(Trace *trace);
@@ -0,0 +1,458 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// System includes
+#include <stdlib.h>
+#include <string.h>
+
+#include "proxy.h"
+#include "timer.h"
+
+#include "libavutil/mem.h"
+
+/*
+ * Single-pass decoding of multiple audio tracks.
+ *
+ * The regular decoding path decodes the best audio stream of a source only. Multi-track
+ * sources (e.g. recordings with several microphones, multi-language movies) would need
+ * to be opened once per track, demuxing and reading the source once per track. A track
+ * set instead opens a decoder for every selected audio stream on the instance's demuxer,
+ * and decodes all of them from the same packet sequence.
+ *
+ * Frames can either be read in decoding order, tagged with their track number
+ * (stream_read_any_track_frame), or per track (stream_read_track_frame), in which case
+ * frames of the other tracks that are decoded in the meantime are kept in per-track queues.
+ * Track selection replaces the regular reading functions, they must not be mixed.
+ */
+
+static void track_free(AudioTrack *t)
+{
+	avcodec_free_context(&t->codec_ctx);
+	swr_free(&t->swr);
+	if (t->queue != NULL) {
+		framequeue_free(t->queue);
+		t->queue = NULL;
+	}
+}
+
+static int track_init(ProxyInstance *pi, AudioTrack *t, int stream_index)
+{
+	if (stream_index < 0 || stream_index >= (int)pi->fmt_ctx->nb_streams
+		|| pi->fmt_ctx->streams[stream_index]->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) {
+		proxy_log(pi, PI_LOG_ERROR, "stream %d is not an audio stream", stream_index);
+		return -1;
+	}
+
+	t->stream = pi->fmt_ctx->streams[stream_index];
+
+	if (open_stream_codec_context(t->stream, &t->codec_ctx, 0, NULL) < 0) {
+		proxy_log(pi, PI_LOG_ERROR, "Cannot open decoder for stream %d", stream_index);
+		return -2;
+	}
+
+	t->swr = create_audio_converter(t->codec_ctx);
+	t->convert = select_audio_converter(t->codec_ctx);
+	t->queue = framequeue_create(TRACK_QUEUE_CAPACITY);
+	if (t->queue == NULL) {
+		return -3;
+	}
+
+	t->output.format.sample_rate = t->codec_ctx->sample_rate;
+	t->output.format.sample_size = get_output_sample_size(t->codec_ctx);
+	t->output.format.channels = t->codec_ctx->ch_layout.nb_channels;
+	t->output.length = t->stream->duration != AV_NOPTS_VALUE
+		? pts_to_samples(t->output.format.sample_rate, t->stream->time_base, t->stream->duration)
+		: pi->fmt_ctx->duration != AV_NOPTS_VALUE
+			? pts_to_samples(t->output.format.sample_rate, AV_TIME_BASE_Q, pi->fmt_ctx->duration)
+			: AV_NOPTS_VALUE;
+	t->output.frame_size = t->output.format.sample_rate; // 1 sec default frame size, same as the regular audio output
+	t->output.sample_position = 0;
+	t->output.stream_index = stream_index;
+
+	return 0;
+}
+
+/*
+ * Returns the number of audio streams of the source, and writes up to max_count of their
+ * stream indices into stream_indices.
+ */
+int stream_get_audio_streams(ProxyInstance *pi, int *stream_indices, int max_count)
+{
+	int count = 0;
+
+	if (pi->released && acquire_decoders(pi, 1) < 0) {
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < pi->fmt_ctx->nb_streams; i++) {
+		if (pi->fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+			if (count < max_count) {
+				stream_indices[count] = i;
+			}
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Selects the audio streams to decode as tracks, in the order of the given stream indices,
+ * or all audio streams if stream_indices is NULL. Returns the number of tracks, or a
+ * negative number on error. Streams that are neither selected nor decoded by the regular
+ * path are discarded by the demuxer. Each selected track must be read, otherwise its frames
+ * pile up in its queue.
+ */
+int stream_select_tracks(ProxyInstance *pi, int *stream_indices, int count)
+{
+	TrackSet *ts;
+	int *all_indices = NULL;
+	int ret = 0;
+
+	if (pi->mode & MODE_LOWMEM) {
+		proxy_log(pi, PI_LOG_ERROR, "track selection is not supported in low-footprint mode");
+		return -1;
+	}
+	if (pi->mode & MODE_DISPATCH) {
+		proxy_log(pi, PI_LOG_ERROR, "track selection is not supported in dispatch mode");
+		return -1;
+	}
+
+	if (pi->tracks != NULL) {
+		tracks_free(pi->tracks);
+		pi->tracks = NULL;
+	}
+
+	if (stream_indices == NULL) {
+		all_indices = malloc(sizeof(int) * pi->fmt_ctx->nb_streams);
+		if (all_indices == NULL) {
+			return -1;
+		}
+		count = stream_get_audio_streams(pi, all_indices, pi->fmt_ctx->nb_streams);
+		stream_indices = all_indices;
+	}
+
+	if (count <= 0) {
+		proxy_log(pi, PI_LOG_ERROR, "no audio tracks to select");
+		free(all_indices);
+		return -1;
+	}
+
+	ts = calloc(1, sizeof(TrackSet));
+	if (ts == NULL || (ts->tracks = calloc(count, sizeof(AudioTrack))) == NULL) {
+		free(ts);
+		free(all_indices);
+		return -1;
+	}
+	ts->count = count;
+
+	for (int i = 0; i < count; i++) {
+		if ((ret = track_init(pi, &ts->tracks[i], stream_indices[i])) < 0) {
+			tracks_free(ts);
+			free(all_indices);
+			return ret;
+		}
+	}
+
+	// Let the demuxer skip the packets of streams that nobody decodes
+	for (unsigned int i = 0; i < pi->fmt_ctx->nb_streams; i++) {
+		AVStream *stream = pi->fmt_ctx->streams[i];
+		int used = stream == pi->audio_stream || stream == pi->video_stream;
+
+		for (int j = 0; j < count && !used; j++) {
+			used = ts->tracks[j].stream == stream;
+		}
+		stream->discard = used ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+	}
+
+	// Drop a packet that the regular path may have left behind
+	av_packet_unref(pi->pkt);
+
+	free(all_indices);
+	pi->tracks = ts;
+
+	return count;
+}
+
+void *stream_get_track_output_config(ProxyInstance *pi, int track)
+{
+	if (pi->tracks == NULL || track < 0 || track >= pi->tracks->count) {
+		return NULL;
+	}
+
+	return &pi->tracks->tracks[track].output;
+}
+
+/*
+ * Decodes the next frame of any track into pi->frame. Returns the track number, or -1
+ * when all tracks have ended.
+ */
+static int tracks_decode_frame(ProxyInstance *pi)
+{
+	TrackSet *ts = pi->tracks;
+	int ret;
+
+	while (1) {
+		int active = 0;
+
+		// Collect decoded frames first, alternating between tracks so that none falls behind
+		for (int i = 0; i < ts->count; i++) {
+			int n = (ts->next + i) % ts->count;
+			AudioTrack *t = &ts->tracks[n];
+
+			if (t->eof) {
+				continue;
+			}
+
+			int64_t decode_start = timer_now_ns();
+			ret = avcodec_receive_frame(t->codec_ctx, pi->frame);
+			int64_t decode_end = timer_now_ns();
+			pi->stats.decode_ns += decode_end - decode_start;
+
+			if (ret == 0) {
+				ts->next = (n + 1) % ts->count;
+				pi->stats.audio_frames_decoded++;
+				if (pi->trace != NULL) {
+					trace_add(pi->trace, TRACE_DECODE, decode_start, decode_end, n);
+				}
+				return n;
+			}
+			else if (ret == AVERROR_EOF) {
+				t->eof = 1;
+			}
+			else if (ret != AVERROR(EAGAIN)) {
+				proxy_log(pi, PI_LOG_ERROR, "Error receiving decoded frame of track %d (%s)", n, av_err2str(ret));
+				t->eof = 1;
+			}
+			else {
+				active++;
+			}
+		}
+
+		if (active == 0 || ts->draining) {
+			return -1; // all tracks have ended
+		}
+
+		// All decoders need more input, feed them the next packet
+		int64_t demux_start = timer_now_ns();
+		ret = av_read_frame(pi->fmt_ctx, pi->pkt);
+		int64_t demux_end = timer_now_ns();
+		pi->stats.demux_ns += demux_end - demux_start;
+		if (pi->trace != NULL) {
+			trace_add(pi->trace, TRACE_DEMUX, demux_start, demux_end, ret >= 0 ? pi->pkt->size : ret);
+		}
+
+		if (ret < 0) {
+			// End of input, let the decoders return their remaining frames
+			for (int i = 0; i < ts->count; i++) {
+				if (!ts->tracks[i].eof) {
+					avcodec_send_packet(ts->tracks[i].codec_ctx, NULL);
+				}
+			}
+			ts->draining = 1;
+			continue;
+		}
+
+		pi->stats.packets_demuxed++;
+		pi->stats.bytes_demuxed += pi->pkt->size;
+
+		AudioTrack *target = NULL;
+		for (int i = 0; i < ts->count; i++) {
+			if (ts->tracks[i].stream->index == pi->pkt->stream_index) {
+				target = &ts->tracks[i];
+				break;
+			}
+		}
+
+		if (target == NULL || target->eof) {
+			pi->stats.packets_discarded++;
+			pi->stats.bytes_discarded += pi->pkt->size;
+		}
+		else {
+			int64_t decode_start = timer_now_ns();
+			ret = avcodec_send_packet(target->codec_ctx, pi->pkt);
+			int64_t decode_end = timer_now_ns();
+			pi->stats.decode_ns += decode_end - decode_start;
+			if (pi->trace != NULL) {
+				trace_add(pi->trace, TRACE_DECODE, decode_start, decode_end, pi->pkt->size);
+			}
+			if (ret < 0) {
+				proxy_log(pi, PI_LOG_ERROR, "Error sending packet of stream %d to decoder (%s)", pi->pkt->stream_index, av_err2str(ret));
+			}
+		}
+
+		av_packet_unref(pi->pkt);
+	}
+}
+
+/*
+ * Converts the decoded frame in pi->frame to the output format of the track. Returns the
+ * number of samples per channel, or a negative number on error.
+ */
+static int track_convert(ProxyInstance *pi, AudioTrack *t, uint8_t *output_buffer, int output_buffer_size, int64_t *timestamp)
+{
+	int size = pi->frame->nb_samples * t->output.format.channels * t->output.format.sample_size;
+	int ret;
+
+	if (output_buffer_size < size) {
+		proxy_log(pi, PI_LOG_ERROR, "output buffer too small (%d < %d)", output_buffer_size, size);
+		return -1;
+	}
+
+	int64_t start = timer_now_ns();
+	if (t->convert != NULL) {
+		t->convert(output_buffer, (const uint8_t **)pi->frame->extended_data, t->output.format.channels, pi->frame->nb_samples);
+		ret = pi->frame->nb_samples;
+	}
+	else {
+		ret = swr_convert(t->swr, &output_buffer, pi->frame->nb_samples, (const uint8_t **)pi->frame->extended_data, pi->frame->nb_samples);
+	}
+	int64_t end = timer_now_ns();
+	pi->stats.swr_ns += end - start;
+	if (pi->trace != NULL) {
+		trace_add(pi->trace, TRACE_CONVERT, start, end, TYPE_AUDIO);
+	}
+
+	if (ret < 0) {
+		proxy_log(pi, PI_LOG_ERROR, "Could not convert input samples");
+		return ret;
+	}
+
+	update_position_and_get_timestamp(pi->frame, t->output.format.sample_rate, t->stream->time_base,
+		ret, &t->output.sample_position, timestamp);
+
+	return ret;
+}
+
+static int track_deliver_queued(ProxyInstance *pi, FrameQueueItem *item, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size)
+{
+	int ret = item->length;
+
+	if (output_buffer_size < item->size) {
+		proxy_log(pi, PI_LOG_ERROR, "output buffer too small (%d < %d)", output_buffer_size, item->size);
+		ret = -1;
+	}
+	else {
+		memcpy(output_buffer, item->data, item->size);
+		*timestamp = item->timestamp;
+	}
+
+	framequeue_item_release(item);
+
+	return ret;
+}
+
+/*
+ * Reads the next frame of any track and returns the number of samples per channel,
+ * or -1 at the end of all tracks. The track number is written to `track`.
+ */
+int stream_read_any_track_frame(ProxyInstance *pi, int *track, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size)
+{
+	TrackSet *ts = pi->tracks;
+	FrameQueueItem item;
+	int n;
+
+	if (ts == NULL) {
+		proxy_log(pi, PI_LOG_ERROR, "no tracks selected");
+		return -1;
+	}
+
+	// Frames that have been queued by stream_read_track_frame come first
+	for (n = 0; n < ts->count; n++) {
+		if (framequeue_try_get(ts->tracks[n].queue, &item)) {
+			*track = n;
+			return track_deliver_queued(pi, &item, timestamp, output_buffer, output_buffer_size);
+		}
+	}
+
+	if ((n = tracks_decode_frame(pi)) < 0) {
+		return -1;
+	}
+
+	*track = n;
+
+	return track_convert(pi, &ts->tracks[n], output_buffer, output_buffer_size, timestamp);
+}
+
+/*
+ * Reads the next frame of the given track and returns the number of samples per channel,
+ * or -1 at the end of the track. Frames of other tracks that are decoded in the meantime
+ * are queued until they are read.
+ */
+int stream_read_track_frame(ProxyInstance *pi, int track, int64_t *timestamp, uint8_t *output_buffer, int output_buffer_size)
+{
+	TrackSet *ts = pi->tracks;
+	FrameQueueItem item;
+	int n;
+
+	if (ts == NULL || track < 0 || track >= ts->count) {
+		proxy_log(pi, PI_LOG_ERROR, "invalid track %d", track);
+		return -1;
+	}
+
+	if (framequeue_try_get(ts->tracks[track].queue, &item)) {
+		return track_deliver_queued(pi, &item, timestamp, output_buffer, output_buffer_size);
+	}
+
+	while (!ts->tracks[track].eof && (n = tracks_decode_frame(pi)) >= 0) {
+		AudioTrack *t = &ts->tracks[n];
+		int64_t frame_timestamp;
+		int size, samples;
+
+		if (n == track) {
+			return track_convert(pi, t, output_buffer, output_buffer_size, timestamp);
+		}
+
+		// Keep the frame of the other track for later
+		size = pi->frame->nb_samples * t->output.format.channels * t->output.format.sample_size;
+		av_fast_malloc(&ts->buffer, &ts->buffer_size, size);
+		if (ts->buffer == NULL) {
+			return -1;
+		}
+		if ((samples = track_convert(pi, t, ts->buffer, size, &frame_timestamp)) < 0
+			|| framequeue_put_nowait(t->queue, TYPE_AUDIO, frame_timestamp, samples,
+				ts->buffer, samples * t->output.format.channels * t->output.format.sample_size) < 0) {
+			return -1;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Resets the decoders and drops all queued frames, e.g. after a seek.
+ */
+void tracks_flush(TrackSet *ts)
+{
+	for (int i = 0; i < ts->count; i++) {
+		avcodec_flush_buffers(ts->tracks[i].codec_ctx);
+		framequeue_clear(ts->tracks[i].queue);
+		ts->tracks[i].eof = 0;
+	}
+	ts->draining = 0;
+}
+
+void tracks_free(TrackSet *ts)
+{
+	for (int i = 0; i < ts->count; i++) {
+		track_free(&ts->tracks[i]);
+	}
+	free(ts->tracks);
+	av_free(ts->buffer);
+	free(ts);
+}
@@ -0,0 +1,72 @@
+// 
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2023  Mario Guggenberger <mg@protyposis.net>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+// FFmpeg includes
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libswresample/swresample.h"
+
+#include "framequeue.h"
+#include "convert.h"
+
+#define TRACK_QUEUE_CAPACITY 16 // initial capacity, the queues grow as needed
+
+/*
+ * Output properties of a track. The leading fields have the same layout as
+ * ProxyInstance.audio_output, so both can be read with the same struct.
+ */
+typedef struct TrackOutput {
+	struct {
+		int					sample_rate;
+		int					sample_size;
+		int					channels;
+	}					format;
+	int64_t				length;
+	int					frame_size;
+	int64_t				sample_position;
+	int					stream_index;
+} TrackOutput;
+
+typedef struct AudioTrack {
+	AVStream			*stream;
+	AVCodecContext		*codec_ctx;
+	SwrContext			*swr;
+	SampleConverter		convert; // fast path for the sample conversion, NULL if swr is needed
+	FrameQueue			*queue; // frames decoded while another track was requested
+	int					eof;
+	TrackOutput			output;
+} AudioTrack;
+
+/*
+ * A set of audio tracks that are decoded together in a single demuxing pass.
+ */
+typedef struct TrackSet {
+	AudioTrack			*tracks;
+	int					count;
+	int					next; // track to check first for decoded frames, to alternate between tracks
+	int					draining; // end of input reached, decoders are flushing their remaining frames
+	uint8_t				*buffer; // conversion buffer for frames that are queued
+	unsigned int		buffer_size;
+} TrackSet;
+
+void tracks_flush(TrackSet *ts);
+void tracks_free(TrackSet *ts);
@@ -0,0 +1,53 @@
+﻿//
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2017  Mario Guggenberger <mg@protyposis.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+using System;
+using System.Runtime.InteropServices;
+
+namespace Aurio.FFmpeg
+{
+    /// <summary>
+    /// Result of <see cref="FFmpegReader.Align"/>.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct AlignResult
+    {
+        /// <summary>
+        /// The time in seconds by which the target content lags behind the source content,
+        /// interpolated between the analysis samples.
+        /// </summary>
+        public double offset { get; internal set; }
+
+        /// <summary>
+        /// The absolute normalized correlation coefficient at the offset (0..1).
+        /// </summary>
+        public double confidence { get; internal set; }
+
+        /// <summary>
+        /// The offset in samples at the analysis sample rate.
+        /// </summary>
+        public int lag { get; internal set; }
+
+        public int rate { get; internal set; }
+
+        public TimeSpan Offset
+        {
+            get { return TimeSpan.FromSeconds(offset); }
+        }
+    }
+}
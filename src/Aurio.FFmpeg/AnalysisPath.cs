@@ -0,0 +1,54 @@
+﻿//
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2017  Mario Guggenberger <mg@protyposis.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+using System;
+
+namespace Aurio.FFmpeg
+{
+    /// <summary>
+    /// The reductions that a reader in <see cref="Type.Analysis"/> mode uses to lower the decoding cost.
+    /// </summary>
+    [Flags]
+    public enum AnalysisPath : int
+    {
+        /// <summary>
+        /// Full decoding, the output is reduced after decoding.
+        /// </summary>
+        Full = 0x00,
+
+        /// <summary>
+        /// The decoder mixes down the channels (e.g. AC-3, E-AC-3, DTS, TrueHD).
+        /// </summary>
+        DecoderDownmix = 0x01,
+
+        /// <summary>
+        /// The decoder skips the extension layers (e.g. the lossless layer of DTS-HD).
+        /// </summary>
+        DecoderCore = 0x02,
+
+        /// <summary>
+        /// The decoded samples are resampled to the analysis sample rate.
+        /// </summary>
+        Resample = 0x04,
+
+        /// <summary>
+        /// The decoded channels are mixed down to mono.
+        /// </summary>
+        Mix = 0x08
+    }
+}
@@ -0,0 +1,48 @@
+﻿//
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2017  Mario Guggenberger <mg@protyposis.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+using System.Runtime.InteropServices;
+
+namespace Aurio.FFmpeg
+{
+    /// <summary>
+    /// Counters of the native frame buffer pools, which are shared by all readers of the process.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct BufferPoolStats
+    {
+        /// <summary>
+        /// Plane buffers handed out to the decoders.
+        /// </summary>
+        public long requests { get; internal set; }
+
+        /// <summary>
+        /// Plane buffers that had to be newly allocated because the pool was empty.
+        /// </summary>
+        public long allocations { get; internal set; }
+
+        /// <summary>
+        /// Memory held by the pools in bytes, whether in use or not.
+        /// </summary>
+        public long pooled_bytes { get; internal set; }
+
+        /// <summary>
+        /// Frames allocated by the FFmpeg default allocator.
+        /// </summary>
+        public long fallbacks { get; internal set; }
+    }
+}
@@ -0,0 +1,52 @@
+﻿//
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2017  Mario Guggenberger <mg@protyposis.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+using System.Runtime.InteropServices;
+
+namespace Aurio.FFmpeg
+{
+    /// <summary>
+    /// A time range to export into a file by <see cref="FFmpegReader.ExportRanges"/>.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ExportRange
+    {
+        /// <summary>
+        /// The start in samples (audio) or frames (video).
+        /// </summary>
+        public long start;
+
+        /// <summary>
+        /// The exclusive end in samples (audio) or frames (video).
+        /// </summary>
+        public long end;
+
+        /// <summary>
+        /// The output file, whose container format is derived from the extension.
+        /// </summary>
+        [MarshalAs(UnmanagedType.LPUTF8Str)]
+        public string filename;
+
+        public ExportRange(long start, long end, string filename)
+        {
+            this.start = start;
+            this.end = end;
+            this.filename = filename;
+        }
+    }
+}
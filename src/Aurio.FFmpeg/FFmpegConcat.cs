@@ -0,0 +1,140 @@
+﻿//
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2017  Mario Guggenberger <mg@protyposis.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+using System;
+using System.IO;
+using System.Runtime.InteropServices;
+
+namespace Aurio.FFmpeg
+{
+    /// <summary>
+    /// Reads the audio of a list of files (e.g. the chunks of a long recording) natively as one
+    /// continuous stream. The next file is opened and decoded ahead in the background, so reading
+    /// does not stall at file boundaries. Samples that a file repeats from the end of the previous
+    /// file, according to their timestamps, are skipped.
+    /// </summary>
+    public class FFmpegConcat : IDisposable
+    {
+        private bool disposed = false;
+        private IntPtr concat = IntPtr.Zero;
+        private AudioOutputConfig audioOutputConfig;
+
+        /// <summary>
+        /// Opens the files, which must have the same audio format and a known length.
+        /// </summary>
+        /// <param name="filenames">the files in playback order</param>
+        /// <param name="mode">additional modes, e.g. <see cref="Type.Analysis"/></param>
+        public FFmpegConcat(string[] filenames, Type mode = Type.Audio)
+        {
+            FFmpegReader.ValidateNativeLibraryAvailability();
+
+            concat = InteropWrapper.concat_open(mode, filenames, filenames.Length);
+            if (concat == IntPtr.Zero)
+            {
+                throw new IOException("Error opening the files as one stream");
+            }
+
+            IntPtr ocp = InteropWrapper.concat_get_output_config(concat);
+            audioOutputConfig = (AudioOutputConfig)
+                Marshal.PtrToStructure(ocp, typeof(AudioOutputConfig));
+        }
+
+        /// <summary>
+        /// The output format, with the length of the concatenated stream.
+        /// </summary>
+        public AudioOutputConfig AudioOutputConfig
+        {
+            get { return audioOutputConfig; }
+        }
+
+        /// <summary>
+        /// Reads the next frame, which fits <see cref="AudioOutputConfig.frame_size"/> samples.
+        /// </summary>
+        /// <param name="timestamp">the position of the frame in the concatenated stream</param>
+        /// <returns>the number of samples per channel, or -1 at the end of the stream</returns>
+        public int ReadFrame(out long timestamp, byte[] outputBuffer, int outputBufferSize)
+        {
+            CheckAndHandleActiveInstance();
+            return InteropWrapper.concat_read_frame(
+                concat,
+                out timestamp,
+                outputBuffer,
+                outputBufferSize
+            );
+        }
+
+        /// <summary>
+        /// Seeks to a sample position in the concatenated stream.
+        /// </summary>
+        public void Seek(long position)
+        {
+            CheckAndHandleActiveInstance();
+            if (InteropWrapper.concat_seek(concat, position) < 0)
+            {
+                throw new IOException("Cannot seek to " + position);
+            }
+        }
+
+        /// <summary>
+        /// The length of the concatenated stream in samples.
+        /// </summary>
+        public long Length
+        {
+            get
+            {
+                CheckAndHandleActiveInstance();
+                return InteropWrapper.concat_get_length(concat);
+            }
+        }
+
+        private void CheckAndHandleActiveInstance()
+        {
+            if (disposed)
+            {
+                throw new IOException("Cannot operate on a disposed stream");
+            }
+        }
+
+        #region IDisposable & destructor
+
+        public void Dispose()
+        {
+            Dispose(true);
+            GC.SuppressFinalize(this);
+        }
+
+        protected virtual void Dispose(bool disposing)
+        {
+            if (!disposed)
+            {
+                if (concat != IntPtr.Zero)
+                {
+                    InteropWrapper.concat_close(concat);
+                    concat = IntPtr.Zero;
+                }
+            }
+            disposed = true;
+        }
+
+        ~FFmpegConcat()
+        {
+            Dispose(false);
+        }
+
+        #endregion
+    }
+}
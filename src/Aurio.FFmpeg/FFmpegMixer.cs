@@ -0,0 +1,184 @@
+﻿//
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2017  Mario Guggenberger <mg@protyposis.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+using System;
+using System.Collections.Generic;
+using System.IO;
+
+namespace Aurio.FFmpeg
+{
+    /// <summary>
+    /// Decodes and mixes the audio of multiple readers natively into one float output, so that
+    /// multitrack playback needs a single native call per output block instead of one per track.
+    /// </summary>
+    public class FFmpegMixer : IDisposable
+    {
+        private const long AV_NOPTS_VALUE = long.MinValue;
+
+        private bool disposed = false;
+        private IntPtr mixer = IntPtr.Zero;
+        private int channels;
+
+        // The mixer reads from the native instances of the readers, which must stay alive
+        private List<FFmpegReader> readers = new List<FFmpegReader>();
+
+        /// <summary>
+        /// Creates a mixer that outputs interleaved float samples.
+        /// </summary>
+        /// <param name="sampleRate">the sample rate of the output and of all tracks</param>
+        /// <param name="channels">the output channels, tracks must have the same number of channels or a single one</param>
+        public FFmpegMixer(int sampleRate, int channels)
+        {
+            mixer = InteropWrapper.mixer_create(sampleRate, channels);
+            if (mixer == IntPtr.Zero)
+            {
+                throw new ArgumentException("Unsupported output format");
+            }
+            this.channels = channels;
+        }
+
+        /// <summary>
+        /// Adds the audio of a reader as a track that starts at the given output sample. The reader
+        /// must not be read by other means while the mixer is in use, and must be disposed by the caller
+        /// after the mixer. Once a track reader is disposed, the mixer cannot be used anymore.
+        /// </summary>
+        /// <returns>the index of the track</returns>
+        public int AddTrack(FFmpegReader reader, long offset = 0)
+        {
+            CheckAndHandleActiveInstance();
+            int track = InteropWrapper.mixer_add_track(mixer, reader.Instance, offset);
+            if (track < 0)
+            {
+                throw new ArgumentException(
+                    "The track does not match the output format of the mixer"
+                );
+            }
+            readers.Add(reader);
+            return track;
+        }
+
+        /// <summary>
+        /// Sets the placement and levels of a track.
+        /// </summary>
+        /// <param name="track">the index of the track</param>
+        /// <param name="offset">the output sample where the track starts</param>
+        /// <param name="volume">the gain, 1.0 leaves the track unchanged</param>
+        /// <param name="balance">-1.0 is left channel only, 1.0 is right channel only</param>
+        /// <param name="mute">muted tracks are not decoded</param>
+        public void SetTrack(int track, long offset, float volume, float balance, bool mute)
+        {
+            CheckAndHandleActiveInstance();
+            if (
+                InteropWrapper.mixer_set_track(
+                    mixer,
+                    track,
+                    offset,
+                    volume,
+                    balance,
+                    mute ? 1 : 0
+                ) < 0
+            )
+            {
+                throw new ArgumentOutOfRangeException(nameof(track));
+            }
+        }
+
+        /// <summary>
+        /// Mixes the next samples into the buffer, which receives `samples` samples per channel.
+        /// </summary>
+        /// <returns>the number of samples until the end of the longest track, less than requested at the end</returns>
+        public int Read(float[] buffer, int samples)
+        {
+            CheckAndHandleActiveInstance();
+            if (buffer.Length < samples * channels)
+            {
+                throw new ArgumentException("Buffer too small");
+            }
+            return InteropWrapper.mixer_read(mixer, buffer, samples);
+        }
+
+        /// <summary>
+        /// Sets the output position in samples. All tracks are repositioned on the next read.
+        /// </summary>
+        public void Seek(long position)
+        {
+            CheckAndHandleActiveInstance();
+            if (InteropWrapper.mixer_seek(mixer, position) < 0)
+            {
+                throw new ArgumentOutOfRangeException(nameof(position));
+            }
+        }
+
+        /// <summary>
+        /// The end of the longest track in samples, or -1 if a track length is unknown.
+        /// </summary>
+        public long Length
+        {
+            get
+            {
+                CheckAndHandleActiveInstance();
+                long length = InteropWrapper.mixer_get_length(mixer);
+                return length == AV_NOPTS_VALUE ? -1 : length;
+            }
+        }
+
+        private void CheckAndHandleActiveInstance()
+        {
+            if (disposed)
+            {
+                throw new IOException("Cannot operate on a disposed mixer");
+            }
+            // The native mixer reads from the instances of the readers, which are freed on disposal
+            foreach (FFmpegReader reader in readers)
+            {
+                if (reader.IsDisposed)
+                {
+                    throw new IOException("Cannot operate on a mixer with a disposed track reader");
+                }
+            }
+        }
+
+        #region IDisposable & destructor
+
+        public void Dispose()
+        {
+            Dispose(true);
+            GC.SuppressFinalize(this);
+        }
+
+        protected virtual void Dispose(bool disposing)
+        {
+            if (!disposed)
+            {
+                if (mixer != IntPtr.Zero)
+                {
+                    InteropWrapper.mixer_free(mixer);
+                    mixer = IntPtr.Zero;
+                }
+                readers = null;
+            }
+            disposed = true;
+        }
+
+        ~FFmpegMixer()
+        {
+            Dispose(false);
+        }
+
+        #endregion
+    }
+}
@@ -31,6 +31,7 @@ namespace Aurio.FFmpeg
         private IntPtr instance = IntPtr.Zero;
         private AudioOutputConfig audioOutputConfig;
         private VideoOutputConfig videoOutputConfig;
+        private AudioOutputConfig[] trackOutputConfigs;
 
         // Delegates for buffered IO mode (stream source)
         // Because the CLR does not know about the references from the native proxy code,
@@ -67,6 +68,20 @@ namespace Aurio.FFmpeg
         public FFmpegReader(FileInfo fileInfo, Type mode)
             : this(fileInfo.FullName, mode) { }
 
+        /// <summary>
+        /// Instantiates an FFmpeg reader from an already opened native instance.
+        /// </summary>
+        private FFmpegReader(IntPtr instance, string filename, Type mode)
+        {
+            this.filename = filename;
+            this.mode = mode;
+            this.instance = instance;
+
+            CheckAndHandleOpeningError();
+
+            ReadOutputConfig();
+        }
+
         /// <summary>
         /// Instantiates an FFmpeg reader in stream mode, where FFmpeg only gets stream reading callbacks
         /// and the actual file access is handled by the caller. An optional file name hint can be passed
@@ -110,7 +125,7 @@ namespace Aurio.FFmpeg
                 mode,
                 IntPtr.Zero,
                 readPacketDelegate,
-                seekDelegate,
+                (mode & Type.Live) == 0 ? seekDelegate : null, // live sources are not seekable
                 fileName
             );
 
@@ -194,6 +209,20 @@ namespace Aurio.FFmpeg
             }
         }
 
+        internal IntPtr Instance
+        {
+            get
+            {
+                CheckAndHandleActiveInstance();
+                return instance;
+            }
+        }
+
+        internal bool IsDisposed
+        {
+            get { return disposed; }
+        }
+
         public AudioOutputConfig AudioOutputConfig
         {
             get { return audioOutputConfig; }
@@ -235,10 +264,96 @@ namespace Aurio.FFmpeg
             return ret;
         }
 
+        /// <summary>
+        /// Reads the next frame of a live source, waiting at most the given time for it. Decoding
+        /// continues in the background from the first call on, so the other ReadFrame overload must
+        /// not be used anymore afterwards.
+        /// </summary>
+        /// <returns>the number of samples per channel (or 1 for a video frame), 0 if no frame was
+        /// decoded within the timeout, or a negative number at the end of the stream</returns>
+        public int ReadFrame(
+            int timeoutMs,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size,
+            out Type frameType
+        )
+        {
+            CheckAndHandleActiveInstance();
+
+            int ret = InteropWrapper.stream_read_frame_timeout(
+                instance,
+                timeoutMs,
+                out timestamp,
+                output_buffer,
+                output_buffer_size,
+                out int type
+            );
+            frameType = (Type)type;
+
+            return ret;
+        }
+
+        /// <summary>
+        /// Reads the frame before the current position, for reverse playback. Reading backwards
+        /// starts at the position of the last <see cref="Seek"/>, e.g. the end of the stream. The
+        /// samples of an audio frame are returned in reverse order. A seek is required to continue
+        /// reading forward. Only readers of a single type are supported.
+        /// </summary>
+        /// <returns>the number of samples per channel (or 1 for a video frame), or a negative number
+        /// at the beginning of the stream</returns>
+        public int ReadFrameReverse(
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size,
+            out Type frameType
+        )
+        {
+            CheckAndHandleActiveInstance();
+
+            int ret = InteropWrapper.stream_read_frame_reverse(
+                instance,
+                out timestamp,
+                output_buffer,
+                output_buffer_size,
+                out int type
+            );
+            frameType = (Type)type;
+
+            return ret;
+        }
+
+        /// <summary>
+        /// Reads the next frame of the given type from a reader in <see cref="Type.Dispatch"/> mode.
+        /// Audio and video frames can be read concurrently from different threads, but frames of
+        /// the same type must not. A seek repositions both types.
+        /// </summary>
+        /// <returns>the number of samples per channel (or 1 for a video frame), or a negative number
+        /// at the end of the stream</returns>
+        public int ReadFrame(
+            Type type,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size
+        )
+        {
+            CheckAndHandleActiveInstance();
+            return InteropWrapper.stream_read_typed_frame(
+                instance,
+                type,
+                out timestamp,
+                output_buffer,
+                output_buffer_size
+            );
+        }
+
         public void Seek(long timestamp, Type type)
         {
             CheckAndHandleActiveInstance();
-            InteropWrapper.stream_seek(instance, timestamp, type);
+            if (InteropWrapper.stream_seek(instance, timestamp, type) < 0)
+            {
+                throw new IOException("Cannot seek the " + type + " stream");
+            }
         }
 
         public void CreateSeekIndex(Type type)
@@ -253,6 +368,545 @@ namespace Aurio.FFmpeg
             InteropWrapper.stream_seekindex_remove(instance, type);
         }
 
+        /// <summary>
+        /// Opens another reader of the same file, with its own read position, that does not probe
+        /// the file again and shares the seek indices of this reader. Only readers in file mode
+        /// can be cloned.
+        /// </summary>
+        public FFmpegReader Clone()
+        {
+            CheckAndHandleActiveInstance();
+            return new FFmpegReader(InteropWrapper.stream_clone(instance), filename, mode);
+        }
+
+        /// <summary>
+        /// Gets the stream indices of all audio streams in the source.
+        /// </summary>
+        public int[] GetAudioStreamIndices()
+        {
+            CheckAndHandleActiveInstance();
+            int count = InteropWrapper.stream_get_audio_streams(instance, null, 0);
+            int[] streamIndices = new int[count];
+            InteropWrapper.stream_get_audio_streams(instance, streamIndices, count);
+            return streamIndices;
+        }
+
+        /// <summary>
+        /// Selects audio streams to be decoded together in a single pass over the source, which
+        /// is much cheaper than opening the source once per stream. The selected tracks are then
+        /// read with <see cref="ReadTrackFrame(out int, out long, byte[], int)"/> or
+        /// <see cref="ReadTrackFrame(int, out long, byte[], int)"/> instead of <see cref="ReadFrame"/>.
+        /// Every selected track must be read, because frames of tracks that fall behind are buffered.
+        /// </summary>
+        /// <param name="streamIndices">the stream indices of the tracks, or none to select all audio streams</param>
+        /// <returns>the output configurations of the tracks, in the order of selection</returns>
+        public AudioOutputConfig[] SelectAudioTracks(params int[] streamIndices)
+        {
+            CheckAndHandleActiveInstance();
+
+            int count = streamIndices.Length > 0
+                ? InteropWrapper.stream_select_tracks(instance, streamIndices, streamIndices.Length)
+                : InteropWrapper.stream_select_tracks(instance, null, 0);
+            if (count < 0)
+            {
+                throw new IOException("Cannot select the audio tracks");
+            }
+
+            trackOutputConfigs = new AudioOutputConfig[count];
+            for (int i = 0; i < count; i++)
+            {
+                IntPtr ocp = InteropWrapper.stream_get_track_output_config(instance, i);
+                trackOutputConfigs[i] = (AudioOutputConfig)
+                    Marshal.PtrToStructure(ocp, typeof(AudioOutputConfig));
+            }
+
+            return trackOutputConfigs;
+        }
+
+        public AudioOutputConfig[] TrackOutputConfigs
+        {
+            get { return trackOutputConfigs; }
+        }
+
+        /// <summary>
+        /// Reads the next frame of any selected track.
+        /// </summary>
+        /// <returns>the number of samples per channel, or a negative number at the end of all tracks</returns>
+        public int ReadTrackFrame(
+            out int track,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size
+        )
+        {
+            CheckAndHandleActiveInstance();
+            return InteropWrapper.stream_read_any_track_frame(
+                instance,
+                out track,
+                out timestamp,
+                output_buffer,
+                output_buffer_size
+            );
+        }
+
+        /// <summary>
+        /// Reads the next frame of a selected track.
+        /// </summary>
+        /// <returns>the number of samples per channel, or a negative number at the end of the track</returns>
+        public int ReadTrackFrame(
+            int track,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size
+        )
+        {
+            CheckAndHandleActiveInstance();
+            return InteropWrapper.stream_read_track_frame(
+                instance,
+                track,
+                out timestamp,
+                output_buffer,
+                output_buffer_size
+            );
+        }
+
+        /// <summary>
+        /// Gets the cumulative performance counters of the native decoder instance.
+        /// </summary>
+        public ProxyStats Stats
+        {
+            get
+            {
+                CheckAndHandleActiveInstance();
+                InteropWrapper.stream_get_stats(instance, out ProxyStats stats);
+                return stats;
+            }
+        }
+
+        /// <summary>
+        /// Gets the counters of the frame buffer pools, which are shared by all readers. In steady
+        /// state, decoded frames are served from the pools without allocations.
+        /// </summary>
+        public static BufferPoolStats BufferPoolStats
+        {
+            get
+            {
+                InteropWrapper.proxy_get_bufpool_stats(out BufferPoolStats stats);
+                return stats;
+            }
+        }
+
+        /// <summary>
+        /// Releases the memory of the frame buffer pools, e.g. after a burst of large frames in a
+        /// long-running process. The pools are capped and refill on demand, and can be trimmed
+        /// while other readers are decoding.
+        /// </summary>
+        public static void TrimBufferPools()
+        {
+            InteropWrapper.proxy_trim_bufpool();
+        }
+
+        /// <summary>
+        /// Gets the reductions that a reader in <see cref="Type.Analysis"/> mode uses. The decoder
+        /// reductions are known after opening, resampling and mixing after the first read.
+        /// </summary>
+        public AnalysisPath AnalysisPath
+        {
+            get
+            {
+                CheckAndHandleActiveInstance();
+                int path = InteropWrapper.stream_get_analysis_path(instance);
+                if (path < 0)
+                {
+                    throw new InvalidOperationException("The reader is not in analysis mode");
+                }
+                return (AnalysisPath)path;
+            }
+        }
+
+        public void ResetStats()
+        {
+            CheckAndHandleActiveInstance();
+            InteropWrapper.stream_reset_stats(instance);
+        }
+
+        /// <summary>
+        /// Starts recording a timeline of the native decoding steps (demuxing, decoding, conversion,
+        /// seeking, I/O), keeping the given number of most recent events (0 for the default).
+        /// </summary>
+        public void StartTrace(int capacity = 0)
+        {
+            CheckAndHandleActiveInstance();
+            if (InteropWrapper.stream_trace_start(instance, capacity) < 0)
+            {
+                throw new OutOfMemoryException("Cannot allocate trace buffer");
+            }
+        }
+
+        public void StopTrace()
+        {
+            CheckAndHandleActiveInstance();
+            InteropWrapper.stream_trace_stop(instance);
+        }
+
+        /// <summary>
+        /// Writes the recorded timeline to a file in the Chrome trace event format,
+        /// which can be viewed in chrome://tracing or Perfetto.
+        /// </summary>
+        /// <returns>the number of written events</returns>
+        public int DumpTrace(string filename)
+        {
+            CheckAndHandleActiveInstance();
+            int count = InteropWrapper.stream_trace_dump(instance, filename);
+            if (count < 0)
+            {
+                throw new IOException("Cannot write trace (tracing not started or file not writable)");
+            }
+            return count;
+        }
+
+        /// <summary>
+        /// Releases the decoders and the demuxer of a reader in <see cref="Type.LowMemory"/> mode.
+        /// They are transparently reopened on the next read or seek, and reading continues at
+        /// the same position.
+        /// </summary>
+        /// <returns>true if the reader has been released</returns>
+        public bool Release()
+        {
+            CheckAndHandleActiveInstance();
+            return InteropWrapper.stream_release(instance) > 0;
+        }
+
+        /// <summary>
+        /// Releases the reader like <see cref="Release"/>, but only if it has not been read or
+        /// sought for the given time.
+        /// </summary>
+        /// <returns>true if the reader has been released</returns>
+        public bool ReleaseIfIdle(TimeSpan idleTime)
+        {
+            CheckAndHandleActiveInstance();
+            return InteropWrapper.stream_release_idle(instance, (int)idleTime.TotalMilliseconds) > 0;
+        }
+
+        /// <summary>
+        /// Gets the memory in bytes that is held by the buffers of the native instance, excluding
+        /// the internal state of the FFmpeg demuxer and decoders.
+        /// </summary>
+        public long MemoryUsage
+        {
+            get
+            {
+                CheckAndHandleActiveInstance();
+                return InteropWrapper.stream_get_memory_usage(instance);
+            }
+        }
+
+        /// <summary>
+        /// Enables a cache of decoded frames that serves repeated seeks into recently
+        /// decoded regions without decoding them again. A budget of 0 disables the cache.
+        /// Only supported for readers of a single stream type.
+        /// </summary>
+        /// <param name="budget">the maximum size of the cached frames in bytes</param>
+        public void EnableFrameCache(long budget)
+        {
+            CheckAndHandleActiveInstance();
+            if (InteropWrapper.stream_cache_enable(instance, budget) < 0)
+            {
+                throw new InvalidOperationException("Cannot enable the frame cache");
+            }
+        }
+
+        /// <summary>
+        /// Starts decoding the whole audio stream into a raw PCM cache file in the background.
+        /// Already decoded regions can be read with <see cref="ReadPcmCache"/> while decoding
+        /// continues. The cache file is deleted when the cache is stopped or the reader disposed.
+        /// Requires a reader that has been opened from a file.
+        /// </summary>
+        public void StartPcmCache(string cacheFilename)
+        {
+            CheckAndHandleActiveInstance();
+            if (InteropWrapper.stream_pcmcache_start(instance, cacheFilename) < 0)
+            {
+                throw new IOException("Cannot start the PCM cache");
+            }
+        }
+
+        /// <summary>
+        /// Gets the number of samples from the stream start that can be read from the PCM cache
+        /// without waiting for the decoder.
+        /// </summary>
+        public long PcmCacheAvailable
+        {
+            get
+            {
+                CheckAndHandleActiveInstance();
+                return InteropWrapper.stream_pcmcache_available(instance);
+            }
+        }
+
+        /// <summary>
+        /// Gets whether the PCM cache has been completely decoded.
+        /// </summary>
+        public bool PcmCacheComplete
+        {
+            get
+            {
+                CheckAndHandleActiveInstance();
+                return InteropWrapper.stream_pcmcache_status(instance) > 0;
+            }
+        }
+
+        /// <summary>
+        /// Reads samples from the PCM cache, blocking until the decoder has reached them.
+        /// </summary>
+        /// <param name="position">the sample position relative to the stream start</param>
+        /// <returns>the number of read samples, less than requested only at the end of the stream</returns>
+        public int ReadPcmCache(long position, byte[] buffer, int samples)
+        {
+            CheckAndHandleActiveInstance();
+            if (buffer.Length < samples * audioOutputConfig.format.channels * audioOutputConfig.format.sample_size)
+            {
+                throw new ArgumentException("buffer too small");
+            }
+            int read = InteropWrapper.stream_pcmcache_read(instance, position, buffer, samples);
+            if (read < 0)
+            {
+                throw new IOException("Cannot read from the PCM cache");
+            }
+            return read;
+        }
+
+        /// <summary>
+        /// Stops decoding into the PCM cache and deletes the cache file.
+        /// </summary>
+        public void StopPcmCache()
+        {
+            CheckAndHandleActiveInstance();
+            InteropWrapper.stream_pcmcache_stop(instance);
+        }
+
+        /// <summary>
+        /// Finds the time offset between a window of this reader's audio and a window of another
+        /// reader's audio by cross-correlation. The windows are decoded and correlated natively,
+        /// so long recordings can be finely aligned without reading their samples into managed memory.
+        /// Both readers are repositioned.
+        /// </summary>
+        /// <param name="target">the reader whose offset to this reader is determined</param>
+        /// <param name="sourcePosition">the start of the window in this reader, in samples</param>
+        /// <param name="targetPosition">the start of the window in the target reader, in samples of the target</param>
+        /// <param name="length">the window length in samples of this reader</param>
+        /// <param name="maxLag">the maximum offset to search in both directions in samples of this reader, or 0 for half the window length</param>
+        /// <param name="rate">the analysis sample rate, or 0 for the default</param>
+        public AlignResult Align(
+            FFmpegReader target,
+            long sourcePosition,
+            long targetPosition,
+            long length,
+            long maxLag = 0,
+            int rate = 0
+        )
+        {
+            CheckAndHandleActiveInstance();
+            target.CheckAndHandleActiveInstance();
+            if (
+                InteropWrapper.stream_align(
+                    instance,
+                    sourcePosition,
+                    target.instance,
+                    targetPosition,
+                    length,
+                    maxLag,
+                    rate,
+                    out AlignResult result
+                ) < 0
+            )
+            {
+                throw new IOException("Cannot align the audio streams");
+            }
+            return result;
+        }
+
+        /// <summary>
+        /// Exports a time range of the decoded streams (including selected audio tracks) into a
+        /// new file by copying the compressed packets, without re-encoding. Video starts at the
+        /// keyframe before the range start.
+        /// </summary>
+        /// <param name="start">the start in samples (audio) or frames (video)</param>
+        /// <param name="end">the exclusive end in samples (audio) or frames (video)</param>
+        /// <param name="type">the stream type in whose units the range is given</param>
+        /// <param name="filename">the output file, whose container format is derived from the extension</param>
+        public void ExportRange(long start, long end, Type type, string filename)
+        {
+            CheckAndHandleActiveInstance();
+            if (InteropWrapper.stream_export_range(instance, start, end, type, filename) < 0)
+            {
+                throw new IOException("Cannot export the range to " + filename);
+            }
+        }
+
+        /// <summary>
+        /// Exports several time ranges like <see cref="ExportRange(long, long, Type, string)"/>,
+        /// in a single pass over the source.
+        /// </summary>
+        /// <returns>the number of written files, which is lower than the number of ranges if ranges are beyond the end</returns>
+        public int ExportRanges(ExportRange[] ranges, Type type)
+        {
+            CheckAndHandleActiveInstance();
+            int count = InteropWrapper.stream_export_ranges(instance, ranges, ranges.Length, type);
+            if (count < 0)
+            {
+                throw new IOException("Cannot export the ranges");
+            }
+            return count;
+        }
+
+        /// <summary>
+        /// Reads many short audio windows at scattered positions in a single pass over the stream.
+        /// Close windows are reached by decoding through the gap between them, distant windows by
+        /// seeking, which uses the seek index if one has been created.
+        /// </summary>
+        /// <param name="positions">the first sample of each window</param>
+        /// <param name="lengths">the number of samples per channel of each window</param>
+        /// <param name="buffers">the buffers that receive the samples of each window</param>
+        /// <param name="maxGap">the largest gap in samples to decode through instead of seeking, or -1 for the default</param>
+        /// <returns>the number of samples that could be read into each window</returns>
+        public int[] ReadWindows(long[] positions, int[] lengths, byte[][] buffers, long maxGap = -1)
+        {
+            CheckAndHandleActiveInstance();
+
+            int blockSize = AudioOutputConfig.format.channels * AudioOutputConfig.format.sample_size;
+            var windows = new FetchWindow[positions.Length];
+            var handles = new GCHandle[positions.Length];
+            try
+            {
+                for (int i = 0; i < windows.Length; i++)
+                {
+                    if (buffers[i].Length < lengths[i] * blockSize)
+                    {
+                        throw new ArgumentException("Buffer " + i + " is too small", nameof(buffers));
+                    }
+                    handles[i] = GCHandle.Alloc(buffers[i], GCHandleType.Pinned);
+                    windows[i].position = positions[i];
+                    windows[i].length = lengths[i];
+                    windows[i].buffer = handles[i].AddrOfPinnedObject();
+                }
+
+                if (InteropWrapper.stream_read_windows(instance, windows, windows.Length, maxGap) < 0)
+                {
+                    throw new IOException("Cannot read the windows");
+                }
+            }
+            finally
+            {
+                foreach (var handle in handles)
+                {
+                    if (handle.IsAllocated)
+                    {
+                        handle.Free();
+                    }
+                }
+            }
+
+            var read = new int[windows.Length];
+            for (int i = 0; i < windows.Length; i++)
+            {
+                read[i] = windows[i].read;
+            }
+            return read;
+        }
+
+        /// <summary>
+        /// Computes a fingerprint of the compressed packets of a stream, without decoding them.
+        /// It only depends on the packet payloads, so copies of the same media with different
+        /// container metadata have the same fingerprint.
+        /// </summary>
+        /// <param name="type">the stream to fingerprint</param>
+        /// <param name="interval">hash only every n-th packet to speed up hashing, or 1 for all packets</param>
+        public StreamFingerprint Fingerprint(Type type, int interval = 1)
+        {
+            CheckAndHandleActiveInstance();
+            if (
+                InteropWrapper.stream_fingerprint(
+                    instance,
+                    type,
+                    interval,
+                    out StreamFingerprint fingerprint
+                ) < 0
+            )
+            {
+                throw new IOException("Cannot compute the fingerprint");
+            }
+            return fingerprint;
+        }
+
+        /// <summary>
+        /// Decodes the audio stream from the start and measures its EBU R128 loudness (integrated
+        /// loudness, loudness range and true peak). The reader is left at the end of the stream.
+        /// For the fastest scan, open the reader with <see cref="Type.Audio"/> only.
+        /// </summary>
+        public LoudnessResult ScanLoudness()
+        {
+            CheckAndHandleActiveInstance();
+            if (InteropWrapper.stream_loudness_scan(instance, out LoudnessResult result, null, 0) < 0)
+            {
+                throw new IOException("Cannot scan the loudness");
+            }
+            return result;
+        }
+
+        /// <summary>
+        /// Scans the loudness like <see cref="ScanLoudness()"/>, and additionally returns the
+        /// short-term loudness curve in LUFS, one value per 100 ms from the first complete 3 s
+        /// window on.
+        /// </summary>
+        public LoudnessResult ScanLoudness(out float[] shortTermLoudness)
+        {
+            CheckAndHandleActiveInstance();
+
+            // Size the curve from the header length, and trim or rescan if it was off
+            var capacity = (int)Math.Max(audioOutputConfig.length * 10 / audioOutputConfig.format.sample_rate, 0) + 1;
+            var curve = new float[capacity];
+            if (InteropWrapper.stream_loudness_scan(instance, out LoudnessResult result, curve, capacity) < 0)
+            {
+                throw new IOException("Cannot scan the loudness");
+            }
+            if (result.shortterm_count > capacity)
+            {
+                curve = new float[result.shortterm_count];
+                if (InteropWrapper.stream_loudness_scan(instance, out result, curve, curve.Length) < 0)
+                {
+                    throw new IOException("Cannot scan the loudness");
+                }
+            }
+
+            Array.Resize(ref curve, result.shortterm_count);
+            shortTermLoudness = curve;
+            return result;
+        }
+
+        /// <summary>
+        /// Scans the loudness of multiple files in parallel, with one decoder per file and thread.
+        /// Files that cannot be scanned have a negative <see cref="LoudnessResult.status"/>.
+        /// </summary>
+        /// <param name="filenames">the files to scan</param>
+        /// <param name="threadCount">the number of parallel scans, or 0 for the number of CPU cores</param>
+        public static LoudnessResult[] ScanLoudness(string[] filenames, int threadCount = 0)
+        {
+            var results = new LoudnessResult[filenames.Length];
+            if (
+                InteropWrapper.proxy_loudness_scan_files(
+                    filenames,
+                    filenames.Length,
+                    threadCount,
+                    results
+                ) < 0
+            )
+            {
+                throw new IOException("Cannot scan the loudness");
+            }
+            return results;
+        }
+
         #region IDisposable & destructor
 
         public void Dispose()
@@ -0,0 +1,49 @@
+﻿//
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2017  Mario Guggenberger <mg@protyposis.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+using System;
+using System.Runtime.InteropServices;
+
+namespace Aurio.FFmpeg
+{
+    /// <summary>
+    /// A range of audio samples to read with <see cref="FFmpegReader.ReadWindows"/>.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FetchWindow
+    {
+        /// <summary>
+        /// The first sample of the window.
+        /// </summary>
+        public long position;
+
+        /// <summary>
+        /// The number of samples per channel.
+        /// </summary>
+        public int length;
+
+        /// <summary>
+        /// The pinned buffer that receives the samples.
+        /// </summary>
+        public IntPtr buffer;
+
+        /// <summary>
+        /// The number of samples that could be read. The rest of the buffer is zeroed.
+        /// </summary>
+        public int read;
+    }
+}
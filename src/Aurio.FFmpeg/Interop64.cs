@@ -31,6 +31,9 @@ namespace Aurio.FFmpeg
             [MarshalAs(UnmanagedType.LPUTF8Str)] string filename
         );
 
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern IntPtr stream_clone(IntPtr instance);
+
         [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
         public static extern IntPtr stream_open_bufferedio(
             Type mode,
@@ -53,7 +56,35 @@ namespace Aurio.FFmpeg
         );
 
         [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
-        public static extern void stream_seek(IntPtr instance, long timestamp, Type type);
+        public static extern int stream_read_frame_timeout(
+            IntPtr instance,
+            int timeout_ms,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size,
+            out int frame_type
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_read_frame_reverse(
+            IntPtr instance,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size,
+            out int frame_type
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_read_typed_frame(
+            IntPtr instance,
+            Type type,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_seek(IntPtr instance, long timestamp, Type type);
 
         [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
         public static extern void stream_seekindex_create(IntPtr instance, Type type);
@@ -61,6 +92,221 @@ namespace Aurio.FFmpeg
         [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
         public static extern void stream_seekindex_remove(IntPtr instance, Type type);
 
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern void stream_get_stats(IntPtr instance, out ProxyStats stats);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern void proxy_get_bufpool_stats(out BufferPoolStats stats);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern void proxy_trim_bufpool();
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int proxy_loudness_scan_files(
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPUTF8Str)]
+                string[] filenames,
+            int count,
+            int thread_count,
+            [Out] LoudnessResult[] results
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern IntPtr mixer_create(int sample_rate, int channels);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int mixer_add_track(IntPtr mixer, IntPtr instance, long offset);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int mixer_set_track(
+            IntPtr mixer,
+            int track,
+            long offset,
+            float gain,
+            float pan,
+            int mute
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int mixer_read(IntPtr mixer, [Out] float[] output, int samples);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int mixer_seek(IntPtr mixer, long position);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern long mixer_get_length(IntPtr mixer);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern void mixer_free(IntPtr mixer);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern IntPtr concat_open(
+            Type mode,
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPUTF8Str)]
+                string[] filenames,
+            int count
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern IntPtr concat_get_output_config(IntPtr concat);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int concat_read_frame(
+            IntPtr concat,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int concat_seek(IntPtr concat, long position);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern long concat_get_length(IntPtr concat);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern void concat_close(IntPtr concat);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern void stream_reset_stats(IntPtr instance);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_get_audio_streams(
+            IntPtr instance,
+            int[] stream_indices,
+            int max_count
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_select_tracks(
+            IntPtr instance,
+            int[] stream_indices,
+            int count
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern IntPtr stream_get_track_output_config(IntPtr instance, int track);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_read_any_track_frame(
+            IntPtr instance,
+            out int track,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_read_track_frame(
+            IntPtr instance,
+            int track,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_trace_start(IntPtr instance, int capacity);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern void stream_trace_stop(IntPtr instance);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_trace_dump(
+            IntPtr instance,
+            [MarshalAs(UnmanagedType.LPUTF8Str)] string filename
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_get_analysis_path(IntPtr instance);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_release(IntPtr instance);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_release_idle(IntPtr instance, int idle_ms);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern long stream_get_memory_usage(IntPtr instance);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_cache_enable(IntPtr instance, long budget);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_pcmcache_start(
+            IntPtr instance,
+            [MarshalAs(UnmanagedType.LPUTF8Str)] string cache_filename
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern long stream_pcmcache_available(IntPtr instance);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_pcmcache_status(IntPtr instance);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_pcmcache_read(
+            IntPtr instance,
+            long position,
+            byte[] buffer,
+            int samples
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern void stream_pcmcache_stop(IntPtr instance);
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_align(
+            IntPtr source,
+            long source_position,
+            IntPtr target,
+            long target_position,
+            long length,
+            long max_lag,
+            int rate,
+            out AlignResult result
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_export_range(
+            IntPtr instance,
+            long start,
+            long end,
+            Type type,
+            [MarshalAs(UnmanagedType.LPUTF8Str)] string filename
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_export_ranges(
+            IntPtr instance,
+            ExportRange[] ranges,
+            int count,
+            Type type
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_read_windows(
+            IntPtr instance,
+            [In, Out] FetchWindow[] windows,
+            int count,
+            long max_gap
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_fingerprint(
+            IntPtr instance,
+            Type type,
+            int interval,
+            out StreamFingerprint fingerprint
+        );
+
+        [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
+        public static extern int stream_loudness_scan(
+            IntPtr instance,
+            out LoudnessResult result,
+            [Out] float[] shortterm,
+            int shortterm_capacity
+        );
+
         [DllImport(FFMPEGPROXYLIB, CallingConvention = InteropWrapper.CC)]
         public static extern void stream_close(IntPtr instance);
 
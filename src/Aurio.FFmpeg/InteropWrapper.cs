@@ -47,6 +47,7 @@ namespace Aurio.FFmpeg
         );
 
         public delegate IntPtr d_stream_open_file(Type mode, string filename);
+        public delegate IntPtr d_stream_clone(IntPtr instance);
         public delegate IntPtr d_stream_open_bufferedio(
             Type mode,
             IntPtr opaque,
@@ -62,20 +63,203 @@ namespace Aurio.FFmpeg
             int output_buffer_size,
             out int frame_type
         );
-        public delegate void d_stream_seek(IntPtr instance, long timestamp, Type type);
+        public delegate int d_stream_read_frame_timeout(
+            IntPtr instance,
+            int timeout_ms,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size,
+            out int frame_type
+        );
+        public delegate int d_stream_read_frame_reverse(
+            IntPtr instance,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size,
+            out int frame_type
+        );
+        public delegate int d_stream_read_typed_frame(
+            IntPtr instance,
+            Type type,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size
+        );
+        public delegate int d_stream_seek(IntPtr instance, long timestamp, Type type);
         public delegate void d_stream_seekindex_create(IntPtr instance, Type type);
         public delegate void d_stream_seekindex_remove(IntPtr instance, Type type);
+        public delegate void d_stream_get_stats(IntPtr instance, out ProxyStats stats);
+        public delegate void d_proxy_get_bufpool_stats(out BufferPoolStats stats);
+        public delegate void d_proxy_trim_bufpool();
+        public delegate int d_proxy_loudness_scan_files(
+            string[] filenames,
+            int count,
+            int thread_count,
+            LoudnessResult[] results
+        );
+        public delegate IntPtr d_mixer_create(int sample_rate, int channels);
+        public delegate int d_mixer_add_track(IntPtr mixer, IntPtr instance, long offset);
+        public delegate int d_mixer_set_track(
+            IntPtr mixer,
+            int track,
+            long offset,
+            float gain,
+            float pan,
+            int mute
+        );
+        public delegate int d_mixer_read(IntPtr mixer, float[] output, int samples);
+        public delegate int d_mixer_seek(IntPtr mixer, long position);
+        public delegate long d_mixer_get_length(IntPtr mixer);
+        public delegate void d_mixer_free(IntPtr mixer);
+        public delegate IntPtr d_concat_open(Type mode, string[] filenames, int count);
+        public delegate IntPtr d_concat_get_output_config(IntPtr concat);
+        public delegate int d_concat_read_frame(
+            IntPtr concat,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size
+        );
+        public delegate int d_concat_seek(IntPtr concat, long position);
+        public delegate long d_concat_get_length(IntPtr concat);
+        public delegate void d_concat_close(IntPtr concat);
+        public delegate void d_stream_reset_stats(IntPtr instance);
+        public delegate int d_stream_get_audio_streams(
+            IntPtr instance,
+            int[] stream_indices,
+            int max_count
+        );
+        public delegate int d_stream_select_tracks(IntPtr instance, int[] stream_indices, int count);
+        public delegate IntPtr d_stream_get_track_output_config(IntPtr instance, int track);
+        public delegate int d_stream_read_any_track_frame(
+            IntPtr instance,
+            out int track,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size
+        );
+        public delegate int d_stream_read_track_frame(
+            IntPtr instance,
+            int track,
+            out long timestamp,
+            byte[] output_buffer,
+            int output_buffer_size
+        );
+        public delegate int d_stream_trace_start(IntPtr instance, int capacity);
+        public delegate void d_stream_trace_stop(IntPtr instance);
+        public delegate int d_stream_trace_dump(IntPtr instance, string filename);
+        public delegate int d_stream_get_analysis_path(IntPtr instance);
+        public delegate int d_stream_release(IntPtr instance);
+        public delegate int d_stream_release_idle(IntPtr instance, int idle_ms);
+        public delegate long d_stream_get_memory_usage(IntPtr instance);
+        public delegate int d_stream_cache_enable(IntPtr instance, long budget);
+        public delegate int d_stream_pcmcache_start(IntPtr instance, string cache_filename);
+        public delegate long d_stream_pcmcache_available(IntPtr instance);
+        public delegate int d_stream_pcmcache_status(IntPtr instance);
+        public delegate int d_stream_pcmcache_read(
+            IntPtr instance,
+            long position,
+            byte[] buffer,
+            int samples
+        );
+        public delegate void d_stream_pcmcache_stop(IntPtr instance);
+        public delegate int d_stream_align(
+            IntPtr source,
+            long source_position,
+            IntPtr target,
+            long target_position,
+            long length,
+            long max_lag,
+            int rate,
+            out AlignResult result
+        );
+        public delegate int d_stream_export_range(
+            IntPtr instance,
+            long start,
+            long end,
+            Type type,
+            string filename
+        );
+        public delegate int d_stream_export_ranges(
+            IntPtr instance,
+            ExportRange[] ranges,
+            int count,
+            Type type
+        );
+        public delegate int d_stream_read_windows(
+            IntPtr instance,
+            [In, Out] FetchWindow[] windows,
+            int count,
+            long max_gap
+        );
+        public delegate int d_stream_fingerprint(
+            IntPtr instance,
+            Type type,
+            int interval,
+            out StreamFingerprint fingerprint
+        );
+        public delegate int d_stream_loudness_scan(
+            IntPtr instance,
+            out LoudnessResult result,
+            float[] shortterm,
+            int shortterm_capacity
+        );
         public delegate void d_stream_close(IntPtr instance);
         public delegate bool d_stream_has_error(IntPtr instance);
         public delegate IntPtr d_stream_get_error(IntPtr instance);
 
         public static d_stream_open_file stream_open_file;
+        public static d_stream_clone stream_clone;
         public static d_stream_open_bufferedio stream_open_bufferedio;
         public static d_stream_get_output_config stream_get_output_config;
         public static d_stream_read_frame stream_read_frame;
+        public static d_stream_read_frame_timeout stream_read_frame_timeout;
+        public static d_stream_read_frame_reverse stream_read_frame_reverse;
+        public static d_stream_read_typed_frame stream_read_typed_frame;
         public static d_stream_seek stream_seek;
         public static d_stream_seekindex_create stream_seekindex_create;
         public static d_stream_seekindex_remove stream_seekindex_remove;
+        public static d_stream_get_stats stream_get_stats;
+        public static d_proxy_get_bufpool_stats proxy_get_bufpool_stats;
+        public static d_proxy_trim_bufpool proxy_trim_bufpool;
+        public static d_proxy_loudness_scan_files proxy_loudness_scan_files;
+        public static d_mixer_create mixer_create;
+        public static d_mixer_add_track mixer_add_track;
+        public static d_mixer_set_track mixer_set_track;
+        public static d_mixer_read mixer_read;
+        public static d_mixer_seek mixer_seek;
+        public static d_mixer_get_length mixer_get_length;
+        public static d_mixer_free mixer_free;
+        public static d_concat_open concat_open;
+        public static d_concat_get_output_config concat_get_output_config;
+        public static d_concat_read_frame concat_read_frame;
+        public static d_concat_seek concat_seek;
+        public static d_concat_get_length concat_get_length;
+        public static d_concat_close concat_close;
+        public static d_stream_reset_stats stream_reset_stats;
+        public static d_stream_get_audio_streams stream_get_audio_streams;
+        public static d_stream_select_tracks stream_select_tracks;
+        public static d_stream_get_track_output_config stream_get_track_output_config;
+        public static d_stream_read_any_track_frame stream_read_any_track_frame;
+        public static d_stream_read_track_frame stream_read_track_frame;
+        public static d_stream_trace_start stream_trace_start;
+        public static d_stream_trace_stop stream_trace_stop;
+        public static d_stream_trace_dump stream_trace_dump;
+        public static d_stream_get_analysis_path stream_get_analysis_path;
+        public static d_stream_release stream_release;
+        public static d_stream_release_idle stream_release_idle;
+        public static d_stream_get_memory_usage stream_get_memory_usage;
+        public static d_stream_cache_enable stream_cache_enable;
+        public static d_stream_pcmcache_start stream_pcmcache_start;
+        public static d_stream_pcmcache_available stream_pcmcache_available;
+        public static d_stream_pcmcache_status stream_pcmcache_status;
+        public static d_stream_pcmcache_read stream_pcmcache_read;
+        public static d_stream_pcmcache_stop stream_pcmcache_stop;
+        public static d_stream_align stream_align;
+        public static d_stream_export_range stream_export_range;
+        public static d_stream_export_ranges stream_export_ranges;
+        public static d_stream_read_windows stream_read_windows;
+        public static d_stream_fingerprint stream_fingerprint;
+        public static d_stream_loudness_scan stream_loudness_scan;
         public static d_stream_close stream_close;
         public static d_stream_has_error stream_has_error;
         public static d_stream_get_error stream_get_error;
@@ -85,12 +269,58 @@ namespace Aurio.FFmpeg
             if (Environment.Is64BitProcess)
             {
                 stream_open_file = Interop64.stream_open_file;
+                stream_clone = Interop64.stream_clone;
                 stream_open_bufferedio = Interop64.stream_open_bufferedio;
                 stream_get_output_config = Interop64.stream_get_output_config;
                 stream_read_frame = Interop64.stream_read_frame;
+                stream_read_frame_timeout = Interop64.stream_read_frame_timeout;
+                stream_read_frame_reverse = Interop64.stream_read_frame_reverse;
+                stream_read_typed_frame = Interop64.stream_read_typed_frame;
                 stream_seek = Interop64.stream_seek;
                 stream_seekindex_create = Interop64.stream_seekindex_create;
                 stream_seekindex_remove = Interop64.stream_seekindex_remove;
+                stream_get_stats = Interop64.stream_get_stats;
+                proxy_get_bufpool_stats = Interop64.proxy_get_bufpool_stats;
+                proxy_trim_bufpool = Interop64.proxy_trim_bufpool;
+                proxy_loudness_scan_files = Interop64.proxy_loudness_scan_files;
+                mixer_create = Interop64.mixer_create;
+                mixer_add_track = Interop64.mixer_add_track;
+                mixer_set_track = Interop64.mixer_set_track;
+                mixer_read = Interop64.mixer_read;
+                mixer_seek = Interop64.mixer_seek;
+                mixer_get_length = Interop64.mixer_get_length;
+                mixer_free = Interop64.mixer_free;
+                concat_open = Interop64.concat_open;
+                concat_get_output_config = Interop64.concat_get_output_config;
+                concat_read_frame = Interop64.concat_read_frame;
+                concat_seek = Interop64.concat_seek;
+                concat_get_length = Interop64.concat_get_length;
+                concat_close = Interop64.concat_close;
+                stream_reset_stats = Interop64.stream_reset_stats;
+                stream_get_audio_streams = Interop64.stream_get_audio_streams;
+                stream_select_tracks = Interop64.stream_select_tracks;
+                stream_get_track_output_config = Interop64.stream_get_track_output_config;
+                stream_read_any_track_frame = Interop64.stream_read_any_track_frame;
+                stream_read_track_frame = Interop64.stream_read_track_frame;
+                stream_trace_start = Interop64.stream_trace_start;
+                stream_trace_stop = Interop64.stream_trace_stop;
+                stream_trace_dump = Interop64.stream_trace_dump;
+                stream_get_analysis_path = Interop64.stream_get_analysis_path;
+                stream_release = Interop64.stream_release;
+                stream_release_idle = Interop64.stream_release_idle;
+                stream_get_memory_usage = Interop64.stream_get_memory_usage;
+                stream_cache_enable = Interop64.stream_cache_enable;
+                stream_pcmcache_start = Interop64.stream_pcmcache_start;
+                stream_pcmcache_available = Interop64.stream_pcmcache_available;
+                stream_pcmcache_status = Interop64.stream_pcmcache_status;
+                stream_pcmcache_read = Interop64.stream_pcmcache_read;
+                stream_pcmcache_stop = Interop64.stream_pcmcache_stop;
+                stream_align = Interop64.stream_align;
+                stream_export_range = Interop64.stream_export_range;
+                stream_export_ranges = Interop64.stream_export_ranges;
+                stream_read_windows = Interop64.stream_read_windows;
+                stream_fingerprint = Interop64.stream_fingerprint;
+                stream_loudness_scan = Interop64.stream_loudness_scan;
                 stream_close = Interop64.stream_close;
                 stream_has_error = Interop64.stream_has_error;
                 stream_get_error = Interop64.stream_get_error;
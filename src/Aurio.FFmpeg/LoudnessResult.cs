@@ -0,0 +1,59 @@
+﻿//
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2017  Mario Guggenberger <mg@protyposis.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+using System;
+using System.Runtime.InteropServices;
+
+namespace Aurio.FFmpeg
+{
+    /// <summary>
+    /// EBU R128 measurements of an audio stream, see <see cref="FFmpegReader.ScanLoudness"/>.
+    /// Levels of silent streams are negative infinity.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct LoudnessResult
+    {
+        /// <summary>
+        /// The integrated loudness in LUFS.
+        /// </summary>
+        public double integrated { get; internal set; }
+
+        /// <summary>
+        /// The loudness range in LU.
+        /// </summary>
+        public double range { get; internal set; }
+
+        /// <summary>
+        /// The true peak in dBTP, measured on the oversampled signal.
+        /// </summary>
+        public double true_peak { get; internal set; }
+
+        public double sample_peak { get; internal set; }
+
+        /// <summary>
+        /// The number of scanned samples per channel.
+        /// </summary>
+        public long length { get; internal set; }
+
+        public int shortterm_count { get; internal set; }
+
+        /// <summary>
+        /// 0 on success, or a negative number if the stream could not be scanned.
+        /// </summary>
+        public int status { get; internal set; }
+    }
+}
@@ -0,0 +1,53 @@
+﻿//
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2017  Mario Guggenberger <mg@protyposis.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+using System.Runtime.InteropServices;
+
+namespace Aurio.FFmpeg
+{
+    /// <summary>
+    /// Cumulative performance counters of a native decoder instance. Times are in nanoseconds.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ProxyStats
+    {
+        public long packets_demuxed { get; internal set; }
+        public long bytes_demuxed { get; internal set; }
+        public long packets_discarded { get; internal set; }
+        public long bytes_discarded { get; internal set; }
+        public long audio_frames_decoded { get; internal set; }
+        public long video_frames_decoded { get; internal set; }
+        public long demux_ns { get; internal set; }
+        public long decode_ns { get; internal set; }
+        public long swr_ns { get; internal set; }
+        public long sws_ns { get; internal set; }
+        public long seeks { get; internal set; }
+        public long seeks_index_adjusted { get; internal set; }
+        public long seek_preroll_frames { get; internal set; }
+        public long io_reads { get; internal set; }
+        public long io_read_bytes { get; internal set; }
+        public long io_read_ns { get; internal set; }
+        public long io_seeks { get; internal set; }
+        public long io_seek_ns { get; internal set; }
+        public long cache_hits { get; internal set; }
+        public long cache_misses { get; internal set; }
+        public long live_frames { get; internal set; }
+        public long live_latency_ns { get; internal set; }
+        public long live_latency_max_ns { get; internal set; }
+    }
+}
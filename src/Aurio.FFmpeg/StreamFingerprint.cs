@@ -0,0 +1,54 @@
+﻿//
+// Aurio: Audio Processing, Analysis and Retrieval Library
+// Copyright (C) 2010-2017  Mario Guggenberger <mg@protyposis.net>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+using System;
+using System.Runtime.InteropServices;
+
+namespace Aurio.FFmpeg
+{
+    /// <summary>
+    /// Content fingerprint of a compressed stream, see <see cref="FFmpegReader.Fingerprint"/>.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct StreamFingerprint
+    {
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 16)]
+        private byte[] digest;
+
+        public long packets { get; internal set; }
+        public long hashed_packets { get; internal set; }
+
+        /// <summary>
+        /// The sum of the packet durations in samples (audio) or frames (video).
+        /// </summary>
+        public long duration { get; internal set; }
+
+        public byte[] Digest
+        {
+            get { return (byte[])digest.Clone(); }
+        }
+
+        /// <summary>
+        /// The digest as a lowercase hex string, e.g. to be used as a cache key.
+        /// </summary>
+        public override string ToString()
+        {
+            return Convert.ToHexString(digest).ToLowerInvariant();
+        }
+    }
+}
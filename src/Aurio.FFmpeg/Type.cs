@@ -25,6 +25,34 @@ namespace Aurio.FFmpeg
     {
         None,
         Audio,
-        Video
+        Video,
+
+        /// <summary>
+        /// Low-latency mode for live sources. Combine with <see cref="Audio"/> and/or
+        /// <see cref="Video"/>, and read with <see cref="FFmpegReader.ReadFrame(int, out long, byte[], int, out Type)"/>.
+        /// </summary>
+        Live = 0x0200,
+
+        /// <summary>
+        /// Low-footprint mode for sessions with many open readers. Decoders are opened on the
+        /// first read, and can be released with <see cref="FFmpegReader.Release"/>. Requires a
+        /// seekable source and a single stream type.
+        /// </summary>
+        LowMemory = 0x0400,
+
+        /// <summary>
+        /// Demuxes the source once on a background thread and decodes audio and video independently.
+        /// Combine with <see cref="Audio"/> and <see cref="Video"/>, and read each type with
+        /// <see cref="FFmpegReader.ReadFrame(Type, out long, byte[], int)"/>, e.g. from separate
+        /// playback and rendering threads. Cannot be combined with <see cref="Live"/> or <see cref="LowMemory"/>.
+        /// </summary>
+        Dispatch = 0x0800,
+
+        /// <summary>
+        /// Reduced-cost decoding for analyses, which outputs mono float samples at no more than 16 kHz.
+        /// Decoders are asked to skip the work that does not contribute to the output where they
+        /// support it, see <see cref="FFmpegReader.AnalysisPath"/>. Combine with <see cref="Audio"/>.
+        /// </summary>
+        Analysis = 0x1000
     }
 }